@@ -0,0 +1,9 @@
+#version 120
+
+uniform sampler2D galaxyTex;
+varying vec4 color;
+
+void main(void)
+{
+    gl_FragColor = texture2D(galaxyTex, gl_TexCoord[0].st) * color;
+}
@@ -0,0 +1,36 @@
+#version 120
+
+// Each blob of a galaxy form is a quad whose four vertices share the
+// blob's position; the texture coordinates tell the corners apart.
+attribute float spriteScale;
+
+uniform mat3 m;           // form to view orientation and scale
+uniform vec3 offset;      // galaxy position relative to the observer
+uniform mat3 viewMat;     // billboard orientation
+uniform float size;       // size of the largest sprite
+uniform float brightness; // overall opacity, with the inclination correction
+
+varying vec4 color;
+
+void main(void)
+{
+    vec3 p = m * gl_Vertex.xyz;
+    float spriteSize = size * spriteScale;
+    float screenFrac = spriteSize / length(p + offset);
+
+    // Sprites covering a tenth of the view or more are left out; moving
+    // all four corners outside the clip volume discards the quad.
+    if (screenFrac >= 0.1)
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        color = vec4(0.0);
+        return;
+    }
+
+    // gl_Color.a is the blob brightness
+    color = vec4(gl_Color.rgb, min(1.0, brightness * gl_Color.a * (0.1 - screenFrac)));
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+
+    vec3 corner = viewMat * vec3(gl_MultiTexCoord0.xy * 2.0 - 1.0, 0.0) * spriteSize;
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(p + corner, 1.0);
+}
@@ -110,7 +110,7 @@ const vector<string>& Body::getNames() const
 /*! Return the primary name for the body; if i18n, return the
  *  localized name of the body.
  */
-string Body::getName(bool i18n) const
+const string& Body::getName(bool i18n) const
 {
     if (!i18n)
         return names[0];
@@ -957,12 +957,19 @@ void Body::computeLocations()
     if (locationsComputed)
         return;
 
-    locationsComputed = true;
-
     // No work to do if there's no mesh, or if the mesh cannot be loaded
     if (geometry == InvalidResource)
+    {
+        locationsComputed = true;
         return;
+    }
     Geometry* g = GetGeometryManager()->find(geometry);
+
+    // Try again once a mesh loading in the background is ready
+    if (GetGeometryManager()->getState(geometry) == ResourceLoadPending)
+        return;
+
+    locationsComputed = true;
     if (!g)
         return;
 
@@ -1196,7 +1203,8 @@ void PlanetarySystem::addAlias(Body* body, const string& alias)
 {
     assert(body->getSystem() == this);
 
-    objectIndex.insert(make_pair(alias, body));
+    if (objectIndex.insert(make_pair(alias, body)).second)
+        completionIndex.add(alias);
 }
 
 
@@ -1212,7 +1220,10 @@ void PlanetarySystem::removeAlias(const Body* body, const string& alias)
     if (iter != objectIndex.end())
     {
         if (iter->second == body)
+        {
+            completionIndex.remove(iter->first);
             objectIndex.erase(iter);
+        }
     }
 }
 
@@ -1230,7 +1241,8 @@ void PlanetarySystem::addBodyToNameIndex(Body* body)
     const vector<string>& names = body->getNames();
     for (const auto& name : names)
     {
-        objectIndex.insert(make_pair(name, body));
+        if (objectIndex.insert(make_pair(name, body)).second)
+            completionIndex.add(name);
     }
 }
 
@@ -1332,18 +1344,9 @@ bool PlanetarySystem::traverse(TraversalFunc func, void* info) const
 std::vector<std::string> PlanetarySystem::getCompletion(const std::string& _name, bool deepSearch) const
 {
     std::vector<std::string> completion;
-    int _name_length = UTF8Length(_name);
 
     // Search through all names in this planetary system.
-    for (const auto& index : objectIndex)
-    {
-        const string& alias = index.first;
-
-        if (UTF8StringCompare(alias, _name, _name_length) == 0)
-        {
-            completion.push_back(alias);
-        }
-    }
+    completionIndex.findPrefix(_name, completion, false);
 
     // Scan child objects
     if (deepSearch)
@@ -18,6 +18,7 @@
 #include <celephem/rotation.h>
 #include <celephem/orbit.h>
 #include <celutil/utf8.h>
+#include <celutil/completionindex.h>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <GL/glew.h>
@@ -77,6 +78,7 @@ class PlanetarySystem
     Body* primary{nullptr};
     std::vector<Body*> satellites;
     ObjectIndex objectIndex;  // index of bodies by name
+    CompletionIndex completionIndex;  // names of objectIndex, for getCompletion
 };
 
 
@@ -191,7 +193,7 @@ class Body : public CatEntry
 
     PlanetarySystem* getSystem() const;
     const std::vector<std::string>& getNames() const;
-    std::string getName(bool i18n = false) const;
+    const std::string& getName(bool i18n = false) const;
     std::string getLocalizedName() const;
     bool hasLocalizedName() const;
     void addAlias(const std::string& alias);
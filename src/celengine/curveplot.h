@@ -103,6 +103,9 @@ class CurvePlot
 
     unsigned int sampleCount() const { return m_samples.size(); }
 
+    // Approximate heap and object size in bytes
+    size_t memoryUsage() const { return sizeof(*this) + m_samples.size() * sizeof(CurvePlotSample); }
+
  private:
     std::deque<CurvePlotSample> m_samples;
  
@@ -46,41 +46,16 @@ constexpr const float DSO_OCTREE_MAGNITUDE   = 8.0f;
 
 constexpr char FILE_HEADER[]                 = "CEL_DSOs";
 
-// Used to sort DSO pointers by catalog number
-struct PtrCatalogNumberOrderingPredicate
-{
-    int unused;
-
-    PtrCatalogNumberOrderingPredicate() = default;
-
-    bool operator()(const DeepSkyObject* const & dso0, const DeepSkyObject* const & dso1) const
-    {
-        return (dso0->getCatalogNumber() < dso1->getCatalogNumber());
-    }
-};
-
-
 DSODatabase::~DSODatabase()
 {
     delete [] DSOs;
-    delete [] catalogNumberIndex;
 }
 
 
 DeepSkyObject* DSODatabase::find(const uint32_t catalogNumber) const
 {
-    Galaxy refDSO;  //terrible hack !!
-    refDSO.setCatalogNumber(catalogNumber);
-
-    DeepSkyObject** dso   = lower_bound(catalogNumberIndex,
-                                        catalogNumberIndex + nDSOs,
-                                        &refDSO,
-                                        PtrCatalogNumberOrderingPredicate());
-
-    if (dso != catalogNumberIndex + nDSOs && (*dso)->getCatalogNumber() == catalogNumber)
-        return *dso;
-    else
-        return nullptr;
+    DeepSkyObject* const* dso = catalogNumberIndex.find(catalogNumber);
+    return dso != nullptr ? *dso : nullptr;
 }
 
 
@@ -118,20 +93,37 @@ string DSODatabase::getDSOName(const DeepSkyObject* const & dso, bool i18n) cons
 
     if (namesDB != nullptr)
     {
-        DSONameDatabase::NumberIndex::const_iterator iter   = namesDB->getFirstNameIter(catalogNumber);
-        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
+        if (i18n)
         {
-            if (i18n && iter->second != _(iter->second.c_str()))
-                return _(iter->second.c_str());
-            else
-                return iter->second;
+            const string* name = namesDB->getLocalizedName(catalogNumber);
+            if (name != nullptr)
+                return *name;
         }
+
+        DSONameDatabase::NumberIndex::const_iterator iter   = namesDB->getFirstNameIter(catalogNumber);
+        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
+            return iter->second;
     }
 
     return "";
 }
 
 
+const string& DSODatabase::getDSOLabel(const DeepSkyObject* dso) const
+{
+    static const string noName;
+
+    if (namesDB != nullptr)
+    {
+        const string* name = namesDB->getLocalizedName(dso->getCatalogNumber());
+        if (name != nullptr)
+            return *name;
+    }
+
+    return noName;
+}
+
+
 string DSODatabase::getDSONameList(const DeepSkyObject* const & dso, const unsigned int maxNames) const
 {
     string dsoNames;
@@ -155,16 +147,13 @@ string DSODatabase::getDSONameList(const DeepSkyObject* const & dso, const unsig
 }
 
 
-void DSODatabase::findVisibleDSOs(DSOHandler&    dsoHandler,
-                                  const Vector3d& obsPos,
-                                  const Quaternionf& obsOrient,
-                                  float fovY,
-                                  float aspectRatio,
-                                  float limitingMag,
-                                  OctreeProcStats *stats) const
+// Compute the bounding planes of an infinite view frustum
+static void computeFrustumPlanes(Hyperplane<double, 3>* frustumPlanes,
+                                 const Vector3d& obsPos,
+                                 const Quaternionf& obsOrient,
+                                 float fovY,
+                                 float aspectRatio)
 {
-    // Compute the bounding planes of an infinite view frustum
-    Hyperplane<double, 3> frustumPlanes[5];
     Vector3d  planeNormals[5];
 
     Quaterniond obsOrientd = obsOrient.cast<double>();
@@ -183,6 +172,19 @@ void DSODatabase::findVisibleDSOs(DSOHandler&    dsoHandler,
         planeNormals[i]    = rot * planeNormals[i].normalized();
         frustumPlanes[i]   = Hyperplane<double, 3>(planeNormals[i], obsPos);
     }
+}
+
+
+void DSODatabase::findVisibleDSOs(DSOHandler&    dsoHandler,
+                                  const Vector3d& obsPos,
+                                  const Quaternionf& obsOrient,
+                                  float fovY,
+                                  float aspectRatio,
+                                  float limitingMag,
+                                  OctreeProcStats *stats) const
+{
+    Hyperplane<double, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, obsPos, obsOrient, fovY, aspectRatio);
 
     octreeRoot->processVisibleObjects(dsoHandler,
                                       obsPos,
@@ -193,6 +195,28 @@ void DSODatabase::findVisibleDSOs(DSOHandler&    dsoHandler,
 }
 
 
+void DSODatabase::findVisibleDSOs(DSOHandler&    dsoHandler,
+                                  const function<DSOHandler&(size_t)>& subtreeHandler,
+                                  ThreadPool&    pool,
+                                  const Vector3d& obsPos,
+                                  const Quaternionf& obsOrient,
+                                  float fovY,
+                                  float aspectRatio,
+                                  float limitingMag) const
+{
+    Hyperplane<double, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, obsPos, obsOrient, fovY, aspectRatio);
+
+    octreeRoot->processVisibleObjects(dsoHandler,
+                                      subtreeHandler,
+                                      pool,
+                                      obsPos,
+                                      frustumPlanes,
+                                      limitingMag,
+                                      DSO_OCTREE_ROOT_SIZE);
+}
+
+
 void DSODatabase::findCloseDSOs(DSOHandler&     dsoHandler,
                                 const Vector3d& obsPos,
                                 float           radius) const
@@ -381,10 +405,12 @@ void DSODatabase::buildOctree()
     // objects end up straddling the base level nodes when the center of the
     // octree is at the origin.
     DynamicDSOOctree* root   = new DynamicDSOOctree(Vector3d::Zero(), absMag);
+    DynamicDSOOctree::ObjectList objects(nDSOs);
     for (int i = 0; i < nDSOs; ++i)
     {
-        root->insertObject(DSOs[i], DSO_OCTREE_ROOT_SIZE);
+        objects[i] = &DSOs[i];
     }
+    root->insertObjects(objects, DSO_OCTREE_ROOT_SIZE, ThreadPool::shared());
 
     DPRINTF(1, "Spatially sorting DSOs for improved locality of reference . . .\n");
     DeepSkyObject** sortedDSOs    = new DeepSkyObject*[nDSOs];
@@ -433,11 +459,10 @@ void DSODatabase::buildIndexes()
 
     DPRINTF(1, "Building catalog number indexes . . .\n");
 
-    catalogNumberIndex = new DeepSkyObject*[nDSOs];
+    catalogNumberIndex.clear();
+    catalogNumberIndex.reserve(nDSOs);
     for (int i = 0; i < nDSOs; ++i)
-        catalogNumberIndex[i] = DSOs[i];
-
-    sort(catalogNumberIndex, catalogNumberIndex + nDSOs, PtrCatalogNumberOrderingPredicate());
+        catalogNumberIndex.insert(DSOs[i]->getCatalogNumber(), DSOs[i]);
 }
 
 
@@ -19,6 +19,7 @@
 #include <celengine/deepskyobj.h>
 #include <celengine/dsooctree.h>
 #include <celengine/parser.h>
+#include <celutil/hashindex.h>
 
 
 constexpr const unsigned int MAX_DSO_NAMES = 10;
@@ -50,12 +51,26 @@ class DSODatabase
                          float limitingMag,
                          OctreeProcStats * = nullptr) const;
 
+    // Multithreaded findVisibleDSOs(), see
+    // StaticOctree::processVisibleObjects().
+    void findVisibleDSOs(DSOHandler& dsoHandler,
+                         const std::function<DSOHandler&(size_t)>& subtreeHandler,
+                         ThreadPool& pool,
+                         const Eigen::Vector3d& obsPosition,
+                         const Eigen::Quaternionf& obsOrientation,
+                         float fovY,
+                         float aspectRatio,
+                         float limitingMag) const;
+
     void findCloseDSOs(DSOHandler& dsoHandler,
                        const Eigen::Vector3d& obsPosition,
                        float radius) const;
 
     std::string getDSOName    (const DeepSkyObject* const &, bool i18n = false) const;
     std::string getDSONameList(const DeepSkyObject* const &, const unsigned int maxNames = MAX_DSO_NAMES) const;
+    // The translated name, empty for objects without a name; unlike
+    // getDSOName() no string is built per call.
+    const std::string& getDSOLabel(const DeepSkyObject*) const;
 
     DSONameDatabase* getNameDatabase() const;
     void setNameDatabase(DSONameDatabase*);
@@ -77,7 +92,7 @@ private:
     int              capacity{ 0 };
     DeepSkyObject**  DSOs{ nullptr };
     DSONameDatabase* namesDB{ nullptr };
-    DeepSkyObject**  catalogNumberIndex{ nullptr };
+    HashIndex<DeepSkyObject*> catalogNumberIndex;
     DSOOctree*       octreeRoot{ nullptr };
     uint32_t         nextAutoCatalogNumber{ 0xfffffffe };
 
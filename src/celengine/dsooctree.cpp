@@ -67,21 +67,12 @@ template<> DynamicDSOOctree::ExclusionFactorDecayFunction*
 
 // total specialization of the StaticOctree template process*() methods for DSOs:
 template<>
-void DSOOctree::processVisibleObjects(DSOHandler&    processor,
-                                      const PointType& obsPosition,
-                                      const Hyperplane<double, 3>*  frustumPlanes,
-                                      float          limitingFactor,
-                                      double         scale,
-                                      OctreeProcStats *stats) const
+bool DSOOctree::processVisibleNode(DSOHandler&    processor,
+                                   const PointType& obsPosition,
+                                   const Hyperplane<double, 3>*  frustumPlanes,
+                                   float          limitingFactor,
+                                   double         scale) const
 {
-#ifdef OCTREE_DEBUG
-    size_t h;
-    if (stats != nullptr)
-    {
-        h = stats->height + 1;
-        stats->nodes++;
-    }
-#endif
     // See if this node lies within the view frustum
 
     // Test the cubic octree node against each one of the five
@@ -92,7 +83,7 @@ void DSOOctree::processVisibleObjects(DSOHandler&    processor,
 
         double r = scale * plane.normal().cwiseAbs().sum();
         if (plane.signedDistance(cellCenterPos) < -r)
-            return;
+            return false;
     }
 
     // Compute the distance to node; this is equal to the distance to
@@ -104,10 +95,6 @@ void DSOOctree::processVisibleObjects(DSOHandler&    processor,
 
     for (unsigned int i=0; i<nObjects; ++i)
     {
-#ifdef OCTREE_DEBUG
-        if (stats != nullptr)
-            stats->objects++;
-#endif
         DeepSkyObject* _obj = _firstObject[i];
         float  absMag      = _obj->getAbsoluteMagnitude();
         if (absMag < dimmest)
@@ -122,29 +109,48 @@ void DSOOctree::processVisibleObjects(DSOHandler&    processor,
 
     // See if any of the objects in child nodes are potentially included
     // that we need to recurse deeper.
-    if (minDistance <= 0.0 || astro::absToAppMag((double) exclusionFactor, minDistance) <= limitingFactor)
+    return _children != nullptr &&
+           (minDistance <= 0.0 || astro::absToAppMag((double) exclusionFactor, minDistance) <= limitingFactor);
+}
+
+
+template<>
+void DSOOctree::processVisibleObjects(DSOHandler&    processor,
+                                      const PointType& obsPosition,
+                                      const Hyperplane<double, 3>*  frustumPlanes,
+                                      float          limitingFactor,
+                                      double         scale,
+                                      OctreeProcStats *stats) const
+{
+#ifdef OCTREE_DEBUG
+    size_t h;
+    if (stats != nullptr)
+    {
+        h = stats->height + 1;
+        stats->nodes++;
+        stats->objects += nObjects;
+    }
+#endif
+    if (processVisibleNode(processor, obsPosition, frustumPlanes, limitingFactor, scale))
     {
         // Recurse into the child nodes
-        if (_children != nullptr)
+        for (int i = 0; i < 8; ++i)
         {
-            for (int i = 0; i < 8; ++i)
-            {
-                _children[i]->processVisibleObjects(processor,
-                                                    obsPosition,
-                                                    frustumPlanes,
-                                                    limitingFactor,
-                                                    scale * 0.5f,
-                                                    stats);
+            _children[i]->processVisibleObjects(processor,
+                                                obsPosition,
+                                                frustumPlanes,
+                                                limitingFactor,
+                                                scale * 0.5f,
+                                                stats);
 #ifdef OCTREE_DEBUG
-                if (stats != nullptr && stats->height > h)
-                    h = stats->height;
+            if (stats != nullptr && stats->height > h)
+                h = stats->height;
 #endif
-            }
+        }
 #ifdef OCTREE_DEBUG
-            if (stats != nullptr)
-                stats->height = h;
+        if (stats != nullptr)
+            stats->height = h;
 #endif
-        }
     }
 }
 
@@ -16,6 +16,7 @@
 #include <celengine/deepskyobj.h>
 #include <celengine/location.h>
 #include <celengine/frame.h>
+#include <celutil/threadpool.h>
 
 using namespace Eigen;
 using namespace std;
@@ -457,6 +458,10 @@ CachingFrame::CachingFrame(Selection _center) :
 Quaterniond
 CachingFrame::getOrientation(double tjd) const
 {
+    // The cache belongs to the main thread
+    if (ThreadPool::isWorkerThread())
+        return computeOrientation(tjd);
+
     if (tjd != lastTime)
     {
         lastTime = tjd;
@@ -476,6 +481,9 @@ CachingFrame::getOrientation(double tjd) const
 
 Vector3d CachingFrame::getAngularVelocity(double tjd) const
 {
+    if (ThreadPool::isWorkerThread())
+        return computeAngularVelocity(tjd);
+
     if (tjd != lastTime)
     {
         lastTime = tjd;
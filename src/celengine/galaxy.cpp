@@ -14,12 +14,15 @@
 #include "galaxy.h"
 #include "vecgl.h"
 #include "texture.h"
+#include "vertexobject.h"
+#include "shadermanager.h"
 #include <celmath/mathlib.h>
 #include <celmath/perlin.h>
 #include <celmath/intersect.h>
 #include <celutil/util.h>
 #include <celutil/debug.h>
 #include <celcompat/filesystem.h>
+#include <cstddef>
 #include <cstring>
 #include <fstream>
 #include <algorithm>
@@ -58,6 +61,8 @@ class GalacticForm
 public:
     BlobVector* blobs;
     Vector3f scale;
+    // Blob sprites, uploaded when the form is first drawn
+    celgl::VertexObject vo{ GL_ARRAY_BUFFER, 0, GL_STATIC_DRAW };
 };
 
 struct GalaxyTypeName
@@ -257,7 +262,7 @@ void Galaxy::render(const Vector3f& offset,
                     const Quaternionf& viewerOrientation,
                     float brightness,
                     float pixelSize,
-                    const Renderer* /* unused */)
+                    const Renderer* renderer)
 {
     if (form == nullptr)
     {
@@ -265,20 +270,70 @@ void Galaxy::render(const Vector3f& offset,
     }
     else
     {
-        renderGalaxyPointSprites(offset, viewerOrientation, brightness, pixelSize);
+        renderGalaxyPointSprites(offset, viewerOrientation, brightness, pixelSize, renderer);
     }
 }
 
 
-inline void glVertex4(const Vector4f& v)
+// Sprites get smaller by this factor each time the blob index reaches a
+// power of two, so that the brightest ones near the center are the largest.
+static const float spriteScaleFactor = 1.0f / 1.55f;
+
+static void initGalaxyData(GalacticForm& form, GLint spriteScaleLoc)
 {
-    glVertex3fv(v.data());
+    struct GalaxyVtx
+    {
+        Vector3f      position;
+        float         spriteScale;
+        GLshort       texCoord[2];
+        unsigned char color[4];
+    };
+    static const GLshort corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    const BlobVector& blobs = *form.blobs;
+    vector<GalaxyVtx> galaxyVtx;
+    galaxyVtx.reserve(blobs.size() * 4);
+
+    float spriteScale = 1.0f;
+    size_t pow2 = 1;
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        if ((i & pow2) != 0)
+        {
+            pow2 <<= 1;
+            spriteScale *= spriteScaleFactor;
+        }
+
+        const Blob& b = blobs[i];
+        GalaxyVtx vtx;
+        vtx.position = b.position.head(3);
+        vtx.spriteScale = spriteScale;
+        Color(colorTable[b.colorIndex].x(),
+              colorTable[b.colorIndex].y(),
+              colorTable[b.colorIndex].z(),
+              b.brightness / 255.0f).get(vtx.color);
+        for (const auto& corner : corners)
+        {
+            vtx.texCoord[0] = corner[0];
+            vtx.texCoord[1] = corner[1];
+            galaxyVtx.push_back(vtx);
+        }
+    }
+
+    form.vo.allocate(galaxyVtx.size() * sizeof(GalaxyVtx), galaxyVtx.data());
+    form.vo.setVertices(3, GL_FLOAT, false, sizeof(GalaxyVtx), offsetof(GalaxyVtx, position));
+    form.vo.setTextureCoords(2, GL_SHORT, false, sizeof(GalaxyVtx), offsetof(GalaxyVtx, texCoord));
+    form.vo.setColors(4, GL_UNSIGNED_BYTE, true, sizeof(GalaxyVtx), offsetof(GalaxyVtx, color));
+    if (spriteScaleLoc != -1)
+        form.vo.setVertexAttrib(spriteScaleLoc, 1, GL_FLOAT, false, sizeof(GalaxyVtx), offsetof(GalaxyVtx, spriteScale));
 }
 
+
 void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
                                       const Quaternionf& viewerOrientation,
                                       float brightness,
-                                      float pixelSize)
+                                      float pixelSize,
+                                      const Renderer* renderer)
 {
     if (form == nullptr)
         return;
@@ -297,45 +352,34 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
     if (size < minimumFeatureSize)
         return;
 
+    auto *prog = renderer->getShaderManager().getShader("galaxy");
+    if (prog == nullptr)
+        return;
+
     if (galaxyTex == nullptr)
     {
         galaxyTex = CreateProceduralTexture(width, height, GL_RGBA,
-                                            GalaxyTextureEval);
+                                            GalaxyTextureEval,
+                                            Texture::EdgeClamp, Texture::DefaultMipMaps,
+                                            "galaxy");
     }
     assert(galaxyTex != nullptr);
 
-    glEnable(GL_TEXTURE_2D);
-    galaxyTex->bind();
-
-    Matrix3f viewMat = viewerOrientation.conjugate().toRotationMatrix();
-    Vector4f v0(Vector4f::Zero());
-    Vector4f v1(Vector4f::Zero());
-    Vector4f v2(Vector4f::Zero());
-    Vector4f v3(Vector4f::Zero());
-    v0.head(3) = viewMat * Vector3f(-1, -1, 0) * size;
-    v1.head(3) = viewMat * Vector3f( 1, -1, 0) * size;
-    v2.head(3) = viewMat * Vector3f( 1,  1, 0) * size;
-    v3.head(3) = viewMat * Vector3f(-1,  1, 0) * size;
-
-    //Mat4f m = (getOrientation().toMatrix4() *
-    //           Mat4f::scaling(form->scale) *
-    //           Mat4f::scaling(getRadius()));
+    // Sprite sizes only decrease with the blob index, so the blobs too
+    // small to be seen are all at the end.
+    GLsizei nPoints = (GLsizei) (form->blobs->size() * clamp(getDetail()));
+    GLsizei count = 1;
+    for (float spriteSize = size * spriteScaleFactor;
+         count < nPoints && spriteSize >= minimumFeatureSize;
+         spriteSize *= spriteScaleFactor)
+    {
+        count <<= 1;
+    }
+    count = min(count, nPoints);
 
     Quaternionf orientation = getOrientation().conjugate();
 
-    Matrix3f mScale = form->scale.asDiagonal() * size;
-    Matrix3f mLinear = orientation.toRotationMatrix() * mScale;
-
-    Matrix4f m = Matrix4f::Identity();
-    m.topLeftCorner(3,3) = mLinear;
-    m.block<3,1>(0, 3) = offset;
-
-    int   pow2  = 1;
-
-    BlobVector* points = form->blobs;
-    unsigned int nPoints = (unsigned int) (points->size() * clamp(getDetail()));
     // corrections to avoid excessive brightening if viewed e.g. edge-on
-
     float brightness_corr = 1.0f;
     float cosi;
 
@@ -354,47 +398,27 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
             brightness_corr = 0.45f;
     }
 
-    glPushMatrix();
-    glTranslatef(-offset.x(), -offset.y(), -offset.z());
-
     float btot = ((type > SBc) && (type < Irr))? 2.5f: 5.0f;
-    const float spriteScaleFactor = 1.0f / 1.55f;
 
-    glBegin(GL_QUADS);
-    for (unsigned int i = 0; i < nPoints; ++i)
-    {
-        if ((i & pow2) != 0)
-        {
-            pow2 <<= 1;
-            size *= spriteScaleFactor;
-            v0 *= spriteScaleFactor;
-            v1 *= spriteScaleFactor;
-            v2 *= spriteScaleFactor;
-            v3 *= spriteScaleFactor;
-            if (size < minimumFeatureSize)
-                break;
-        }
+    glEnable(GL_TEXTURE_2D);
+    galaxyTex->bind();
 
-        const Blob& b  = (*points)[i];
-        Vector4f    p  = m * b.position;
-        float       br = b.brightness / 255.0f;
+    form->vo.bind();
+    if (!form->vo.initialized())
+        initGalaxyData(*form, prog->attribIndex("spriteScale"));
 
-        Vector3f   c      = colorTable[b.colorIndex];     // lookup static color table
+    prog->use();
+    prog->mat3Param("m")            = orientation.toRotationMatrix() * form->scale.asDiagonal() * size;
+    prog->vec3Param("offset")       = offset;
+    prog->mat3Param("viewMat")      = viewerOrientation.conjugate().toRotationMatrix();
+    prog->floatParam("size")        = size;
+    prog->floatParam("brightness")  = (4.0f * lightGain + 1.0f) * btot * brightness_corr * brightness;
+    prog->samplerParam("galaxyTex") = 0;
 
-        float screenFrac = size / p.norm();
-        if (screenFrac < 0.1f)
-        {
-            float a  = btot * (0.1f - screenFrac) * brightness_corr * brightness * br;
-            glColor4f(c.x(), c.y(), c.z(), (4.0f * lightGain + 1.0f) * a);
-            glTexCoord2f(0, 0);          glVertex4(p + v0);
-            glTexCoord2f(1, 0);          glVertex4(p + v1);
-            glTexCoord2f(1, 1);          glVertex4(p + v2);
-            glTexCoord2f(0, 1);          glVertex4(p + v3);
-        }
-    }
-    glEnd();
+    form->vo.draw(GL_QUADS, count * 4);
 
-    glPopMatrix();
+    glUseProgram(0);
+    form->vo.unbind();
 }
 
 
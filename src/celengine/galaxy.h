@@ -85,7 +85,8 @@ class Galaxy : public DeepSkyObject
     void renderGalaxyPointSprites(const Eigen::Vector3f& offset,
                                   const Eigen::Quaternionf& viewerOrientation,
                                   float brightness,
-                                  float pixelSize);
+                                  float pixelSize,
+                                  const Renderer* renderer);
 #if 0
     void renderGalaxyEllipsoid(const Eigen::Vector3f& offset,
                                const Eigen::Quaternionf& viewerOrientation,
@@ -453,14 +453,18 @@ void Globular::renderGlobularPointSprites(
     if(centerTex[ic] == nullptr)
     {
         centerTex[ic] = CreateProceduralTexture(cntrTexWidth, cntrTexHeight, GL_RGBA,
-                                                CenterCloudTexEval);
+                                                CenterCloudTexEval,
+                                                Texture::EdgeClamp, Texture::DefaultMipMaps,
+                                                "globular-center-" + to_string(ic));
     }
     assert(centerTex[ic] != nullptr);
 
     if (globularTex == nullptr)
     {
         globularTex = CreateProceduralTexture(starTexWidth, starTexHeight, GL_RGBA,
-                                              GlobularTextureEval);
+                                              GlobularTextureEval,
+                                              Texture::EdgeClamp, Texture::DefaultMipMaps,
+                                              "globular-star");
     }
     assert(globularTex != nullptr);
 
@@ -231,6 +231,34 @@ GLProgram::link()
 }
 
 
+void
+GLProgram::setBinaryRetrievable()
+{
+    if (GLEW_ARB_get_program_binary)
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+
+bool
+GLProgram::getBinary(GLenum& format, vector<char>& binary) const
+{
+    if (!GLEW_ARB_get_program_binary)
+        return false;
+
+    GLint length = 0;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    binary.resize(length);
+    GLsizei written = 0;
+    glGetProgramBinary(id, length, &written, &format, binary.data());
+    binary.resize(written);
+
+    return written > 0;
+}
+
+
 //************* GLShaderLoader ************
 
 GLShaderStatus
@@ -375,6 +403,31 @@ GLShaderLoader::CreateProgram(const string& vsSource,
 }
 
 
+GLShaderStatus
+GLShaderLoader::CreateProgram(GLenum binaryFormat,
+                              const vector<char>& binary,
+                              GLProgram** progOut)
+{
+    if (!GLEW_ARB_get_program_binary || binary.empty())
+        return ShaderStatus_EmptyProgram;
+
+    GLuint progid = glCreateProgram();
+    glProgramBinary(progid, binaryFormat, binary.data(), (GLsizei) binary.size());
+
+    GLint linkSuccess;
+    glGetProgramiv(progid, GL_LINK_STATUS, &linkSuccess);
+    if (linkSuccess != GL_TRUE)
+    {
+        glDeleteProgram(progid);
+        return ShaderStatus_LinkError;
+    }
+
+    *progOut = new GLProgram(progid);
+
+    return ShaderStatus_OK;
+}
+
+
 const string
 GetInfoLog(GLuint obj)
 {
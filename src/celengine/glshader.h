@@ -75,6 +75,14 @@ class GLProgram
 
     GLShaderStatus link();
 
+    // Ask the driver to keep the binary of the program, see getBinary();
+    // must be called before linking.
+    void setBinaryRetrievable();
+    // Get the linked program binary for GLShaderLoader::CreateProgram.
+    // Returns false if GL_ARB_get_program_binary isn't supported or the
+    // driver didn't keep a binary.
+    bool getBinary(GLenum& format, std::vector<char>& binary) const;
+
     void use() const;
     GLuint getID() const { return id; }
 
@@ -184,6 +192,12 @@ class GLShaderLoader
     static GLShaderStatus CreateProgram(const std::string& vsSource,
                                         const std::string& fsSource,
                                         GLProgram**);
+    // Create a linked program from a binary returned by
+    // GLProgram::getBinary(). Drivers reject binaries made by other
+    // drivers or versions, which isn't logged.
+    static GLShaderStatus CreateProgram(GLenum binaryFormat,
+                                        const std::vector<char>& binary,
+                                        GLProgram**);
 };
 
 
@@ -23,6 +23,7 @@
 #include "modelgeometry.h"
 
 #include <cel3ds/3dsread.h>
+#include <celmodel/meshoptimizer.h>
 #include <celmodel/modelfile.h>
 
 #include <celmath/mathlib.h>
@@ -34,6 +35,7 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdio>
 #include <utility>
 #include <fmt/printf.h>
 #include <memory>
@@ -73,14 +75,101 @@ private:
 };
 
 
+// Returned for models still loading in the background, so that they're
+// neither drawn nor picked until they're ready; without a model, a body
+// would be picked as an ellipsoid.
+class LoadingGeometry : public Geometry
+{
+ public:
+    void render(RenderContext& /*rc*/, double /*t*/) override {}
+    bool pick(const celmath::Ray3d& /*r*/, double& /*distance*/) const override { return false; }
+    bool isOpaque() const override { return true; }
+};
+
+
 GeometryManager* GetGeometryManager()
 {
     if (geometryManager == nullptr)
+    {
+        static LoadingGeometry loadingGeometry;
         geometryManager = new GeometryManager("models");
+        geometryManager->setFallback(&loadingGeometry);
+    }
     return geometryManager;
 }
 
 
+static bool optimizeModels = false;
+static fs::path modelCacheDir;
+
+// Bump when the optimizations change, so that old cached models are
+// ignored.
+static const unsigned int OptimizedModelVersion = 1;
+
+void SetModelOptimization(bool enable, const fs::path& cacheDir)
+{
+    optimizeModels = enable;
+    modelCacheDir = cacheDir;
+}
+
+
+// Optimized models are cached under a hash of the original file's contents,
+// so an edited model is optimized again and models shared by several
+// objects are cached once.
+static fs::path OptimizedModelPath(const fs::path& filename)
+{
+    ifstream in(filename.string(), ios::in | ios::binary);
+    if (!in.good())
+        return fs::path();
+
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    char buffer[65536];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+    {
+        for (streamsize i = 0; i < in.gcount(); i++)
+        {
+            hash ^= (unsigned char) buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    return modelCacheDir / fmt::sprintf("%016llx-%u.cmod", (unsigned long long) hash, OptimizedModelVersion);
+}
+
+static Model* LoadOptimizedModel(const fs::path& cachePath, const fs::path& texturePath)
+{
+    ifstream in(cachePath.string(), ios::in | ios::binary);
+    if (!in.good())
+        return nullptr;
+
+    CelestiaTextureLoader textureLoader(texturePath);
+    return LoadModel(in, &textureLoader);
+}
+
+static void SaveOptimizedModel(const Model& model, const fs::path& cachePath)
+{
+    // Write to a temporary file first so that a partially written file is
+    // never read back.
+    fs::path tmpPath = cachePath;
+    tmpPath += ".tmp";
+    {
+        ofstream out(tmpPath.string(), ios::out | ios::binary);
+        if (!out.good())
+            return;
+
+        if (!SaveModelBinary(&model, out) || !out.good())
+        {
+            out.close();
+            remove(tmpPath.string().c_str());
+            return;
+        }
+    }
+    if (rename(tmpPath.string().c_str(), cachePath.string().c_str()) != 0)
+        remove(tmpPath.string().c_str());
+}
+
+
 fs::path GeometryInfo::resolve(const fs::path& baseDir)
 {
     // Ensure that models with different centers get resolved to different objects by
@@ -120,63 +209,82 @@ Geometry* GeometryInfo::load(const fs::path& resolvedFilename)
     Model* model = nullptr;
     ContentType fileType = DetermineFileType(filename);
 
-    if (fileType == Content_3DStudio)
-    {
-        M3DScene* scene = Read3DSFile(filename);
-        if (scene != nullptr)
-        {
-            if (resolvedToPath)
-                model = Convert3DSModel(*scene, path);
-            else
-                model = Convert3DSModel(*scene, "");
-
-            if (isNormalized)
-                model->normalize(center);
-            else
-                model->transform(center, scale);
+    // 3DS textures are only looked up in the add-on directory when the
+    // model was found there.
+    fs::path texturePath = path;
+    if (fileType == Content_3DStudio && !resolvedToPath)
+        texturePath = "";
 
-            delete scene;
-        }
+    fs::path cachePath;
+    if (optimizeModels && !modelCacheDir.empty())
+    {
+        cachePath = OptimizedModelPath(filename);
+        if (!cachePath.empty())
+            model = LoadOptimizedModel(cachePath, texturePath);
     }
-    else if (fileType == Content_CelestiaModel)
+
+    uint32_t originalMaterialCount = 0;
+    if (model == nullptr)
     {
-        ifstream in(filename.string(), ios::binary);
-        if (in.good())
+        if (fileType == Content_3DStudio)
         {
-            CelestiaTextureLoader textureLoader(path);
-
-            model = LoadModel(in, &textureLoader);
-            if (model != nullptr)
+            M3DScene* scene = Read3DSFile(filename);
+            if (scene != nullptr)
             {
-                if (isNormalized)
-                    model->normalize(center);
-                else
-                    model->transform(center, scale);
+                model = Convert3DSModel(*scene, texturePath);
+                delete scene;
             }
         }
-    }
-    else if (fileType == Content_CelestiaMesh)
-    {
-        model = LoadCelestiaMesh(filename);
-        if (model != nullptr)
+        else if (fileType == Content_CelestiaModel)
         {
-            if (isNormalized)
-                model->normalize(center);
-            else
-                model->transform(center, scale);
+            ifstream in(filename.string(), ios::binary);
+            if (in.good())
+            {
+                CelestiaTextureLoader textureLoader(texturePath);
+
+                model = LoadModel(in, &textureLoader);
+            }
+        }
+        else if (fileType == Content_CelestiaMesh)
+        {
+            model = LoadCelestiaMesh(filename);
         }
-    }
 #if PARTICLE_SYSTEM
-    else if (fileType == Content_CelestiaParticleSystem)
-    {
-        ifstream in(filename);
-        if (in.good())
+        else if (fileType == Content_CelestiaParticleSystem)
         {
-            return LoadParticleSystem(in, path);
+            ifstream in(filename);
+            if (in.good())
+            {
+                return LoadParticleSystem(in, path);
+            }
         }
-    }
 #endif
 
+        // Optimize before the model is moved and scaled, so that the cached
+        // copy doesn't depend on how it's placed.
+        if (model != nullptr && optimizeModels)
+        {
+            originalMaterialCount = model->getMaterialCount();
+            model->uniquifyMaterials();
+
+            float acmr = ComputeACMR(*model);
+            OptimizeModel(*model);
+            fmt::fprintf(clog, _("   Optimized model: %.3f vertices per triangle (was %.3f)\n"),
+                         ComputeACMR(*model), acmr);
+
+            if (!cachePath.empty())
+                SaveOptimizedModel(*model, cachePath);
+        }
+    }
+
+    if (model != nullptr)
+    {
+        if (isNormalized)
+            model->normalize(center);
+        else
+            model->transform(center, scale);
+    }
+
     // Condition the model for optimal rendering
     if (model != nullptr)
     {
@@ -185,7 +293,8 @@ Geometry* GeometryInfo::load(const fs::path& resolvedFilename)
         // impact rendering performance. Ideally uniquification of materials
         // would be performed just once when the model was created, but
         // that's not the case.
-        uint32_t originalMaterialCount = model->getMaterialCount();
+        if (originalMaterialCount == 0)
+            originalMaterialCount = model->getMaterialCount();
         model->uniquifyMaterials();
 
         // Sort the submeshes roughly by opacity.  This will eliminate a
@@ -213,6 +322,27 @@ Geometry* GeometryInfo::load(const fs::path& resolvedFilename)
 }
 
 
+// Models are loaded entirely on the loader thread: nothing is sent to the
+// GL until a model is first rendered.
+void GeometryInfo::prepare(const fs::path& resolvedFilename)
+{
+    prepared = load(resolvedFilename);
+}
+
+
+Geometry* GeometryInfo::commit(const fs::path& /*resolvedFilename*/)
+{
+    return prepared;
+}
+
+
+void GeometryInfo::discard()
+{
+    delete prepared;
+    prepared = nullptr;
+}
+
+
 struct NoiseMeshParameters
 {
     Vector3f size;
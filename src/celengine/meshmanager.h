@@ -52,6 +52,12 @@ class GeometryInfo : public ResourceInfo<Geometry>
 
     virtual fs::path resolve(const fs::path&);
     virtual Geometry* load(const fs::path&);
+    void prepare(const fs::path&) override;
+    Geometry* commit(const fs::path&) override;
+    void discard() override;
+
+ private:
+    Geometry* prepared{ nullptr };
 };
 
 inline bool operator<(const GeometryInfo& g0, const GeometryInfo& g1)
@@ -76,5 +82,10 @@ typedef ResourceManager<GeometryInfo> GeometryManager;
 
 extern GeometryManager* GetGeometryManager();
 
+// Weld vertices, reorder triangles and vertices for the vertex caches and
+// merge primitive groups of models as they're loaded. With a cache
+// directory, the optimized models are kept there as binary .cmod files.
+extern void SetModelOptimization(bool enable, const fs::path& cacheDir);
+
 #endif // _CELENGINE_MESHMANAGER_H_
 
@@ -70,6 +70,10 @@ Texture* MultiResTexture::find(unsigned int resolution)
     if (res != nullptr)
         return res;
 
+    // Don't give up on a texture that's still loading in the background
+    if (texMan->getState(tex[resolution]) == ResourceLoadPending)
+        return nullptr;
+
     // Preferred resolution isn't available; try the second choice
     // Set these to some defaults to avoid GCC complaints
     // about possible uninitialized variable usage:
@@ -19,13 +19,21 @@ void NameDatabase::add(const uint32_t catalogNumber, const std::string& name, bo
         //nameIndex.insert(NameIndex::value_type(name, catalogNumber));
         std::string fname = ReplaceGreekLetterAbbr(name);
 
-        nameIndex[fname] = catalogNumber;
+        auto inserted = nameIndex.insert(NameIndex::value_type(fname, catalogNumber));
+        if (inserted.second)
+            completionIndex.add(fname);
+        else
+            inserted.first->second = catalogNumber;
         numberIndex.insert(NumberIndex::value_type(catalogNumber, fname));
+
+        if (localizedNames.find(catalogNumber) == localizedNames.end())
+            localizedNames.emplace(catalogNumber, _(fname.c_str()));
     }
 }
 void NameDatabase::erase(const uint32_t catalogNumber)
 {
     numberIndex.erase(catalogNumber);
+    localizedNames.erase(catalogNumber);
 }
 
 uint32_t NameDatabase::getCatalogNumberByName(const std::string& name) const
@@ -41,6 +49,13 @@ uint32_t NameDatabase::getCatalogNumberByName(const std::string& name) const
     return iter->second;
 }
 
+const std::string* NameDatabase::getLocalizedName(const uint32_t catalogNumber) const
+{
+    auto iter = localizedNames.find(catalogNumber);
+    return iter != localizedNames.end() ? &iter->second : nullptr;
+}
+
+
 // Return the first name matching the catalog number or end()
 // if there are no matching names.  The first name *should* be the
 // proper name of the OBJ, if one exists. This requires the
@@ -96,15 +111,7 @@ std::vector<std::string> NameDatabase::getCompletion(const std::string& name, bo
     }
 
     std::vector<std::string> completion;
-    int name_length = UTF8Length(name);
-
-    for (NameIndex::const_iterator iter = nameIndex.begin(); iter != nameIndex.end(); ++iter)
-    {
-        if (!UTF8StringCompare(iter->first, name, name_length, true))
-        {
-            completion.push_back(iter->first);
-        }
-    }
+    completionIndex.findPrefix(name, completion);
     return completion;
 }
 
@@ -118,3 +125,10 @@ std::vector<std::string> NameDatabase::getCompletion(const std::vector<std::stri
     }
     return completion;
 }
+
+std::vector<std::string> NameDatabase::getSubstringMatches(const std::string& name) const
+{
+    std::vector<std::string> matches;
+    completionIndex.findSubstring(ReplaceGreekLetterAbbr(name), matches);
+    return matches;
+}
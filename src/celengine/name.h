@@ -15,10 +15,12 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <celutil/debug.h>
 #include <celutil/util.h>
 #include <celutil/utf8.h>
+#include <celutil/completionindex.h>
 
 // TODO: this can be "detemplatized" by creating e.g. a global-scope enum InvalidCatalogNumber since there
 // lies the one and only need for type genericity.
@@ -45,14 +47,23 @@ class NameDatabase
     uint32_t      getCatalogNumberByName(const std::string&) const;
     std::string getNameByCatalogNumber(const uint32_t)       const;
 
+    // The translated first name of the object, looked up once when the name
+    // is added, or nullptr if it has no name. The string stays valid until
+    // the object's names are erased.
+    const std::string* getLocalizedName(const uint32_t) const;
+
     NumberIndex::const_iterator getFirstNameIter(const uint32_t catalogNumber) const;
     NumberIndex::const_iterator getFinalNameIter() const;
 
     std::vector<std::string> getCompletion(const std::string& name, bool greek = true) const;
     std::vector<std::string> getCompletion(const std::vector<std::string> &list) const;
+    // Names containing the string anywhere, ignoring case
+    std::vector<std::string> getSubstringMatches(const std::string& name) const;
 
  protected:
     NameIndex   nameIndex;
     NumberIndex numberIndex;
+    CompletionIndex completionIndex;
+    std::unordered_map<uint32_t, std::string> localizedNames;
 };
 
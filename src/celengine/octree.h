@@ -16,6 +16,9 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <celengine/observer.h>
+#include <celutil/threadpool.h>
+#include <algorithm>
+#include <functional>
 #include <vector>
 
 // The DynamicOctree and StaticOctree template arguments are:
@@ -56,10 +59,9 @@ template <class OBJ, class PREC> class DynamicOctree
 {
 public:
     typedef Eigen::Matrix<PREC, 3, 1> PointType;
-
-private:
     typedef std::vector<const OBJ*> ObjectList;
 
+private:
 
     typedef bool (LimitingFactorPredicate)     (const OBJ&, const float);
     typedef bool (StraddlingPredicate)         (const Eigen::Matrix<PREC, 3, 1>&, const OBJ&, const float);
@@ -68,9 +70,12 @@ private:
  public:
     DynamicOctree(const Eigen::Matrix<PREC, 3, 1>& cellCenterPos,
                   const float         exclusionFactor);
+    DynamicOctree(const StaticOctree<OBJ, PREC>&          staticNode,
+                  const std::function<bool(const OBJ&)>& isExcluded);
     ~DynamicOctree();
 
     void insertObject  (const OBJ&, const PREC);
+    void insertObjects (const ObjectList&, const PREC, ThreadPool&);
     void rebuildAndSort(StaticOctree<OBJ, PREC>*&, OBJ*&);
 
  private:
@@ -86,6 +91,14 @@ private:
     void           sortIntoChildNodes();
     DynamicOctree* getChild(const OBJ&, const Eigen::Matrix<PREC, 3, 1>&);
 
+    struct InsertionTask
+    {
+        DynamicOctree* node;
+        ObjectList     objects;
+        PREC           scale;
+    };
+    void distribute(const ObjectList&, const PREC, std::vector<InsertionTask>&);
+
     DynamicOctree**            _children;
     Eigen::Matrix<PREC, 3, 1>  cellCenterPos;
     PREC                       exclusionFactor;
@@ -107,9 +120,17 @@ template <class OBJ, class PREC> class StaticOctree
     StaticOctree(const PointType&    cellCenterPos,
                  const float         exclusionFactor,
                  OBJ*                _firstObject,
-                 unsigned int        nObjects);
+                 unsigned int        nObjects,
+                 StaticOctree**      _children = nullptr);
     ~StaticOctree();
 
+    const PointType& getCellCenterPos() const { return cellCenterPos; }
+    float getExclusionFactor() const { return exclusionFactor; }
+    OBJ* getFirstObject() const { return _firstObject; }
+    unsigned int getObjectCount() const { return nObjects; }
+    // Returns nullptr for leaf nodes
+    const StaticOctree* getChild(int i) const { return _children != nullptr ? _children[i] : nullptr; }
+
     // These methods are only declared at the template level; we'll implement them as
     // full specializations, allowing for different traversal strategies depending on the
     // object type and nature.
@@ -128,6 +149,45 @@ template <class OBJ, class PREC> class StaticOctree
                                PREC                              scale,
                                OctreeProcStats * = nullptr) const;
 
+    // Process the objects of this node only; the return value tells whether
+    // processVisibleObjects() would descend into the children of the node.
+    bool processVisibleNode(OctreeProcessor<OBJ, PREC>&       processor,
+                            const PointType&                  obsPosition,
+                            const Eigen::Hyperplane<PREC, 3>* frustumPlanes,
+                            float                             limitingFactor,
+                            PREC                              scale) const;
+
+    // Multithreaded version of processVisibleObjects(). The top of the tree
+    // is processed with processor on the calling thread until it fans out
+    // into enough subtrees to keep the pool busy; the subtrees are then
+    // traversed on the pool, subtree i with subtreeProcessor(i). The
+    // subtreeProcessor function is called on the calling thread, in subtree
+    // order, before any subtree is traversed.
+    void processVisibleObjects(OctreeProcessor<OBJ, PREC>&       processor,
+                               const std::function<OctreeProcessor<OBJ, PREC>&(size_t)>& subtreeProcessor,
+                               ThreadPool&                       pool,
+                               const PointType&                  obsPosition,
+                               const Eigen::Hyperplane<PREC, 3>* frustumPlanes,
+                               float                             limitingFactor,
+                               PREC                              scale) const;
+
+    struct Subtree
+    {
+        const StaticOctree* node;
+        PREC                scale;
+    };
+
+    // Open the top of the tree breadth first, starting with this node, until
+    // there are at least minSubtrees independent subtrees left or only
+    // leaves remain. visitNode(node, scale) is called for each node opened;
+    // it must process the objects of the node and return whether its
+    // children have to be visited.
+    template <class VISITOR>
+    void splitTraversal(PREC                  scale,
+                        size_t                minSubtrees,
+                        VISITOR               visitNode,
+                        std::vector<Subtree>& subtrees) const;
+
     void processCloseObjects(OctreeProcessor<OBJ, PREC>&        processor,
                              const PointType&                   obsPosition,
                              PREC                               boundingRadius,
@@ -185,6 +245,34 @@ inline DynamicOctree<OBJ, PREC>::DynamicOctree(const Eigen::Matrix<PREC, 3, 1>&
 }
 
 
+// Recreate a dynamic octree from a static one, so that more objects can be
+// inserted into an octree that was loaded presorted. Objects for which
+// isExcluded returns true are left out; the caller is expected to insert them
+// again if they still belong in the tree.
+template <class OBJ, class PREC>
+inline DynamicOctree<OBJ, PREC>::DynamicOctree(const StaticOctree<OBJ, PREC>&          staticNode,
+                                               const std::function<bool(const OBJ&)>& isExcluded):
+    _children      (nullptr),
+    cellCenterPos  (staticNode.cellCenterPos),
+    exclusionFactor(staticNode.exclusionFactor),
+    _objects       (nullptr)
+{
+    for (unsigned int i = 0; i < staticNode.nObjects; ++i)
+    {
+        const OBJ& obj = staticNode._firstObject[i];
+        if (!isExcluded(obj))
+            add(obj);
+    }
+
+    if (staticNode._children != nullptr)
+    {
+        _children = new DynamicOctree*[8];
+        for (int i = 0; i < 8; ++i)
+            _children[i] = new DynamicOctree(*staticNode._children[i], isExcluded);
+    }
+}
+
+
 template <class OBJ, class PREC>
 inline DynamicOctree<OBJ, PREC>::~DynamicOctree()
 {
@@ -231,6 +319,84 @@ inline void DynamicOctree<OBJ, PREC>::insertObject(const OBJ& obj, const PREC sc
 }
 
 
+// Insert a list of objects, building the subtrees on the thread pool. The
+// result is the same octree that calling insertObject for each object in
+// turn would produce: objects are distributed to the child nodes without
+// changing their order, so every child subtree sees exactly the sequence of
+// insertions it would have seen in a serial build, independently of its
+// siblings.
+template <class OBJ, class PREC>
+void DynamicOctree<OBJ, PREC>::insertObjects(const ObjectList& objects, const PREC scale, ThreadPool& pool)
+{
+    // Subtrees receiving no more objects than this are built by a single
+    // task; larger ones are distributed further.
+    const size_t maxTaskSize = std::max(objects.size() / (8 * pool.size()), (size_t) 1000);
+
+    std::vector<InsertionTask> tasks;
+    std::vector<InsertionTask> leafTasks;
+    tasks.push_back({ this, objects, scale });
+    while (!tasks.empty())
+    {
+        InsertionTask task = std::move(tasks.back());
+        tasks.pop_back();
+        if (task.objects.size() <= maxTaskSize)
+            leafTasks.push_back(std::move(task));
+        else
+            task.node->distribute(task.objects, task.scale, tasks);
+    }
+
+    // Largest subtrees first for better load balancing
+    std::sort(leafTasks.begin(), leafTasks.end(),
+              [](const InsertionTask& a, const InsertionTask& b)
+              { return a.objects.size() > b.objects.size(); });
+
+    pool.parallelFor(leafTasks.size(), [&leafTasks](size_t i)
+    {
+        const InsertionTask& task = leafTasks[i];
+        for (const OBJ* obj : task.objects)
+            task.node->insertObject(*obj, task.scale);
+    });
+}
+
+
+// Insert objects into this node until it has been split, then pass the
+// remaining ones on to the children as new insertion tasks.
+template <class OBJ, class PREC>
+void DynamicOctree<OBJ, PREC>::distribute(const ObjectList& objects,
+                                          const PREC scale,
+                                          std::vector<InsertionTask>& tasks)
+{
+    size_t i = 0;
+    while (i < objects.size() && _children == nullptr)
+        insertObject(*objects[i++], scale);
+
+    if (i == objects.size())
+        return;
+
+    ObjectList childObjects[8];
+    for (; i < objects.size(); ++i)
+    {
+        const OBJ& obj = *objects[i];
+        if (limitingFactorPredicate(obj, exclusionFactor) ||
+            straddlingPredicate(cellCenterPos, obj, exclusionFactor))
+        {
+            add(obj);
+        }
+        else
+        {
+            DynamicOctree* child = this->getChild(obj, cellCenterPos);
+            childObjects[std::find(_children, _children + 8, child) - _children].push_back(&obj);
+        }
+    }
+
+    for (int c = 0; c < 8; ++c)
+    {
+        if (!childObjects[c].empty())
+            tasks.push_back({ _children[c], std::move(childObjects[c]), scale * (PREC) 0.5 });
+    }
+}
+
+
 template <class OBJ, class PREC>
 inline void DynamicOctree<OBJ, PREC>::add(const OBJ& obj)
 {
@@ -327,8 +493,9 @@ template <class OBJ, class PREC>
 inline StaticOctree<OBJ, PREC>::StaticOctree(const Eigen::Matrix<PREC, 3, 1>& cellCenterPos,
                                              const float         exclusionFactor,
                                              OBJ*                _firstObject,
-                                             unsigned int        nObjects):
-    _children      (nullptr),
+                                             unsigned int        nObjects,
+                                             StaticOctree**      _children):
+    _children      (_children),
     cellCenterPos  (cellCenterPos),
     exclusionFactor(exclusionFactor),
     _firstObject   (_firstObject),
@@ -350,6 +517,76 @@ inline StaticOctree<OBJ, PREC>::~StaticOctree()
 }
 
 
+template <class OBJ, class PREC>
+void StaticOctree<OBJ, PREC>::processVisibleObjects(OctreeProcessor<OBJ, PREC>&       processor,
+                                                    const std::function<OctreeProcessor<OBJ, PREC>&(size_t)>& subtreeProcessor,
+                                                    ThreadPool&                       pool,
+                                                    const PointType&                  obsPosition,
+                                                    const Eigen::Hyperplane<PREC, 3>* frustumPlanes,
+                                                    float                             limitingFactor,
+                                                    PREC                              scale) const
+{
+    std::vector<Subtree> subtrees;
+    splitTraversal(scale, (size_t) pool.size() * 4,
+                   [&](const StaticOctree& node, PREC nodeScale)
+                   {
+                       return node.processVisibleNode(processor, obsPosition, frustumPlanes,
+                                                      limitingFactor, nodeScale);
+                   },
+                   subtrees);
+
+    std::vector<OctreeProcessor<OBJ, PREC>*> processors;
+    processors.reserve(subtrees.size());
+    for (size_t i = 0; i < subtrees.size(); i++)
+        processors.push_back(&subtreeProcessor(i));
+
+    pool.parallelFor(subtrees.size(), [&](size_t i)
+    {
+        subtrees[i].node->processVisibleObjects(*processors[i], obsPosition, frustumPlanes,
+                                                limitingFactor, subtrees[i].scale);
+    });
+}
+
+
+template <class OBJ, class PREC>
+template <class VISITOR>
+void StaticOctree<OBJ, PREC>::splitTraversal(PREC                  scale,
+                                             size_t                minSubtrees,
+                                             VISITOR               visitNode,
+                                             std::vector<Subtree>& subtrees) const
+{
+    subtrees.clear();
+    subtrees.push_back({ this, scale });
+
+    std::vector<Subtree> opened;
+    while (subtrees.size() < minSubtrees)
+    {
+        bool anyOpened = false;
+        opened.clear();
+        for (const Subtree& subtree : subtrees)
+        {
+            // Leaves are kept whole; culled nodes are dropped
+            if (subtree.node->_children == nullptr)
+            {
+                opened.push_back(subtree);
+                continue;
+            }
+
+            anyOpened = true;
+            if (visitNode(*subtree.node, subtree.scale))
+            {
+                for (int i = 0; i < 8; ++i)
+                    opened.push_back({ subtree.node->_children[i], subtree.scale * (PREC) 0.5 });
+            }
+        }
+
+        subtrees.swap(opened);
+        if (!anyOpened)
+            break;
+    }
+}
+
+
 template <class OBJ, class PREC>
 inline int StaticOctree<OBJ, PREC>::countChildren() const
 {
@@ -0,0 +1,111 @@
+// orbitpathcache.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Least recently used cache of sampled orbit paths.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "curveplot.h"
+#include "orbitpathcache.h"
+
+using namespace std;
+
+
+OrbitPathCache::OrbitPathCache(size_t maxBytes) :
+    maxBytes(maxBytes)
+{
+}
+
+
+OrbitPathCache::~OrbitPathCache()
+{
+    clear();
+}
+
+
+CurvePlot* OrbitPathCache::find(const Orbit* orbit)
+{
+    auto iter = index.find(orbit);
+    if (iter == index.end())
+    {
+        stats.misses++;
+        return nullptr;
+    }
+
+    stats.hits++;
+    entries.splice(entries.begin(), entries, iter->second);
+    return iter->second->plot;
+}
+
+
+void OrbitPathCache::insert(const Orbit* orbit, CurvePlot* plot)
+{
+    auto iter = index.find(orbit);
+    if (iter != index.end())
+    {
+        stats.bytes -= iter->second->bytes;
+        delete iter->second->plot;
+        entries.erase(iter->second);
+        index.erase(iter);
+    }
+
+    entries.push_front(Entry{ orbit, plot, plot->memoryUsage() });
+    index[orbit] = entries.begin();
+    stats.bytes += entries.front().bytes;
+    stats.entries = entries.size();
+
+    evict();
+}
+
+
+void OrbitPathCache::updateSize()
+{
+    if (entries.empty())
+        return;
+
+    Entry& entry = entries.front();
+    size_t bytes = entry.plot->memoryUsage();
+    stats.bytes = stats.bytes - entry.bytes + bytes;
+    entry.bytes = bytes;
+
+    evict();
+}
+
+
+void OrbitPathCache::clear()
+{
+    for (const auto& entry : entries)
+        delete entry.plot;
+    entries.clear();
+    index.clear();
+    stats.entries = 0;
+    stats.bytes = 0;
+}
+
+
+void OrbitPathCache::setMaxBytes(size_t _maxBytes)
+{
+    maxBytes = _maxBytes;
+    evict();
+}
+
+
+// Remove the least recently used paths until the cache fits its limit.
+// The most recently used path is always kept, as it's about to be drawn.
+void OrbitPathCache::evict()
+{
+    while (stats.bytes > maxBytes && entries.size() > 1)
+    {
+        const Entry& entry = entries.back();
+        stats.bytes -= entry.bytes;
+        index.erase(entry.orbit);
+        delete entry.plot;
+        entries.pop_back();
+        stats.evictions++;
+    }
+    stats.entries = entries.size();
+}
@@ -0,0 +1,77 @@
+// orbitpathcache.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Least recently used cache of sampled orbit paths.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+
+class CurvePlot;
+class Orbit;
+
+// Orbit paths are kept in a list ordered by last use, with a hash map from
+// orbit to list position, so that lookups, insertions and evictions are
+// all constant time. The cache is bounded by the memory used by the
+// samples rather than by the number of paths, as an asteroid's path and a
+// spacecraft trajectory differ by orders of magnitude.
+class OrbitPathCache
+{
+ public:
+    struct Statistics
+    {
+        size_t hits{ 0 };
+        size_t misses{ 0 };
+        size_t evictions{ 0 };
+        size_t entries{ 0 };
+        size_t bytes{ 0 };
+    };
+
+    explicit OrbitPathCache(size_t maxBytes);
+    ~OrbitPathCache();
+
+    OrbitPathCache(const OrbitPathCache&) = delete;
+    OrbitPathCache& operator=(const OrbitPathCache&) = delete;
+
+    // Return the path of orbit and make it the most recently used one, or
+    // nullptr if it isn't cached.
+    CurvePlot* find(const Orbit* orbit);
+
+    // Add the path of orbit, which the cache takes ownership of, as the
+    // most recently used one.
+    void insert(const Orbit* orbit, CurvePlot* plot);
+
+    // Account for samples added to or removed from the most recently used
+    // path, and evict paths if the cache has grown over its limit.
+    void updateSize();
+
+    void clear();
+
+    size_t getMaxBytes() const { return maxBytes; }
+    void setMaxBytes(size_t);
+
+    const Statistics& getStatistics() const { return stats; }
+
+ private:
+    struct Entry
+    {
+        const Orbit* orbit;
+        CurvePlot* plot;
+        size_t bytes;
+    };
+
+    void evict();
+
+    std::list<Entry> entries;
+    std::unordered_map<const Orbit*, std::list<Entry>::iterator> index;
+    size_t maxBytes;
+    Statistics stats;
+};
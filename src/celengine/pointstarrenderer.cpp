@@ -0,0 +1,315 @@
+// pointstarrenderer.cpp
+//
+// Copyright (C) 2001-2009, the Celestia Development Team
+// Original version by Chris Laurel <claurel@gmail.com>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "pointstarrenderer.h"
+#include "pointstarvertexbuffer.h"
+#include "astro.h"
+#include "observer.h"
+#include "starcolors.h"
+#include "stardb.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Eigen;
+using namespace std;
+
+static const float STAR_DISTANCE_LIMIT = 1.0e6f;
+static const float RenderDistance      = 50.0f;
+
+
+PointStarRenderer::PointStarRenderer() :
+    ObjectRenderer<Star, float>(STAR_DISTANCE_LIMIT)
+{
+}
+
+
+void PointStarRenderer::process(const Star& star, float distance, float appMag)
+{
+    nProcessed++;
+
+    Vector3f starPos = star.getPosition();
+
+    // Calculate the difference at double precision *before* converting to float.
+    // This is very important for stars that are far from the origin.
+    Vector3f relPos = (starPos.cast<double>() - obsPos).cast<float>();
+    float   orbitalRadius = star.getOrbitalRadius();
+    bool    hasOrbit = orbitalRadius > 0.0f;
+
+    if (distance > distanceLimit)
+        return;
+
+
+    // A very rough check to see if the star may be visible: is the star in
+    // front of the viewer? If the star might be close (relPos.x^2 < 0.1) or
+    // is moving in an orbit, we'll always regard it as potentially visible.
+    // TODO: consider normalizing relPos and comparing relPos*viewNormal against
+    // cosFOV--this will cull many more stars than relPos*viewNormal, at the
+    // cost of a normalize per star.
+    if (relPos.dot(viewNormal) > 0.0f || relPos.x() * relPos.x() < 0.1f || hasOrbit)
+    {
+        Color color = starColor(star.getTemperature());
+        float discSizeInPixels = 0.0f;
+        float orbitSizeInPixels = 0.0f;
+
+        if (hasOrbit)
+            orbitSizeInPixels = orbitalRadius / (distance * pixelSize);
+
+        // Special handling for stars less than one light year away . . .
+        // We can't just go ahead and render a nearby star in the usual way
+        // for two reasons:
+        //   * It may be clipped by the near plane
+        //   * It may be large enough that we should render it as a mesh
+        //     instead of a particle
+        // It's possible that the second condition might apply for stars
+        // further than one light year away if the star is huge, the fov is
+        // very small and the resolution is high.  We'll ignore this for now
+        // and use the most inexpensive test possible . . .
+        if (distance < 1.0f || orbitSizeInPixels > 1.0f)
+        {
+            // Compute the position of the observer relative to the star.
+            // This is a much more accurate (and expensive) distance
+            // calculation than the previous one which used the observer's
+            // position rounded off to floats.
+            Vector3d hPos = observer->getPosition().offsetFromKm(star.getPosition(observer->getTime()));
+            relPos = hPos.cast<float>() * -astro::kilometersToLightYears(1.0f),
+            distance = relPos.norm();
+
+            // Recompute apparent magnitude using new distance computation
+            appMag = astro::absToAppMag(star.getAbsoluteMagnitude(), distance);
+
+            starPos = obsPos.cast<float>() + relPos * (RenderDistance / distance);
+
+            float radius = star.getRadius();
+            discSizeInPixels = radius / astro::lightYearsToKilometers(distance) / pixelSize;
+            ++nClose;
+        }
+
+        addStarLabel(star, relPos, appMag);
+
+        // Stars closer than the maximum solar system size are actually
+        // added to the render list and depth sorted, since they may occlude
+        // planets.
+        if (distance > SolarSystemMaxDistance)
+        {
+            addDistantStar(relPos, color, appMag);
+        }
+        else
+        {
+            Matrix3f viewMat = observer->getOrientationf().toRotationMatrix();
+            Vector3f viewMatZ = viewMat.row(2);
+
+            RenderListEntry rle;
+            rle.renderableType = RenderListEntry::RenderableStar;
+            rle.star = &star;
+
+            // Objects in the render list are always rendered relative to
+            // a viewer at the origin--this is different than for distant
+            // stars.
+            float scale = astro::lightYearsToKilometers(1.0f);
+            rle.position = relPos * scale;
+            rle.centerZ = rle.position.dot(viewMatZ);
+            rle.distance = rle.position.norm();
+            rle.radius = star.getRadius();
+            rle.discSizeInPixels = discSizeInPixels;
+            rle.appMag = appMag;
+            rle.isOpaque = true;
+            renderList->push_back(rle);
+        }
+    }
+}
+
+
+Color PointStarRenderer::starColor(float temperature) const
+{
+#ifdef HDR_COMPRESS
+    Color starColorFull = colorTemp->lookupColor(temperature);
+    return Color(starColorFull.red()   * 0.5f,
+                 starColorFull.green() * 0.5f,
+                 starColorFull.blue()  * 0.5f);
+#else
+    return colorTemp->lookupColor(temperature);
+#endif
+}
+
+
+// Place labels for stars brighter than the specified label threshold brightness
+void PointStarRenderer::addStarLabel(const Star& star, const Vector3f& relPos, float appMag)
+{
+    if ((labelMode & Renderer::StarLabels) && appMag < labelThresholdMag)
+    {
+        Vector3f starDir = relPos;
+        starDir.normalize();
+        if (starDir.dot(viewNormal) > cosFOV)
+        {
+            float distr = 3.5f * (labelThresholdMag - appMag)/labelThresholdMag;
+            if (distr > 1.0f)
+                distr = 1.0f;
+            Color labelColor(Renderer::StarLabelColor, distr * Renderer::StarLabelColor.alpha());
+            if (pendingLabels != nullptr)
+                pendingLabels->push_back({ &star, relPos, labelColor });
+            else
+                renderer->addBackgroundAnnotation(nullptr, &starDB->getStarLabel(star),
+                                                  labelColor, relPos);
+            nLabelled++;
+        }
+    }
+}
+
+
+// Add a star beyond the solar system to the point star vertex buffers
+void PointStarRenderer::addDistantStar(const Vector3f& relPos, const Color& color, float appMag)
+{
+#ifdef USE_HDR
+    float satPoint = saturationMag;
+    float alpha = exposure*(faintestMag - appMag)/(faintestMag - saturationMag + 0.001f);
+#else
+    float satPoint = faintestMag - (1.0f - brightnessBias) / brightnessScale; // TODO: precompute this value
+    float alpha = (faintestMag - appMag) * brightnessScale + brightnessBias;
+#endif
+#ifdef DEBUG_HDR_ADAPT
+    minMag = max(minMag, appMag);
+    maxMag = min(maxMag, appMag);
+    minAlpha = min(minAlpha, alpha);
+    maxAlpha = max(maxAlpha, alpha);
+    ++total;
+    if (alpha > above)
+    {
+        ++countAboveN;
+    }
+#endif
+
+    if (useScaledDiscs)
+    {
+        float discSize = size;
+        if (alpha < 0.0f)
+        {
+            alpha = 0.0f;
+        }
+        else if (alpha > 1.0f)
+        {
+            float discScale = min(MaxScaledDiscStarSize, (float) pow(2.0f, 0.3f * (satPoint - appMag)));
+            discSize *= discScale;
+
+            float glareAlpha = min(0.5f, discScale / 4.0f);
+            glareVertexBuffer->addStar(relPos, Color(color, glareAlpha), discSize * 3.0f);
+
+            alpha = 1.0f;
+        }
+        starVertexBuffer->addStar(relPos, Color(color, alpha), discSize);
+    }
+    else
+    {
+        if (alpha < 0.0f)
+        {
+            alpha = 0.0f;
+        }
+        else if (alpha > 1.0f)
+        {
+            float discScale = min(100.0f, satPoint - appMag + 2.0f);
+            float glareAlpha = min(GlareOpacity, (discScale - 2.0f) / 4.0f);
+            glareVertexBuffer->addStar(relPos, Color(color, glareAlpha), 2.0f * discScale * size);
+#ifdef DEBUG_HDR_ADAPT
+            maxSize = max(maxSize, 2.0f * discScale * size);
+#endif
+        }
+        starVertexBuffer->addStar(relPos, Color(color, alpha), size);
+    }
+
+    ++nRendered;
+}
+
+
+// Batched version of process() for all the stars of an octree node. The
+// stars brighter than dimmest are gathered into fixed size batches, whose
+// relative positions, distances and apparent magnitudes are computed with
+// Eigen arrays, vectorized with SSE/AVX/NEON depending on the target. Most
+// stars of a node are usually too dim, so they are left out before any of
+// the math rather than computed and thrown away. Stars that need the
+// careful treatment of process()--nearby stars, stars within the solar
+// system distance and stars with orbits--are passed to it individually.
+void PointStarRenderer::processBatch(const StarOctreeMirror& mirror,
+                                     unsigned int first,
+                                     unsigned int end,
+                                     float dimmest,
+                                     float limitingFactor)
+{
+    constexpr unsigned int BatchSize = 64;
+    typedef Eigen::Array<float, BatchSize, 1> BatchArray;
+
+    const Star* stars = mirror.getStars();
+    const float* mirrorX = mirror.getX();
+    const float* mirrorY = mirror.getY();
+    const float* mirrorZ = mirror.getZ();
+    const float* absMags = mirror.getAbsoluteMagnitudes();
+    const float* orbitalRadii = mirror.getOrbitalRadii();
+    const float* temperatures = mirror.getTemperatures();
+
+    unsigned int next = first;
+    while (next < end)
+    {
+        unsigned int index[BatchSize];
+        BatchArray x, y, z, absMag;
+        unsigned int n = 0;
+        for (; next < end && n < BatchSize; next++)
+        {
+            if (absMags[next] < dimmest)
+            {
+                index[n] = next;
+                x[n] = mirrorX[next];
+                y[n] = mirrorY[next];
+                z[n] = mirrorZ[next];
+                absMag[n] = absMags[next];
+                n++;
+            }
+        }
+
+        if (n == 0)
+            break;
+
+        // Calculate the difference at double precision *before* converting
+        // to float, just like process() does. Only the first n entries of
+        // the arrays are computed.
+        BatchArray relX, relY, relZ, distance, appMag, facing;
+        relX.head(n) = (x.head(n).cast<double>() - obsPos.x()).cast<float>();
+        relY.head(n) = (y.head(n).cast<double>() - obsPos.y()).cast<float>();
+        relZ.head(n) = (z.head(n).cast<double>() - obsPos.z()).cast<float>();
+        distance.head(n) = (relX.head(n).square() + relY.head(n).square() + relZ.head(n).square()).sqrt();
+        appMag.head(n) = absMag.head(n) - 5.0f + 5.0f * (distance.head(n) * (float) (1.0 / LY_PER_PARSEC)).log10();
+        facing.head(n) = relX.head(n) * viewNormal.x() + relY.head(n) * viewNormal.y() + relZ.head(n) * viewNormal.z();
+
+        for (unsigned int j = 0; j < n; j++)
+        {
+            unsigned int i = index[j];
+            bool bright = appMag[j] < limitingFactor;
+            if (distance[j] < 1.0f || distance[j] <= SolarSystemMaxDistance || orbitalRadii[i] > 0.0f)
+            {
+                if (bright || (distance[j] < MAX_STAR_ORBIT_RADIUS && stars[i].getOrbit()))
+                    process(stars[i], distance[j], appMag[j]);
+                continue;
+            }
+
+            if (!bright)
+                continue;
+
+            nProcessed++;
+            if (distance[j] > distanceLimit)
+                continue;
+
+            // Same rough visibility test as process()
+            if (facing[j] <= 0.0f && relX[j] * relX[j] >= 0.1f)
+                continue;
+
+            Vector3f relPos(relX[j], relY[j], relZ[j]);
+            addStarLabel(stars[i], relPos, appMag[j]);
+            addDistantStar(relPos, starColor(temperatures[i]), appMag[j]);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+// pointstarrenderer.h
+//
+// Copyright (C) 2001-2009, the Celestia Development Team
+// Original version by Chris Laurel <claurel@gmail.com>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <celengine/objectrenderer.h>
+#include <celengine/render.h>
+#include <celengine/staroctree.h>
+#include <Eigen/Core>
+#include <vector>
+
+class ColorTemperatureTable;
+class PointStarVertexBuffer;
+class StarDatabase;
+
+// Also used by the renderer for the stars of solar systems
+static const float MaxScaledDiscStarSize = 8.0f;
+static const float GlareOpacity = 0.65f;
+
+class PointStarRenderer : public ObjectRenderer<Star, float>, public StarBatchProcessor
+{
+ public:
+    PointStarRenderer();
+
+    void process(const Star& star, float distance, float appMag);
+    void processBatch(const StarOctreeMirror& mirror,
+                      unsigned int first,
+                      unsigned int end,
+                      float dimmest,
+                      float limitingFactor) override;
+
+ private:
+    Color starColor(float temperature) const;
+    void addStarLabel(const Star& star, const Eigen::Vector3f& relPos, float appMag);
+    void addDistantStar(const Eigen::Vector3f& relPos, const Color& starColor, float appMag);
+
+ public:
+    Eigen::Vector3d obsPos;
+
+    std::vector<RenderListEntry>* renderList{ nullptr };
+    PointStarVertexBuffer*   starVertexBuffer{ nullptr };
+    PointStarVertexBuffer*   glareVertexBuffer{ nullptr };
+
+    struct PendingLabel
+    {
+        const Star*     star;
+        Eigen::Vector3f position;
+        Color           color;
+    };
+    // When set, star labels are queued here instead of being added to the
+    // renderer, which isn't safe from the octree traversal threads.
+    std::vector<PendingLabel>* pendingLabels{ nullptr };
+
+    const StarDatabase* starDB{ nullptr };
+
+    bool  useScaledDiscs{ false };
+    float maxDiscSize{ 1.0f };
+
+    float cosFOV{ 1.0f };
+
+    const ColorTemperatureTable* colorTemp{ nullptr };
+    float SolarSystemMaxDistance { 1.0f };
+#ifdef DEBUG_HDR_ADAPT
+    float minMag;
+    float maxMag;
+    float minAlpha;
+    float maxAlpha;
+    float maxSize;
+    float above;
+    unsigned long countAboveN;
+    unsigned long total;
+#endif
+};
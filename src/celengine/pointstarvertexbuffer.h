@@ -0,0 +1,85 @@
+// pointstarvertexbuffer.h
+//
+// Copyright (C) 2001-2009, the Celestia Development Team
+// Original version by Chris Laurel <claurel@gmail.com>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <celutil/color.h>
+#include <Eigen/Core>
+#include <algorithm>
+
+class Renderer;
+class Texture;
+
+// PointStarVertexBuffer is used when hardware supports point sprites.
+class PointStarVertexBuffer
+{
+ public:
+    PointStarVertexBuffer(const Renderer& _renderer, unsigned int _capacity);
+    ~PointStarVertexBuffer();
+    void startPoints();
+    void startSprites();
+    void render();
+    void finish();
+    void addStar(const Eigen::Vector3f& pos, const Color&, float);
+    void setTexture(Texture* /*_texture*/);
+
+    // A deferred buffer never draws: it grows as stars are added and is
+    // drawn by appending it to a regular buffer. The octree traversal
+    // threads, which can't make GL calls, fill deferred buffers.
+    void setDeferred(bool);
+    void append(PointStarVertexBuffer& other);
+
+ private:
+    struct StarVertex
+    {
+        Eigen::Vector3f position;
+        float size;
+        unsigned char color[4];
+        float pad;
+    };
+
+    const Renderer& renderer;
+    unsigned int capacity;
+    unsigned int nStars{ 0 };
+    StarVertex* vertices{ nullptr };
+    bool useSprites{ false };
+    bool deferred{ false };
+    Texture* texture{ nullptr };
+};
+
+inline void PointStarVertexBuffer::addStar(const Eigen::Vector3f& pos,
+                                           const Color& color,
+                                           float size)
+{
+    if (nStars < capacity)
+    {
+        vertices[nStars].position = pos;
+        vertices[nStars].size = size;
+        color.get(vertices[nStars].color);
+        nStars++;
+    }
+
+    if (nStars == capacity)
+    {
+        if (deferred)
+        {
+            auto* newVertices = new StarVertex[capacity * 2];
+            std::copy(vertices, vertices + nStars, newVertices);
+            delete[] vertices;
+            vertices = newVertices;
+            capacity *= 2;
+        }
+        else
+        {
+            render();
+            nStars = 0;
+        }
+    }
+}
@@ -57,6 +57,9 @@ std::ofstream hdrlog;
 #include "skygrid.h"
 #include "modelgeometry.h"
 #include "curveplot.h"
+#include "objectrenderer.h"
+#include "pointstarrenderer.h"
+#include "pointstarvertexbuffer.h"
 #include "shadermanager.h"
 #include <celutil/debug.h>
 #include <celmath/frustum.h>
@@ -77,6 +80,7 @@ std::ofstream hdrlog;
 #endif //_WIN32
 #endif // VIDEO_SYNC
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <cassert>
 #include <sstream>
@@ -92,7 +96,6 @@ using namespace celmath;
 #define NEAR_DIST      0.5f
 #define FAR_DIST       1.0e9f
 
-static const float  STAR_DISTANCE_LIMIT  = 1.0e6f;
 static const int REF_DISTANCE_TO_SCREEN  = 400; //[mm]
 
 // Contribution from planetshine beyond this distance (in units of object radius)
@@ -117,12 +120,8 @@ static const float PixelOffset = 0.125f;
 static const float MinNearPlaneDistance = 0.0001f; // km
 static const float MaxFarNearRatio      = 2000000.0f;
 
-static const float RenderDistance       = 50.0f;
-
 // Star disc size in pixels
 static const float BaseStarDiscSize      = 5.0f;
-static const float MaxScaledDiscStarSize = 8.0f;
-static const float GlareOpacity = 0.65f;
 
 static const float MinRelativeOccluderRadius = 0.005f;
 
@@ -176,10 +175,11 @@ static const int MaxSkyRings = 32;
 static const int MaxSkySlices = 180;
 static const int MinSkySlices = 30;
 
-// Size at which the orbit cache will be flushed of old orbit paths
-static const unsigned int OrbitCacheCullThreshold = 200;
-// Age in frames at which unused orbit paths may be eliminated from the cache
-static const uint32_t OrbitCacheRetireAge = 16;
+// Memory used by cached orbit paths before the least recently used ones are
+// dropped; enough for a few tens of thousands of asteroid orbits.
+static const size_t DefaultOrbitCacheSize = 64 * 1024 * 1024;
+// Time spent sampling new orbit paths per frame
+static const double DefaultOrbitSamplingBudget = 0.004;
 
 Color Renderer::StarLabelColor          (0.471f, 0.356f, 0.682f);
 Color Renderer::PlanetLabelColor        (0.407f, 0.333f, 0.964f);
@@ -275,175 +275,7 @@ double computeCosViewConeAngle(double verticalFOV, double width, double height)
     return 1.0 / diag;
 }
 
-// PointStarVertexBuffer is used when hardware supports point sprites.
-class PointStarVertexBuffer
-{
-public:
-    PointStarVertexBuffer(const Renderer& _renderer, unsigned int _capacity);
-    ~PointStarVertexBuffer();
-    void startPoints();
-    void startSprites();
-    void render();
-    void finish();
-    inline void addStar(const Eigen::Vector3f& pos, const Color&, float);
-    void setTexture(Texture* /*_texture*/);
-
-private:
-    struct StarVertex
-    {
-        Eigen::Vector3f position;
-        float size;
-        unsigned char color[4];
-        float pad;
-    };
-
-    const Renderer& renderer;
-    unsigned int capacity;
-    unsigned int nStars{ 0 };
-    StarVertex* vertices{ nullptr };
-    bool useSprites{ false };
-    Texture* texture{ nullptr };
-};
-
-PointStarVertexBuffer::PointStarVertexBuffer(const Renderer& _renderer,
-                                             unsigned int _capacity) :
-    renderer(_renderer),
-    capacity(_capacity)
-{
-    vertices = new StarVertex[capacity];
-}
-
-PointStarVertexBuffer::~PointStarVertexBuffer()
-{
-    delete[] vertices;
-}
-
-void PointStarVertexBuffer::startSprites()
-{
-    CelestiaGLProgram* prog = renderer.getShaderManager().getShader("star");
-    if (prog == nullptr)
-        return;
-
-    prog->use();
-    prog->samplerParam("starTex") = 0;
-
-    unsigned int stride = sizeof(StarVertex);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, stride, &vertices[0].position);
-    glEnableClientState(GL_COLOR_ARRAY);
-    glColorPointer(4, GL_UNSIGNED_BYTE, stride, &vertices[0].color);
-
-    glEnableVertexAttribArray(CelestiaGLProgram::PointSizeAttributeIndex);
-    glVertexAttribPointer(CelestiaGLProgram::PointSizeAttributeIndex,
-                          1, GL_FLOAT, GL_FALSE,
-                          stride, &vertices[0].size);
-
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-
-    glEnable(GL_POINT_SPRITE);
-
-    useSprites = true;
-}
-
-void PointStarVertexBuffer::startPoints()
-{
-    unsigned int stride = sizeof(StarVertex);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, stride, &vertices[0].position);
-    glEnableClientState(GL_COLOR_ARRAY);
-    glColorPointer(4, GL_UNSIGNED_BYTE, stride, &vertices[0].color);
-
-    // An option to control the size of the stars would be helpful.
-    // Which size looks best depends a lot on the resolution and the
-    // type of display device.
-    // glPointSize(2.0f);
-    // glEnable(GL_POINT_SMOOTH);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisable(GL_TEXTURE_2D);
-
-    glDisableClientState(GL_NORMAL_ARRAY);
-
-    useSprites = false;
-}
-
-void PointStarVertexBuffer::render()
-{
-    if (nStars != 0)
-    {
-        unsigned int stride = sizeof(StarVertex);
-        if (useSprites)
-        {
-            glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
-            glEnable(GL_TEXTURE_2D);
-        }
-        else
-        {
-            glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
-            glDisable(GL_TEXTURE_2D);
-            glPointSize(1.0f);
-        }
-        glVertexPointer(3, GL_FLOAT, stride, &vertices[0].position);
-        glColorPointer(4, GL_UNSIGNED_BYTE, stride, &vertices[0].color);
-
-        if (useSprites)
-        {
-            glVertexAttribPointer(CelestiaGLProgram::PointSizeAttributeIndex,
-                                  1, GL_FLOAT, GL_FALSE,
-                                  stride, &vertices[0].size);
-        }
-
-        if (texture != nullptr)
-            texture->bind();
-        glDrawArrays(GL_POINTS, 0, nStars);
-        nStars = 0;
-    }
-}
-
-void PointStarVertexBuffer::finish()
-{
-    render();
-    glDisableClientState(GL_COLOR_ARRAY);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-
-    if (useSprites)
-    {
-        glDisableVertexAttribArray(CelestiaGLProgram::PointSizeAttributeIndex);
-        glUseProgram(0);
-        glDisable(GL_POINT_SPRITE);
-    }
-    else
-    {
-        glEnable(GL_TEXTURE_2D);
-    }
-}
-
-inline void PointStarVertexBuffer::addStar(const Eigen::Vector3f& pos,
-                                           const Color& color,
-                                           float size)
-{
-    if (nStars < capacity)
-    {
-        vertices[nStars].position = pos;
-        vertices[nStars].size = size;
-        color.get(vertices[nStars].color);
-        nStars++;
-    }
-
-    if (nStars == capacity)
-    {
-        render();
-        nStars = 0;
-    }
-}
-
-void PointStarVertexBuffer::setTexture(Texture* _texture)
-{
-  texture = _texture;
-}
-
-/**** End star vertex buffer classes ****/
+static void deleteSubtreeOutputs(vector<StarSubtreeOutput*>&, vector<DSOSubtreeOutput*>&);
 
 
 Renderer::Renderer() :
@@ -467,7 +299,8 @@ Renderer::Renderer() :
     glareVertexBuffer(nullptr),
     textureResolution(medres),
     frameCount(0),
-    lastOrbitCacheFlush(0),
+    orbitCache(DefaultOrbitCacheSize),
+    orbitSamplingBudget(DefaultOrbitSamplingBudget),
     minOrbitSize(MinOrbitSizeForLabel),
     distanceLimit(1.0e6f),
     minFeatureSize(MinFeatureSizeForLabel),
@@ -534,6 +367,7 @@ Renderer::~Renderer()
 {
     delete pointStarVertexBuffer;
     delete glareVertexBuffer;
+    deleteSubtreeOutputs(starSubtreeOutputs, dsoSubtreeOutputs);
     delete[] skyVertices;
     delete[] skyIndices;
     delete[] skyContour;
@@ -649,6 +483,8 @@ class ShadowTextureFunction : public TexelFunctionObject
 public:
     ShadowTextureFunction(float _umbra) : umbra(_umbra) {};
     void operator()(float u, float v, float w, unsigned char* pixel) override;
+    void evalRow(const float* u, float v, int count,
+                 unsigned char* pixels, int components) override;
     float umbra;
 };
 
@@ -678,6 +514,32 @@ void ShadowTextureFunction::operator()(float u, float v, float /*w*/,
     pixel[2] = pixVal;
 };
 
+// The same function without branches, so that the loop vectorizes.
+void ShadowTextureFunction::evalRow(const float* u, float v, int count,
+                                    unsigned char* pixels, int components)
+{
+    const float edge = 15.0f / 16.0f;
+    const float penumbraScale = 1.0f / (1.0f - umbra);
+    float values[256];
+
+    for (int start = 0; start < count; start += 256)
+    {
+        int n = min(count - start, 256);
+        for (int x = 0; x < n; x++)
+        {
+            float r = sqrt(u[start + x] * u[start + x] + v * v) / edge;
+            float penumbra = sqrt(max(r - umbra, 0.0f) * penumbraScale) * 255.99f;
+            values[x] = r < 1.0f ? penumbra : 255.0f;
+        }
+
+        for (int x = 0; x < n; x++)
+        {
+            unsigned char* pixel = pixels + (start + x) * components;
+            pixel[0] = pixel[1] = pixel[2] = (unsigned char) values[x];
+        }
+    }
+}
+
 
 class ShadowMaskTextureFunction : public TexelFunctionObject
 {
@@ -948,11 +810,15 @@ bool Renderer::init(
     {
         g_lodSphere = new LODSphereMesh();
 
-        starTex = CreateProceduralTexture(64, 64, GL_RGB, StarTextureEval);
+        starTex = CreateProceduralTexture(64, 64, GL_RGB, StarTextureEval,
+                                          Texture::EdgeClamp, Texture::DefaultMipMaps,
+                                          "star");
 
         glareTex = LoadTextureFromFile("textures/flare.jpg");
         if (glareTex == nullptr)
-            glareTex = CreateProceduralTexture(64, 64, GL_RGB, GlareTextureEval);
+            glareTex = CreateProceduralTexture(64, 64, GL_RGB, GlareTextureEval,
+                                               Texture::EdgeClamp, Texture::DefaultMipMaps,
+                                               "glare");
 
         // Max mipmap level doesn't work reliably on all graphics
         // cards.  In particular, Rage 128 and TNT cards resort to software
@@ -968,7 +834,8 @@ bool Renderer::init(
                                             detailOptions.shadowTextureSize,
                                             GL_RGB,
                                             ShadowTextureEval,
-                                            shadowTexAddress, shadowTexMip);
+                                            shadowTexAddress, shadowTexMip,
+                                            "shadow");
         shadowTex->setBorderColor(Color::White);
 
         if (gaussianDiscTex == nullptr)
@@ -985,7 +852,8 @@ bool Renderer::init(
                     CreateProceduralTexture(detailOptions.eclipseTextureSize,
                                             detailOptions.eclipseTextureSize,
                                             GL_RGB, func,
-                                            shadowTexAddress, shadowTexMip);
+                                            shadowTexAddress, shadowTexMip,
+                                            "eclipse-shadow-" + to_string(i));
                 if (eclipseShadowTextures[i] != nullptr)
                 {
                     // eclipseShadowTextures[i]->setMaxMipMapLevel(2);
@@ -1005,9 +873,11 @@ bool Renderer::init(
         // fragment program eclipse shadows.
         penumbraFunctionTexture = CreateProceduralTexture(512, 1, GL_LUMINANCE,
                                                           PenumbraFunctionEval,
-                                                          Texture::EdgeClamp);
+                                                          Texture::EdgeClamp,
+                                                          Texture::DefaultMipMaps,
+                                                          "penumbra");
 
-         normalizationTex = CreateProceduralCubeMap(64, GL_RGB, IllumMapEval);
+         normalizationTex = CreateProceduralCubeMap(64, GL_RGB, IllumMapEval, "normalization");
 #if ADVANCED_CLOUD_SHADOWS
          rectToSphericalTexture = CreateProceduralCubeMap(128, GL_RGBA, RectToSphericalMapEval);
 #endif
@@ -1300,7 +1170,7 @@ void Renderer::setDistanceLimit(float distanceLimit_)
 
 void Renderer::addAnnotation(vector<Annotation>& annotations,
                              const MarkerRepresentation* markerRep,
-                             const string& labelText,
+                             const string* labelText,
                              Color color,
                              const Vector3f& pos,
                              LabelAlignment halign,
@@ -1320,15 +1190,12 @@ void Renderer::addAnnotation(vector<Annotation>& annotations,
                    &winX, &winY, &winZ) != GL_FALSE)
     {
         Annotation a;
-        if (special)
+        a.labelText = nullptr;
+        if (labelText != nullptr && !labelText->empty())
         {
-            if (markerRep == nullptr)
+            if (!special || markerRep == nullptr)
                 a.labelText = labelText;
         }
-        else
-        {
-            a.labelText = labelText;
-        }
         a.markerRep = markerRep;
         a.color = color;
         a.position = Vector3f((float) winX, (float) winY, -depth);
@@ -1348,7 +1215,7 @@ void Renderer::addForegroundAnnotation(const MarkerRepresentation* markerRep,
                                        LabelVerticalAlignment valign,
                                        float size)
 {
-    addAnnotation(foregroundAnnotations, markerRep, labelText, color, pos, halign, valign, size);
+    addAnnotation(foregroundAnnotations, markerRep, copyLabel(labelText), color, pos, halign, valign, size);
 }
 
 
@@ -1360,7 +1227,7 @@ void Renderer::addBackgroundAnnotation(const MarkerRepresentation* markerRep,
                                        LabelVerticalAlignment valign,
                                        float size)
 {
-    addAnnotation(backgroundAnnotations, markerRep, labelText, color, pos, halign, valign, size);
+    addAnnotation(backgroundAnnotations, markerRep, copyLabel(labelText), color, pos, halign, valign, size);
 }
 
 
@@ -1371,11 +1238,53 @@ void Renderer::addSortedAnnotation(const MarkerRepresentation* markerRep,
                                    LabelAlignment halign,
                                    LabelVerticalAlignment valign,
                                    float size)
+{
+    addAnnotation(depthSortedAnnotations, markerRep, copyLabel(labelText), color, pos, halign, valign, size, true);
+}
+
+
+void Renderer::addBackgroundAnnotation(const MarkerRepresentation* markerRep,
+                                       const string* labelText,
+                                       Color color,
+                                       const Vector3f& pos,
+                                       LabelAlignment halign,
+                                       LabelVerticalAlignment valign,
+                                       float size)
+{
+    addAnnotation(backgroundAnnotations, markerRep, labelText, color, pos, halign, valign, size);
+}
+
+
+void Renderer::addSortedAnnotation(const MarkerRepresentation* markerRep,
+                                   const string* labelText,
+                                   Color color,
+                                   const Vector3f& pos,
+                                   LabelAlignment halign,
+                                   LabelVerticalAlignment valign,
+                                   float size)
 {
     addAnnotation(depthSortedAnnotations, markerRep, labelText, color, pos, halign, valign, size, true);
 }
 
 
+// Keep a copy of a label that isn't interned until the end of the frame.
+// The strings are reused, so their buffers are allocated only when the
+// number or length of the labels grows.
+const string* Renderer::copyLabel(const string& labelText)
+{
+    if (labelText.empty())
+        return nullptr;
+
+    // Unlike vector, deque doesn't move its elements when it grows.
+    if (labelStringCount == labelStrings.size())
+        labelStrings.emplace_back();
+    string& copy = labelStrings[labelStringCount++];
+    copy = labelText;
+
+    return &copy;
+}
+
+
 void Renderer::clearAnnotations(vector<Annotation>& annotations)
 {
     annotations.clear();
@@ -1439,7 +1348,7 @@ void Renderer::addObjectAnnotation(const MarkerRepresentation* markerRep,
     assert(objectAnnotationSetOpen);
     if (objectAnnotationSetOpen)
     {
-        addAnnotation(objectAnnotations, markerRep, labelText, color, pos, AlignCenter, VerticalAlignCenter);
+        addAnnotation(objectAnnotations, markerRep, copyLabel(labelText), color, pos, AlignCenter, VerticalAlignCenter);
     }
 }
 
@@ -1592,17 +1501,19 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
     else
         orbit = orbitPath.star->getOrbit();
 
-    CurvePlot* cachedOrbit = nullptr;
-    OrbitCache::iterator cached = orbitCache.find(orbit);
-    if (cached != orbitCache.end())
-    {
-        cachedOrbit = cached->second;
+    CurvePlot* cachedOrbit = orbitCache.find(orbit);
+    if (cachedOrbit != nullptr)
         cachedOrbit->setLastUsed(frameCount);
-    }
 
     // If it's not in the cache already
     if (cachedOrbit == nullptr)
     {
+        // Once this frame's sampling time is spent, new paths wait for the
+        // next frames; at least one is sampled per frame.
+        if (orbitSamplingBudget > 0.0 && orbitSamplingTime > orbitSamplingBudget)
+            return;
+        auto samplingStart = chrono::steady_clock::now();
+
         double startTime = t;
         int nSamples = detailOptions.orbitPathSamplePoints;
 
@@ -1645,26 +1556,10 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
                       sampler);
         sampler.insertForward(cachedOrbit);
 
-        // If the orbit cache is full, first try and eliminate some old orbits
-        if (orbitCache.size() > OrbitCacheCullThreshold)
-        {
-            // Check for old orbits at most once per frame
-            if (lastOrbitCacheFlush != frameCount)
-            {
-                for (auto iter = orbitCache.begin(); iter != orbitCache.end();)
-                {
-                    // Tricky code to eliminate a node in the orbit cache without screwing
-                    // up the iterator. Should work in all STL implementations.
-                    if (frameCount - iter->second->lastUsed() > OrbitCacheRetireAge)
-                        orbitCache.erase(iter++);
-                    else
-                        ++iter;
-                }
-                lastOrbitCacheFlush = frameCount;
-            }
-        }
+        // The least recently used paths are dropped if the cache is full
+        orbitCache.insert(orbit, cachedOrbit);
 
-        orbitCache[orbit] = cachedOrbit;
+        orbitSamplingTime += chrono::duration<double>(chrono::steady_clock::now() - samplingStart).count();
     }
 
     if (cachedOrbit->empty())
@@ -1740,6 +1635,9 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
             clog << "new sample count: " << cachedOrbit->sampleCount() << endl;
 #endif
         }
+
+        // Resampling changes the number of samples
+        orbitCache.updateSize();
     }
 
     // We perform vertex tranformations on the CPU because double precision is necessary to
@@ -2485,6 +2383,8 @@ void Renderer::draw(const Observer& observer,
     realTime = observer.getRealTime();
 
     frameCount++;
+    orbitSamplingTime = 0.0;
+    labelStringCount = 0;
     settingsChanged = false;
 
     // Compute the size of a pixel
@@ -2950,20 +2850,20 @@ void Renderer::draw(const Observer& observer,
             // both markers are drawn and cursor appears much brighter as a result.
             if (distance < astro::lightYearsToKilometers(1.0))
             {
-                addSortedAnnotation(&cursorRep, "", Color(SelectionCursorColor, 1.0f),
+                addSortedAnnotation(&cursorRep, nullptr, Color(SelectionCursorColor, 1.0f),
                                     offset.cast<float>(),
                                     AlignLeft, VerticalAlignTop, symbolSize);
             }
             else
             {
-                addAnnotation(backgroundAnnotations, &cursorRep, "", Color(SelectionCursorColor, 1.0f),
+                addAnnotation(backgroundAnnotations, &cursorRep, nullptr, Color(SelectionCursorColor, 1.0f),
                               offset.cast<float>(),
                               AlignLeft, VerticalAlignTop, symbolSize);
             }
 
             Color occludedCursorColor(SelectionCursorColor.red(), SelectionCursorColor.green() + 0.3f, SelectionCursorColor.blue());
             addAnnotation(foregroundAnnotations,
-                          &cursorRep, "", Color(occludedCursorColor, 0.4f),
+                          &cursorRep, nullptr, Color(occludedCursorColor, 0.4f),
                           offset.cast<float>(),
                           AlignLeft, VerticalAlignTop, symbolSize);
         }
@@ -6360,7 +6260,7 @@ void Renderer::buildLabelLists(const Frustum& viewFrustum,
                         }
                     }
 
-                    addSortedAnnotation(nullptr, body->getName(true), labelColor, pos);
+                    addSortedAnnotation(nullptr, &body->getName(true), labelColor, pos);
                 }
             }
         }
@@ -6407,278 +6307,6 @@ void Renderer::addStarOrbitToRenderList(const Star& star,
 }
 
 
-template <class OBJ, class PREC> class ObjectRenderer : public OctreeProcessor<OBJ, PREC>
-{
- public:
-    ObjectRenderer(PREC _distanceLimit);
-
-    void process(const OBJ& /*unused*/, PREC /*unused*/, float /*unused*/) {};
-
- public:
-    const Observer* observer{ nullptr };
-
-#ifdef USE_GLCONTEXT
-    GLContext* context{ nullptr };
-#endif
-    Renderer*  renderer{ nullptr };
-
-    Eigen::Vector3f viewNormal;
-
-    float fov{ 0.0f };
-    float size{ 0.0f };
-    float pixelSize{ 0.0f };
-    float faintestMag{ 0.0f };
-    float faintestMagNight{ 0.0f };
-    float saturationMag{ 0.0f };
-#ifdef USE_HDR
-    float exposure{ 0.0f };
-#endif
-    float brightnessScale{ 0.0f };
-    float brightnessBias{ 0.0f };
-    float distanceLimit{ 0.0f };
-
-    // Objects brighter than labelThresholdMag will be labeled
-    float labelThresholdMag{ 0.0f };
-
-    // These are not fully used by this template's descendants
-    // but we place them here just in case a more sophisticated
-    // rendering scheme is implemented:
-    int nRendered{ 0 };
-    int nClose{ 0 };
-    int nBright{ 0 };
-    int nProcessed{ 0 };
-    int nLabelled{ 0 };
-
-    uint64_t renderFlags{ 0 };
-    int labelMode{ 0 };
-};
-
-
-template <class OBJ, class PREC>
-ObjectRenderer<OBJ, PREC>::ObjectRenderer(const PREC _distanceLimit) :
-    distanceLimit((float) _distanceLimit)
-{
-}
-
-
-class PointStarRenderer : public ObjectRenderer<Star, float>
-{
- public:
-    PointStarRenderer();
-
-    void process(const Star& star, float distance, float appMag);
-
- public:
-    Vector3d obsPos;
-
-    vector<RenderListEntry>* renderList{ nullptr };
-    PointStarVertexBuffer*   starVertexBuffer{ nullptr };
-    PointStarVertexBuffer*   glareVertexBuffer{ nullptr };
-
-    const StarDatabase* starDB{ nullptr };
-
-    bool  useScaledDiscs{ false };
-    float maxDiscSize{ 1.0f };
-
-    float cosFOV{ 1.0f };
-
-    const ColorTemperatureTable* colorTemp{ nullptr };
-    float SolarSystemMaxDistance { 1.0f };
-#ifdef DEBUG_HDR_ADAPT
-    float minMag;
-    float maxMag;
-    float minAlpha;
-    float maxAlpha;
-    float maxSize;
-    float above;
-    unsigned long countAboveN;
-    unsigned long total;
-#endif
-};
-
-
-PointStarRenderer::PointStarRenderer() :
-    ObjectRenderer<Star, float>(STAR_DISTANCE_LIMIT)
-{
-}
-
-
-void PointStarRenderer::process(const Star& star, float distance, float appMag)
-{
-    nProcessed++;
-
-    Vector3f starPos = star.getPosition();
-
-    // Calculate the difference at double precision *before* converting to float.
-    // This is very important for stars that are far from the origin.
-    Vector3f relPos = (starPos.cast<double>() - obsPos).cast<float>();
-    float   orbitalRadius = star.getOrbitalRadius();
-    bool    hasOrbit = orbitalRadius > 0.0f;
-
-    if (distance > distanceLimit)
-        return;
-
-
-    // A very rough check to see if the star may be visible: is the star in
-    // front of the viewer? If the star might be close (relPos.x^2 < 0.1) or
-    // is moving in an orbit, we'll always regard it as potentially visible.
-    // TODO: consider normalizing relPos and comparing relPos*viewNormal against
-    // cosFOV--this will cull many more stars than relPos*viewNormal, at the
-    // cost of a normalize per star.
-    if (relPos.dot(viewNormal) > 0.0f || relPos.x() * relPos.x() < 0.1f || hasOrbit)
-    {
-#ifdef HDR_COMPRESS
-        Color starColorFull = colorTemp->lookupColor(star.getTemperature());
-        Color starColor(starColorFull.red()   * 0.5f,
-                        starColorFull.green() * 0.5f,
-                        starColorFull.blue()  * 0.5f);
-#else
-        Color starColor = colorTemp->lookupColor(star.getTemperature());
-#endif
-        float discSizeInPixels = 0.0f;
-        float orbitSizeInPixels = 0.0f;
-
-        if (hasOrbit)
-            orbitSizeInPixels = orbitalRadius / (distance * pixelSize);
-
-        // Special handling for stars less than one light year away . . .
-        // We can't just go ahead and render a nearby star in the usual way
-        // for two reasons:
-        //   * It may be clipped by the near plane
-        //   * It may be large enough that we should render it as a mesh
-        //     instead of a particle
-        // It's possible that the second condition might apply for stars
-        // further than one light year away if the star is huge, the fov is
-        // very small and the resolution is high.  We'll ignore this for now
-        // and use the most inexpensive test possible . . .
-        if (distance < 1.0f || orbitSizeInPixels > 1.0f)
-        {
-            // Compute the position of the observer relative to the star.
-            // This is a much more accurate (and expensive) distance
-            // calculation than the previous one which used the observer's
-            // position rounded off to floats.
-            Vector3d hPos = astrocentricPosition(observer->getPosition(),
-                                                 star,
-                                                 observer->getTime());
-            relPos = hPos.cast<float>() * -astro::kilometersToLightYears(1.0f),
-            distance = relPos.norm();
-
-            // Recompute apparent magnitude using new distance computation
-            appMag = astro::absToAppMag(star.getAbsoluteMagnitude(), distance);
-
-            starPos = obsPos.cast<float>() + relPos * (RenderDistance / distance);
-
-            float radius = star.getRadius();
-            discSizeInPixels = radius / astro::lightYearsToKilometers(distance) / pixelSize;
-            ++nClose;
-        }
-
-        // Place labels for stars brighter than the specified label threshold brightness
-        if ((labelMode & Renderer::StarLabels) && appMag < labelThresholdMag)
-        {
-            Vector3f starDir = relPos;
-            starDir.normalize();
-            if (starDir.dot(viewNormal) > cosFOV)
-            {
-                float distr = 3.5f * (labelThresholdMag - appMag)/labelThresholdMag;
-                if (distr > 1.0f)
-                    distr = 1.0f;
-                renderer->addBackgroundAnnotation(nullptr, starDB->getStarName(star, true),
-                                                  Color(Renderer::StarLabelColor, distr * Renderer::StarLabelColor.alpha()),
-                                                  relPos);
-                nLabelled++;
-            }
-        }
-
-        // Stars closer than the maximum solar system size are actually
-        // added to the render list and depth sorted, since they may occlude
-        // planets.
-        if (distance > SolarSystemMaxDistance)
-        {
-#ifdef USE_HDR
-            float satPoint = saturationMag;
-            float alpha = exposure*(faintestMag - appMag)/(faintestMag - saturationMag + 0.001f);
-#else
-            float satPoint = faintestMag - (1.0f - brightnessBias) / brightnessScale; // TODO: precompute this value
-            float alpha = (faintestMag - appMag) * brightnessScale + brightnessBias;
-#endif
-#ifdef DEBUG_HDR_ADAPT
-            minMag = max(minMag, appMag);
-            maxMag = min(maxMag, appMag);
-            minAlpha = min(minAlpha, alpha);
-            maxAlpha = max(maxAlpha, alpha);
-            ++total;
-            if (alpha > above)
-            {
-                ++countAboveN;
-            }
-#endif
-
-            if (useScaledDiscs)
-            {
-                float discSize = size;
-                if (alpha < 0.0f)
-                {
-                    alpha = 0.0f;
-                }
-                else if (alpha > 1.0f)
-                {
-                    float discScale = min(MaxScaledDiscStarSize, (float) pow(2.0f, 0.3f * (satPoint - appMag)));
-                    discSize *= discScale;
-
-                    float glareAlpha = min(0.5f, discScale / 4.0f);
-                    glareVertexBuffer->addStar(relPos, Color(starColor, glareAlpha), discSize * 3.0f);
-
-                    alpha = 1.0f;
-                }
-                starVertexBuffer->addStar(relPos, Color(starColor, alpha), discSize);
-            }
-            else
-            {
-                if (alpha < 0.0f)
-                {
-                    alpha = 0.0f;
-                }
-                else if (alpha > 1.0f)
-                {
-                    float discScale = min(100.0f, satPoint - appMag + 2.0f);
-                    float glareAlpha = min(GlareOpacity, (discScale - 2.0f) / 4.0f);
-                    glareVertexBuffer->addStar(relPos, Color(starColor, glareAlpha), 2.0f * discScale * size);
-#ifdef DEBUG_HDR_ADAPT
-                    maxSize = max(maxSize, 2.0f * discScale * size);
-#endif
-                }
-                starVertexBuffer->addStar(relPos, Color(starColor, alpha), size);
-            }
-
-            ++nRendered;
-        }
-        else
-        {
-            Matrix3f viewMat = observer->getOrientationf().toRotationMatrix();
-            Vector3f viewMatZ = viewMat.row(2);
-
-            RenderListEntry rle;
-            rle.renderableType = RenderListEntry::RenderableStar;
-            rle.star = &star;
-
-            // Objects in the render list are always rendered relative to
-            // a viewer at the origin--this is different than for distant
-            // stars.
-            float scale = astro::lightYearsToKilometers(1.0f);
-            rle.position = relPos * scale;
-            rle.centerZ = rle.position.dot(viewMatZ);
-            rle.distance = rle.position.norm();
-            rle.radius = star.getRadius();
-            rle.discSizeInPixels = discSizeInPixels;
-            rle.appMag = appMag;
-            rle.isOpaque = true;
-            renderList->push_back(rle);
-        }
-    }
-}
-
-
 // Calculate the maximum field of view (from top left corner to bottom right) of
 // a frustum with the specified aspect ratio (width/height) and vertical field of
 // view. We follow the convention used elsewhere and use units of degrees for
@@ -6690,6 +6318,28 @@ static double calcMaxFOV(double fovY_degrees, double aspectRatio)
 }
 
 
+// Everything produced by the traversal of one subtree of the star octree
+// on a worker thread. The results are merged on the render thread in
+// subtree order, so the frame doesn't depend on the thread scheduling.
+class StarSubtreeOutput
+{
+ public:
+    StarSubtreeOutput(const Renderer& renderer) :
+        starVertices(renderer, 1024),
+        glareVertices(renderer, 256)
+    {
+        starVertices.setDeferred(true);
+        glareVertices.setDeferred(true);
+    }
+
+    PointStarRenderer starRenderer;
+    PointStarVertexBuffer starVertices;
+    PointStarVertexBuffer glareVertices;
+    vector<RenderListEntry> renderList;
+    vector<PointStarRenderer::PendingLabel> labels;
+};
+
+
 void Renderer::renderPointStars(const StarDatabase& starDB,
                                 float faintestMagNight,
                                 const Observer& observer)
@@ -6768,17 +6418,66 @@ void Renderer::renderPointStars(const StarDatabase& starDB,
     m_starProcStats.height = 0;
     m_starProcStats.objects = 0;
 #endif
-    starDB.findVisibleStars(starRenderer,
-                            obsPos.cast<float>(),
-                            observer.getOrientationf(),
-                            degToRad(fov),
-                            (float) windowWidth / (float) windowHeight,
-                            faintestMagNight,
+#ifndef OCTREE_DEBUG
+    ThreadPool& pool = ThreadPool::shared();
+    if (pool.size() > 1)
+    {
+        // Each subtree gets a copy of starRenderer writing to buffers of
+        // its own; handlers are requested in order on this thread.
+        size_t nSubtrees = 0;
+        auto subtreeHandler = [&](size_t i) -> StarHandler&
+        {
+            nSubtrees = i + 1;
+            if (i == starSubtreeOutputs.size())
+                starSubtreeOutputs.push_back(new StarSubtreeOutput(*this));
+            StarSubtreeOutput* output = starSubtreeOutputs[i];
+            output->renderList.clear();
+            output->labels.clear();
+            output->starRenderer = starRenderer;
+            output->starRenderer.starVertexBuffer = &output->starVertices;
+            output->starRenderer.glareVertexBuffer = &output->glareVertices;
+            output->starRenderer.renderList = &output->renderList;
+            output->starRenderer.pendingLabels = &output->labels;
+            return output->starRenderer;
+        };
+
+        starDB.findVisibleStars(starRenderer,
+                                subtreeHandler,
+                                pool,
+                                obsPos.cast<float>(),
+                                observer.getOrientationf(),
+                                degToRad(fov),
+                                (float) windowWidth / (float) windowHeight,
+                                faintestMagNight);
+
+        for (size_t i = 0; i < nSubtrees; i++)
+        {
+            StarSubtreeOutput* output = starSubtreeOutputs[i];
+            starRenderer.starVertexBuffer->append(output->starVertices);
+            starRenderer.glareVertexBuffer->append(output->glareVertices);
+            renderList.insert(renderList.end(), output->renderList.begin(), output->renderList.end());
+            for (const auto& label : output->labels)
+            {
+                addBackgroundAnnotation(nullptr, &starDB.getStarLabel(*label.star),
+                                        label.color, label.position);
+            }
+        }
+    }
+    else
+#endif
+    {
+        starDB.findVisibleStars(starRenderer,
+                                obsPos.cast<float>(),
+                                observer.getOrientationf(),
+                                degToRad(fov),
+                                (float) windowWidth / (float) windowHeight,
+                                faintestMagNight,
 #ifdef OCTREE_DEBUG
-                            &m_starProcStats);
+                                &m_starProcStats);
 #else
-                            nullptr);
+                                nullptr);
 #endif
+    }
 
     starRenderer.starVertexBuffer->render();
     starRenderer.glareVertexBuffer->render();
@@ -6816,6 +6515,37 @@ DSORenderer::DSORenderer() :
 };
 
 
+// Collects the DSOs found in one subtree of the DSO octree on a worker
+// thread; DSORenderer::process() makes GL calls, so the DSOs are rendered
+// afterwards on the render thread, in subtree order.
+class DSOSubtreeOutput : public DSOHandler
+{
+ public:
+    void process(DeepSkyObject* const& dso, double distance, float absMag) override
+    {
+        dsos.push_back({ dso, distance, absMag });
+    }
+
+    struct Entry
+    {
+        DeepSkyObject* dso;
+        double         distance;
+        float          absMag;
+    };
+    vector<Entry> dsos;
+};
+
+
+static void deleteSubtreeOutputs(vector<StarSubtreeOutput*>& starOutputs,
+                                 vector<DSOSubtreeOutput*>& dsoOutputs)
+{
+    for (auto output : starOutputs)
+        delete output;
+    for (auto output : dsoOutputs)
+        delete output;
+}
+
+
 void DSORenderer::process(DeepSkyObject* const & dso,
                           double distanceToDSO,
                           float  absMag)
@@ -6977,7 +6707,7 @@ void DSORenderer::process(DeepSkyObject* const & dso,
                         distr = 1.0f;
 
                     renderer->addBackgroundAnnotation(rep,
-                                                      dsoDB->getDSOName(dso, true),
+                                                      &dsoDB->getDSOLabel(dso),
                                                       Color(labelColor, distr * labelColor.alpha()),
                                                       relPos,
                                                       Renderer::AlignLeft, Renderer::VerticalAlignCenter, symbolSize);
@@ -7045,17 +6775,50 @@ void Renderer::renderDeepSkyObjects(const Universe&  universe,
     m_dsoProcStats.nodes = 0;
     m_dsoProcStats.height = 0;
 #endif
-    dsoDB->findVisibleDSOs(dsoRenderer,
-                           obsPos,
-                           observer.getOrientationf(),
-                           degToRad(fov),
-                           (float) windowWidth / (float) windowHeight,
-                           2 * faintestMagNight,
+#ifndef OCTREE_DEBUG
+    ThreadPool& pool = ThreadPool::shared();
+    if (pool.size() > 1)
+    {
+        size_t nSubtrees = 0;
+        auto subtreeHandler = [&](size_t i) -> DSOHandler&
+        {
+            nSubtrees = i + 1;
+            if (i == dsoSubtreeOutputs.size())
+                dsoSubtreeOutputs.push_back(new DSOSubtreeOutput());
+            dsoSubtreeOutputs[i]->dsos.clear();
+            return *dsoSubtreeOutputs[i];
+        };
+
+        dsoDB->findVisibleDSOs(dsoRenderer,
+                               subtreeHandler,
+                               pool,
+                               obsPos,
+                               observer.getOrientationf(),
+                               degToRad(fov),
+                               (float) windowWidth / (float) windowHeight,
+                               2 * faintestMagNight);
+
+        for (size_t i = 0; i < nSubtrees; i++)
+        {
+            for (const auto& entry : dsoSubtreeOutputs[i]->dsos)
+                dsoRenderer.process(entry.dso, entry.distance, entry.absMag);
+        }
+    }
+    else
+#endif
+    {
+        dsoDB->findVisibleDSOs(dsoRenderer,
+                               obsPos,
+                               observer.getOrientationf(),
+                               degToRad(fov),
+                               (float) windowWidth / (float) windowHeight,
+                               2 * faintestMagNight,
 #ifdef OCTREE_DEBUG
-                           &m_dsoProcStats);
+                               &m_dsoProcStats);
 #else
-                            nullptr);
+                               nullptr);
 #endif
+    }
 
     // clog << "DSOs processed: " << dsoRenderer.dsosProcessed << endl;
 
@@ -7394,6 +7157,7 @@ void Renderer::renderAnnotations(const vector<Annotation>& annotations, FontStyl
     glPushMatrix();
     glLoadIdentity();
 
+    labelVertices.clear();
     for (int i = 0; i < (int) annotations.size(); i++)
     {
         if (annotations[i].markerRep != nullptr)
@@ -7417,19 +7181,20 @@ void Renderer::renderAnnotations(const vector<Annotation>& annotations, FontStyl
             else
                 markerRep.render(*this, size);
             glEnable(GL_TEXTURE_2D);
+            glPopMatrix();
 
             if (!markerRep.label().empty())
             {
                 int labelOffset = (int) markerRep.size() / 2;
-                glTranslatef(labelOffset + PixelOffset, -labelOffset - font[fs]->getHeight() + PixelOffset, 0.0f);
-                font[fs]->render(markerRep.label(), 0.0f, 0.0f);
+                font[fs]->addText(labelVertices, markerRep.label(),
+                                  (int) annotations[i].position.x() + labelOffset + PixelOffset,
+                                  (int) annotations[i].position.y() - labelOffset - font[fs]->getHeight() + PixelOffset,
+                                  0.0f, annotations[i].color);
             }
-            glPopMatrix();
         }
 
-        if (!annotations[i].labelText.empty())
+        if (annotations[i].labelText != nullptr)
         {
-            glPushMatrix();
             int labelWidth = 0;
             int hOffset = 2;
             int vOffset = 0;
@@ -7437,12 +7202,12 @@ void Renderer::renderAnnotations(const vector<Annotation>& annotations, FontStyl
             switch (annotations[i].halign)
             {
             case AlignCenter:
-                labelWidth = (font[fs]->getWidth(annotations[i].labelText));
+                labelWidth = (font[fs]->getWidth(*annotations[i].labelText));
                 hOffset = -labelWidth / 2;
                 break;
 
             case AlignRight:
-                labelWidth = (font[fs]->getWidth(annotations[i].labelText));
+                labelWidth = (font[fs]->getWidth(*annotations[i].labelText));
                 hOffset = -(labelWidth + 2);
                 break;
 
@@ -7465,15 +7230,17 @@ void Renderer::renderAnnotations(const vector<Annotation>& annotations, FontStyl
                 break;
             }
 
-            glColor(annotations[i].color);
-            glTranslatef((int) annotations[i].position.x() + hOffset + PixelOffset,
-                         (int) annotations[i].position.y() + vOffset + PixelOffset, 0.0f);
-            // EK TODO: Check where to replace (see '_(' above)
-            font[fs]->render(annotations[i].labelText, 0.0f, 0.0f);
-            glPopMatrix();
+            font[fs]->addText(labelVertices, *annotations[i].labelText,
+                              (int) annotations[i].position.x() + hOffset + PixelOffset,
+                              (int) annotations[i].position.y() + vOffset + PixelOffset,
+                              0.0f, annotations[i].color);
         }
     }
 
+    // Symbols may have bound other textures.
+    font[fs]->bind();
+    font[fs]->render(labelVertices);
+
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
@@ -7537,6 +7304,7 @@ Renderer::renderSortedAnnotations(vector<Annotation>::iterator iter,
     float d1 = -(farDist + nearDist) / (farDist - nearDist);
     float d2 = -2.0f * nearDist * farDist / (farDist - nearDist);
 
+    labelVertices.clear();
     for (; iter != depthSortedAnnotations.end() && iter->position.z() > nearDist; iter++)
     {
         // Compute normalized device z
@@ -7547,7 +7315,6 @@ Renderer::renderSortedAnnotations(vector<Annotation>::iterator iter,
         int labelHOffset = 0;
         int labelVOffset = 0;
 
-        glPushMatrix();
         if (iter->markerRep != nullptr)
         {
             const MarkerRepresentation& markerRep = *iter->markerRep;
@@ -7557,6 +7324,7 @@ Renderer::renderSortedAnnotations(vector<Annotation>::iterator iter,
                 size = iter->size;
             }
 
+            glPushMatrix();
             glTranslatef((GLfloat) (int) iter->position.x(), (GLfloat) (int) iter->position.y(), ndc_z);
             glColor(iter->color);
 
@@ -7566,25 +7334,29 @@ Renderer::renderSortedAnnotations(vector<Annotation>::iterator iter,
             else
                 markerRep.render(*this, size);
             glEnable(GL_TEXTURE_2D);
+            glPopMatrix();
 
             if (!markerRep.label().empty())
             {
                 int labelOffset = (int) markerRep.size() / 2;
-                glTranslatef(labelOffset + PixelOffset, -labelOffset - font[fs]->getHeight() + PixelOffset, 0.0f);
-                font[fs]->render(markerRep.label(), 0.0f, 0.0f);
+                font[fs]->addText(labelVertices, markerRep.label(),
+                                  (int) iter->position.x() + labelOffset + PixelOffset,
+                                  (int) iter->position.y() - labelOffset - font[fs]->getHeight() + PixelOffset,
+                                  ndc_z, iter->color);
             }
         }
-        else
+        else if (iter->labelText != nullptr)
         {
-            glTranslatef((int) iter->position.x() + PixelOffset + labelHOffset,
-                         (int) iter->position.y() + PixelOffset + labelVOffset,
-                         ndc_z);
-            glColor(iter->color);
-            font[fs]->render(iter->labelText, 0.0f, 0.0f);
+            font[fs]->addText(labelVertices, *iter->labelText,
+                              (int) iter->position.x() + PixelOffset + labelHOffset,
+                              (int) iter->position.y() + PixelOffset + labelVOffset,
+                              ndc_z, iter->color);
         }
-        glPopMatrix();
     }
 
+    font[fs]->bind();
+    font[fs]->render(labelVertices);
+
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
@@ -7626,6 +7398,7 @@ Renderer::renderAnnotations(vector<Annotation>::iterator startIter,
     float d1 = -(farDist + nearDist) / (farDist - nearDist);
     float d2 = -2.0f * nearDist * farDist / (farDist - nearDist);
 
+    labelVertices.clear();
     vector<Annotation>::iterator iter = startIter;
     for (; iter != endIter && iter->position.z() > nearDist; iter++)
     {
@@ -7656,31 +7429,33 @@ Renderer::renderAnnotations(vector<Annotation>::iterator startIter,
             else
                 markerRep.render(*this, size);
             glEnable(GL_TEXTURE_2D);
+            glPopMatrix();
 
             if (!markerRep.label().empty())
             {
                 int labelOffset = (int) markerRep.size() / 2;
-                glTranslatef(labelOffset + PixelOffset, -labelOffset - font[fs]->getHeight() + PixelOffset, 0.0f);
-                font[fs]->render(markerRep.label(), 0.0f, 0.0f);
+                font[fs]->addText(labelVertices, markerRep.label(),
+                                  (int) iter->position.x() + labelOffset + PixelOffset,
+                                  (int) iter->position.y() - labelOffset - font[fs]->getHeight() + PixelOffset,
+                                  ndc_z, iter->color);
             }
-            glPopMatrix();
         }
 
-        if (!iter->labelText.empty())
+        if (iter->labelText != nullptr)
         {
             if (iter->markerRep != nullptr)
                 labelHOffset += (int) iter->markerRep->size() / 2 + 3;
 
-            glPushMatrix();
-            glTranslatef((int) iter->position.x() + PixelOffset + labelHOffset,
-                         (int) iter->position.y() + PixelOffset + labelVOffset,
-                         ndc_z);
-            glColor(iter->color);
-            font[fs]->render(iter->labelText, 0.0f, 0.0f);
-            glPopMatrix();
+            font[fs]->addText(labelVertices, *iter->labelText,
+                              (int) iter->position.x() + PixelOffset + labelHOffset,
+                              (int) iter->position.y() + PixelOffset + labelVOffset,
+                              ndc_z, iter->color);
         }
     }
 
+    font[fs]->bind();
+    font[fs]->render(labelVertices);
+
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
@@ -7734,14 +7509,14 @@ void Renderer::renderMarkers(const MarkerList& markers,
                         boundingRadius = marker.object().radius();
                     offset *= (1.0 - boundingRadius * 1.01 / distance);
 
-                    addSortedAnnotation(&(marker.representation()), "", marker.representation().color(),
+                    addSortedAnnotation(&(marker.representation()), nullptr, marker.representation().color(),
                                         offset.cast<float>(),
                                         AlignLeft, VerticalAlignTop, symbolSize);
                 }
                 else
                 {
                     addAnnotation(backgroundAnnotations,
-                                  &(marker.representation()), "", marker.representation().color(),
+                                  &(marker.representation()), nullptr, marker.representation().color(),
                                   offset.cast<float>(),
                                   AlignLeft, VerticalAlignTop, symbolSize);
                 }
@@ -7749,7 +7524,7 @@ void Renderer::renderMarkers(const MarkerList& markers,
             else
             {
                 addAnnotation(foregroundAnnotations,
-                              &(marker.representation()), "", marker.representation().color(),
+                              &(marker.representation()), nullptr, marker.representation().color(),
                               offset.cast<float>(),
                               AlignLeft, VerticalAlignTop, symbolSize);
             }
@@ -7817,6 +7592,24 @@ void Renderer::invalidateOrbitCache()
 }
 
 
+void Renderer::setOrbitCacheSize(size_t bytes)
+{
+    orbitCache.setMaxBytes(bytes);
+}
+
+
+const OrbitPathCache::Statistics& Renderer::getOrbitCacheStatistics() const
+{
+    return orbitCache.getStatistics();
+}
+
+
+void Renderer::setOrbitSamplingBudget(double seconds)
+{
+    orbitSamplingBudget = seconds;
+}
+
+
 bool Renderer::settingsHaveChanged() const
 {
     return settingsChanged;
@@ -7907,7 +7700,14 @@ constexpr GLenum toGLFormat(Renderer::PixelFormat format)
 
 bool Renderer::captureFrame(int x, int y, int w, int h, Renderer::PixelFormat format, unsigned char* buffer, bool back) const
 {
-    glReadBuffer(back ? GL_BACK : GL_FRONT);
+    // A framebuffer object, as drawn into by the offline renderer, has
+    // neither a front nor a back buffer.
+    GLint fboId = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &fboId);
+    if (fboId != 0)
+        glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    else
+        glReadBuffer(back ? GL_BACK : GL_FRONT);
     glReadPixels(x, y, w, h, toGLFormat(format), GL_UNSIGNED_BYTE, (void*) buffer);
 
     return glGetError() == GL_NO_ERROR;
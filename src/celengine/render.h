@@ -20,8 +20,10 @@
 #include <celengine/glcontext.h>
 #endif
 #include <celengine/starcolors.h>
+#include <celengine/orbitpathcache.h>
 #include <celengine/rendcontext.h>
 #include <celtxf/texturefont.h>
+#include <deque>
 #include <vector>
 #include <list>
 #include <string>
@@ -86,6 +88,8 @@ struct SecondaryIlluminator
 
 
 class PointStarVertexBuffer;
+class StarSubtreeOutput;
+class DSOSubtreeOutput;
 
 class Renderer
 {
@@ -292,9 +296,12 @@ class Renderer
         VerticalAlignTop,
     };
 
+    // The label text isn't copied: it points to an interned name, such as
+    // StarDatabase::getStarLabel(), or to a copy kept until the end of the
+    // frame. It's nullptr for annotations without a label.
     struct Annotation
     {
-        std::string labelText;
+        const std::string* labelText;
         const MarkerRepresentation* markerRep;
         Color color;
         Eigen::Vector3f position;
@@ -327,6 +334,23 @@ class Renderer
                              LabelVerticalAlignment valign = VerticalAlignBottom,
                              float size = 0.0f);
 
+    // As above, without copying the label, which must stay valid until the
+    // end of the frame.
+    void addBackgroundAnnotation(const MarkerRepresentation* markerRep,
+                                 const std::string* labelText,
+                                 Color color,
+                                 const Eigen::Vector3f& position,
+                                 LabelAlignment halign = AlignLeft,
+                                 LabelVerticalAlignment valign = VerticalAlignBottom,
+                                 float size = 0.0f);
+    void addSortedAnnotation(const MarkerRepresentation* markerRep,
+                             const std::string* labelText,
+                             Color color,
+                             const Eigen::Vector3f& position,
+                             LabelAlignment halign = AlignLeft,
+                             LabelVerticalAlignment valign = VerticalAlignBottom,
+                             float size = 0.0f);
+
    ShaderManager& getShaderManager() const { return *shaderManager; }
 
     // Callbacks for renderables; these belong in a special renderer interface
@@ -342,6 +366,15 @@ class Renderer
 
     void invalidateOrbitCache();
 
+    // Orbit paths are kept up to this many bytes of samples
+    void setOrbitCacheSize(size_t bytes);
+    const OrbitPathCache::Statistics& getOrbitCacheStatistics() const;
+
+    // Time spent sampling new orbit paths in one frame, in seconds, before
+    // the remaining ones are left to the next frames. Zero samples every
+    // path in the frame it first appears.
+    void setOrbitSamplingBudget(double seconds);
+
     struct OrbitPathListEntry
     {
         float centerZ;
@@ -582,13 +615,14 @@ class Renderer
 
     void addAnnotation(std::vector<Annotation>&,
                        const MarkerRepresentation*,
-                       const std::string& labelText,
+                       const std::string* labelText,
                        Color color,
                        const Eigen::Vector3f& position,
                        LabelAlignment halign = AlignLeft,
                        LabelVerticalAlignment = VerticalAlignBottom,
                        float size = 0.0f,
                        bool special = false);
+    const std::string* copyLabel(const std::string&);
     void renderAnnotations(const std::vector<Annotation>&, FontStyle fs);
     void renderBackgroundAnnotations(FontStyle fs);
     void renderForegroundAnnotations(FontStyle fs);
@@ -685,6 +719,10 @@ class Renderer
     Eigen::Quaternionf m_cameraOrientation;
     PointStarVertexBuffer* pointStarVertexBuffer;
     PointStarVertexBuffer* glareVertexBuffer;
+    // Per subtree outputs of the multithreaded star and DSO octree
+    // traversals, kept between frames to avoid reallocating them
+    std::vector<StarSubtreeOutput*> starSubtreeOutputs;
+    std::vector<DSOSubtreeOutput*> dsoSubtreeOutputs;
     std::vector<RenderListEntry> renderList;
     std::vector<SecondaryIlluminator> secondaryIlluminators;
     std::vector<DepthBufferPartition> depthPartitions;
@@ -693,6 +731,11 @@ class Renderer
     std::vector<Annotation> foregroundAnnotations;
     std::vector<Annotation> depthSortedAnnotations;
     std::vector<Annotation> objectAnnotations;
+    // Labels passed by value, reused from one frame to the next
+    std::deque<std::string> labelStrings;
+    size_t labelStringCount{ 0 };
+    // Glyphs of the labels of one annotation pass, drawn in a single call
+    std::vector<TextureFont::TextVertex> labelVertices;
     std::vector<OrbitPathListEntry> orbitPathList;
     LightingState::EclipseShadowVector eclipseShadows[MaxLights];
     std::vector<const Star*> nearStars;
@@ -738,9 +781,9 @@ class Renderer
 #endif
 
  private:
-    typedef std::map<const Orbit*, CurvePlot*> OrbitCache;
-    OrbitCache orbitCache;
-    uint32_t lastOrbitCacheFlush;
+    OrbitPathCache orbitCache;
+    double orbitSamplingBudget;
+    double orbitSamplingTime{ 0.0 };
 
     float minOrbitSize;
     float distanceLimit;
@@ -839,6 +839,7 @@ FramebufferObject::FramebufferObject(GLuint width, GLuint height, unsigned int a
     m_colorTexId(0),
     m_depthTexId(0),
     m_fboId(0),
+    m_prevFboId(0),
     m_status(GL_FRAMEBUFFER_UNSUPPORTED_EXT)
 {
     if (attachments != 0)
@@ -922,9 +923,21 @@ FramebufferObject::generateDepthTexture()
 }
 
 
+// The framebuffer that was bound isn't necessarily the default one: the
+// offline renderer draws into a framebuffer object of its own.
+static GLuint CurrentFramebuffer()
+{
+    GLint fboId = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &fboId);
+    return (GLuint) fboId;
+}
+
+
 void
 FramebufferObject::generateFbo(unsigned int attachments)
 {
+    GLuint prevFboId = CurrentFramebuffer();
+
     // Create the FBO
     glGenFramebuffersEXT(1, &m_fboId);
     glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_fboId);
@@ -938,7 +951,7 @@ FramebufferObject::generateFbo(unsigned int attachments)
         m_status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
         if (m_status != GL_FRAMEBUFFER_COMPLETE_EXT)
         {
-            glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+            glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, prevFboId);
             cleanup();
             return;
         }
@@ -956,7 +969,7 @@ FramebufferObject::generateFbo(unsigned int attachments)
         m_status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
         if (m_status != GL_FRAMEBUFFER_COMPLETE_EXT)
         {
-            glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+            glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, prevFboId);
             cleanup();
             return;
         }
@@ -966,8 +979,8 @@ FramebufferObject::generateFbo(unsigned int attachments)
         glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_TEXTURE_2D, 0, 0);
     }
 
-    // Restore default frame buffer
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    // Restore the previous frame buffer
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, prevFboId);
 }
 
 
@@ -997,6 +1010,7 @@ FramebufferObject::bind()
 {
     if (isValid())
     {
+        m_prevFboId = CurrentFramebuffer();
         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_fboId);
         return true;
     }
@@ -1008,8 +1022,8 @@ FramebufferObject::bind()
 bool
 FramebufferObject::unbind()
 {
-    // Restore default frame buffer
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    // Restore the frame buffer bound before bind()
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_prevFboId);
     return true;
 }
 
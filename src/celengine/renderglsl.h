@@ -122,6 +122,7 @@ private:
     GLuint m_colorTexId;
     GLuint m_depthTexId;
     GLuint m_fboId;
+    GLuint m_prevFboId;     // bound before bind(), restored by unbind()
     GLenum m_status;
 };
 
@@ -13,12 +13,14 @@
 #include "shadermanager.h"
 #include <GL/glew.h>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
 #include <fmt/printf.h>
 #include <cassert>
+#include <cstring>
 #include <Eigen/Geometry>
 
 using namespace Eigen;
@@ -377,6 +379,224 @@ ShaderManager::getShader(const string& name)
     return prog;
 }
 
+
+// The program cache file starts with a header:
+//   "CELSHDR\0", uint32 version, uint32 id length, id
+// followed by one record per program:
+//   uint16 nLights, texUsage, lightModel, effects
+//   uint32 shadowCounts, simpleProps
+//   uint64 hash of the program sources
+//   uint32 binary format, binary length
+//   binary
+static const char ProgramCacheMagic[8] = { 'C', 'E', 'L', 'S', 'H', 'D', 'R', '\0' };
+static const uint32_t ProgramCacheVersion = 2;
+
+template <typename T> static bool readValue(istream& in, T& value)
+{
+    return in.read(reinterpret_cast<char*>(&value), sizeof(T)).good();
+}
+
+template <typename T> static void writeValue(ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// 64-bit FNV-1a of both sources, with a separator between them
+static uint64_t HashShaderSources(const string& vs, const string& fs)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const string& source)
+    {
+        for (char c : source)
+        {
+            hash ^= (unsigned char) c;
+            hash *= 1099511628211ull;
+        }
+        hash *= 1099511628211ull;
+    };
+
+    add(vs);
+    add(fs);
+    return hash;
+}
+
+// Binaries are only valid for the driver which made them; the records
+// keep the hash of their sources for changes to the shader generator.
+static string GetProgramCacheId()
+{
+    auto glString = [](GLenum name)
+    {
+        const GLubyte* s = glGetString(name);
+        return s != nullptr ? string(reinterpret_cast<const char*>(s)) : string();
+    };
+
+    return fmt::sprintf("%s\n%s\n%s",
+                        glString(GL_VENDOR), glString(GL_RENDERER), glString(GL_VERSION));
+}
+
+
+void
+ShaderManager::setProgramCache(const fs::path& filename)
+{
+    if (!GLEW_ARB_get_program_binary)
+        return;
+
+    programCacheFile = filename;
+    programCacheId = GetProgramCacheId();
+    if (!loadProgramCache() && !saveProgramCache())
+    {
+        fmt::fprintf(cerr, "Error writing shader cache %s\n", filename);
+        programCacheFile = fs::path();
+    }
+}
+
+
+void
+ShaderManager::warmUp()
+{
+    vector<ShaderProperties> cached;
+    for (const auto& program : cachedPrograms)
+        cached.push_back(program.first);
+
+    for (const auto& props : cached)
+        getShader(props);
+}
+
+
+// Returns false unless the whole cache could be read and was made with
+// the same id; the file then needs to be rewritten.
+bool
+ShaderManager::loadProgramCache()
+{
+    cachedPrograms.clear();
+
+    ifstream in(programCacheFile.string(), ios::in | ios::binary);
+    if (!in.good())
+        return false;
+
+    in.seekg(0, ios::end);
+    auto fileSize = (uint64_t) in.tellg();
+    in.seekg(0, ios::beg);
+
+    char magic[8];
+    uint32_t version, idLength;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, ProgramCacheMagic, sizeof(magic)) != 0 ||
+        !readValue(in, version) || version != ProgramCacheVersion ||
+        !readValue(in, idLength) || idLength != programCacheId.size())
+    {
+        return false;
+    }
+
+    string id(idLength, '\0');
+    if (!in.read(&id[0], idLength) || id != programCacheId)
+        return false;
+
+    for (;;)
+    {
+        ShaderProperties props;
+        CachedProgram program;
+        uint32_t format, length;
+        if (!readValue(in, props.nLights))
+            return in.eof();
+
+        if (!readValue(in, props.texUsage) ||
+            !readValue(in, props.lightModel) ||
+            !readValue(in, props.effects) ||
+            !readValue(in, props.shadowCounts) ||
+            !readValue(in, props.simpleProps) ||
+            !readValue(in, program.sourceHash) ||
+            !readValue(in, format) ||
+            !readValue(in, length))
+        {
+            return false;
+        }
+
+        // Don't trust the length of a truncated or corrupt file
+        if (length > fileSize - (uint64_t) in.tellg())
+            return false;
+
+        program.format = format;
+        program.binary.resize(length);
+        if (!in.read(program.binary.data(), length))
+            return false;
+
+        cachedPrograms[props] = move(program);
+    }
+}
+
+
+// The whole cache is written to a temporary file which then replaces the
+// old one, so that an interrupted write can't leave a corrupt cache.
+bool
+ShaderManager::saveProgramCache()
+{
+    fs::path tmpPath = programCacheFile;
+    tmpPath += ".tmp";
+    {
+        ofstream out(tmpPath.string(), ios::out | ios::binary | ios::trunc);
+        if (!out.good())
+            return false;
+
+        out.write(ProgramCacheMagic, sizeof(ProgramCacheMagic));
+        writeValue(out, ProgramCacheVersion);
+        writeValue(out, (uint32_t) programCacheId.size());
+        out.write(programCacheId.data(), programCacheId.size());
+
+        for (const auto& program : cachedPrograms)
+        {
+            const ShaderProperties& props = program.first;
+            writeValue(out, props.nLights);
+            writeValue(out, props.texUsage);
+            writeValue(out, props.lightModel);
+            writeValue(out, props.effects);
+            writeValue(out, props.shadowCounts);
+            writeValue(out, props.simpleProps);
+            writeValue(out, program.second.sourceHash);
+            writeValue(out, (uint32_t) program.second.format);
+            writeValue(out, (uint32_t) program.second.binary.size());
+            out.write(program.second.binary.data(), program.second.binary.size());
+        }
+
+        out.close();
+        if (out.fail())
+        {
+            remove(tmpPath.string().c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename() doesn't replace an existing file on Windows
+    remove(programCacheFile.string().c_str());
+#endif
+    if (rename(tmpPath.string().c_str(), programCacheFile.string().c_str()) != 0)
+    {
+        remove(tmpPath.string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+// Programs are only built the first time they're needed, a few dozen per
+// session, so rewriting the whole cache each time is cheap enough.
+void
+ShaderManager::addToProgramCache(const ShaderProperties& props, uint64_t sourceHash, const GLProgram& prog)
+{
+    CachedProgram program;
+    program.sourceHash = sourceHash;
+    if (!prog.getBinary(program.format, program.binary))
+        return;
+
+    cachedPrograms[props] = move(program);
+    if (!saveProgramCache())
+    {
+        fmt::fprintf(cerr, "Error writing shader cache %s\n", programCacheFile);
+        programCacheFile = fs::path();
+    }
+}
+
 static string
 LightProperty(unsigned int i, const char* property)
 {
@@ -1587,7 +1807,7 @@ PointSizeCalculation()
 }
 
 
-GLVertexShader*
+string
 ShaderManager::buildVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -1901,13 +2121,11 @@ ShaderManager::buildVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2324,14 +2542,12 @@ ShaderManager::buildFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
 #if 0
-GLVertexShader*
+string
 ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2379,13 +2595,11 @@ ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2464,14 +2678,12 @@ ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 #endif
 
 
-GLVertexShader*
+string
 ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2507,13 +2719,11 @@ ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2617,13 +2827,11 @@ ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
-GLVertexShader*
+string
 ShaderManager::buildAtmosphereVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2654,13 +2862,11 @@ ShaderManager::buildAtmosphereVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildAtmosphereFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2705,15 +2911,13 @@ ShaderManager::buildAtmosphereFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
 // The emissive shader ignores all lighting and uses the diffuse color
 // as the final fragment color.
-GLVertexShader*
+string
 ShaderManager::buildEmissiveVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2769,13 +2973,11 @@ ShaderManager::buildEmissiveVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildEmissiveFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2818,14 +3020,12 @@ ShaderManager::buildEmissiveFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
 // Build the vertex shader used for rendering particle systems.
-GLVertexShader*
+string
 ShaderManager::buildParticleVertexShader(const ShaderProperties& props)
 {
     ostringstream source;
@@ -2903,13 +3103,11 @@ ShaderManager::buildParticleVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source.str(), &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source.str();
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildParticleFragmentShader(const ShaderProperties& props)
 {
     ostringstream source;
@@ -2969,12 +3167,10 @@ ShaderManager::buildParticleFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source.str(), &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source.str();
 }
 
-GLVertexShader*
+string
 ShaderManager::buildSimpleVertexShader(uint32_t props)
 {
     ostringstream source;
@@ -3002,13 +3198,11 @@ ShaderManager::buildSimpleVertexShader(uint32_t props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source.str(), &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source.str();
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildSimpleFragmentShader(uint32_t props)
 {
     ostringstream source;
@@ -3041,9 +3235,7 @@ ShaderManager::buildSimpleFragmentShader(uint32_t props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source.str(), &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source.str();
 }
 
 
@@ -3054,40 +3246,61 @@ ShaderManager::buildProgram(const ShaderProperties& props)
     GLProgram* prog = nullptr;
     GLShaderStatus status;
 
-    GLVertexShader* vs = nullptr;
-    GLFragmentShader* fs = nullptr;
+    string vsSource;
+    string fsSource;
 
     if (props.simpleProps != 0)
     {
-        vs = buildSimpleVertexShader(props.simpleProps);
-        fs = buildSimpleFragmentShader(props.simpleProps);
+        vsSource = buildSimpleVertexShader(props.simpleProps);
+        fsSource = buildSimpleFragmentShader(props.simpleProps);
     }
     else if (props.lightModel == ShaderProperties::RingIllumModel)
     {
-        vs = buildRingsVertexShader(props);
-        fs = buildRingsFragmentShader(props);
+        vsSource = buildRingsVertexShader(props);
+        fsSource = buildRingsFragmentShader(props);
     }
     else if (props.lightModel == ShaderProperties::AtmosphereModel)
     {
-        vs = buildAtmosphereVertexShader(props);
-        fs = buildAtmosphereFragmentShader(props);
+        vsSource = buildAtmosphereVertexShader(props);
+        fsSource = buildAtmosphereFragmentShader(props);
     }
     else if (props.lightModel == ShaderProperties::EmissiveModel)
     {
-        vs = buildEmissiveVertexShader(props);
-        fs = buildEmissiveFragmentShader(props);
+        vsSource = buildEmissiveVertexShader(props);
+        fsSource = buildEmissiveFragmentShader(props);
     }
     else if (props.lightModel == ShaderProperties::ParticleModel)
     {
-        vs = buildParticleVertexShader(props);
-        fs = buildParticleFragmentShader(props);
+        vsSource = buildParticleVertexShader(props);
+        fsSource = buildParticleFragmentShader(props);
     }
     else
     {
-        vs = buildVertexShader(props);
-        fs = buildFragmentShader(props);
+        vsSource = buildVertexShader(props);
+        fsSource = buildFragmentShader(props);
+    }
+
+    // Generating the sources is cheap next to compiling them; a cached
+    // binary is only used if it was built from the same sources.
+    uint64_t sourceHash = HashShaderSources(vsSource, fsSource);
+    auto cached = cachedPrograms.find(props);
+    if (cached != cachedPrograms.end())
+    {
+        if (cached->second.sourceHash == sourceHash &&
+            GLShaderLoader::CreateProgram(cached->second.format, cached->second.binary, &prog) == ShaderStatus_OK)
+        {
+            return new CelestiaGLProgram(*prog, props);
+        }
+
+        // The binary is stale or was rejected, build the program again
+        cachedPrograms.erase(cached);
     }
 
+    GLVertexShader* vs = nullptr;
+    GLFragmentShader* fs = nullptr;
+    GLShaderLoader::CreateVertexShader(vsSource, &vs);
+    GLShaderLoader::CreateFragmentShader(fsSource, &fs);
+
     if (vs != nullptr && fs != nullptr)
     {
         status = GLShaderLoader::CreateProgram(*vs, *fs, &prog);
@@ -3106,7 +3319,12 @@ ShaderManager::buildProgram(const ShaderProperties& props)
                 glBindAttribLocation(prog->getID(), 7, "pointSize");
             }
 
+            if (!programCacheFile.empty())
+                prog->setBinaryRetrievable();
+
             status = prog->link();
+            if (status == ShaderStatus_OK && !programCacheFile.empty())
+                addToProgramCache(props, sourceHash, *prog);
         }
     }
     else
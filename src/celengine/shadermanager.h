@@ -12,6 +12,8 @@
 
 #include <map>
 #include <iostream>
+#include <vector>
+#include <celcompat/filesystem.h>
 #include <celengine/glshader.h>
 #include <celengine/lightenv.h>
 #include <celengine/atmosphere.h>
@@ -304,30 +306,56 @@ class ShaderManager
     CelestiaGLProgram* getShader(const std::string&);
     CelestiaGLProgram* getShader(const std::string&, const std::string&, const std::string&);
 
+    // Keep the binaries of the programs built for ShaderProperties in a
+    // file, and reuse the ones kept by previous sessions instead of
+    // compiling them again. Binaries are discarded when the driver or
+    // the generated shader sources change. Requires
+    // GL_ARB_get_program_binary.
+    void setProgramCache(const fs::path& filename);
+
+    // Build the programs found in the cache now rather than the first
+    // time they're needed.
+    void warmUp();
+
  private:
+    struct CachedProgram
+    {
+        uint64_t sourceHash;
+        GLenum format;
+        std::vector<char> binary;
+    };
+
+    bool loadProgramCache();
+    bool saveProgramCache();
+    void addToProgramCache(const ShaderProperties&, uint64_t, const GLProgram&);
+
     CelestiaGLProgram* buildProgram(const ShaderProperties&);
     CelestiaGLProgram* buildProgram(const std::string&, const std::string&);
 
-    GLVertexShader* buildVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildFragmentShader(const ShaderProperties&);
+    std::string buildVertexShader(const ShaderProperties&);
+    std::string buildFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildRingsVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildRingsFragmentShader(const ShaderProperties&);
+    std::string buildRingsVertexShader(const ShaderProperties&);
+    std::string buildRingsFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildAtmosphereVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildAtmosphereFragmentShader(const ShaderProperties&);
+    std::string buildAtmosphereVertexShader(const ShaderProperties&);
+    std::string buildAtmosphereFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildEmissiveVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildEmissiveFragmentShader(const ShaderProperties&);
+    std::string buildEmissiveVertexShader(const ShaderProperties&);
+    std::string buildEmissiveFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildParticleVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildParticleFragmentShader(const ShaderProperties&);
+    std::string buildParticleVertexShader(const ShaderProperties&);
+    std::string buildParticleFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildSimpleVertexShader(uint32_t);
-    GLFragmentShader* buildSimpleFragmentShader(uint32_t);
+    std::string buildSimpleVertexShader(uint32_t);
+    std::string buildSimpleFragmentShader(uint32_t);
 
     std::map<ShaderProperties, CelestiaGLProgram*, ShaderProperties::Cmp> dynamicShaders;
     std::map<std::string, CelestiaGLProgram*> staticShaders;
+
+    std::map<ShaderProperties, CachedProgram, ShaderProperties::Cmp> cachedPrograms;
+    fs::path programCacheFile;
+    std::string programCacheId;
 };
 
 #endif // _CELENGINE_SHADERMANAGER_H_
@@ -17,6 +17,7 @@
 #include <celmath/mathlib.h>
 #include <celutil/util.h>
 #include <celutil/bytes.h>
+#include <celutil/mappedfile.h>
 #include <celengine/stardb.h>
 #include <config.h>
 #include "astro.h"
@@ -81,20 +82,6 @@ struct CatalogNumberEquivalencePredicate
 };
 
 
-// Used to sort star pointers by catalog number
-struct PtrCatalogNumberOrderingPredicate
-{
-    int unused;
-
-    PtrCatalogNumberOrderingPredicate() = default;
-
-    bool operator()(const Star* const & star0, const Star* const & star1) const
-    {
-        return (star0->getCatalogNumber() < star1->getCatalogNumber());
-    }
-};
-
-
 static bool parseSimpleCatalogNumber(const string& name,
                                      const string& prefix,
                                      uint32_t* catalogNumber)
@@ -188,7 +175,8 @@ StarDatabase::StarDatabase()
 StarDatabase::~StarDatabase()
 {
     delete [] stars;
-    delete [] catalogNumberIndex;
+    delete [] presortedStars;
+    delete presortedOctree;
 
     for (const auto index : crossIndexes)
         delete index;
@@ -197,18 +185,8 @@ StarDatabase::~StarDatabase()
 
 Star* StarDatabase::find(uint32_t catalogNumber) const
 {
-    Star refStar;
-    refStar.setCatalogNumber(catalogNumber);
-
-    Star** star   = lower_bound(catalogNumberIndex,
-                                catalogNumberIndex + nStars,
-                                &refStar,
-                                PtrCatalogNumberOrderingPredicate());
-
-    if (star != catalogNumberIndex + nStars && (*star)->getCatalogNumber() == catalogNumber)
-        return *star;
-    else
-        return nullptr;
+    Star* const* star = catalogNumberIndex.find(catalogNumber);
+    return star != nullptr ? *star : nullptr;
 }
 
 
@@ -269,18 +247,12 @@ uint32_t StarDatabase::crossIndex(const Catalog catalog, const uint32_t celCatal
     if (static_cast<uint32_t>(catalog) >= crossIndexes.size())
         return Star::InvalidCatalogNumber;
 
-    CrossIndex* xindex = crossIndexes[catalog];
+    CrossIndexMaps* xindex = crossIndexes[catalog];
     if (xindex == nullptr)
         return Star::InvalidCatalogNumber;
 
-    // A simple linear search.  We could store cross indices sorted by
-    // both catalog numbers and trade memory for speed
-    auto iter = std::find_if(xindex->begin(), xindex->end(),
-                             [celCatalogNumber](CrossIndexEntry& o){ return celCatalogNumber == o.celCatalogNumber; });
-    if (iter != xindex->end())
-        return iter->catalogNumber;
-
-    return Star::InvalidCatalogNumber;
+    const uint32_t* catalogNumber = xindex->fromCelestia.find(celCatalogNumber);
+    return catalogNumber != nullptr ? *catalogNumber : Star::InvalidCatalogNumber;
 }
 
 
@@ -291,19 +263,12 @@ uint32_t StarDatabase::searchCrossIndexForCatalogNumber(const Catalog catalog, c
     if (static_cast<unsigned int>(catalog) >= crossIndexes.size())
         return Star::InvalidCatalogNumber;
 
-    CrossIndex* xindex = crossIndexes[catalog];
+    CrossIndexMaps* xindex = crossIndexes[catalog];
     if (xindex == nullptr)
         return Star::InvalidCatalogNumber;
 
-    CrossIndexEntry xindexEnt;
-    xindexEnt.catalogNumber = number;
-
-    CrossIndex::iterator iter = lower_bound(xindex->begin(), xindex->end(),
-                                            xindexEnt);
-    if (iter == xindex->end() || iter->catalogNumber != number)
-        return Star::InvalidCatalogNumber;
-    else
-        return iter->celCatalogNumber;
+    const uint32_t* celCatalogNumber = xindex->toCelestia.find(number);
+    return celCatalogNumber != nullptr ? *celCatalogNumber : Star::InvalidCatalogNumber;
 }
 
 
@@ -374,14 +339,16 @@ string StarDatabase::getStarName(const Star& star, bool i18n) const
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
-        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
+        if (i18n)
         {
-            if (i18n && iter->second != _(iter->second.c_str()))
-                return _(iter->second.c_str());
-            else
-                return iter->second;
+            const string* name = namesDB->getLocalizedName(catalogNumber);
+            if (name != nullptr)
+                return *name;
         }
+
+        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
+        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
+            return iter->second;
     }
 
     /*
@@ -422,6 +389,26 @@ void StarDatabase::getStarName(const Star& star, char* nameBuffer, unsigned int
 }
 
 
+const string& StarDatabase::getStarLabel(const Star& star) const
+{
+    uint32_t catalogNumber = star.getCatalogNumber();
+
+    if (namesDB != nullptr)
+    {
+        const string* name = namesDB->getLocalizedName(catalogNumber);
+        if (name != nullptr)
+            return *name;
+    }
+
+    // Elements of an unordered_map don't move when it grows.
+    lock_guard<mutex> lock(numberLabelsMutex);
+    auto iter = numberLabels.find(catalogNumber);
+    if (iter == numberLabels.end())
+        iter = numberLabels.emplace(catalogNumber, catalogNumberToString(catalogNumber)).first;
+    return iter->second;
+}
+
+
 string StarDatabase::getStarNameList(const Star& star, const unsigned int maxNames) const
 {
     string starNames;
@@ -486,16 +473,13 @@ string StarDatabase::getStarNameList(const Star& star, const unsigned int maxNam
 }
 
 
-void StarDatabase::findVisibleStars(StarHandler& starHandler,
-                                    const Vector3f& position,
-                                    const Quaternionf& orientation,
-                                    float fovY,
-                                    float aspectRatio,
-                                    float limitingMag,
-                                    OctreeProcStats *stats) const
+// Compute the bounding planes of an infinite view frustum
+static void computeFrustumPlanes(Hyperplane<float, 3>* frustumPlanes,
+                                 const Vector3f& position,
+                                 const Quaternionf& orientation,
+                                 float fovY,
+                                 float aspectRatio)
 {
-    // Compute the bounding planes of an infinite view frustum
-    Hyperplane<float, 3> frustumPlanes[5];
     Vector3f planeNormals[5];
     Eigen::Matrix3f rot = orientation.toRotationMatrix();
     float h = (float) tan(fovY / 2);
@@ -510,13 +494,50 @@ void StarDatabase::findVisibleStars(StarHandler& starHandler,
         planeNormals[i] = rot.transpose() * planeNormals[i].normalized();
         frustumPlanes[i] = Hyperplane<float, 3>(planeNormals[i], position);
     }
+}
+
+
+void StarDatabase::findVisibleStars(StarHandler& starHandler,
+                                    const Vector3f& position,
+                                    const Quaternionf& orientation,
+                                    float fovY,
+                                    float aspectRatio,
+                                    float limitingMag,
+                                    OctreeProcStats *stats) const
+{
+    Hyperplane<float, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, position, orientation, fovY, aspectRatio);
+
+    octreeMirror.processVisibleObjects(*octreeRoot,
+                                       starHandler,
+                                       position,
+                                       frustumPlanes,
+                                       limitingMag,
+                                       STAR_OCTREE_ROOT_SIZE,
+                                       stats);
+}
 
-    octreeRoot->processVisibleObjects(starHandler,
-                                      position,
-                                      frustumPlanes,
-                                      limitingMag,
-                                      STAR_OCTREE_ROOT_SIZE,
-                                      stats);
+
+void StarDatabase::findVisibleStars(StarHandler& starHandler,
+                                    const function<StarHandler&(size_t)>& subtreeHandler,
+                                    ThreadPool& pool,
+                                    const Vector3f& position,
+                                    const Quaternionf& orientation,
+                                    float fovY,
+                                    float aspectRatio,
+                                    float limitingMag) const
+{
+    Hyperplane<float, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, position, orientation, fovY, aspectRatio);
+
+    octreeMirror.processVisibleObjects(*octreeRoot,
+                                       starHandler,
+                                       subtreeHandler,
+                                       pool,
+                                       position,
+                                       frustumPlanes,
+                                       limitingMag,
+                                       STAR_OCTREE_ROOT_SIZE);
 }
 
 
@@ -531,6 +552,12 @@ void StarDatabase::findCloseStars(StarHandler& starHandler,
 }
 
 
+const StarOctree* StarDatabase::getOctree() const
+{
+    return octreeRoot;
+}
+
+
 StarNameDatabase* StarDatabase::getNameDatabase() const
 {
     return namesDB;
@@ -548,8 +575,8 @@ bool StarDatabase::loadCrossIndex(const Catalog catalog, istream& in)
     if (static_cast<unsigned int>(catalog) >= crossIndexes.size())
         return false;
 
-    if (crossIndexes[catalog] != nullptr)
-        delete crossIndexes[catalog];
+    delete crossIndexes[catalog];
+    crossIndexes[catalog] = nullptr;
 
     // Verify that the star database file has a correct header
     {
@@ -577,7 +604,7 @@ bool StarDatabase::loadCrossIndex(const Catalog catalog, istream& in)
         }
     }
 
-    CrossIndex* xindex = new CrossIndex();
+    CrossIndex entries;
 
     unsigned int record = 0;
     for (;;)
@@ -593,16 +620,26 @@ bool StarDatabase::loadCrossIndex(const Catalog catalog, istream& in)
         if (in.fail())
         {
             fmt::fprintf(cerr, _("Loading cross index failed at record %u\n"), record);
-            delete xindex;
             return false;
         }
 
-        xindex->push_back(ent);
+        entries.push_back(ent);
 
         record++;
     }
 
-    sort(xindex->begin(), xindex->end());
+    // When a number appears more than once, the lookups return the entry
+    // with the smallest catalog number, as the sorted index used to.
+    stable_sort(entries.begin(), entries.end());
+
+    auto* xindex = new CrossIndexMaps();
+    xindex->toCelestia.reserve(entries.size());
+    xindex->fromCelestia.reserve(entries.size());
+    for (const auto& ent : entries)
+    {
+        xindex->toCelestia.insert(ent.catalogNumber, ent.celCatalogNumber);
+        xindex->fromCelestia.insert(ent.celCatalogNumber, ent.catalogNumber);
+    }
 
     crossIndexes[catalog] = xindex;
 
@@ -610,106 +647,263 @@ bool StarDatabase::loadCrossIndex(const Catalog catalog, istream& in)
 }
 
 
+// Both binary star database versions share the same star record: catalog
+// number, x, y, z, absolute magnitude * 256 and packed spectral type, all
+// little endian. Version 0x0200 files have the stars already sorted into
+// octree order, preceded by the octree nodes in depth first order.
+constexpr const size_t STAR_RECORD_SIZE = 20;
+constexpr const size_t OCTREE_NODE_RECORD_SIZE = 24;
+constexpr const size_t FILE_HEADER_SIZE = sizeof(FILE_HEADER) - 1 + sizeof(uint16_t);
+
+// Return the version of a binary star database, or 0 if the header is bad
+static uint16_t checkBinaryHeader(const char* header)
+{
+    if (strncmp(header, FILE_HEADER, sizeof(FILE_HEADER) - 1) != 0)
+        return 0;
+
+    uint16_t version;
+    memcpy(&version, header + sizeof(FILE_HEADER) - 1, sizeof version);
+    LE_TO_CPU_INT16(version, version);
+    if (version != 0x0100 && version != 0x0200)
+        return 0;
+
+    return version;
+}
+
+
+static uint32_t readUint32(const char* p)
+{
+    uint32_t n;
+    memcpy(&n, p, sizeof n);
+    LE_TO_CPU_INT32(n, n);
+    return n;
+}
+
+
+static float readFloat(const char* p)
+{
+    float f;
+    memcpy(&f, p, sizeof f);
+    LE_TO_CPU_FLOAT(f, f);
+    return f;
+}
+
+
+static bool unpackStar(const char* record, Star& star)
+{
+    int16_t absMag;
+    uint16_t spectralType;
+    memcpy(&absMag, record + 16, sizeof absMag);
+    LE_TO_CPU_INT16(absMag, absMag);
+    memcpy(&spectralType, record + 18, sizeof spectralType);
+    LE_TO_CPU_INT16(spectralType, spectralType);
+
+    StarDetails* details = nullptr;
+    StellarClass sc;
+    if (sc.unpack(spectralType))
+        details = StarDetails::GetStarDetails(sc);
+
+    if (details == nullptr)
+        return false;
+
+    star.setCatalogNumber(readUint32(record));
+    star.setPosition(readFloat(record + 4), readFloat(record + 8), readFloat(record + 12));
+    star.setAbsoluteMagnitude((float) absMag / 256.0f);
+    star.setDetails(details);
+
+    return true;
+}
+
+
 bool StarDatabase::loadBinary(istream& in)
 {
-    uint32_t nStarsInFile = 0;
+    char header[FILE_HEADER_SIZE];
+    in.read(header, sizeof header);
+    if (!in.good())
+        return false;
 
-    // Verify that the star database file has a correct header
-    {
-        int headerLength = strlen(FILE_HEADER);
-        char* header = new char[headerLength];
-        in.read(header, headerLength);
-        if (strncmp(header, FILE_HEADER, headerLength)) {
-            delete[] header;
-            return false;
-        }
-        delete[] header;
-    }
+    uint16_t version = checkBinaryHeader(header);
+    if (version == 0)
+        return false;
 
-    // Verify the version
+    // Read the rest of the file in a single block and unpack the records
+    // from memory.
+    vector<char> data;
+    char buf[65536];
+    while (in.read(buf, sizeof buf) || in.gcount() > 0)
+        data.insert(data.end(), buf, buf + in.gcount());
+
+    if (in.bad())
+        return false;
+
+    return loadBinaryData(version, data.data(), data.size());
+}
+
+
+/*! Load a binary star database by mapping it into memory rather than
+ *  reading it through a stream.
+ */
+bool StarDatabase::loadBinary(const fs::path& filename)
+{
+    MappedFile file(filename);
+    if (!file.isOpen() || file.size() < FILE_HEADER_SIZE)
+        return false;
+
+    uint16_t version = checkBinaryHeader(file.data());
+    if (version == 0)
+        return false;
+
+    return loadBinaryData(version,
+                          file.data() + FILE_HEADER_SIZE,
+                          file.size() - FILE_HEADER_SIZE);
+}
+
+
+bool StarDatabase::loadBinaryData(uint16_t version, const char* data, size_t size)
+{
+    size_t countsSize = (version == 0x0100 ? 1 : 2) * sizeof(uint32_t);
+    if (size < countsSize)
+        return false;
+
+    uint32_t nStarsInFile = readUint32(data);
+
+    if (version == 0x0100)
     {
-        uint16_t version;
-        in.read((char*) &version, sizeof version);
-        LE_TO_CPU_INT16(version, version);
-        if (version != 0x0100)
-            return false;
+        // Like the stream reader always did, accept a truncated file and
+        // keep the complete records.
+        size -= countsSize;
+        nStarsInFile = min(nStarsInFile, (uint32_t) (size / STAR_RECORD_SIZE));
+        return loadUnsortedStars(data + countsSize, nStarsInFile);
     }
 
-    // Read the star count
-    in.read((char *) &nStarsInFile, sizeof nStarsInFile);
-    LE_TO_CPU_INT32(nStarsInFile, nStarsInFile);
-    if (!in.good())
+    uint32_t nNodes = readUint32(data + sizeof(uint32_t));
+    size -= countsSize;
+    if (nNodes == 0 ||
+        (uint64_t) nNodes * OCTREE_NODE_RECORD_SIZE +
+        (uint64_t) nStarsInFile * STAR_RECORD_SIZE > size)
+    {
+        cerr << _("Truncated presorted star database\n");
         return false;
+    }
 
-    unsigned int totalStars = nStars + nStarsInFile;
+    const char* nodes = data + countsSize;
+    const char* records = nodes + (size_t) nNodes * OCTREE_NODE_RECORD_SIZE;
 
-    while (((unsigned int) nStars) < totalStars)
-    {
-        uint32_t catNo = 0;
-        float x = 0.0f, y = 0.0f, z = 0.0f;
-        int16_t absMag;
-        uint16_t spectralType;
-
-        in.read((char *) &catNo, sizeof catNo);
-        LE_TO_CPU_INT32(catNo, catNo);
-        in.read((char *) &x, sizeof x);
-        LE_TO_CPU_FLOAT(x, x);
-        in.read((char *) &y, sizeof y);
-        LE_TO_CPU_FLOAT(y, y);
-        in.read((char *) &z, sizeof z);
-        LE_TO_CPU_FLOAT(z, z);
-        in.read((char *) &absMag, sizeof absMag);
-        LE_TO_CPU_INT16(absMag, absMag);
-        in.read((char *) &spectralType, sizeof spectralType);
-        LE_TO_CPU_INT16(spectralType, spectralType);
-        if (in.bad())
-        break;
+    // The presorted octree can only be used for the first binary database
+    // loaded; otherwise, treat the stars as unsorted.
+    if (nStars != 0 || presortedStars != nullptr)
+        return loadUnsortedStars(records, nStarsInFile);
 
-        Star star;
-        star.setPosition(x, y, z);
-        star.setAbsoluteMagnitude((float) absMag / 256.0f);
+    return loadSortedStars(nodes, nNodes, records, nStarsInFile);
+}
 
-        StarDetails* details = nullptr;
-        StellarClass sc;
-        if (sc.unpack(spectralType))
-            details = StarDetails::GetStarDetails(sc);
 
-        if (details == nullptr)
+bool StarDatabase::loadUnsortedStars(const char* records, uint32_t nStarsInFile)
+{
+    for (uint32_t i = 0; i < nStarsInFile; i++, records += STAR_RECORD_SIZE)
+    {
+        Star star;
+        if (!unpackStar(records, star))
         {
             fmt::fprintf(cerr, _("Bad spectral type in star database, star #%u\n"), nStars);
             return false;
         }
 
-        star.setDetails(details);
-        star.setCatalogNumber(catNo);
         unsortedStars.add(star);
-
         nStars++;
     }
 
-    if (in.bad())
+    DPRINTF(0, "StarDatabase::read: nStars = %d\n", nStarsInFile);
+    fmt::fprintf(clog, _("%d stars in binary database\n"), nStars);
+
+    buildBinFileIndex();
+
+    return true;
+}
+
+
+// Stars of a presorted database are unpacked straight into their final
+// octree order and the static octree is recreated from the node records,
+// so no sorting is needed at all when stc files don't change the catalog.
+bool StarDatabase::loadSortedStars(const char* nodes, uint32_t nNodes,
+                                   const char* records, uint32_t nStarsInFile)
+{
+    presortedStars = new Star[nStarsInFile];
+    for (uint32_t i = 0; i < nStarsInFile; i++, records += STAR_RECORD_SIZE)
+    {
+        if (!unpackStar(records, presortedStars[i]))
+        {
+            fmt::fprintf(cerr, _("Bad spectral type in star database, star #%u\n"), i);
+            delete[] presortedStars;
+            presortedStars = nullptr;
+            return false;
+        }
+    }
+
+    const char* nodesEnd = nodes + (size_t) nNodes * OCTREE_NODE_RECORD_SIZE;
+    Star* firstStar = presortedStars;
+    presortedOctree = readSortedOctreeNode(nodes, nodesEnd, firstStar, presortedStars + nStarsInFile);
+    if (presortedOctree == nullptr || nodes != nodesEnd || firstStar != presortedStars + nStarsInFile)
+    {
+        cerr << _("Bad octree in presorted star database\n");
+        delete presortedOctree;
+        delete[] presortedStars;
+        presortedOctree = nullptr;
+        presortedStars = nullptr;
         return false;
+    }
+
+    presortedStarCount = nStarsInFile;
+    presortedStarModified.assign(nStarsInFile, false);
+    nStars += nStarsInFile;
 
     DPRINTF(0, "StarDatabase::read: nStars = %d\n", nStarsInFile);
     fmt::fprintf(clog, _("%d stars in binary database\n"), nStars);
 
-    // Create the temporary list of stars sorted by catalog number; this
-    // will be used to lookup stars during file loading. After loading is
-    // complete, the stars are sorted into an octree and this list gets
-    // replaced.
-    if (unsortedStars.size() > 0)
+    buildBinFileIndex();
+
+    return true;
+}
+
+
+StarOctree* StarDatabase::readSortedOctreeNode(const char*& node,
+                                               const char* nodesEnd,
+                                               Star*& firstStar,
+                                               const Star* starsEnd)
+{
+    if (node + OCTREE_NODE_RECORD_SIZE > nodesEnd)
+        return nullptr;
+
+    Vector3f cellCenterPos(readFloat(node), readFloat(node + 4), readFloat(node + 8));
+    float exclusionFactor = readFloat(node + 12);
+    uint32_t nObjects = readUint32(node + 16);
+    bool hasChildren = readUint32(node + 20) != 0;
+    node += OCTREE_NODE_RECORD_SIZE;
+
+    if (nObjects > (size_t) (starsEnd - firstStar))
+        return nullptr;
+
+    Star* nodeStars = firstStar;
+    firstStar += nObjects;
+
+    StarOctree** children = nullptr;
+    if (hasChildren)
     {
-        binFileStarCount = unsortedStars.size();
-        binFileCatalogNumberIndex = new Star*[binFileStarCount];
-        for (unsigned int i = 0; i < binFileStarCount; i++)
+        children = new StarOctree*[8];
+        for (int i = 0; i < 8; i++)
         {
-            binFileCatalogNumberIndex[i] = &unsortedStars[i];
+            children[i] = readSortedOctreeNode(node, nodesEnd, firstStar, starsEnd);
+            if (children[i] == nullptr)
+            {
+                for (int j = 0; j < i; j++)
+                    delete children[j];
+                delete[] children;
+                return nullptr;
+            }
         }
-        sort(binFileCatalogNumberIndex, binFileCatalogNumberIndex + binFileStarCount,
-             PtrCatalogNumberOrderingPredicate());
     }
 
-    return true;
+    return new StarOctree(cellCenterPos, exclusionFactor, nodeStars, nObjects, children);
 }
 
 
@@ -721,7 +915,7 @@ void StarDatabase::finish()
     buildIndexes();
 
     // Delete the temporary indices used only during loading
-    delete[] binFileCatalogNumberIndex;
+    binFileCatalogNumberIndex.clear();
     stcFileCatalogNumberIndex.clear();
 
     // Resolve all barycenters; this can't be done before star sorting. There's
@@ -743,6 +937,8 @@ void StarDatabase::finish()
     }
 
     barycenters.clear();
+
+    octreeMirror.build(stars, nStars);
 }
 
 
@@ -1283,6 +1479,13 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
 
         bool isNewStar = star == nullptr;
 
+        // A changed star may no longer belong in its presorted octree node
+        if (!isNewStar && star >= presortedStars && star < presortedStars + presortedStarCount)
+        {
+            presortedStarModified[star - presortedStars] = true;
+            anyPresortedStarModified = true;
+        }
+
         tokenizer.pushBack();
 
         Value* starDataValue = parser.readValue();
@@ -1324,7 +1527,7 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
                 delete star;
 
                 // Add the new star to the temporary (load time) index.
-                stcFileCatalogNumberIndex[catalogNumber] = &unsortedStars[unsortedStars.size() - 1];
+                stcFileCatalogNumberIndex.set(catalogNumber, &unsortedStars[unsortedStars.size() - 1]);
             }
 
             if (namesDB != nullptr && !objName.empty())
@@ -1371,16 +1574,49 @@ void StarDatabase::buildOctree()
     // This should only be called once for the database
     // ASSERT(octreeRoot == nullptr);
 
+    // A presorted catalog that no stc file touched needs no sorting at all
+    if (presortedOctree != nullptr && unsortedStars.size() == 0 && !anyPresortedStarModified)
+    {
+        DPRINTF(1, "Using presorted star octree\n");
+        octreeRoot = presortedOctree;
+        stars = presortedStars;
+        presortedOctree = nullptr;
+        presortedStars = nullptr;
+        presortedStarCount = 0;
+        return;
+    }
+
     DPRINTF(1, "Sorting stars into octree . . .\n");
-    float absMag = astro::appToAbsMag(STAR_OCTREE_MAGNITUDE,
-                                      STAR_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
-    DynamicStarOctree* root = new DynamicStarOctree(Vector3f(1000.0f, 1000.0f, 1000.0f),
-                                                    absMag);
+    DynamicStarOctree* root;
+    if (presortedOctree != nullptr)
+    {
+        // Start from the presorted octree, leaving out the stars changed by
+        // stc files; those are inserted again with the new stars.
+        root = new DynamicStarOctree(*presortedOctree,
+                                     [this](const Star& star)
+                                     { return presortedStarModified[&star - presortedStars]; });
+    }
+    else
+    {
+        float absMag = astro::appToAbsMag(STAR_OCTREE_MAGNITUDE,
+                                          STAR_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
+        root = new DynamicStarOctree(Vector3f(1000.0f, 1000.0f, 1000.0f), absMag);
+    }
+
+    DynamicStarOctree::ObjectList newStars;
+    newStars.reserve(unsortedStars.size());
+    for (unsigned int i = 0; i < presortedStarCount; ++i)
+    {
+        if (presortedStarModified[i])
+            newStars.push_back(&presortedStars[i]);
+    }
     for (unsigned int i = 0; i < unsortedStars.size(); ++i)
     {
-        root->insertObject(unsortedStars[i], STAR_OCTREE_ROOT_SIZE);
+        newStars.push_back(&unsortedStars[i]);
     }
 
+    root->insertObjects(newStars, STAR_OCTREE_ROOT_SIZE, ThreadPool::shared());
+
     DPRINTF(1, "Spatially sorting stars for improved locality of reference . . .\n");
     Star* sortedStars    = new Star[nStars];
     Star* firstStar      = sortedStars;
@@ -1410,6 +1646,12 @@ void StarDatabase::buildOctree()
     //delete[] stars;
     unsortedStars.clear();
     delete root;
+    delete presortedOctree;
+    delete[] presortedStars;
+    presortedOctree = nullptr;
+    presortedStars = nullptr;
+    presortedStarCount = 0;
+    presortedStarModified.clear();
 
     stars = sortedStars;
 }
@@ -1422,11 +1664,24 @@ void StarDatabase::buildIndexes()
 
     DPRINTF(1, "Building catalog number indexes . . .\n");
 
-    catalogNumberIndex = new Star*[nStars];
+    catalogNumberIndex.clear();
+    catalogNumberIndex.reserve(nStars);
     for (int i = 0; i < nStars; ++i)
-        catalogNumberIndex[i] = &stars[i];
+        catalogNumberIndex.insert(stars[i].getCatalogNumber(), &stars[i]);
+}
+
 
-    sort(catalogNumberIndex, catalogNumberIndex + nStars, PtrCatalogNumberOrderingPredicate());
+// Create the temporary index of stars from binary files; this will be used
+// to lookup stars during file loading. After loading is complete, the stars
+// are sorted into an octree and this index gets replaced.
+void StarDatabase::buildBinFileIndex()
+{
+    binFileCatalogNumberIndex.clear();
+    binFileCatalogNumberIndex.reserve(presortedStarCount + unsortedStars.size());
+    for (unsigned int i = 0; i < presortedStarCount; i++)
+        binFileCatalogNumberIndex.insert(presortedStars[i].getCatalogNumber(), &presortedStars[i]);
+    for (unsigned int i = 0; i < unsortedStars.size(); i++)
+        binFileCatalogNumberIndex.insert(unsortedStars[i].getCatalogNumber(), &unsortedStars[i]);
 }
 
 
@@ -1434,36 +1689,22 @@ void StarDatabase::buildIndexes()
  *  find(). The final catalog number index for stars cannot be built until
  *  after all stars have been loaded. During catalog loading, there are two
  *  separate indexes: one for the binary catalog and another index for stars
- *  loaded from stc files. They binary catalog index is a sorted array, while
- *  the stc catalog index is an STL map. Since the binary file can be quite
- *  large, we want to avoid creating a map with as many nodes as there are
- *  stars. Stc files should collectively contain many fewer stars, and stars
- *  in an stc file may reference each other (barycenters). Thus, a dynamic
- *  structure like a map is both practical and essential.
+ *  loaded from stc files. The binary catalog index is built once the binary
+ *  file has been read, while the stc catalog index grows as stars are
+ *  added, since stars in an stc file may reference each other
+ *  (barycenters).
  */
 Star* StarDatabase::findWhileLoading(uint32_t catalogNumber) const
 {
     // First check for stars loaded from the binary database
-    if (binFileCatalogNumberIndex != nullptr)
-    {
-        Star refStar;
-        refStar.setCatalogNumber(catalogNumber);
-
-        Star** star   = lower_bound(binFileCatalogNumberIndex,
-                                    binFileCatalogNumberIndex + binFileStarCount,
-                                    &refStar,
-                                    PtrCatalogNumberOrderingPredicate());
-
-        if (star != binFileCatalogNumberIndex + binFileStarCount && (*star)->getCatalogNumber() == catalogNumber)
-            return *star;
-    }
+    Star* const* star = binFileCatalogNumberIndex.find(catalogNumber);
+    if (star != nullptr)
+        return *star;
 
     // Next check for stars loaded from an stc file
-    map<uint32_t, Star*>::const_iterator iter = stcFileCatalogNumberIndex.find(catalogNumber);
-    if (iter != stcFileCatalogNumberIndex.end())
-    {
-        return iter->second;
-    }
+    star = stcFileCatalogNumberIndex.find(catalogNumber);
+    if (star != nullptr)
+        return *star;
 
     // Star not found
     return nullptr;
@@ -14,11 +14,14 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <celengine/constellation.h>
 #include <celengine/starname.h>
 #include <celengine/star.h>
 #include <celengine/staroctree.h>
 #include <celengine/parseobject.h>
+#include <celutil/hashindex.h>
 
 
 static const unsigned int MAX_STAR_NAMES = 10;
@@ -124,6 +127,18 @@ class StarDatabase
                           float limitingMag,
                           OctreeProcStats * = nullptr) const;
 
+    // Multithreaded findVisibleStars(): the subtrees below the top of the
+    // octree are traversed on the pool, each one with its own handler, see
+    // StaticOctree::processVisibleObjects().
+    void findVisibleStars(StarHandler& starHandler,
+                          const std::function<StarHandler&(size_t)>& subtreeHandler,
+                          ThreadPool& pool,
+                          const Eigen::Vector3f& obsPosition,
+                          const Eigen::Quaternionf&   obsOrientation,
+                          float fovY,
+                          float aspectRatio,
+                          float limitingMag) const;
+
     void findCloseStars(StarHandler& starHandler,
                         const Eigen::Vector3f& obsPosition,
                         float radius) const;
@@ -132,11 +147,19 @@ class StarDatabase
     void getStarName(const Star& star, char* nameBuffer, unsigned int bufferSize, bool i18n = false) const;
     std::string getStarNameList(const Star&, const unsigned int maxNames = MAX_STAR_NAMES) const;
 
+    // The translated name of the star, or its catalog number if it has no
+    // name. No string is built per call, the reference stays valid until
+    // the star's names change.
+    const std::string& getStarLabel(const Star&) const;
+
     StarNameDatabase* getNameDatabase() const;
     void setNameDatabase(StarNameDatabase*);
 
     bool load(std::istream&, const fs::path& resourcePath = fs::path());
     bool loadBinary(std::istream&);
+    bool loadBinary(const fs::path&);
+
+    const StarOctree* getOctree() const;
 
     enum Catalog
     {
@@ -177,28 +200,53 @@ private:
                     const fs::path& path,
                     const bool isBarycenter);
 
+    bool loadBinaryData(uint16_t version, const char* data, size_t size);
+    bool loadUnsortedStars(const char* records, uint32_t nStarsInFile);
+    bool loadSortedStars(const char* nodes, uint32_t nNodes,
+                         const char* records, uint32_t nStarsInFile);
+    StarOctree* readSortedOctreeNode(const char*& node, const char* nodesEnd,
+                                     Star*& firstStar, const Star* starsEnd);
+
     void buildOctree();
     void buildIndexes();
+    void buildBinFileIndex();
     Star* findWhileLoading(uint32_t catalogNumber) const;
 
     int nStars{ 0 };
 
     Star*             stars{ nullptr };
     StarNameDatabase* namesDB{ nullptr };
-    Star**            catalogNumberIndex{ nullptr };
+    HashIndex<Star*>  catalogNumberIndex;
     StarOctree*       octreeRoot{ nullptr };
+    StarOctreeMirror  octreeMirror;
     uint32_t            nextAutoCatalogNumber{ 0xfffffffe };
 
-    std::vector<CrossIndex*> crossIndexes;
+    // Labels of the stars without a name, built when first needed
+    mutable std::unordered_map<uint32_t, std::string> numberLabels;
+    mutable std::mutex numberLabelsMutex;
+
+    // Catalog number -> Celestia catalog number, and the reverse mapping
+    struct CrossIndexMaps
+    {
+        HashIndex<uint32_t> toCelestia;
+        HashIndex<uint32_t> fromCelestia;
+    };
+    std::vector<CrossIndexMaps*> crossIndexes;
 
     // These values are used by the star database loader; they are
     // not used after loading is complete.
     BlockArray<Star> unsortedStars;
-    // List of stars loaded from binary file, sorted by catalog number
-    Star** binFileCatalogNumberIndex{ nullptr };
-    unsigned int binFileStarCount{ 0 };
+    // Catalog number -> star mapping for stars loaded from binary files
+    HashIndex<Star*> binFileCatalogNumberIndex;
     // Catalog number -> star mapping for stars loaded from stc files
-    std::map<uint32_t, Star*> stcFileCatalogNumberIndex;
+    HashIndex<Star*> stcFileCatalogNumberIndex;
+    // Stars and octree read from a presorted binary file; they're used as
+    // is unless stc files add stars or modify the presorted ones.
+    Star* presortedStars{ nullptr };
+    StarOctree* presortedOctree{ nullptr };
+    unsigned int presortedStarCount{ 0 };
+    std::vector<bool> presortedStarModified;
+    bool anyPresortedStarModified{ false };
 
     struct BarycenterUsage
     {
@@ -10,20 +10,11 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <cmath>
 #include <celengine/staroctree.h>
 
 using namespace Eigen;
 
-// Maximum permitted orbital radius for stars, in light years. Orbital
-// radii larger than this value are not guaranteed to give correct
-// results. The problem case is extremely faint stars (such as brown
-// dwarfs.) The distance from the viewer to star's barycenter is used
-// rough estimate of the brightness for the purpose of culling. When the
-// star is very faint, this estimate may not work when the star is
-// far from the barycenter. Thus, the star octree traversal will always
-// render stars with orbits that are closer than MAX_STAR_ORBIT_RADIUS.
-static const float MAX_STAR_ORBIT_RADIUS = 1.0f;
-
 
 // The octree node into which a star is placed is dependent on two properties:
 // its obsPosition and its luminosity--the fainter the star, the deeper the node
@@ -213,3 +204,180 @@ void StarOctree::processCloseObjects(StarHandler&    processor,
         }
     }
 }
+
+
+void StarOctreeMirror::build(const Star* _stars, unsigned int nStars)
+{
+    stars = _stars;
+
+    x.resize(nStars);
+    y.resize(nStars);
+    z.resize(nStars);
+    absMag.resize(nStars);
+    temperature.resize(nStars);
+    orbitalRadius.resize(nStars);
+
+    for (unsigned int i = 0; i < nStars; ++i)
+    {
+        const Star& star = stars[i];
+        Vector3f pos = star.getPosition();
+        x[i] = pos.x();
+        y[i] = pos.y();
+        z[i] = pos.z();
+        absMag[i] = star.getAbsoluteMagnitude();
+        temperature[i] = star.getTemperature();
+        orbitalRadius[i] = star.getOrbitalRadius();
+    }
+}
+
+
+void StarOctreeMirror::processVisibleObjects(const StarOctree&           node,
+                                             StarHandler&                processor,
+                                             const Vector3f&             obsPosition,
+                                             const Hyperplane<float, 3>* frustumPlanes,
+                                             float                       limitingFactor,
+                                             float                       scale,
+                                             OctreeProcStats*            stats) const
+{
+    processNode(node,
+                processor,
+                dynamic_cast<StarBatchProcessor*>(&processor),
+                obsPosition,
+                frustumPlanes,
+                limitingFactor,
+                scale,
+                stats);
+}
+
+
+void StarOctreeMirror::processVisibleObjects(const StarOctree&           node,
+                                             StarHandler&                processor,
+                                             const std::function<StarHandler&(size_t)>& subtreeProcessor,
+                                             ThreadPool&                 pool,
+                                             const Vector3f&             obsPosition,
+                                             const Hyperplane<float, 3>* frustumPlanes,
+                                             float                       limitingFactor,
+                                             float                       scale) const
+{
+    StarBatchProcessor* batchProcessor = dynamic_cast<StarBatchProcessor*>(&processor);
+
+    std::vector<StarOctree::Subtree> subtrees;
+    node.splitTraversal(scale, (size_t) pool.size() * 4,
+                        [&](const StarOctree& n, float nodeScale)
+                        {
+                            return visitNode(n, processor, batchProcessor, obsPosition,
+                                             frustumPlanes, limitingFactor, nodeScale);
+                        },
+                        subtrees);
+
+    std::vector<StarHandler*> processors;
+    processors.reserve(subtrees.size());
+    for (size_t i = 0; i < subtrees.size(); i++)
+        processors.push_back(&subtreeProcessor(i));
+
+    pool.parallelFor(subtrees.size(), [&](size_t i)
+    {
+        processNode(*subtrees[i].node,
+                    *processors[i],
+                    dynamic_cast<StarBatchProcessor*>(processors[i]),
+                    obsPosition,
+                    frustumPlanes,
+                    limitingFactor,
+                    subtrees[i].scale,
+                    nullptr);
+    });
+}
+
+
+// Process the stars of a single node; returns whether the children of the
+// node have to be visited.
+bool StarOctreeMirror::visitNode(const StarOctree&           node,
+                                 StarHandler&                processor,
+                                 StarBatchProcessor*         batchProcessor,
+                                 const Vector3f&             obsPosition,
+                                 const Hyperplane<float, 3>* frustumPlanes,
+                                 float                       limitingFactor,
+                                 float                       scale) const
+{
+    const Vector3f& cellCenterPos = node.getCellCenterPos();
+
+    // See if this node lies within the view frustum
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        const Hyperplane<float, 3>& plane = frustumPlanes[i];
+        float r = scale * plane.normal().cwiseAbs().sum();
+        if (plane.signedDistance(cellCenterPos) < -r)
+            return false;
+    }
+
+    float minDistance = (obsPosition - cellCenterPos).norm() - scale * 1.732050807568877f;
+    float dimmest     = minDistance > 0 ? astro::appToAbsMag(limitingFactor, minDistance) : 1000;
+
+    unsigned int first = (unsigned int) (node.getFirstObject() - stars);
+    unsigned int end   = first + node.getObjectCount();
+    if (batchProcessor != nullptr)
+    {
+        if (end > first)
+            batchProcessor->processBatch(*this, first, end, dimmest, limitingFactor);
+    }
+    else for (unsigned int i = first; i < end; ++i)
+    {
+        if (absMag[i] < dimmest)
+        {
+            float dx = obsPosition.x() - x[i];
+            float dy = obsPosition.y() - y[i];
+            float dz = obsPosition.z() - z[i];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float appMag   = astro::absToAppMag(absMag[i], distance);
+
+            if (appMag < limitingFactor || (distance < MAX_STAR_ORBIT_RADIUS && stars[i].getOrbit()))
+                processor.process(stars[i], distance, appMag);
+        }
+    }
+
+    return node.getChild(0) != nullptr &&
+           (minDistance <= 0 || astro::absToAppMag(node.getExclusionFactor(), minDistance) <= limitingFactor);
+}
+
+
+void StarOctreeMirror::processNode(const StarOctree&           node,
+                                   StarHandler&                processor,
+                                   StarBatchProcessor*         batchProcessor,
+                                   const Vector3f&             obsPosition,
+                                   const Hyperplane<float, 3>* frustumPlanes,
+                                   float                       limitingFactor,
+                                   float                       scale,
+                                   OctreeProcStats*            stats) const
+{
+#ifdef OCTREE_DEBUG
+    size_t h;
+    if (stats != nullptr)
+    {
+        h = stats->height + 1;
+        stats->nodes++;
+        stats->objects += node.getObjectCount();
+    }
+#endif
+    if (visitNode(node, processor, batchProcessor, obsPosition, frustumPlanes, limitingFactor, scale))
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            processNode(*node.getChild(i),
+                        processor,
+                        batchProcessor,
+                        obsPosition,
+                        frustumPlanes,
+                        limitingFactor,
+                        scale * 0.5f,
+                        stats);
+#ifdef OCTREE_DEBUG
+            if (stats != nullptr && stats->height > h)
+                h = stats->height;
+#endif
+        }
+#ifdef OCTREE_DEBUG
+        if (stats != nullptr)
+            stats->height = h;
+#endif
+    }
+}
@@ -15,10 +15,110 @@
 
 #include <celengine/star.h>
 #include <celengine/octree.h>
+#include <vector>
 
 
 typedef DynamicOctree  <Star, float> DynamicStarOctree;
 typedef StaticOctree   <Star, float> StarOctree;
 typedef OctreeProcessor<Star, float> StarHandler;
 
+// Maximum permitted orbital radius for stars, in light years. Orbital
+// radii larger than this value are not guaranteed to give correct
+// results. The problem case is extremely faint stars (such as brown
+// dwarfs.) The distance from the viewer to star's barycenter is used
+// rough estimate of the brightness for the purpose of culling. When the
+// star is very faint, this estimate may not work when the star is
+// far from the barycenter. Thus, the star octree traversal will always
+// render stars with orbits that are closer than MAX_STAR_ORBIT_RADIUS.
+static const float MAX_STAR_ORBIT_RADIUS = 1.0f;
+
+class StarOctreeMirror;
+
+// Star handlers implementing this interface receive the stars of an octree
+// node as a whole range of the mirror instead of one process() call per
+// star. The handler is then responsible for the per-star culling: a star
+// must be processed when its absolute magnitude is below dimmest and either
+// its apparent magnitude is below limitingFactor or it has an orbit and is
+// closer than MAX_STAR_ORBIT_RADIUS.
+class StarBatchProcessor
+{
+ public:
+    virtual ~StarBatchProcessor() = default;
+
+    virtual void processBatch(const StarOctreeMirror& mirror,
+                              unsigned int            first,
+                              unsigned int            end,
+                              float                   dimmest,
+                              float                   limitingFactor) = 0;
+};
+
+
+// Structure of arrays copy of the star properties read in the octree
+// traversal hot loop. The arrays are in the same order as the octree's
+// star array, so the stars of each node are a contiguous range of them.
+// Culling with the packed arrays avoids pulling every Star (vtable,
+// catalog entry data and details pointer) into the cache; only the stars
+// that pass the cull are touched.
+class StarOctreeMirror
+{
+ public:
+    void build(const Star* stars, unsigned int nStars);
+
+    bool empty() const { return absMag.empty(); }
+
+    const Star* getStars() const { return stars; }
+    const float* getX() const { return x.data(); }
+    const float* getY() const { return y.data(); }
+    const float* getZ() const { return z.data(); }
+    const float* getAbsoluteMagnitudes() const { return absMag.data(); }
+    const float* getTemperatures() const { return temperature.data(); }
+    const float* getOrbitalRadii() const { return orbitalRadius.data(); }
+
+    // Same traversal as StarOctree::processVisibleObjects; handlers that
+    // are also a StarBatchProcessor get whole nodes at once.
+    void processVisibleObjects(const StarOctree&                  node,
+                               StarHandler&                       processor,
+                               const Eigen::Vector3f&             obsPosition,
+                               const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                               float                              limitingFactor,
+                               float                              scale,
+                               OctreeProcStats*                   stats = nullptr) const;
+
+    // Multithreaded traversal, see the StaticOctree version
+    void processVisibleObjects(const StarOctree&                  node,
+                               StarHandler&                       processor,
+                               const std::function<StarHandler&(size_t)>& subtreeProcessor,
+                               ThreadPool&                        pool,
+                               const Eigen::Vector3f&             obsPosition,
+                               const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                               float                              limitingFactor,
+                               float                              scale) const;
+
+ private:
+    bool visitNode(const StarOctree&                  node,
+                   StarHandler&                       processor,
+                   StarBatchProcessor*                batchProcessor,
+                   const Eigen::Vector3f&             obsPosition,
+                   const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                   float                              limitingFactor,
+                   float                              scale) const;
+    void processNode(const StarOctree&                  node,
+                     StarHandler&                       processor,
+                     StarBatchProcessor*                batchProcessor,
+                     const Eigen::Vector3f&             obsPosition,
+                     const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                     float                              limitingFactor,
+                     float                              scale,
+                     OctreeProcStats*                   stats) const;
+
+    const Star* stars{ nullptr };
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> absMag;
+    // Indexes the star color tables
+    std::vector<float> temperature;
+    std::vector<float> orbitalRadius;
+};
+
 #endif  // _CELENGINE_STAROCTREE_H_
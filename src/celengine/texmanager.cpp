@@ -9,6 +9,7 @@
 
 #include <config.h>
 #include <celutil/debug.h>
+#include <celutil/filetype.h>
 #include <iostream>
 #include <fstream>
 #include "multitexture.h"
@@ -112,20 +113,32 @@ fs::path TextureInfo::resolve(const fs::path& baseDir)
 }
 
 
-Texture* TextureInfo::load(const fs::path& name)
+Texture::AddressMode TextureInfo::getAddressMode() const
 {
-    Texture::AddressMode addressMode = Texture::EdgeClamp;
-    Texture::MipMapMode mipMode = Texture::DefaultMipMaps;
-
     if (flags & WrapTexture)
-        addressMode = Texture::Wrap;
+        return Texture::Wrap;
     else if (flags & BorderClamp)
-        addressMode = Texture::BorderClamp;
+        return Texture::BorderClamp;
+    else
+        return Texture::EdgeClamp;
+}
 
+
+Texture::MipMapMode TextureInfo::getMipMapMode() const
+{
     if (flags & NoMipMaps)
-        mipMode = Texture::NoMipMaps;
+        return Texture::NoMipMaps;
     else if (flags & AutoMipMaps)
-        mipMode = Texture::AutoMipMaps;
+        return Texture::AutoMipMaps;
+    else
+        return Texture::DefaultMipMaps;
+}
+
+
+Texture* TextureInfo::load(const fs::path& name)
+{
+    Texture::AddressMode addressMode = getAddressMode();
+    Texture::MipMapMode mipMode = getMipMapMode();
 
     if (bumpHeight == 0.0f)
     {
@@ -140,3 +153,41 @@ Texture* TextureInfo::load(const fs::path& name)
 
     return LoadHeightMapFromFile(name, bumpHeight, addressMode);
 }
+
+
+// Runs on a loader thread: decode the image, and compute the normal map of
+// bump maps, leaving only the upload to commit().
+void TextureInfo::prepare(const fs::path& name)
+{
+    // Virtual textures only read their tile directory layout, they're
+    // created by load() on the main thread.
+    if (DetermineFileType(name) == Content_CelestiaTexture)
+        return;
+
+    prepared = true;
+    Image* img = LoadImageFromFile(name);
+    if (img != nullptr && bumpHeight != 0.0f)
+    {
+        Image* normalMap = img->computeNormalMap(bumpHeight, getAddressMode() == Texture::Wrap);
+        delete img;
+        img = normalMap;
+    }
+    image.reset(img);
+}
+
+
+Texture* TextureInfo::commit(const fs::path& name)
+{
+    if (!prepared)
+        return load(name);
+    if (image == nullptr)
+        return nullptr;
+
+    DPRINTF(0, "Loading texture: %s\n", name.c_str());
+
+    Texture::MipMapMode mipMode = bumpHeight == 0.0f ? getMipMapMode() : Texture::DefaultMipMaps;
+    Texture* tex = CreateTextureFromImage(*image, name, getAddressMode(), mipMode);
+    image.reset();
+
+    return tex;
+}
@@ -12,6 +12,7 @@
 
 #include <string>
 #include <map>
+#include <memory>
 #include <celutil/resmanager.h>
 #include <celengine/texture.h>
 #include "multitexture.h"
@@ -67,6 +68,16 @@ class TextureInfo : public ResourceInfo<Texture>
 
     fs::path resolve(const fs::path&) override;
     Texture* load(const fs::path&) override;
+    void prepare(const fs::path&) override;
+    Texture* commit(const fs::path&) override;
+
+ private:
+    Texture::AddressMode getAddressMode() const;
+    Texture::MipMapMode getMipMapMode() const;
+
+    // Image decoded by prepare(); virtual textures aren't prepared
+    std::shared_ptr<Image> image;
+    bool prepared{ false };
 };
 
 inline bool operator<(const TextureInfo& ti0, const TextureInfo& ti1)
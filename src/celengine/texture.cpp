@@ -12,6 +12,8 @@
 #include <cassert>
 #include <cstdlib>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -23,6 +25,7 @@ extern "C" {
 #include <celutil/filetype.h>
 #include <celutil/debug.h>
 #include <celutil/util.h>
+#include <celutil/threadpool.h>
 #include <Eigen/Core>
 #include <GL/glew.h>
 #include <fmt/printf.h>
@@ -761,22 +764,135 @@ void CubeMap::setBorderColor(Color borderColor)
 
 
 
+void TexelFunctionObject::evalRow(const float* u, float v, int count,
+                                  unsigned char* pixels, int components)
+{
+    for (int x = 0; x < count; x++)
+        (*this)(u[x], v, 0.0f, pixels + x * components);
+}
+
+
+static fs::path proceduralTextureCacheDir;
+
+void SetProceduralTextureCacheDir(const fs::path& dir)
+{
+    proceduralTextureCacheDir = dir;
+}
+
+
+struct ProceduralTextureHeader
+{
+    char     magic[8];
+    uint32_t version;
+    int32_t  format;
+    int32_t  width;
+    int32_t  height;
+    int32_t  faceCount;
+};
+
+static const char ProceduralTextureMagic[8] = "CELPTEX";
+static const uint32_t ProceduralTextureVersion = 1;
+
+static fs::path ProceduralTextureCachePath(const string& name, const Image& img, int faceCount)
+{
+    return proceduralTextureCacheDir /
+           fmt::sprintf("%s-%dx%dx%d-%x.tex", name, img.getWidth(), img.getHeight(),
+                        faceCount, img.getFormat());
+}
+
+// Fill the faces with the pixels cached for name, if there are any.
+static bool LoadCachedProceduralTexture(const string& name, Image** faces, int faceCount)
+{
+    if (name.empty() || proceduralTextureCacheDir.empty())
+        return false;
+
+    ifstream in(ProceduralTextureCachePath(name, *faces[0], faceCount).string(), ios::in | ios::binary);
+    if (!in.good())
+        return false;
+
+    ProceduralTextureHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, ProceduralTextureMagic, sizeof(header.magic)) != 0 ||
+        header.version != ProceduralTextureVersion ||
+        header.format != faces[0]->getFormat() ||
+        header.width != faces[0]->getWidth() ||
+        header.height != faces[0]->getHeight() ||
+        header.faceCount != faceCount)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < faceCount; i++)
+    {
+        if (!in.read(reinterpret_cast<char*>(faces[i]->getPixels()), faces[i]->getSize()))
+            return false;
+    }
+
+    return true;
+}
+
+static void SaveCachedProceduralTexture(const string& name, Image** faces, int faceCount)
+{
+    if (name.empty() || proceduralTextureCacheDir.empty())
+        return;
+
+    // Write to a temporary file first so that a partially written file is
+    // never read back.
+    fs::path path = ProceduralTextureCachePath(name, *faces[0], faceCount);
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        ofstream out(tmpPath.string(), ios::out | ios::binary);
+        if (!out.good())
+            return;
+
+        ProceduralTextureHeader header;
+        memcpy(header.magic, ProceduralTextureMagic, sizeof(header.magic));
+        header.version = ProceduralTextureVersion;
+        header.format = faces[0]->getFormat();
+        header.width = faces[0]->getWidth();
+        header.height = faces[0]->getHeight();
+        header.faceCount = faceCount;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (int i = 0; i < faceCount; i++)
+            out.write(reinterpret_cast<const char*>(faces[i]->getPixels()), faces[i]->getSize());
+        if (!out.good())
+        {
+            out.close();
+            remove(tmpPath.string().c_str());
+            return;
+        }
+    }
+    if (rename(tmpPath.string().c_str(), path.string().c_str()) != 0)
+        remove(tmpPath.string().c_str());
+}
+
+
+// Texel centers map to (-1, 1) in both directions.
+static inline float ProceduralTexCoord(int x, int size)
+{
+    return ((float) x + 0.5f) / (float) size * 2 - 1;
+}
+
 Texture* CreateProceduralTexture(int width, int height,
                                  int format,
                                  ProceduralTexEval func,
                                  Texture::AddressMode addressMode,
-                                 Texture::MipMapMode mipMode)
+                                 Texture::MipMapMode mipMode,
+                                 const string& cacheName)
 {
     Image* img = new Image(format, width, height);
 
-    for (int y = 0; y < height; y++)
+    if (!LoadCachedProceduralTexture(cacheName, &img, 1))
     {
-        for (int x = 0; x < width; x++)
+        ThreadPool::shared().parallelFor(height, [&](size_t y)
         {
-            float u = ((float) x + 0.5f) / (float) width * 2 - 1;
-            float v = ((float) y + 0.5f) / (float) height * 2 - 1;
-            func(u, v, 0, img->getPixelRow(y) + x * img->getComponents());
-        }
+            unsigned char* row = img->getPixelRow((int) y);
+            float v = ProceduralTexCoord((int) y, height);
+            for (int x = 0; x < width; x++)
+                func(ProceduralTexCoord(x, width), v, 0, row + x * img->getComponents());
+        });
+        SaveCachedProceduralTexture(cacheName, &img, 1);
     }
 
     Texture* tex = new ImageTexture(*img, addressMode, mipMode);
@@ -790,18 +906,23 @@ Texture* CreateProceduralTexture(int width, int height,
                                  int format,
                                  TexelFunctionObject& func,
                                  Texture::AddressMode addressMode,
-                                 Texture::MipMapMode mipMode)
+                                 Texture::MipMapMode mipMode,
+                                 const string& cacheName)
 {
     Image* img = new Image(format, width, height);
 
-    for (int y = 0; y < height; y++)
+    if (!LoadCachedProceduralTexture(cacheName, &img, 1))
     {
+        vector<float> u(width);
         for (int x = 0; x < width; x++)
+            u[x] = ProceduralTexCoord(x, width);
+
+        ThreadPool::shared().parallelFor(height, [&](size_t y)
         {
-            float u = ((float) x + 0.5f) / (float) width * 2 - 1;
-            float v = ((float) y + 0.5f) / (float) height * 2 - 1;
-            func(u, v, 0, img->getPixelRow(y) + x * img->getComponents());
-        }
+            func.evalRow(u.data(), ProceduralTexCoord((int) y, height), width,
+                         img->getPixelRow((int) y), img->getComponents());
+        });
+        SaveCachedProceduralTexture(cacheName, &img, 1);
     }
 
     Texture* tex = new ImageTexture(*img, addressMode, mipMode);
@@ -848,26 +969,30 @@ static Vector3f cubeVector(int face, float s, float t)
 
 
 extern Texture* CreateProceduralCubeMap(int size, int format,
-                                        ProceduralTexEval func)
+                                        ProceduralTexEval func,
+                                        const string& cacheName)
 {
     Image* faces[6];
 
     for (int i = 0; i < 6; i++)
-    {
         faces[i] = new Image(format, size, size);
 
-        Image* face = faces[i];
-        for (int y = 0; y < size; y++)
+    if (!LoadCachedProceduralTexture(cacheName, faces, 6))
+    {
+        // The rows of all six faces are evaluated together.
+        ThreadPool::shared().parallelFor(6 * size, [&](size_t i)
         {
+            int face = (int) i / size;
+            int y = (int) i % size;
+            unsigned char* row = faces[face]->getPixelRow(y);
+            float t = ProceduralTexCoord(y, size);
             for (int x = 0; x < size; x++)
             {
-                float s = ((float) x + 0.5f) / (float) size * 2 - 1;
-                float t = ((float) y + 0.5f) / (float) size * 2 - 1;
-                Vector3f v = cubeVector(i, s, t);
-                func(v.x(), v.y(), v.z(),
-                     face->getPixelRow(y) + x * face->getComponents());
+                Vector3f v = cubeVector(face, ProceduralTexCoord(x, size), t);
+                func(v.x(), v.y(), v.z(), row + x * faces[face]->getComponents());
             }
-        }
+        });
+        SaveCachedProceduralTexture(cacheName, faces, 6);
     }
 
     Texture* tex = new CubeMap(faces);
@@ -955,22 +1080,33 @@ Texture* LoadTextureFromFile(const fs::path& filename,
     if (img == nullptr)
         return nullptr;
 
-    Texture* tex = CreateTextureFromImage(*img, addressMode, mipMode);
+    Texture* tex = CreateTextureFromImage(*img, filename, addressMode, mipMode);
+
+    delete img;
+
+    return tex;
+}
 
-    if (contentType == Content_DXT5NormalMap)
+
+Texture* CreateTextureFromImage(Image& img,
+                                const fs::path& filename,
+                                Texture::AddressMode addressMode,
+                                Texture::MipMapMode mipMode)
+{
+    Texture* tex = CreateTextureFromImage(img, addressMode, mipMode);
+
+    if (DetermineFileType(filename) == Content_DXT5NormalMap)
     {
         // If the texture came from a .dxt5nm file then mark it as a dxt5
         // compressed normal map. There's no separate OpenGL format for dxt5
         // normal maps, so the file extension is the only thing that
         // distinguishes it from a plain old dxt5 texture.
-        if (img->getFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        if (img.getFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
         {
             tex->setFormatOptions(Texture::DXT5NormalMap);
         }
     }
 
-    delete img;
-
     return tex;
 }
 
@@ -34,6 +34,8 @@ struct TextureTile
 };
 
 
+// Rows of procedural textures are evaluated concurrently, so texel
+// functions must not change any state.
 class TexelFunctionObject
 {
  public:
@@ -41,6 +43,12 @@ class TexelFunctionObject
     virtual ~TexelFunctionObject() {};
     virtual void operator()(float u, float v, float w,
                             unsigned char* pixel) = 0;
+
+    // Evaluate count texels at (u[i], v), with components bytes per texel.
+    // The default calls operator() for each one; functions can override it
+    // with a loop the compiler can vectorize.
+    virtual void evalRow(const float* u, float v, int count,
+                         unsigned char* pixels, int components);
 };
 
 
@@ -167,23 +175,38 @@ class CubeMap : public Texture
 };
 
 
+// Procedural textures are evaluated a row at a time on the shared thread
+// pool. When a cache directory is set, textures with a cache name are
+// kept there, in files named after it and the texture size and format; the
+// name must change whenever the function does.
 extern Texture* CreateProceduralTexture(int width, int height,
                                         int format,
                                         ProceduralTexEval func,
                                         Texture::AddressMode addressMode = Texture::EdgeClamp,
-                                        Texture::MipMapMode mipMode = Texture::DefaultMipMaps);
+                                        Texture::MipMapMode mipMode = Texture::DefaultMipMaps,
+                                        const std::string& cacheName = std::string());
 extern Texture* CreateProceduralTexture(int width, int height,
                                         int format,
                                         TexelFunctionObject& func,
                                         Texture::AddressMode addressMode = Texture::EdgeClamp,
-                                        Texture::MipMapMode mipMode = Texture::DefaultMipMaps);
+                                        Texture::MipMapMode mipMode = Texture::DefaultMipMaps,
+                                        const std::string& cacheName = std::string());
 extern Texture* CreateProceduralCubeMap(int size, int format,
-                                        ProceduralTexEval func);
+                                        ProceduralTexEval func,
+                                        const std::string& cacheName = std::string());
+extern void SetProceduralTextureCacheDir(const fs::path& dir);
 
 extern Texture* LoadTextureFromFile(const fs::path& filename,
                                     Texture::AddressMode addressMode = Texture::EdgeClamp,
                                     Texture::MipMapMode mipMode = Texture::DefaultMipMaps);
 
+// Create the texture for an image read from filename by LoadImageFromFile;
+// this is the part of LoadTextureFromFile that needs the GL context.
+extern Texture* CreateTextureFromImage(Image& img,
+                                       const fs::path& filename,
+                                       Texture::AddressMode addressMode,
+                                       Texture::MipMapMode mipMode);
+
 extern Texture* LoadHeightMapFromFile(const fs::path& filename,
                                       float height,
                                       Texture::AddressMode addressMode = Texture::EdgeClamp);
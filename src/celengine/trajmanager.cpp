@@ -9,6 +9,7 @@
 
 #include <config.h>
 #include "trajmanager.h"
+#include <celephem/chebyshevorbit.h>
 #include <celephem/samporbit.h>
 #include <celutil/debug.h>
 #include <celutil/filetype.h>
@@ -68,7 +69,13 @@ Orbit* TrajectoryInfo::load(const fs::path& filename)
 
     Orbit* sampTrajectory = nullptr;
 
-    if (filetype == Content_CelestiaXYZVTrajectory)
+    if (filetype == Content_CelestiaChebyshevTrajectory)
+    {
+        // Compiled trajectories are always double precision, and the
+        // interpolation is fixed when they're compiled.
+        sampTrajectory = LoadChebyshevTrajectory(strippedFilename);
+    }
+    else if (filetype == Content_CelestiaXYZVTrajectory)
     {
         switch (precision)
         {
@@ -7,6 +7,7 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <algorithm>
 #include <cmath>
 #include <cassert>
 #include <cmath>
@@ -19,6 +20,7 @@
 #include <celutil/debug.h>
 #include <celcompat/filesystem.h>
 #include <celutil/filetype.h>
+#include <celutil/threadpool.h>
 #include "parser.h"
 #include "virtualtex.h"
 
@@ -27,6 +29,15 @@ using namespace std;
 
 static const int MaxResolutionLevels = 13;
 
+// Memory for the tiles streamed in by one virtual texture. Tiles used by
+// the last MinEvictionAge usages are kept even over the budget.
+static const size_t TileMemoryBudget = 256 * 1024 * 1024;
+static const unsigned int MinEvictionAge = 4;
+
+// Limits on the tiles loaded ahead of need
+static const unsigned int MaxPrefetchTiles = 8;
+static const unsigned int MaxTilesInFlight = 32;
+
 
 // Virtual textures are composed of tiles that are loaded from the hard drive
 // as they become visible.  Hidden tiles may be evicted from graphics memory
@@ -38,6 +49,10 @@ static const int MaxResolutionLevels = 13;
 // a power of two, with width = 2 * height.  The baseSplit determines the
 // number of tiles at the lowest LOD.  It is the log base 2 of the width in
 // tiles of LOD zero.  Though it's not required
+//
+// Tiles are decoded by loader threads and uploaded by the next
+// beginUsage(); until then getTile() returns the finest resident tile
+// above the requested one. Only the coarsest tiles are loaded right away.
 
 static bool isPow2(int x)
 {
@@ -45,6 +60,17 @@ static bool isPow2(int x)
 }
 
 
+// Tiles are read from disk, so they have threads of their own instead of
+// using the shared compute pool.
+static ThreadPool& TileLoaderPool()
+{
+    static ThreadPool pool(2);
+    return pool;
+}
+
+static bool SynchronousLoading = false;
+
+
 #if 0
 // Useful if we want to use a packed quadtree to store tiles instead of
 // the currently implemented tree structure.
@@ -66,7 +92,8 @@ VirtualTexture::VirtualTexture(fs::path _tilePath,
     baseSplit(_baseSplit),
     tileSize(_tileSize),
     ticks(0),
-    nResolutionLevels(0)
+    nResolutionLevels(0),
+    loadQueue(make_shared<LoadQueue>())
 {
     assert(tileSize != 0 && isPow2(tileSize));
     tileTree[0] = new TileQuadtreeNode();
@@ -99,6 +126,12 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
     Tile* tile = node->tile;
     unsigned int tileLOD = 0;
 
+    // The coarsest tile on the path, and the finest one ready to be drawn
+    Tile* baseTile = tile;
+    unsigned int baseLOD = 0;
+    Tile* residentTile = tile != nullptr && tile->tex != nullptr ? tile : nullptr;
+    unsigned int residentLOD = 0;
+
     for (int n = 0; n < lod; n++)
     {
         unsigned int mask = 1 << (lod - n - 1);
@@ -112,6 +145,16 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
         {
             tile = node->tile;
             tileLOD = n + 1;
+            if (baseTile == nullptr)
+            {
+                baseTile = tile;
+                baseLOD = tileLOD;
+            }
+            if (tile->tex != nullptr)
+            {
+                residentTile = tile;
+                residentLOD = tileLOD;
+            }
         }
     }
 
@@ -119,17 +162,35 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
     if (!tile)
         return TextureTile(0);
 
-    // Make the tile resident.
-    unsigned int tileU = u >> (lod - tileLOD);
-    unsigned int tileV = v >> (lod - tileLOD);
-    makeResident(tile, tileLOD, tileU, tileV);
+    requests.push_back({ (unsigned int) lod, (unsigned int) u, (unsigned int) v });
 
-    // It's possible that we failed to make the tile resident, either
-    // because the texture file was bad, or there was an unresolvable
-    // out of memory situation.  In that case there is nothing else to
-    // do but return a texture tile with a null texture name.
-    if (!tile->tex)
-        return TextureTile(0);
+    // Start loading the tile; a coarser one is used until it's ready.
+    if (tile != baseTile)
+    {
+        requestTile(tile, tileLOD, u >> (lod - tileLOD), v >> (lod - tileLOD));
+        if (tile->tex != nullptr)
+        {
+            residentTile = tile;
+            residentLOD = tileLOD;
+        }
+    }
+
+    if (residentTile == nullptr)
+    {
+        makeResident(baseTile, baseLOD, u >> (lod - baseLOD), v >> (lod - baseLOD));
+
+        // It's possible that we failed to make the tile resident, either
+        // because the texture file was bad, or there was an unresolvable
+        // out of memory situation.  In that case there is nothing else to
+        // do but return a texture tile with a null texture name.
+        if (!baseTile->tex)
+            return TextureTile(0);
+
+        residentTile = baseTile;
+        residentLOD = baseLOD;
+    }
+
+    markUsed(residentTile);
 
     // Set up the texture subrect to be the entire texture
     float texU = 0.0f;
@@ -139,16 +200,16 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
 
     // If the tile came from a lower LOD than the requested one,
     // we'll only use a subsection of it.
-    unsigned int lodDiff = lod - tileLOD;
+    unsigned int lodDiff = lod - residentLOD;
     texDU = texDV = 1.0f / (float) (1 << lodDiff);
     texU = (u & ((1 << lodDiff) - 1)) * texDU;
     texV = (v & ((1 << lodDiff) - 1)) * texDV;
 
 #if 0
-    cout << "Tile: " << tile->tex->getName() << ", " <<
+    cout << "Tile: " << residentTile->tex->getName() << ", " <<
         texU << ", " << texV << ", " << texDU << ", " << texDV << '\n';
 #endif
-    return TextureTile(tile->tex->getName(), texU, texV, texDU, texDV);
+    return TextureTile(residentTile->tex->getName(), texU, texV, texDU, texDV);
 }
 
 
@@ -181,11 +242,23 @@ void VirtualTexture::beginUsage()
 {
     ticks++;
     tilesRequested = 0;
+    requests.clear();
+
+    commitLoadedTiles();
+    evictTiles();
 }
 
 
 void VirtualTexture::endUsage()
 {
+    if (!SynchronousLoading)
+        prefetchTiles();
+}
+
+
+void VirtualTexture::setSynchronousLoading(bool synchronous)
+{
+    SynchronousLoading = synchronous;
 }
 
 
@@ -199,31 +272,43 @@ unsigned int VirtualTexture::tileIndex(unsigned int lod,
 #endif
 
 
-ImageTexture* VirtualTexture::loadTileTexture(unsigned int lod, unsigned int u, unsigned int v)
+fs::path VirtualTexture::getTileFilename(unsigned int lod, unsigned int u, unsigned int v) const
 {
-    lod >>= baseSplit;
+    lod -= baseSplit;
     assert(lod < (unsigned)MaxResolutionLevels);
 
-    auto path = fs::path(fmt::sprintf("%slevel%d", tilePath, lod)) /
-                fmt::sprintf("%s%d_%d%s", tilePrefix, u, v, tileExt);
+    return fs::path(fmt::sprintf("%slevel%d", tilePath, lod)) /
+           fmt::sprintf("%s%d_%d%s", tilePrefix, u, v, tileExt);
+}
 
-    Image* img = LoadImageFromFile(path);
-    if (img == nullptr)
-        return nullptr;
 
+ImageTexture* VirtualTexture::createTileTexture(Image& img, unsigned int lod)
+{
     ImageTexture* tex = nullptr;
 
     // Only use mip maps for the LOD 0; for higher LODs, the function of mip
     // mapping is built into the texture.
-    MipMapMode mipMapMode = lod == 0 ? DefaultMipMaps : NoMipMaps;
+    MipMapMode mipMapMode = lod == baseSplit ? DefaultMipMaps : NoMipMaps;
 
-    if (isPow2(img->getWidth()) && isPow2(img->getHeight()))
-        tex = new ImageTexture(*img, EdgeClamp, mipMapMode);
+    if (isPow2(img.getWidth()) && isPow2(img.getHeight()))
+        tex = new ImageTexture(img, EdgeClamp, mipMapMode);
 
     // TODO: Virtual textures can have tiles in different formats, some
     // compressed and some not. The compression flag doesn't make much
     // sense for them.
-    compressed = img->isCompressed();
+    compressed = img.isCompressed();
+
+    return tex;
+}
+
+
+ImageTexture* VirtualTexture::loadTileTexture(unsigned int lod, unsigned int u, unsigned int v)
+{
+    Image* img = LoadImageFromFile(getTileFilename(lod, u, v));
+    if (img == nullptr)
+        return nullptr;
+
+    ImageTexture* tex = createTileTexture(*img, lod);
 
     delete img;
 
@@ -235,7 +320,6 @@ void VirtualTexture::makeResident(Tile* tile, unsigned int lod, unsigned int u,
 {
     if (tile->tex == nullptr && !tile->loadFailed)
     {
-        // Potentially evict other tiles in order to make this one fit
         tile->tex = loadTileTexture(lod, u, v);
         if (tile->tex == nullptr)
         {
@@ -246,6 +330,207 @@ void VirtualTexture::makeResident(Tile* tile, unsigned int lod, unsigned int u,
 }
 
 
+// Queue the tile for decoding on a loader thread
+void VirtualTexture::requestTile(Tile* tile, unsigned int lod, unsigned int u, unsigned int v)
+{
+    if (tile->tex != nullptr || tile->loadFailed || tile->loading)
+        return;
+
+    if (SynchronousLoading)
+    {
+        unique_ptr<Image> img(LoadImageFromFile(getTileFilename(lod, u, v)));
+        addStreamedTile(tile, lod, img.get());
+        return;
+    }
+
+    tile->loading = true;
+    tilesInFlight++;
+
+    fs::path filename = getTileFilename(lod, u, v);
+    shared_ptr<LoadQueue> queue = loadQueue;
+    TileLoaderPool().submit([tile, lod, filename, queue]()
+    {
+        unique_ptr<Image> img(LoadImageFromFile(filename));
+
+        lock_guard<mutex> lock(queue->mutex);
+        queue->loaded.push_back({ tile, lod, move(img) });
+    });
+}
+
+
+// Upload the tiles decoded since the last usage
+void VirtualTexture::commitLoadedTiles()
+{
+    vector<LoadedTile> loaded;
+    {
+        lock_guard<mutex> lock(loadQueue->mutex);
+        loaded.swap(loadQueue->loaded);
+    }
+
+    for (auto& loadedTile : loaded)
+    {
+        Tile* tile = loadedTile.tile;
+        tile->loading = false;
+        tilesInFlight--;
+
+        addStreamedTile(tile, loadedTile.lod, loadedTile.image.get());
+    }
+}
+
+
+// Create the texture of a tile loaded on demand and add it to the tiles
+// that may be evicted.
+void VirtualTexture::addStreamedTile(Tile* tile, unsigned int lod, Image* image)
+{
+    if (image != nullptr)
+        tile->tex = createTileTexture(*image, lod);
+    if (tile->tex == nullptr)
+    {
+        tile->loadFailed = true;
+        return;
+    }
+
+    tile->streamed = true;
+    tile->memory = (size_t) image->getSize();
+    tile->lastUsed = ticks;
+    lru.push_front(tile);
+    tile->lruPos = lru.begin();
+    streamedMemory += tile->memory;
+}
+
+
+void VirtualTexture::evictTiles()
+{
+    while (streamedMemory > TileMemoryBudget && !lru.empty())
+    {
+        // The other tiles have all been used more recently
+        Tile* tile = lru.back();
+        if (tile->lastUsed + MinEvictionAge > ticks)
+            break;
+
+        lru.pop_back();
+        streamedMemory -= tile->memory;
+        delete tile->tex;
+        tile->tex = nullptr;
+        tile->streamed = false;
+        tile->memory = 0;
+    }
+}
+
+
+void VirtualTexture::markUsed(Tile* tile)
+{
+    tile->lastUsed = ticks;
+    if (tile->streamed)
+        lru.splice(lru.begin(), lru, tile->lruPos);
+}
+
+
+// Guess from the tiles drawn in this usage and the previous one where the
+// view is going, and start loading the tiles it'll need next: the next
+// tiles over in the direction the view is moving, and the tiles of the
+// next level of detail when it has just increased.
+void VirtualTexture::prefetchTiles()
+{
+    if (requests.empty())
+        return;
+
+    unsigned int lod = 0;
+    for (const auto& request : requests)
+        lod = max(lod, request.lod);
+
+    float centerU = 0.0f;
+    float centerV = 0.0f;
+    unsigned int nRequests = 0;
+    for (const auto& request : requests)
+    {
+        if (request.lod == lod)
+        {
+            centerU += (float) request.u;
+            centerV += (float) request.v;
+            nRequests++;
+        }
+    }
+    centerU /= (float) nRequests;
+    centerV /= (float) nRequests;
+
+    int uTiles = 2 << lod;
+    int vTiles = 1 << lod;
+
+    int du = 0;
+    int dv = 0;
+    if (lod == lastLOD)
+    {
+        // The texture wraps around in u
+        float deltaU = centerU - lastCenterU;
+        if (deltaU > (float) uTiles / 2.0f)
+            deltaU -= (float) uTiles;
+        else if (deltaU < (float) -uTiles / 2.0f)
+            deltaU += (float) uTiles;
+        float deltaV = centerV - lastCenterV;
+
+        du = deltaU > 0.0f ? 1 : (deltaU < 0.0f ? -1 : 0);
+        dv = deltaV > 0.0f ? 1 : (deltaV < 0.0f ? -1 : 0);
+    }
+    bool lodIncreased = lod > lastLOD;
+
+    lastLOD = lod;
+    lastCenterU = centerU;
+    lastCenterV = centerV;
+
+    unsigned int nPrefetched = 0;
+    auto prefetch = [&](unsigned int tileLOD, int u, int v)
+    {
+        if (tileLOD >= nResolutionLevels || v < 0 || v >= (1 << tileLOD))
+            return;
+        u = (u + (2 << tileLOD)) % (2 << tileLOD);
+
+        Tile* tile = findTile(tileLOD, (unsigned int) u, (unsigned int) v);
+        if (tile != nullptr && tile->tex == nullptr && !tile->loading && !tile->loadFailed)
+        {
+            requestTile(tile, tileLOD, (unsigned int) u, (unsigned int) v);
+            nPrefetched++;
+        }
+    };
+
+    for (const auto& request : requests)
+    {
+        if (nPrefetched >= MaxPrefetchTiles || tilesInFlight >= MaxTilesInFlight)
+            break;
+        if (request.lod != lod)
+            continue;
+
+        if (du != 0 || dv != 0)
+            prefetch(lod, (int) request.u + du, (int) request.v + dv);
+        if (lodIncreased)
+        {
+            for (unsigned int i = 0; i < 4; i++)
+                prefetch(lod + 1, (int) (request.u * 2 + (i & 1)), (int) (request.v * 2 + (i >> 1)));
+        }
+    }
+}
+
+
+VirtualTexture::Tile* VirtualTexture::findTile(unsigned int lod,
+                                               unsigned int u, unsigned int v)
+{
+    if (u >= (2u << lod) || v >= (1u << lod))
+        return nullptr;
+
+    TileQuadtreeNode* node = tileTree[u >> lod];
+    for (unsigned int n = 0; n < lod; n++)
+    {
+        unsigned int mask = 1 << (lod - n - 1);
+        unsigned int child = (((v & mask) << 1) | (u & mask)) >> (lod - n - 1);
+        node = node->children[child];
+        if (node == nullptr)
+            return nullptr;
+    }
+
+    return node->tile;
+}
+
+
 void VirtualTexture::populateTileTree()
 {
     // Count the number of resolution levels present
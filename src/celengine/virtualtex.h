@@ -10,7 +10,11 @@
 #ifndef _CELENGINE_VIRTUALTEX_H_
 #define _CELENGINE_VIRTUALTEX_H_
 
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <celengine/texture.h>
 
 
@@ -33,6 +37,11 @@ class VirtualTexture : public Texture
     void beginUsage() override;
     void endUsage() override;
 
+    // Load tiles as soon as they're needed instead of in the background,
+    // so that a frame doesn't depend on how fast the loaders are. Used for
+    // offline rendering.
+    static void setSynchronousLoading(bool);
+
  private:
     struct Tile
     {
@@ -40,6 +49,14 @@ class VirtualTexture : public Texture
         unsigned int lastUsed{ 0 };
         ImageTexture* tex{ nullptr };
         bool loadFailed{ false };
+        bool loading{ false };
+
+        // Tiles loaded in the background are kept in the LRU list and may
+        // be evicted; the coarsest tiles are loaded right away and stay
+        // resident, so there's always a tile to fall back to.
+        bool streamed{ false };
+        size_t memory{ 0 };
+        std::list<Tile*>::iterator lruPos;
     };
 
     struct TileQuadtreeNode
@@ -49,9 +66,40 @@ class VirtualTexture : public Texture
         TileQuadtreeNode* children[4]{ nullptr, nullptr, nullptr, nullptr};
     };
 
+    // Tiles decoded by the loader threads, waiting to be uploaded by the
+    // next beginUsage(). Shared with the loader tasks, which may outlive
+    // the texture.
+    struct LoadedTile
+    {
+        Tile* tile;
+        unsigned int lod;
+        std::unique_ptr<Image> image;
+    };
+
+    struct LoadQueue
+    {
+        std::mutex mutex;
+        std::vector<LoadedTile> loaded;
+    };
+
+    struct TileRequest
+    {
+        unsigned int lod;
+        unsigned int u;
+        unsigned int v;
+    };
+
     void populateTileTree();
     void addTileToTree(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
     void makeResident(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
+    void requestTile(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
+    void commitLoadedTiles();
+    void addStreamedTile(Tile* tile, unsigned int lod, Image* image);
+    void evictTiles();
+    void markUsed(Tile* tile);
+    void prefetchTiles();
+    fs::path getTileFilename(unsigned int lod, unsigned int u, unsigned int v) const;
+    ImageTexture* createTileTexture(Image& img, unsigned int lod);
     ImageTexture* loadTileTexture(unsigned int lod, unsigned int u, unsigned int v);
 
     Tile* tiles{ nullptr };
@@ -75,6 +123,21 @@ class VirtualTexture : public Texture
     };
 
     TileQuadtreeNode* tileTree[2];
+
+    std::shared_ptr<LoadQueue> loadQueue;
+    unsigned int tilesInFlight{ 0 };
+
+    // Streamed tiles, most recently used first
+    std::list<Tile*> lru;
+    size_t streamedMemory{ 0 };
+
+    // Tiles requested since beginUsage(), and the finest level of detail
+    // and its center in the previous usage, from which the prefetch
+    // guesses where the view is going.
+    std::vector<TileRequest> requests;
+    unsigned int lastLOD{ 0 };
+    float lastCenterU{ 0.0f };
+    float lastCenterV{ 0.0f };
 };
 
 
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Compiled trajectory written by xyzv2cheb: positions fitted with
+// Chebyshev polynomials over consecutive segments, which are shorter where
+// the trajectory is harder to fit. The header is followed by segmentCount
+// segment records in time order, then by the coefficients of all
+// segments, everything in native byte order. A segment ends where the
+// next one starts, and the last one at the end time.
+struct ChebyshevBinaryHeader
+{
+    char magic[8];
+    uint16_t byteOrder;
+    uint16_t digits;
+    uint32_t reserved;
+    uint64_t segmentCount;
+    uint64_t coeffCount;
+    double startTime;       // TDB
+    double endTime;         // TDB
+    double boundingRadius;  // km
+};
+
+struct ChebyshevBinarySegment
+{
+    double startTime;       // TDB
+    uint64_t offset;        // index of the first coefficient of the segment
+    uint32_t coeffCount;    // coefficients of x, followed by those of y and z
+    uint32_t reserved;
+};
@@ -0,0 +1,303 @@
+// chebyshevorbit.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Trajectories compiled to piecewise Chebyshev polynomials.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <fmt/printf.h>
+#include <celutil/bytes.h> // __BYTE_ORDER__
+#include <celutil/mappedfile.h>
+#include <celutil/threadpool.h>
+#include <celutil/util.h> // intl.h
+#include "chebyshevbinary.h"
+#include "chebyshevorbit.h"
+#include "orbit.h"
+
+using namespace Eigen;
+using namespace std;
+
+
+// The segment of a time is found through a table built at load time: the
+// valid range is split into cells of equal duration, and each cell stores
+// the first segment overlapping it. A lookup divides to find the cell and
+// steps forward over the segments starting inside it, which are rarely
+// more than one. The file is memory mapped and the coefficients are read
+// from the mapping.
+class ChebyshevOrbit : public CachingOrbit
+{
+ public:
+    ChebyshevOrbit() = default;
+    ~ChebyshevOrbit() override = default;
+
+    bool load(const fs::path& filename);
+
+    double getPeriod() const override;
+    double getBoundingRadius() const override;
+    Vector3d computePosition(double jd) const override;
+    Vector3d computeVelocity(double jd) const override;
+
+    bool isPeriodic() const override;
+    void getValidRange(double& begin, double& end) const override;
+
+ private:
+    void buildCellTable();
+    uint64_t findSegment(double jd) const;
+    void evaluate(double jd, Vector3d* position, Vector3d* velocity) const;
+
+    MappedFile file;
+    const ChebyshevBinarySegment* segments{ nullptr };
+    const double* coeffs{ nullptr };
+    uint64_t segmentCount{ 0 };
+    double startTime{ 0.0 };
+    double endTime{ 0.0 };
+    double boundingRadius{ 0.0 };
+    std::vector<uint64_t> cellSegments;
+    double cellDuration{ 0.0 };
+    mutable uint64_t lastSegment{ 0 };
+};
+
+// The cells are no shorter than the shortest segment, so that a cell
+// overlaps at most two segments where the segments are evenly spread, but
+// there are no more than this number of cells per segment: near close
+// passes the segments can be a million times shorter than elsewhere.
+constexpr const uint64_t MaxCellsPerSegment = 4;
+
+
+bool ChebyshevOrbit::load(const fs::path& filename)
+{
+    if (!file.open(filename))
+    {
+        fmt::fprintf(cerr, _("Error opening %s.\n"), filename);
+        return false;
+    }
+
+    ChebyshevBinaryHeader header;
+    if (file.size() < sizeof(header))
+    {
+        fmt::fprintf(cerr, _("Error reading header of %s.\n"), filename);
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (strncmp(header.magic, "CELCHEB", 8) != 0)
+    {
+        fmt::fprintf(cerr, _("Bad compiled trajectory file %s.\n"), filename);
+        return false;
+    }
+
+    if (header.byteOrder != __BYTE_ORDER__)
+    {
+        fmt::fprintf(cerr, _("Unsupported byte order %i, expected %i.\n"),
+                     header.byteOrder, __BYTE_ORDER__);
+        return false;
+    }
+
+    if (header.digits != std::numeric_limits<double>::digits)
+    {
+        fmt::fprintf(cerr, _("Unsupported digits number %i, expected %i.\n"),
+                     header.digits, std::numeric_limits<double>::digits);
+        return false;
+    }
+
+    // Check that the segments and their coefficients are all inside the
+    // file, so that evaluation doesn't have to.
+    uint64_t maxSegments = (file.size() - sizeof(header)) / sizeof(ChebyshevBinarySegment);
+    if (header.segmentCount == 0 || header.segmentCount > maxSegments ||
+        header.coeffCount > (file.size() - sizeof(header) - header.segmentCount * sizeof(ChebyshevBinarySegment)) / sizeof(double) ||
+        !(header.endTime > header.startTime))
+    {
+        fmt::fprintf(cerr, _("Bad compiled trajectory file %s.\n"), filename);
+        return false;
+    }
+
+    segments = reinterpret_cast<const ChebyshevBinarySegment*>(file.data() + sizeof(header));
+    coeffs = reinterpret_cast<const double*>(segments + header.segmentCount);
+    for (uint64_t i = 0; i < header.segmentCount; i++)
+    {
+        double segmentEnd = i + 1 < header.segmentCount ? segments[i + 1].startTime : header.endTime;
+        if (!(segments[i].startTime < segmentEnd) ||
+            (i == 0 && segments[i].startTime != header.startTime) ||
+            segments[i].coeffCount == 0 ||
+            segments[i].offset > header.coeffCount ||
+            (header.coeffCount - segments[i].offset) / 3 < segments[i].coeffCount)
+        {
+            fmt::fprintf(cerr, _("Bad compiled trajectory file %s.\n"), filename);
+            return false;
+        }
+    }
+
+    segmentCount = header.segmentCount;
+    startTime = header.startTime;
+    endTime = header.endTime;
+    boundingRadius = header.boundingRadius;
+    buildCellTable();
+
+    return true;
+}
+
+
+void ChebyshevOrbit::buildCellTable()
+{
+    double shortestSegment = endTime - startTime;
+    for (uint64_t i = 0; i < segmentCount; i++)
+    {
+        double segmentEnd = i + 1 < segmentCount ? segments[i + 1].startTime : endTime;
+        shortestSegment = min(shortestSegment, segmentEnd - segments[i].startTime);
+    }
+
+    double cellCount = ceil((endTime - startTime) / shortestSegment);
+    cellCount = min(cellCount, (double) (segmentCount * MaxCellsPerSegment));
+    cellDuration = (endTime - startTime) / cellCount;
+
+    cellSegments.resize((size_t) cellCount);
+    uint64_t segment = 0;
+    for (size_t cell = 0; cell < cellSegments.size(); cell++)
+    {
+        double cellStart = startTime + cell * cellDuration;
+        while (segment + 1 < segmentCount && segments[segment + 1].startTime <= cellStart)
+            segment++;
+        cellSegments[cell] = segment;
+    }
+}
+
+
+double ChebyshevOrbit::getPeriod() const
+{
+    return endTime - startTime;
+}
+
+
+double ChebyshevOrbit::getBoundingRadius() const
+{
+    return boundingRadius;
+}
+
+
+bool ChebyshevOrbit::isPeriodic() const
+{
+    return false;
+}
+
+
+void ChebyshevOrbit::getValidRange(double& begin, double& end) const
+{
+    begin = startTime;
+    end = endTime;
+}
+
+
+// Find the last segment starting at or before jd, which must be in the
+// valid range.
+uint64_t ChebyshevOrbit::findSegment(double jd) const
+{
+    // lastSegment is a hint kept by the main thread only
+    bool workerThread = ThreadPool::isWorkerThread();
+    if (!workerThread)
+    {
+        uint64_t n = lastSegment;
+        if (segments[n].startTime <= jd &&
+            (n + 1 == segmentCount || jd < segments[n + 1].startTime))
+        {
+            return n;
+        }
+    }
+
+    size_t cell = min((size_t) ((jd - startTime) / cellDuration), cellSegments.size() - 1);
+    uint64_t n = cellSegments[cell];
+    // Rounding can put jd just before the start of its cell
+    while (n > 0 && segments[n].startTime > jd)
+        n--;
+    while (n + 1 < segmentCount && segments[n + 1].startTime <= jd)
+        n++;
+
+    if (!workerThread)
+        lastSegment = n;
+
+    return n;
+}
+
+
+// Evaluate the position and, unless it's null, the velocity in km/day.
+// Times outside the valid range are clamped to it.
+void ChebyshevOrbit::evaluate(double jd, Vector3d* position, Vector3d* velocity) const
+{
+    jd = max(startTime, min(jd, endTime));
+    uint64_t n = findSegment(jd);
+    const ChebyshevBinarySegment& segment = segments[n];
+    double segmentEnd = n + 1 < segmentCount ? segments[n + 1].startTime : endTime;
+    double segmentDuration = segmentEnd - segment.startTime;
+
+    const double* c = coeffs + segment.offset;
+    unsigned int nCoeffs = segment.coeffCount;
+
+    // Chebyshev polynomials and their derivatives at s in [-1, 1]
+    double s = 2.0 * (jd - segment.startTime) / segmentDuration - 1.0;
+    s = max(-1.0, min(s, 1.0));
+    double t0 = 1.0, t1 = s;
+    double d0 = 0.0, d1 = 1.0;
+
+    Vector3d p(c[0], c[nCoeffs], c[nCoeffs * 2]);
+    Vector3d v(Vector3d::Zero());
+    for (unsigned int k = 1; k < nCoeffs; k++)
+    {
+        Vector3d ck(c[k], c[nCoeffs + k], c[nCoeffs * 2 + k]);
+        p += ck * t1;
+        v += ck * d1;
+
+        double t2 = 2.0 * s * t1 - t0;
+        double d2 = 2.0 * t1 + 2.0 * s * d1 - d0;
+        t0 = t1; t1 = t2;
+        d0 = d1; d1 = d2;
+    }
+
+    // Add correction for Celestia's coordinate system
+    *position = Vector3d(p.x(), p.z(), -p.y());
+    if (velocity != nullptr)
+    {
+        // ds/dt = 2 / segmentDuration
+        v *= 2.0 / segmentDuration;
+        *velocity = Vector3d(v.x(), v.z(), -v.y());
+    }
+}
+
+
+Vector3d ChebyshevOrbit::computePosition(double jd) const
+{
+    Vector3d position;
+    evaluate(jd, &position, nullptr);
+    return position;
+}
+
+
+Vector3d ChebyshevOrbit::computeVelocity(double jd) const
+{
+    Vector3d position, velocity;
+    evaluate(jd, &position, &velocity);
+    return velocity;
+}
+
+
+/*! Load a trajectory compiled by xyzv2cheb.
+ */
+Orbit* LoadChebyshevTrajectory(const fs::path& filename)
+{
+    auto* orbit = new ChebyshevOrbit();
+    if (!orbit->load(filename))
+    {
+        delete orbit;
+        return nullptr;
+    }
+
+    return orbit;
+}
@@ -0,0 +1,18 @@
+// chebyshevorbit.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Trajectories compiled to piecewise Chebyshev polynomials.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <celcompat/filesystem.h>
+
+class Orbit;
+
+extern Orbit* LoadChebyshevTrajectory(const fs::path& filename);
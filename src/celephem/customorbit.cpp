@@ -15,7 +15,6 @@
 #include <celmath/geomutil.h>
 #include <cassert>
 #include <vector>
-#include <fstream>
 #include <fmt/printf.h>
 
 using namespace Eigen;
@@ -3082,10 +3081,29 @@ class JPLEphOrbit : public CachingOrbit
     }
 
     Vector3d computePosition(double tjd) const override
+    {
+        Vector3d position;
+        computeState(tjd, position, nullptr);
+        return position;
+    }
+
+    Vector3d computeVelocity(double tjd) const override
+    {
+        Vector3d position, velocity;
+        computeState(tjd, position, &velocity);
+        return velocity;
+    }
+
+ private:
+    void computeState(double tjd, Vector3d& position, Vector3d* velocity) const
     {
         // Get the position relative to the Earth (for the Moon) or
-        // the solar system barycenter.
-        Vector3d pos = ephem.getPlanetPosition(target, tjd);
+        // the solar system barycenter. The target, the center, and the
+        // Earth when the Moon has to be translated are evaluated together.
+        JPLEphemItem items[3] = { target, center, JPLEph_Earth };
+        Vector3d pos[3];
+        Vector3d vel[3] = { Vector3d::Zero(), Vector3d::Zero(), Vector3d::Zero() };
+        unsigned int nItems = 1;
 
         if (center == JPLEph_SSB && target != JPLEph_Moon)
         {
@@ -3097,28 +3115,41 @@ class JPLEphOrbit : public CachingOrbit
         }
         else
         {
-            Vector3d centerPos = ephem.getPlanetPosition(center, tjd);
+            nItems = (target == JPLEph_Moon || center == JPLEph_Moon) ? 3 : 2;
+        }
+
+        ephem.getPlanetStates(items, nItems, tjd, pos, velocity != nullptr ? vel : nullptr);
+
+        if (nItems > 1)
+        {
             if (target == JPLEph_Moon)
             {
-                pos += ephem.getPlanetPosition(JPLEph_Earth, tjd);
+                pos[0] += pos[2];
+                vel[0] += vel[2];
             }
             if (center == JPLEph_Moon)
             {
-                centerPos += ephem.getPlanetPosition(JPLEph_Earth, tjd);
+                pos[1] += pos[2];
+                vel[1] += vel[2];
             }
 
-            // Compute the position of target relative to the center
-            pos -= centerPos;
+            // Compute the state of target relative to the center
+            pos[0] -= pos[1];
+            vel[0] -= vel[1];
         }
 
-        // Rotate from the J2000 mean equator to the ecliptic
-        pos = XRotation(-astro::J2000Obliquity) * pos;
-
-        // Convert to Celestia's coordinate system
-        return Vector3d(pos.x(), pos.z(), -pos.y());
+        // Rotate from the J2000 mean equator to the ecliptic, and convert
+        // to Celestia's coordinate system
+        Quaterniond rotation = XRotation(-astro::J2000Obliquity);
+        Vector3d p = rotation * pos[0];
+        position = Vector3d(p.x(), p.z(), -p.y());
+        if (velocity != nullptr)
+        {
+            Vector3d v = rotation * vel[0];
+            *velocity = Vector3d(v.x(), v.z(), -v.y());
+        }
     }
 
- private:
     const JPLEphemeris& ephem;
     JPLEphemItem target;
     JPLEphemItem center;
@@ -3155,9 +3186,7 @@ Orbit* GetCustomOrbit(const string& name)
     if (!jplephInitialized)
     {
         jplephInitialized = true;
-        ifstream in("data/jpleph.dat", ios::in | ios::binary);
-        if (in.good())
-            jpleph = JPLEphemeris::load(in);
+        jpleph = JPLEphemeris::load("data/jpleph.dat");
         if (jpleph != nullptr)
         {
            fmt::fprintf(clog, "Loaded DE%u ephemeris. Valid from JD %.8lf to JD %.8lf\n",
@@ -7,22 +7,17 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 //
-// Load JPL's DE200, DE405, and DE406 ephemerides and compute planet
-// positions.
+// Load JPL's DE ephemerides (DE200 and later, including DE430 and DE440)
+// and compute planet positions.
 
-#include <fstream>
-#include <iomanip>
-#include <cassert>
-#include <celutil/bytes.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include "jpleph.h"
 
 using namespace Eigen;
 using namespace std;
 
-static const unsigned int DE200RecordSize    =  826;
-static const unsigned int DE405RecordSize    = 1018;
-static const unsigned int DE406RecordSize    =  728;
-
 static const unsigned int NConstants         =  400;
 static const unsigned int ConstantNameLength =  6;
 
@@ -30,33 +25,48 @@ static const unsigned int MaxChebyshevCoeffs = 32;
 
 static const int LabelSize = 84;
 
+// Byte offsets of the header fields in the first record
+static const size_t StartDateOffset      = LabelSize * 3 + NConstants * ConstantNameLength;
+static const size_t NConstantsOffset     = StartDateOffset + 24;
+static const size_t AUOffset             = NConstantsOffset + 4;
+static const size_t EMRatioOffset        = AUOffset + 8;
+static const size_t CoeffInfoOffset      = EMRatioOffset + 8;
+static const size_t DENumberOffset       = CoeffInfoOffset + JPLEph_NItems * 12;
+static const size_t LibrationInfoOffset  = DENumberOffset + 4;
+static const size_t ExtraConstantsOffset = LibrationInfoOffset + 12;
+
+// Item 11 of the coefficient table is the nutation, which has only two
+// components. Celestia computes the Earth from the Earth-Moon barycenter
+// and the Moon instead.
+static const unsigned int NutationItem = 11;
+
 
-// Read a big-endian 32-bit unsigned integer
-static int32_t readUint(istream& in)
+static uint32_t readUint(const char* p, bool swapBytes)
 {
-    int32_t ret;
-    in.read((char*) &ret, sizeof(int32_t));
-    BE_TO_CPU_INT32(ret, ret);
-    return (uint32_t) ret;
+    unsigned char b[4];
+    memcpy(b, p, 4);
+    if (swapBytes)
+        reverse(b, b + 4);
+
+    uint32_t n;
+    memcpy(&n, b, 4);
+    return n;
 }
 
-// Read a big-endian 64-bit IEEE double--if the native double format isn't
-// IEEE 754, there will be troubles.
-static double readDouble(istream& in)
+// If the native double format isn't IEEE 754, there will be troubles.
+static double readDouble(const char* p, bool swapBytes)
 {
+    unsigned char b[8];
+    memcpy(b, p, 8);
+    if (swapBytes)
+        reverse(b, b + 8);
+
     double d;
-    in.read((char*) &d, sizeof(double));
-    BE_TO_CPU_DOUBLE(d, d);
+    memcpy(&d, b, 8);
     return d;
 }
 
 
-JPLEphRecord::~JPLEphRecord()
-{
-    delete coeffs;
-}
-
-
 unsigned int JPLEphemeris::getDENumber() const
 {
     return DENum;
@@ -73,192 +83,328 @@ double JPLEphemeris::getEndDate() const
 }
 
 
+// The Chebyshev polynomials and their derivatives at one time, for the
+// items with nGranules subdivisions of a record.
+struct JPLEphemeris::ChebyshevBasis
+{
+    unsigned int nGranules;
+    unsigned int granule;
+    unsigned int nCoeffs;       // number of polynomials computed so far
+    double u;
+    double T[MaxChebyshevCoeffs];
+    double dT[MaxChebyshevCoeffs];
+};
+
+
 // Return the position of an object relative to the solar system barycenter
 // or the Earth (in the case of the Moon) at a specified TDB Julian date tjd.
 // If tjd is outside the span covered by the ephemeris it is clamped to a
 // valid time.
 Vector3d JPLEphemeris::getPlanetPosition(JPLEphemItem planet, double tjd) const
 {
-    // Solar system barycenter is the origin
-    if (planet == JPLEph_SSB)
-    {
-        return Vector3d::Zero();
-    }
-
-    // The position of the Earth must be computed from the positions of the
-    // Earth-Moon barycenter and Moon
-    if (planet == JPLEph_Earth)
-    {
-        Vector3d embPos = getPlanetPosition(JPLEph_EarthMoonBary, tjd);
-
-        // Get the geocentric position of the Moon
-        Vector3d moonPos = getPlanetPosition(JPLEph_Moon, tjd);
+    Vector3d position;
+    getPlanetStates(&planet, 1, tjd, &position, nullptr);
+    return position;
+}
 
-        return embPos - moonPos * (1.0 / (earthMoonMassRatio + 1.0));
-    }
 
+void JPLEphemeris::getPlanetStates(const JPLEphemItem* items, unsigned int nItems, double tjd,
+                                   Vector3d* positions, Vector3d* velocities) const
+{
     // Clamp time to [ startDate, endDate ]
     if (tjd < startDate)
         tjd = startDate;
     else if (tjd > endDate)
-    tjd = endDate;
+        tjd = endDate;
 
     // recNo is always >= 0:
     auto recNo = (unsigned int) ((tjd - startDate) / daysPerInterval);
     // Make sure we don't go past the end of the array if t == endDate
-    if (recNo >= records.size())
-        recNo = records.size() - 1;
-    const JPLEphRecord* rec = &records[recNo];
+    if (recNo >= nRecords)
+        recNo = nRecords - 1;
 
-    assert(coeffInfo[planet].nGranules >= 1);
-    assert(coeffInfo[planet].nGranules <= 32);
-    assert(coeffInfo[planet].nCoeffs <= MaxChebyshevCoeffs);
+    // The first two doubles of a record are its start and end time
+    const double* rec = records + (size_t) recNo * recordSize;
 
-    // u is the normalized time (in [-1, 1]) for interpolating
-    // coeffs is a pointer to the Chebyshev coefficients
-    double u = 0.0;
-    double* coeffs = nullptr;
+    // Items are usually split in one of a few numbers of granules, so
+    // there are few distinct bases.
+    ChebyshevBasis bases[JPLEph_NItems];
+    unsigned int nBases = 0;
 
-    // nGranules is unsigned int so it will be compared against FFFFFFFF:
-    if (coeffInfo[planet].nGranules == (unsigned int) -1)
-    {
-        coeffs = rec->coeffs + coeffInfo[planet].offset;
-        u = 2.0 * (tjd - rec->t0) / daysPerInterval - 1.0;
-    }
-    else
+    Vector3d itemPositions[JPLEph_NItems];
+    Vector3d itemVelocities[JPLEph_NItems];
+    bool evaluated[JPLEph_NItems] = { false };
+    auto evaluateItem = [&](unsigned int item)
     {
-    double daysPerGranule = daysPerInterval / coeffInfo[planet].nGranules;
-    auto granule = (int) ((tjd - rec->t0) / daysPerGranule);
-    double granuleStartDate = rec->t0 + daysPerGranule * (double) granule;
-    coeffs = rec->coeffs + coeffInfo[planet].offset +
-            granule * coeffInfo[planet].nCoeffs * 3;
-    u = 2.0 * (tjd - granuleStartDate) / daysPerGranule - 1.0;
-    }
+        if (!evaluated[item])
+        {
+            evaluate(item, rec, tjd, bases, nBases, itemPositions[item],
+                     velocities != nullptr ? &itemVelocities[item] : nullptr);
+            evaluated[item] = true;
+        }
+    };
 
-    // Evaluate the Chebyshev polynomials
-    double sum[3];
-    double cc[MaxChebyshevCoeffs];
-    unsigned int nCoeffs = coeffInfo[planet].nCoeffs;
-    for (int i = 0; i < 3; i++)
+    for (unsigned int i = 0; i < nItems; i++)
     {
-        cc[0] = 1.0;
-        cc[1] = u;
-        sum[i] = coeffs[i * nCoeffs] + coeffs[i * nCoeffs + 1] * u;
-        for (unsigned int j = 2; j < nCoeffs; j++)
+        JPLEphemItem item = items[i];
+        Vector3d velocity = Vector3d::Zero();
+
+        if (item == JPLEph_SSB)
         {
-            cc[j] = 2.0 * u * cc[j - 1] - cc[j - 2];
-            sum[i] += coeffs[i * nCoeffs + j] * cc[j];
+            // Solar system barycenter is the origin
+            positions[i] = Vector3d::Zero();
+        }
+        else if (item == JPLEph_Earth)
+        {
+            // The position of the Earth must be computed from the positions
+            // of the Earth-Moon barycenter and the geocentric Moon
+            evaluateItem(JPLEph_EarthMoonBary);
+            evaluateItem(JPLEph_Moon);
+
+            double moonFactor = 1.0 / (earthMoonMassRatio + 1.0);
+            positions[i] = itemPositions[JPLEph_EarthMoonBary] - itemPositions[JPLEph_Moon] * moonFactor;
+            velocity = itemVelocities[JPLEph_EarthMoonBary] - itemVelocities[JPLEph_Moon] * moonFactor;
+        }
+        else
+        {
+            evaluateItem(item);
+            positions[i] = itemPositions[item];
+            velocity = itemVelocities[item];
         }
-    }
 
-    return Vector3d(sum[0], sum[1], sum[2]);
+        if (velocities != nullptr)
+            velocities[i] = velocity;
+    }
 }
 
 
-JPLEphemeris* JPLEphemeris::load(istream& in)
+void JPLEphemeris::getPlanetStates(JPLEphemItem item, const double* tjd, unsigned int nTimes,
+                                   Vector3d* positions, Vector3d* velocities) const
 {
-    JPLEphemeris* eph = nullptr;
+    for (unsigned int i = 0; i < nTimes; i++)
+    {
+        getPlanetStates(&item, 1, tjd[i], positions + i,
+                        velocities != nullptr ? velocities + i : nullptr);
+    }
+}
 
-    // Skip past three header labels
-    in.ignore(LabelSize * 3);
-    if (!in.good())
-        return nullptr;
 
-    // Skip past the constant names
-    in.ignore(NConstants * ConstantNameLength);
-    if (!in.good())
-        return nullptr;
+// Evaluate the Chebyshev series of an item in the record rec. The basis
+// for the granule containing t is looked up in bases, and added to it
+// if it isn't there yet.
+void JPLEphemeris::evaluate(unsigned int item, const double* rec, double tjd,
+                            ChebyshevBasis* bases, unsigned int& nBases,
+                            Vector3d& position, Vector3d* velocity) const
+{
+    const JPLEphCoeffInfo& info = coeffInfo[item];
+    unsigned int nCoeffs = info.nCoeffs;
 
-    eph = new JPLEphemeris();
+    ChebyshevBasis* basis = nullptr;
+    for (unsigned int i = 0; i < nBases; i++)
+    {
+        if (bases[i].nGranules == info.nGranules)
+            basis = &bases[i];
+    }
 
-    // Read the start time, end time, and time interval
-    eph->startDate = readDouble(in);
-    eph->endDate = readDouble(in);
-    eph->daysPerInterval = readDouble(in);
-    if (!in.good())
+    if (basis == nullptr)
     {
-        delete eph;
-        return nullptr;
+        double t0 = getCoeff(rec);
+        double daysPerGranule = daysPerInterval / info.nGranules;
+
+        basis = &bases[nBases++];
+        basis->nGranules = info.nGranules;
+        basis->granule = min((unsigned int) ((tjd - t0) / daysPerGranule), info.nGranules - 1);
+        // u is the normalized time (in [-1, 1]) for interpolating
+        basis->u = 2.0 * (tjd - (t0 + daysPerGranule * (double) basis->granule)) / daysPerGranule - 1.0;
+        basis->T[0] = 1.0;
+        basis->T[1] = basis->u;
+        basis->dT[0] = 0.0;
+        basis->dT[1] = 1.0;
+        basis->nCoeffs = 2;
     }
 
-    // Number of constants with valid values; not useful for us
-    (void) readUint(in);
+    // Items with the same granules may have different numbers of
+    // coefficients; extend the basis as needed.
+    double u = basis->u;
+    for (unsigned int j = basis->nCoeffs; j < nCoeffs; j++)
+    {
+        basis->T[j] = 2.0 * u * basis->T[j - 1] - basis->T[j - 2];
+        basis->dT[j] = 2.0 * basis->T[j - 1] + 2.0 * u * basis->dT[j - 1] - basis->dT[j - 2];
+    }
+    basis->nCoeffs = max(basis->nCoeffs, nCoeffs);
 
-    eph->au = readDouble(in);     // kilometers per astronomical unit
-    eph->earthMoonMassRatio = readDouble(in);
+    // coeffs is a pointer to the Chebyshev coefficients of x, y and z;
+    // files in the other byte order are converted first.
+    const double* coeffs = rec + 2 + info.offset + basis->granule * nCoeffs * 3;
+    double swapped[MaxChebyshevCoeffs * 3];
+    if (swapBytes)
+    {
+        for (unsigned int j = 0; j < nCoeffs * 3; j++)
+            swapped[j] = getCoeff(coeffs + j);
+        coeffs = swapped;
+    }
 
-    // Read the coefficient information for each item in the ephemeris
-    unsigned int i;
-    for (i = 0; i < JPLEph_NItems; i++)
+    const double* cx = coeffs;
+    const double* cy = coeffs + nCoeffs;
+    const double* cz = coeffs + nCoeffs * 2;
+    double x = 0.0, y = 0.0, z = 0.0;
+    for (unsigned int j = 0; j < nCoeffs; j++)
     {
-        eph->coeffInfo[i].offset = readUint(in) - 3;
-        eph->coeffInfo[i].nCoeffs = readUint(in);
-        eph->coeffInfo[i].nGranules = readUint(in);
+        x += cx[j] * basis->T[j];
+        y += cy[j] * basis->T[j];
+        z += cz[j] * basis->T[j];
     }
-    if (!in.good())
+    position = Vector3d(x, y, z);
+
+    if (velocity != nullptr)
+    {
+        double vx = 0.0, vy = 0.0, vz = 0.0;
+        for (unsigned int j = 1; j < nCoeffs; j++)
+        {
+            vx += cx[j] * basis->dT[j];
+            vy += cy[j] * basis->dT[j];
+            vz += cz[j] * basis->dT[j];
+        }
+
+        // du/dt = 2 / daysPerGranule
+        *velocity = Vector3d(vx, vy, vz) * (2.0 * info.nGranules / daysPerInterval);
+    }
+}
+
+
+double JPLEphemeris::getCoeff(const double* p) const
+{
+    return readDouble(reinterpret_cast<const char*>(p), swapBytes);
+}
+
+
+JPLEphemeris* JPLEphemeris::load(const fs::path& filename)
+{
+    auto* eph = new JPLEphemeris();
+    if (!eph->file.open(filename) || eph->file.size() < ExtraConstantsOffset)
     {
         delete eph;
         return nullptr;
     }
 
-    eph->DENum = readUint(in);
+    const char* header = eph->file.data();
 
-    switch (eph->DENum)
+    // JPL distributes big endian files for some platforms and little
+    // endian ones for others; the DE number tells which one this is.
+    uint32_t DENum = readUint(header + DENumberOffset, false);
+    eph->swapBytes = DENum == 0 || DENum > 9999;
+    if (eph->swapBytes)
+        DENum = readUint(header + DENumberOffset, true);
+    if (DENum == 0 || DENum > 9999)
     {
-    case 200:
-        eph->recordSize = DE200RecordSize;
-        break;
-    case 405:
-        eph->recordSize = DE405RecordSize;
-        break;
-    case 406:
-        eph->recordSize = DE406RecordSize;
-        break;
-    default:
         delete eph;
         return nullptr;
     }
+    eph->DENum = DENum;
+    bool swapBytes = eph->swapBytes;
 
-    eph->librationCoeffInfo.offset        = readUint(in);
-    eph->librationCoeffInfo.nCoeffs       = readUint(in);
-    eph->librationCoeffInfo.nGranules     = readUint(in);
-    if (!in.good())
+    // Read the start time, end time, and time interval
+    eph->startDate = readDouble(header + StartDateOffset, swapBytes);
+    eph->endDate = readDouble(header + StartDateOffset + 8, swapBytes);
+    eph->daysPerInterval = readDouble(header + StartDateOffset + 16, swapBytes);
+    if (!(eph->daysPerInterval > 0.0) || !(eph->endDate > eph->startDate))
     {
         delete eph;
         return nullptr;
     }
 
-    // Skip past the rest of the record
-    in.ignore(eph->recordSize * 8 - 2856);
-    // The next record contains constant values (which we don't need)
-    in.ignore(eph->recordSize * 8);
-    if (!in.good())
+    eph->au = readDouble(header + AUOffset, swapBytes);     // kilometers per astronomical unit
+    eph->earthMoonMassRatio = readDouble(header + EMRatioOffset, swapBytes);
+
+    // The record size isn't stored in the file; it's the end of the
+    // coefficients of the last item. Offsets are one based and count
+    // the start and end time of the record, so anything below 3 means a
+    // corrupt file.
+    unsigned int recordSize = 0;
+    bool corrupt = false;
+    auto addItem = [&](uint32_t offset, uint32_t nCoeffs, uint32_t nGranules, unsigned int nComponents)
+    {
+        if (nCoeffs == 0)
+            return;
+
+        uint64_t end = (uint64_t) offset - 1 + (uint64_t) nCoeffs * nGranules * nComponents;
+        if (offset < 3 || end > UINT32_MAX / 8)
+            corrupt = true;
+        else
+            recordSize = max(recordSize, (unsigned int) end);
+    };
+
+    // Read the coefficient information for each item in the ephemeris
+    unsigned int i;
+    for (i = 0; i < JPLEph_NItems; i++)
+    {
+        const char* info = header + CoeffInfoOffset + i * 12;
+        uint32_t offset = readUint(info, swapBytes);
+        uint32_t nCoeffs = readUint(info + 4, swapBytes);
+        uint32_t nGranules = readUint(info + 8, swapBytes);
+        addItem(offset, nCoeffs, nGranules, i == NutationItem ? 2 : 3);
+
+        eph->coeffInfo[i].offset = offset >= 3 ? offset - 3 : 0;
+        eph->coeffInfo[i].nCoeffs = nCoeffs;
+        eph->coeffInfo[i].nGranules = nGranules;
+    }
+
+    eph->librationCoeffInfo.offset        = readUint(header + LibrationInfoOffset, swapBytes);
+    eph->librationCoeffInfo.nCoeffs       = readUint(header + LibrationInfoOffset + 4, swapBytes);
+    eph->librationCoeffInfo.nGranules     = readUint(header + LibrationInfoOffset + 8, swapBytes);
+    addItem(eph->librationCoeffInfo.offset,
+            eph->librationCoeffInfo.nCoeffs,
+            eph->librationCoeffInfo.nGranules, 3);
+
+    // DE430 and later have more than 400 constants; the names of the
+    // extra ones come next, followed by the coefficient information of
+    // the lunar mantle angular velocity and of TT-TDB when present.
+    uint32_t nConstants = readUint(header + NConstantsOffset, swapBytes);
+    if (nConstants > NConstants)
+    {
+        size_t extraInfoOffset = ExtraConstantsOffset + (nConstants - NConstants) * ConstantNameLength;
+        for (unsigned int j = 0; j < 2 && extraInfoOffset + 12 <= eph->file.size(); j++)
+        {
+            const char* info = header + extraInfoOffset + j * 12;
+            addItem(readUint(info, swapBytes), readUint(info + 4, swapBytes),
+                    readUint(info + 8, swapBytes), j == 0 ? 3 : 1);
+        }
+    }
+
+    // The first record is the header and the second holds the values of
+    // the constants, which we don't need.
+    eph->recordSize = recordSize;
+    double nIntervals = (eph->endDate - eph->startDate) / eph->daysPerInterval;
+    if (nIntervals > (double) (eph->file.size() / 8))
+        corrupt = true;
+    else
+        eph->nRecords = (unsigned int) nIntervals;
+    if (corrupt || recordSize * 8 < ExtraConstantsOffset || recordSize < nConstants ||
+        eph->nRecords == 0 ||
+        eph->file.size() / (recordSize * 8) < (size_t) eph->nRecords + 2)
     {
         delete eph;
         return nullptr;
     }
 
-    auto nRecords = (unsigned int) ((eph->endDate - eph->startDate) /
-                        eph->daysPerInterval);
-    eph->records.resize(nRecords);
-    for (i = 0; i < nRecords; i++)
+    // Check the coefficients of the planets so that evaluating them
+    // can't go past the end of a record.
+    for (i = 0; i < JPLEph_NItems; i++)
     {
-        eph->records[i].t0 = readDouble(in);
-        eph->records[i].t1 = readDouble(in);
+        if (i == NutationItem)
+            continue;
 
-        // Allocate coefficient array for this record; the first two
-        // 'coefficients' are actually the start and end time (t0 and t1)
-        eph->records[i].coeffs = new double[eph->recordSize - 2];
-        for (unsigned int j = 0; j < eph->recordSize - 2; j++)
-            eph->records[i].coeffs[j] = readDouble(in);
-
-        // Make sure that we read this record successfully
-        if (!in.good())
+        const JPLEphCoeffInfo& info = eph->coeffInfo[i];
+        if (info.nCoeffs < 2 || info.nCoeffs > MaxChebyshevCoeffs ||
+            info.nGranules < 1 || info.nGranules > 32 ||
+            info.offset + info.nCoeffs * info.nGranules * 3 > recordSize - 2)
         {
             delete eph;
             return nullptr;
         }
     }
 
+    eph->records = reinterpret_cast<const double*>(header + (size_t) recordSize * 8 * 2);
+
     return eph;
 }
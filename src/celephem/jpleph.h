@@ -7,15 +7,15 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 //
-// Load JPL's DE200, DE405, and DE406 ephemerides and compute planet
-// positions.
+// Load JPL's DE ephemerides (DE200 and later, including DE430 and DE440)
+// and compute planet positions.
 
 #ifndef _CELENGINE_JPLEPH_H_
 #define _CELENGINE_JPLEPH_H_
 
-#include <iostream>
-#include <vector>
 #include <Eigen/Core>
+#include <celcompat/filesystem.h>
+#include <celutil/mappedfile.h>
 
 enum JPLEphemItem
 {
@@ -45,17 +45,8 @@ struct JPLEphCoeffInfo
 };
 
 
-struct JPLEphRecord
-{
-    JPLEphRecord() = default;
-    ~JPLEphRecord();
-
-    double t0{ 0.0 };
-    double t1{ 0.0 };
-    double* coeffs{ nullptr };
-};
-
-
+// The ephemeris file is memory mapped, and only the records evaluated are
+// read. Files in either byte order are accepted.
 class JPLEphemeris
 {
 private:
@@ -66,13 +57,32 @@ public:
 
     Eigen::Vector3d getPlanetPosition(JPLEphemItem, double t) const;
 
-    static JPLEphemeris* load(std::istream&);
+    // Positions and, unless velocities is null, velocities in km/day of
+    // several items at the same time. The Chebyshev polynomials are
+    // computed once for all the items sharing a subdivision of the
+    // record, and the Earth-Moon barycenter and Moon once for the Earth.
+    void getPlanetStates(const JPLEphemItem* items, unsigned int nItems, double t,
+                         Eigen::Vector3d* positions, Eigen::Vector3d* velocities) const;
+
+    // Positions and, unless velocities is null, velocities in km/day of
+    // one item at several times.
+    void getPlanetStates(JPLEphemItem item, const double* t, unsigned int nTimes,
+                         Eigen::Vector3d* positions, Eigen::Vector3d* velocities) const;
+
+    static JPLEphemeris* load(const fs::path& filename);
 
     unsigned int getDENumber() const;
     double getStartDate() const;
     double getEndDate() const;
 
 private:
+    struct ChebyshevBasis;
+
+    double getCoeff(const double* p) const;
+    void evaluate(unsigned int item, const double* rec, double t,
+                  ChebyshevBasis* bases, unsigned int& nBases,
+                  Eigen::Vector3d& position, Eigen::Vector3d* velocity) const;
+
     JPLEphCoeffInfo coeffInfo[JPLEph_NItems];
     JPLEphCoeffInfo librationCoeffInfo;
 
@@ -85,8 +95,11 @@ private:
 
     unsigned int DENum;       // ephemeris version
     unsigned int recordSize;  // number of doubles per record
+    unsigned int nRecords;
+    bool swapBytes;           // file byte order differs from ours
 
-    std::vector<JPLEphRecord> records;
+    MappedFile file;
+    const double* records;    // first data record
 };
 
 #endif // _CELENGINE_JPLEPH_H_
@@ -13,8 +13,10 @@
 #include <celmath/mathlib.h>
 #include <celmath/solve.h>
 #include <celmath/geomutil.h>
+#include <celutil/threadpool.h>
 #include <functional>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cassert>
 
@@ -433,8 +435,64 @@ double EllipticalOrbit::getBoundingRadius() const
 }
 
 
+namespace
+{
+// The cache of an orbit belongs to the main thread. Worker threads, such
+// as those of the eclipse finder, have a few cache entries of their own
+// instead, shared by all orbits.
+struct WorkerCacheEntry
+{
+    uint64_t key{ 0 };
+    double time{ 0.0 };
+    Vector3d position;
+    Vector3d velocity;
+    bool positionValid{ false };
+    bool velocityValid{ false };
+};
+
+constexpr const unsigned int WorkerCacheSize = 16;
+thread_local WorkerCacheEntry workerCache[WorkerCacheSize];
+
+// Return the entry of the orbit at jd, emptying it if it held another
+// position. Computing a position may use other entries, so an entry is
+// looked up again to store the result.
+WorkerCacheEntry& workerCacheEntry(uint64_t key, double jd)
+{
+    WorkerCacheEntry& entry = workerCache[key % WorkerCacheSize];
+    if (entry.key != key || entry.time != jd)
+    {
+        entry.key = key;
+        entry.time = jd;
+        entry.positionValid = false;
+        entry.velocityValid = false;
+    }
+    return entry;
+}
+}
+
+
+uint64_t CachingOrbit::newWorkerCacheKey()
+{
+    static atomic<uint64_t> nextKey{ 1 };
+    return nextKey++;
+}
+
+
 Vector3d CachingOrbit::positionAtTime(double jd) const
 {
+    if (ThreadPool::isWorkerThread())
+    {
+        const WorkerCacheEntry& cached = workerCacheEntry(workerCacheKey, jd);
+        if (cached.positionValid)
+            return cached.position;
+
+        Vector3d position = computePosition(jd);
+        WorkerCacheEntry& entry = workerCacheEntry(workerCacheKey, jd);
+        entry.position = position;
+        entry.positionValid = true;
+        return position;
+    }
+
     if (jd != lastTime)
     {
         lastTime = jd;
@@ -454,6 +512,19 @@ Vector3d CachingOrbit::positionAtTime(double jd) const
 
 Vector3d CachingOrbit::velocityAtTime(double jd) const
 {
+    if (ThreadPool::isWorkerThread())
+    {
+        const WorkerCacheEntry& cached = workerCacheEntry(workerCacheKey, jd);
+        if (cached.velocityValid)
+            return cached.velocity;
+
+        Vector3d velocity = computeVelocity(jd);
+        WorkerCacheEntry& entry = workerCacheEntry(workerCacheKey, jd);
+        entry.velocity = velocity;
+        entry.velocityValid = true;
+        return velocity;
+    }
+
     if (jd != lastTime)
     {
         lastVelocity = computeVelocity(jd);
@@ -11,6 +11,7 @@
 #define _CELENGINE_ORBIT_H_
 
 #include <Eigen/Core>
+#include <cstdint>
 
 
 class OrbitSampleProc;
@@ -124,6 +125,10 @@ class CachingOrbit : public Orbit
     mutable double lastTime{ -1.0e30 };
     mutable bool positionCacheValid{ false };
     mutable bool velocityCacheValid{ false };
+
+    // Identifies the orbit in the caches of the worker threads
+    uint64_t workerCacheKey{ newWorkerCacheKey() };
+    static uint64_t newWorkerCacheKey();
 };
 
 
@@ -14,6 +14,7 @@
 #include "rotation.h"
 #include <celmath/geomutil.h>
 #include <celmath/mathlib.h>
+#include <celutil/threadpool.h>
 #include <cmath>
 
 using namespace Eigen;
@@ -67,6 +68,10 @@ CachingRotationModel::CachingRotationModel() :
 Quaterniond
 CachingRotationModel::spin(double tjd) const
 {
+    // The cache belongs to the main thread
+    if (ThreadPool::isWorkerThread())
+        return computeSpin(tjd);
+
     if (tjd != lastTime)
     {
         lastTime = tjd;
@@ -88,6 +93,9 @@ CachingRotationModel::spin(double tjd) const
 Quaterniond
 CachingRotationModel::equatorOrientationAtTime(double tjd) const
 {
+    if (ThreadPool::isWorkerThread())
+        return computeEquatorOrientation(tjd);
+
     if (tjd != lastTime)
     {
         lastTime = tjd;
@@ -109,6 +117,9 @@ CachingRotationModel::equatorOrientationAtTime(double tjd) const
 Vector3d
 CachingRotationModel::angularVelocityAtTime(double tjd) const
 {
+    if (ThreadPool::isWorkerThread())
+        return computeAngularVelocity(tjd);
+
     if (tjd != lastTime)
     {
         lastAngularVelocity = computeAngularVelocity(tjd);
@@ -16,6 +16,7 @@
 #include <celengine/astro.h>
 #include <celmath/mathlib.h>
 #include <celutil/bytes.h>
+#include <celutil/threadpool.h>
 #include <celutil/util.h> // intl.h
 #include <cmath>
 #include <string>
@@ -177,7 +178,9 @@ template <typename T> Vector3d SampledOrbit<T>::computePosition(double jd) const
     {
         Sample<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        // lastSample is a hint kept by the main thread only
+        bool workerThread = ThreadPool::isWorkerThread();
+        int n = workerThread ? 0 : lastSample;
 
         if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
         {
@@ -189,7 +192,8 @@ template <typename T> Vector3d SampledOrbit<T>::computePosition(double jd) const
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            if (!workerThread)
+                lastSample = n;
         }
 
         if (n == 0)
@@ -292,7 +296,9 @@ template <typename T> Vector3d SampledOrbit<T>::computeVelocity(double jd) const
     {
         Sample<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        // lastSample is a hint kept by the main thread only
+        bool workerThread = ThreadPool::isWorkerThread();
+        int n = workerThread ? 0 : lastSample;
 
         if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
         {
@@ -303,7 +309,8 @@ template <typename T> Vector3d SampledOrbit<T>::computeVelocity(double jd) const
                 n = samples.size();
             else
                 n = iter - samples.begin();
-            lastSample = n;
+            if (!workerThread)
+                lastSample = n;
         }
 
         if (n == 0)
@@ -529,7 +536,9 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computePosition(double jd) c
     {
         SampleXYZV<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        // lastSample is a hint kept by the main thread only
+        bool workerThread = ThreadPool::isWorkerThread();
+        int n = workerThread ? 0 : lastSample;
 
         if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
         {
@@ -541,7 +550,8 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computePosition(double jd) c
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            if (!workerThread)
+                lastSample = n;
         }
 
         if (n == 0)
@@ -600,7 +610,9 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computeVelocity(double jd) c
     {
         SampleXYZV<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        // lastSample is a hint kept by the main thread only
+        bool workerThread = ThreadPool::isWorkerThread();
+        int n = workerThread ? 0 : lastSample;
 
         if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
         {
@@ -612,7 +624,8 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computeVelocity(double jd) c
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            if (!workerThread)
+                lastSample = n;
         }
 
         if (n > 0 && n < (int) samples.size())
@@ -14,6 +14,7 @@
 #include "samporient.h"
 #include <celmath/mathlib.h>
 #include <celmath/geomutil.h>
+#include <celutil/threadpool.h>
 #include <cmath>
 #include <cassert>
 #include <string>
@@ -165,7 +166,9 @@ SampledOrientation::getOrientation(double tjd) const
     {
         OrientationSample samp;
         samp.t = tjd;
-        int n = lastSample;
+        // lastSample is a hint kept by the main thread only
+        bool workerThread = ThreadPool::isWorkerThread();
+        int n = workerThread ? 0 : lastSample;
 
         // Do a binary search to find the samples that define the orientation
         // at the current time. Cache the previous sample used and avoid
@@ -180,7 +183,8 @@ SampledOrientation::getOrientation(double tjd) const
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            if (!workerThread)
+                lastSample = n;
         }
 
         if (n == 0)
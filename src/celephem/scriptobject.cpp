@@ -9,6 +9,7 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <atomic>
 #include <fmt/printf.h>
 
 #include "scriptobject.h"
@@ -20,7 +21,7 @@ using namespace std;
 static lua_State* scriptObjectLuaState = NULL;
 
 static const char* ScriptedObjectNamePrefix = "cel_script_object_";
-static unsigned int ScriptedObjectNameIndex = 1;
+static std::atomic<unsigned int> ScriptedObjectNameIndex{ 1 };
 
 
 /*! Set the script context for ScriptedOrbits and ScriptRotations
@@ -49,13 +50,21 @@ string
 GenerateScriptObjectName()
 {
     string buf;
-    buf = fmt::sprintf("%s%u", ScriptedObjectNamePrefix, ScriptedObjectNameIndex);
-    ScriptedObjectNameIndex++;
+    buf = fmt::sprintf("%s%u", ScriptedObjectNamePrefix, ScriptedObjectNameIndex++);
 
     return buf;
 }
 
 
+/*! Return true if any scripted orbit or rotation object has been created.
+ */
+bool
+ScriptedObjectsExist()
+{
+    return ScriptedObjectNameIndex > 1;
+}
+
+
 /*! Helper function to retrieve an entry from a table and leave
  *  it on the top of the stack.
  */
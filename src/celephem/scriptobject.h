@@ -28,6 +28,11 @@ lua_State* GetScriptedObjectContext();
 
 std::string GenerateScriptObjectName();
 
+// Scripted orbits and rotations run in the Lua state of the scripting
+// hooks, so while any exist, orbits can only be evaluated on the main
+// thread.
+bool ScriptedObjectsExist();
+
 void GetLuaTableEntry(lua_State* state,
                       int tableIndex,
                       const std::string& key);
@@ -85,6 +85,8 @@ bool IsSpiceKernelLoaded(const fs::path& filepath)
  */
 bool LoadSpiceKernel(const fs::path& filepath)
 {
+    std::lock_guard<std::mutex> lock(GetSpiceMutex());
+
     // Only load the kernel if it is not already resident. Note that this detection
     // of duplicate kernels will not work if a file was originally loaded through
     // a metakernel.
@@ -111,3 +113,10 @@ bool LoadSpiceKernel(const fs::path& filepath)
      clog << "Loaded SPK file " << filepath << "\n";
      return true;
 }
+
+
+std::mutex& GetSpiceMutex()
+{
+    static std::mutex spiceMutex;
+    return spiceMutex;
+}
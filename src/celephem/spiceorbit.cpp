@@ -246,6 +246,8 @@ SpiceOrbit::computePosition(double jd) const
     }
     else
     {
+        std::lock_guard<std::mutex> lock(GetSpiceMutex());
+
         // Input time for SPICE is seconds after J2000
         double t = astro::daysToSecs(jd - astro::J2000);
         double position[3];
@@ -291,6 +293,8 @@ SpiceOrbit::computeVelocity(double jd) const
     }
     else
     {
+        std::lock_guard<std::mutex> lock(GetSpiceMutex());
+
         // Input time for SPICE is seconds after J2000
         double t = astro::daysToSecs(jd - astro::J2000);
         double state[6];
@@ -148,6 +148,8 @@ SpiceRotation::computeSpin(double jd) const
     }
     else
     {
+        std::lock_guard<std::mutex> lock(GetSpiceMutex());
+
         // Input time for SPICE is seconds after J2000
         double t = astro::daysToSecs(jd - astro::J2000);
         double xform[3][3];
@@ -12,7 +12,11 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <limits>
+#include <vector>
 #include <celmath/mathlib.h>
 #include <celengine/astro.h>
 #include "vsop87.h"
@@ -10998,28 +11002,208 @@ static VSOPSeries sun_Z[] = {
 };
 
 
-static double SumSeries(const VSOPSeries& series, double t)
+// Error budgets per degree used by vsoptrunc-sph and vsoptrunc-rect to
+// truncate the series; the runtime truncation scales them.
+static const double AngleError[6] = {
+    5e-6, 5e-7, 1e-7, 5e-8, 5e-8, 1e-8
+};
+
+// AU
+static const double DistanceError[6] = {
+    1e-6, 5e-7, 1e-7, 5e-8, 1e-8, 5e-9
+};
+
+// Multiplier of the error budgets; 0 sums all terms of the tables.
+static std::atomic<double> errorMultiplier{ 0.0 };
+
+// Times are evaluated in blocks of this size
+static const unsigned int TimeBlockSize = 64;
+
+// Same time step as CachingOrbit::computeVelocity()
+static const double VelocityDiffDelta = 1.0 / 1440.0;
+
+
+/*! Set the multiplier of the error budgets vsoptrunc used to truncate the
+ *  VSOP87 series; terms are dropped where the vsoptrunc criterion says
+ *  they contribute less than the scaled budget. A multiplier of 0, the
+ *  default, sums all the terms of the tables.
+ */
+void SetVSOP87ErrorMultiplier(double multiplier)
+{
+    errorMultiplier = max(multiplier, 0.0);
+}
+
+
+// A series in structure of arrays form, so that the summation loop does
+// contiguous loads and can be vectorized.
+struct VSOPCompiledSeries
 {
-    if (series.nTerms < 1)
-        return 0.0;
+    vector<double> A;
+    vector<double> B;
+    vector<double> C;
 
-    double x = 0.0;
-    VSOPTerm* term = &series.terms[0];
-    for (int i = 0; i < series.nTerms; i++, term++)
-        x += term->A * cos(term->B + term->C * t);
+    // Estimated error of truncating the series before each term, as
+    // computed by vsoptrunc and made non increasing.
+    vector<double> truncationError;
 
-    return x;
+    // Error budget of this degree for a multiplier of 1
+    double maxError;
+
+    unsigned int termCount(double multiplier) const
+    {
+        double threshold = maxError * multiplier;
+        auto iter = upper_bound(truncationError.begin(), truncationError.end(), threshold,
+                                [](double t, double e) { return e < t; });
+        return (unsigned int) (iter - truncationError.begin());
+    }
 };
 
+using VSOPVariable = vector<VSOPCompiledSeries>;
+
+
+static VSOPVariable CompileVariable(const VSOPSeries* series, int nSeries,
+                                    const double* maxError)
+{
+    VSOPVariable variable(nSeries);
+    for (int i = 0; i < nSeries; i++)
+    {
+        VSOPCompiledSeries& compiled = variable[i];
+        compiled.maxError = maxError[i];
+
+        double error = numeric_limits<double>::infinity();
+        for (int j = 0; j < series[i].nTerms; j++)
+        {
+            const VSOPTerm& term = series[i].terms[j];
+            compiled.A.push_back(term.A);
+            compiled.B.push_back(term.B);
+            compiled.C.push_back(term.C);
+
+            error = min(error, 2.0 * sqrt((double) (j + 1)) * abs(term.A));
+            compiled.truncationError.push_back(error);
+        }
+    }
+
+    return variable;
+}
+
+
+// Cosine without a library call so that summation loops can be vectorized.
+// The argument is reduced to [-pi/4, pi/4] with pi/2 split in three parts,
+// the first two exactly multiplied by quadrant numbers up to 2^23, so the
+// absolute error stays within a few ulps of 1 for |x| < 5e6; VSOP87 terms
+// reach about 1e6 over the span they're used for.
+static inline double FastCos(double x)
+{
+    const double TwoOverPi = 0.636619772367581343076;
+    const double PiOver2_1 = 1.570796325802803e+00;   // 0x1.921fb54p+0
+    const double PiOver2_2 = 9.920935791635221e-10;   // 0x1.10b46118p-30
+    const double PiOver2_3 = 5.170182981794105e-19;
+
+    // Round to integers by adding and subtracting 1.5 * 2^52, which needs no
+    // library call and is exact for |n| < 2^51. Only the quadrant modulo 4
+    // is converted to int, so that huge or non-finite arguments can't
+    // overflow the conversion; the result is meaningless for those anyway.
+    const double Round = 6755399441055744.0;
+
+    double n = (x * TwoOverPi + Round) - Round;
+    double m = n - 4.0 * ((n * 0.25 + Round) - Round);
+    int q = (m >= -2.0 && m <= 2.0) ? (int) m : 0;
+    double r = ((x - n * PiOver2_1) - n * PiOver2_2) - n * PiOver2_3;
+
+    // fdlibm kernels
+    double r2 = r * r;
+    double c = 1.0 - 0.5 * r2 + r2 * r2 * (4.16666666666666019037e-02 + r2 *
+               (-1.38888888888741095749e-03 + r2 * (2.48015872894767294178e-05 + r2 *
+               (-2.75573143513906633035e-07 + r2 * (2.08757232129817482790e-09 + r2 *
+               -1.13596475577881948265e-11)))));
+    double s = r + r * r2 * (-1.66666666666666324348e-01 + r2 *
+               (8.33333333332248946124e-03 + r2 * (-1.98412698298579493134e-04 + r2 *
+               (2.75573137070700676789e-06 + r2 * (-2.50507602534068634195e-08 + r2 *
+               1.58969099521155010221e-10)))));
+
+    // cos(r + q pi/2) is c, -s, -c, s for the quadrants 0 to 3
+    double v = (q & 1) != 0 ? s : c;
+    return ((q + 1) & 2) != 0 ? -v : v;
+}
+
+
+static double SumSeries(const VSOPCompiledSeries& series, unsigned int nTerms, double t)
+{
+    const double* A = series.A.data();
+    const double* B = series.B.data();
+    const double* C = series.C.data();
+
+    // Four partial sums, so that the loop can be vectorized without
+    // reassociating the additions
+    double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+    unsigned int i = 0;
+    for (; i + 4 <= nTerms; i += 4)
+    {
+        for (unsigned int j = 0; j < 4; j++)
+            sum[j] += A[i + j] * FastCos(B[i + j] + C[i + j] * t);
+    }
+    for (; i < nTerms; i++)
+        sum[0] += A[i] * FastCos(B[i] + C[i] * t);
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+
+// Sum a series at n <= TimeBlockSize times, vectorized over the times
+static void SumSeries(const VSOPCompiledSeries& series, unsigned int nTerms,
+                      const double* t, unsigned int n, double* sums)
+{
+    if (n == 1)
+    {
+        sums[0] = SumSeries(series, nTerms, t[0]);
+        return;
+    }
+
+    for (unsigned int k = 0; k < n; k++)
+        sums[k] = 0.0;
+
+    for (unsigned int i = 0; i < nTerms; i++)
+    {
+        double A = series.A[i];
+        double B = series.B[i];
+        double C = series.C[i];
+        for (unsigned int k = 0; k < n; k++)
+            sums[k] += A * FastCos(B + C * t[k]);
+    }
+}
+
+
+// Evaluate a variable, the sum of its series times powers of t, at
+// n <= TimeBlockSize times
+static void EvaluateVariable(const VSOPVariable& variable, double multiplier,
+                             const double* t, unsigned int n, double* values)
+{
+    double sums[TimeBlockSize];
+    double T[TimeBlockSize];
+    for (unsigned int k = 0; k < n; k++)
+    {
+        values[k] = 0.0;
+        T[k] = 1.0;
+    }
+
+    for (const auto& series : variable)
+    {
+        SumSeries(series, series.termCount(multiplier), t, n, sums);
+        for (unsigned int k = 0; k < n; k++)
+        {
+            values[k] += sums[k] * T[k];
+            T[k] *= t[k];
+        }
+    }
+}
+
+
 class VSOP87Orbit : public CachingOrbit
 {
  private:
-    VSOPSeries* vsL;
-    int nL;
-    VSOPSeries* vsB;
-    int nB;
-    VSOPSeries* vsR;
-    int nR;
+    VSOPVariable vsL;
+    VSOPVariable vsB;
+    VSOPVariable vsR;
     double period;
     double boundingRadius;
 
@@ -11029,9 +11213,9 @@ class VSOP87Orbit : public CachingOrbit
                 VSOPSeries* _vsR, int _nR,
                 double _period,
                 double _boundingRadius) :
-        vsL(_vsL), nL(_nL),
-        vsB(_vsB), nB(_nB),
-        vsR(_vsR), nR(_nR),
+        vsL(CompileVariable(_vsL, _nL, AngleError)),
+        vsB(CompileVariable(_vsB, _nB, AngleError)),
+        vsR(CompileVariable(_vsR, _nR, DistanceError)),
         period(_period),
         boundingRadius(_boundingRadius)
     {
@@ -11050,71 +11234,81 @@ class VSOP87Orbit : public CachingOrbit
 
     Vector3d computePosition(double jd) const override
     {
-        // t is Julian millenia since J2000.0
-        double t = (jd - 2451545.0) / 365250.0;
-
-        // Heliocentric coordinates
-        double l = 0.0; // longitude
-        double b = 0.0; // latitude
-        double r = 0.0; // radius
-
-        int i;
-        double T;
-
-        // Evaluate series for l
-        T = 1;
-        for (i = 0; i < nL; i++)
-        {
-            l += SumSeries(vsL[i], t) * T;
-            T = t * T;
-        }
-
-        // Evaluate series for b
-        T = 1;
-        for (i = 0; i < nB; i++)
-        {
-            b += SumSeries(vsB[i], t) * T;
-            T = t * T;
-        }
+        Vector3d position;
+        computePositions(&jd, 1, &position);
+        return position;
+    }
 
-        // Evaluate series for r
-        T = 1;
-        for (i = 0; i < nR; i++)
+    void computePositions(const double* jd, unsigned int n, Vector3d* positions) const
+    {
+        double multiplier = errorMultiplier;
+        for (unsigned int first = 0; first < n; first += TimeBlockSize)
         {
-            r += SumSeries(vsR[i], t) * T;
-            T = t * T;
+            unsigned int count = min(n - first, TimeBlockSize);
+
+            // t is Julian millenia since J2000.0
+            double t[TimeBlockSize];
+            for (unsigned int k = 0; k < count; k++)
+                t[k] = (jd[first + k] - 2451545.0) / 365250.0;
+
+            // Heliocentric coordinates
+            double l[TimeBlockSize]; // longitude
+            double b[TimeBlockSize]; // latitude
+            double r[TimeBlockSize]; // radius
+            EvaluateVariable(vsL, multiplier, t, count, l);
+            EvaluateVariable(vsB, multiplier, t, count, b);
+            EvaluateVariable(vsR, multiplier, t, count, r);
+
+            for (unsigned int k = 0; k < count; k++)
+            {
+                double radius = r[k] * KM_PER_AU;
+
+                // Corrections for internal coordinate system
+                double lat = b[k] - PI / 2;
+                double lon = l[k] + PI;
+
+                positions[first + k] = Vector3d(cos(lon) * sin(lat) * radius,
+                                                cos(lat) * radius,
+                                                -sin(lon) * sin(lat) * radius);
+            }
         }
-
-        r *= KM_PER_AU;
-
-        // Corrections for internal coordinate system
-        b -= PI / 2;
-        l += PI;
-
-        return Vector3d(cos(l) * sin(b) * r,
-                        cos(b) * r,
-                        -sin(l) * sin(b) * r);
     }
 
 
     /** Custom implementation of sample() for VSOP87 orbits. The default
       * implementation runs too slowly and produces too many samples.
+      * The samples are uniformly spaced, so the positions and the
+      * differentiated velocities are evaluated in one batch.
       */
     void sample(double startTime, double endTime, OrbitSampleProc& proc) const override
     {
-        double span = getPeriod();
+        double step = getPeriod() / 150.0;
+        if (!(step > 0.0) || !(endTime > startTime))
+        {
+            Orbit::sample(startTime, endTime, proc);
+            return;
+        }
 
-        AdaptiveSamplingParameters samplingParams{};
-        samplingParams.tolerance = 1.0; // kilometers
+        // Sample times are startTime, startTime + step... and endTime,
+        // with the times used for the velocities interleaved.
+        vector<double> times;
+        for (double t = startTime; ; t += step)
+        {
+            t = min(t, endTime);
+            times.push_back(t);
+            times.push_back(t + VelocityDiffDelta);
+            if (t >= endTime)
+                break;
+        }
 
-        // startStep, minStep, and maxStep are all set to identical values,
-        // so the adaptive sampling function actuall behaves like uniform
-        // sampling.
-        samplingParams.startStep = span / 150.0;
-        samplingParams.minStep   = samplingParams.startStep;
-        samplingParams.maxStep   = samplingParams.startStep;
+        vector<Vector3d> positions(times.size());
+        computePositions(times.data(), (unsigned int) times.size(), positions.data());
 
-        adaptiveSample(startTime, endTime, proc, samplingParams);
+        for (size_t i = 0; i < times.size(); i += 2)
+        {
+            Vector3d velocity = (positions[i + 1] - positions[i]) * (1.0 / VelocityDiffDelta);
+            proc.sample(times[i], positions[i], velocity);
+        }
     }
 
 };
@@ -11124,12 +11318,9 @@ class VSOP87Orbit : public CachingOrbit
 class VSOP87OrbitRect : public CachingOrbit
 {
  private:
-    VSOPSeries* vsX;
-    int nX;
-    VSOPSeries* vsY;
-    int nY;
-    VSOPSeries* vsZ;
-    int nZ;
+    VSOPVariable vsX;
+    VSOPVariable vsY;
+    VSOPVariable vsZ;
     double period;
     double boundingRadius;
 
@@ -11139,9 +11330,9 @@ class VSOP87OrbitRect : public CachingOrbit
                     VSOPSeries* _vsZ, int _nZ,
                     double _period,
                     double _boundingRadius) :
-        vsX(_vsX), nX(_nX),
-        vsY(_vsY), nY(_nY),
-        vsZ(_vsZ), nZ(_nZ),
+        vsX(CompileVariable(_vsX, _nX, DistanceError)),
+        vsY(CompileVariable(_vsY, _nY, DistanceError)),
+        vsZ(CompileVariable(_vsZ, _nZ, DistanceError)),
         period(_period),
         boundingRadius(_boundingRadius)
     {
@@ -11168,34 +11359,11 @@ class VSOP87OrbitRect : public CachingOrbit
         // t is Julian millenia since J2000.0
         double t = (jd - 2451545.0) / 365250.0;
 
-        Vector3d v(Vector3d::Zero());
-
-        int i;
-        double T;
-
-        // Evaluate series for x
-        T = 1;
-        for (i = 0; i < nX; i++)
-        {
-            v.x() += SumSeries(vsX[i], t) * T;
-            T = t * T;
-        }
-
-        // Evaluate series for y
-        T = 1;
-        for (i = 0; i < nY; i++)
-        {
-            v.y() += SumSeries(vsY[i], t) * T;
-            T = t * T;
-        }
-
-        // Evaluate series for z
-        T = 1;
-        for (i = 0; i < nZ; i++)
-        {
-            v.z() += SumSeries(vsZ[i], t) * T;
-            T = t * T;
-        }
+        double multiplier = errorMultiplier;
+        Vector3d v;
+        EvaluateVariable(vsX, multiplier, &t, 1, &v.x());
+        EvaluateVariable(vsY, multiplier, &t, 1, &v.y());
+        EvaluateVariable(vsZ, multiplier, &t, 1, &v.z());
 
         v *= KM_PER_AU;
 
@@ -15,4 +15,6 @@
 
 extern Orbit* CreateVSOP87Orbit(const std::string& name);
 
+extern void SetVSOP87ErrorMultiplier(double multiplier);
+
 #endif // _CELENGINE_VSOP87_H_
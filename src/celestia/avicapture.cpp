@@ -51,7 +51,6 @@ bool AVICapture::start(const string& filename,
     // Compute the width of a row in bytes; pad so that rows are aligned on
     // 4 byte boundaries.
     int rowBytes = (width * 3 + 3) & ~0x3;
-    image = new unsigned char[rowBytes * height];
 
     HRESULT hr = AVIFileOpenA(&aviFile,
                               filename.c_str(),
@@ -122,7 +121,18 @@ bool AVICapture::start(const string& filename,
         return false;
     }
 
+    if (!capture.start(renderer, width, height, Renderer::PixelFormat::BGR_EXT,
+                       [this](const unsigned char* pixels, int rowStride)
+                       {
+                           writeFrame(pixels, rowStride);
+                       }))
+    {
+        cleanup();
+        return false;
+    }
+
     capturing = true;
+    capturedFrames = 0;
     frameCounter = 0;
 
     return true;
@@ -149,38 +159,45 @@ bool AVICapture::captureFrame()
 
     x += (w - width) / 2;
     y += (h - height) / 2;
-    renderer->captureFrame(x, y, width, height,
-                 Renderer::PixelFormat::BGR_EXT,
-                 image);
 
-    int rowBytes = (width * 3 + 3) & ~0x3;
+    if (!capture.captureFrame(x, y))
+        return false;
+
+    capturedFrames++;
+    return true;
+}
+
 
+// Called on the capture worker for each frame read back.
+void AVICapture::writeFrame(const unsigned char* pixels, int rowStride)
+{
     LONG samplesWritten = 0;
     LONG bytesWritten = 0;
     HRESULT hr = AVIStreamWrite(compAviStream,
                                 frameCounter,
                                 1,
-                                image,
-                                rowBytes * height,
+                                (LPVOID) pixels,
+                                rowStride * height,
                                 AVIIF_KEYFRAME,
                                 &samplesWritten,
                                 &bytesWritten);
     if (hr != AVIERR_OK)
     {
-        DPRINTF(0, "AVIStreamWrite failed on frame %d\n", frameCounter);
-        return false;
+        DPRINTF(0, "AVIStreamWrite failed on frame %d\n", (int) frameCounter);
+        return;
     }
 
     // fmt::printf("Writing frame: %d  %d => %d bytes\n",
-    //             frameCounter, rowBytes * height, bytesWritten);
+    //             frameCounter, rowStride * height, bytesWritten);
     frameCounter++;
-
-    return true;
 }
 
 
 void AVICapture::cleanup()
 {
+    // Wait for the frames still being read back or written
+    capture.finish();
+
     if (aviStream != nullptr)
     {
         AVIStreamRelease(aviStream);
@@ -196,11 +213,6 @@ void AVICapture::cleanup()
         AVIFileRelease(aviFile);
         aviFile = nullptr;
     }
-    if (image != nullptr)
-    {
-        delete[] image;
-        image = nullptr;
-    }
 }
 
 
@@ -221,5 +233,5 @@ float AVICapture::getFrameRate() const
 
 int AVICapture::getFrameCount() const
 {
-    return frameCounter;
+    return capturedFrames;
 }
@@ -13,6 +13,8 @@
 #include <windows.h>
 #include <windowsx.h>
 #include <vfw.h>
+#include <atomic>
+#include "framecapture.h"
 #include "moviecapture.h"
 
 
@@ -37,18 +39,20 @@ class AVICapture : public MovieCapture
     virtual void recordingStatus(bool) {};
 
  private:
+    void writeFrame(const unsigned char* pixels, int rowStride);
     void cleanup();
 
  private:
     int width{ -1 };
     int height{ -1 };
     float frameRate{ 30.0f };
-    int frameCounter{ 0 };
+    int capturedFrames{ 0 };             // frames handed to the capture
+    std::atomic<int> frameCounter{ 0 };  // frames written by the worker
     bool capturing{ false };
     PAVIFILE aviFile{ nullptr };
     PAVISTREAM aviStream{ nullptr };
     PAVISTREAM compAviStream{ nullptr };
-    unsigned char* image{ nullptr };
+    FrameCapture capture;
 };
 
 #endif // _AVICAPTURE_H_
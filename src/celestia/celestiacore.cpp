@@ -24,9 +24,12 @@
 #include "execution.h"
 #include "cmdparser.h"
 #include <celengine/multitexture.h>
+#include <celengine/texmanager.h>
+#include <celengine/meshmanager.h>
 #ifdef USE_SPICE
 #include <celephem/spiceinterface.h>
 #endif
+#include <celephem/vsop87.h>
 #include <celengine/axisarrow.h>
 #include <celengine/planetgrid.h>
 #include <celengine/visibleregion.h>
@@ -321,6 +324,14 @@ CelestiaCore::~CelestiaCore()
     delete execEnv;
     delete timer;
     delete renderer;
+
+    // Loads not committed yet are dropped, and the queued ones skipped
+    if (resourceLoader != nullptr)
+    {
+        GetTextureManager()->setLoaderPool(nullptr);
+        GetGeometryManager()->setLoaderPool(nullptr);
+        delete resourceLoader;
+    }
 }
 
 void CelestiaCore::readFavoritesFile()
@@ -2145,6 +2156,14 @@ void CelestiaCore::tick()
         dt = sysTime - lastTime;
     }
 
+    tick(dt);
+}
+
+
+// Advance by dt seconds of real time, whatever the system clock says.
+// Used directly by offline rendering, which steps by exactly one frame.
+void CelestiaCore::tick(double dt)
+{
     // Pause script execution
     if (scriptState == ScriptPaused)
         dt = 0.0;
@@ -2333,6 +2352,14 @@ void CelestiaCore::tick()
 
 void CelestiaCore::draw()
 {
+    // Textures and models loaded in the background are created here, where
+    // the GL context is current.
+    if (resourceLoader != nullptr)
+    {
+        if (GetTextureManager()->commitPending() + GetGeometryManager()->commitPending() > 0)
+            viewChanged = true;
+    }
+
     if (!viewUpdateRequired())
         return;
     viewChanged = false;
@@ -4127,6 +4154,8 @@ bool CelestiaCore::initSimulation(const fs::path& configFileName,
 
 
     /***** Load the solar system catalogs *****/
+    SetVSOP87ErrorMultiplier(config->vsop87ErrorMultiplier);
+
     // First read the solar system files listed individually in the
     // config file.
     {
@@ -4256,6 +4285,10 @@ bool CelestiaCore::initRenderer()
     detailOptions.orbitPeriodsShown = config->orbitPeriodsShown;
     detailOptions.linearFadeFraction = config->linearFadeFraction;
 
+    if (!config->textureCacheDir.empty())
+        SetProceduralTextureCacheDir(config->textureCacheDir);
+    SetModelOptimization(config->optimizeModels, config->modelCacheDir);
+
     // Prepare the scene for rendering.
 #ifdef USE_GLCONTEXT
     if (!renderer->init(context, (int) width, (int) height, detailOptions))
@@ -4267,6 +4300,15 @@ bool CelestiaCore::initRenderer()
         return false;
     }
 
+    renderer->setOrbitCacheSize((size_t) config->orbitCacheSize * 1024 * 1024);
+
+    if (!config->shaderCacheFile.empty())
+    {
+        renderer->getShaderManager().setProgramCache(config->shaderCacheFile);
+        if (config->shaderWarmUp)
+            renderer->getShaderManager().warmUp();
+    }
+
     if ((renderer->getRenderFlags() & Renderer::ShowAutoMag) != 0)
     {
         renderer->setFaintestAM45deg(renderer->getFaintestAM45deg());
@@ -4319,6 +4361,15 @@ bool CelestiaCore::initRenderer()
         logoTexture = LoadTextureFromFile(fs::path("textures") / config->logoTextureFile);
     }
 
+    // Sampled trajectories are left out: the catalog parser needs them as
+    // soon as the object is created.
+    if (config->loaderThreads > 0)
+    {
+        resourceLoader = new ThreadPool(config->loaderThreads);
+        GetTextureManager()->setLoaderPool(resourceLoader);
+        GetGeometryManager()->setLoaderPool(resourceLoader);
+    }
+
     return true;
 }
 
@@ -4368,8 +4419,7 @@ bool CelestiaCore::readStars(const CelestiaConfig& cfg,
         if (progressNotifier)
             progressNotifier->update(cfg.starDatabaseFile.string());
 
-        ifstream starFile(cfg.starDatabaseFile.string(), ios::in | ios::binary);
-        if (!starFile.good())
+        if (!fs::exists(cfg.starDatabaseFile))
         {
             fmt::fprintf(cerr, _("Error opening %s\n"), cfg.starDatabaseFile);
             delete starDB;
@@ -4377,7 +4427,7 @@ bool CelestiaCore::readStars(const CelestiaConfig& cfg,
             return false;
         }
 
-        if (!starDB->loadBinary(starFile))
+        if (!starDB->loadBinary(cfg.starDatabaseFile))
         {
             cerr << _("Error reading stars file\n");
             delete starDB;
@@ -4634,6 +4684,11 @@ bool CelestiaCore::isCaptureActive()
     return movieCapture != nullptr;
 }
 
+bool CelestiaCore::isScriptRunning() const
+{
+    return scriptState != ScriptCompleted;
+}
+
 bool CelestiaCore::isRecording()
 {
     return recording;
@@ -12,6 +12,7 @@
 
 #include <celutil/timer.h>
 #include <celutil/watcher.h>
+#include <celutil/threadpool.h>
 // #include <celutil/watchable.h>
 #include <celengine/solarsys.h>
 #include <celengine/overlay.h>
@@ -268,6 +269,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
     void resize(GLsizei w, GLsizei h);
     void draw();
     void tick();
+    void tick(double dt);
 
     Simulation* getSimulation() const;
     Renderer* getRenderer() const;
@@ -307,6 +309,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
     void runScript(const fs::path& filename);
     void cancelScript();
     void resumeScript();
+    bool isScriptRunning() const;
 
     int getHudDetail();
     void setHudDetail(int);
@@ -399,6 +402,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
 
     Simulation* sim{ nullptr };
     Renderer* renderer{ nullptr };
+    ThreadPool* resourceLoader{ nullptr };
     Overlay* overlay{ nullptr };
     int width{ 1 };
     int height{ 1 };
@@ -494,6 +494,14 @@ double LuaState::getTime() const
 }
 
 
+// Time used by wait() and getscripttime(). Timeslices are still measured
+// with the system clock.
+double LuaState::getScriptTime() const
+{
+    return scriptTime;
+}
+
+
 // Check if the running script has exceeded its allowed timeslice
 // and terminate it if it has:
 static void checkTimeslice(lua_State* l, lua_Debug* /*ar*/)
@@ -995,6 +1003,8 @@ bool LuaState::tick(double dt)
     if (!isAlive())
         return false;
 
+    scriptTime += dt;
+
     if (ioMode == Asking)
     {
         CelestiaCore* appCore = getAppCore(costate, NoErrors);
@@ -1041,7 +1051,7 @@ bool LuaState::tick(double dt)
         return false;
     }
 
-    if (dt == 0 || scriptAwakenTime > getTime())
+    if (dt == 0 || scriptAwakenTime > getScriptTime())
         return false;
 
     int nArgs = resume();
@@ -1058,7 +1068,7 @@ bool LuaState::tick(double dt)
         delay = lua_tonumber(state, -1);
     else
         delay = 0.0;
-    scriptAwakenTime = getTime() + delay;
+    scriptAwakenTime = getScriptTime() + delay;
 
     // Clean up the stack
     lua_pop(state, nArgs);
@@ -55,6 +55,7 @@ public:
 
     bool charEntered(const char*);
     double getTime() const;
+    double getScriptTime() const;
     int screenshotCount;
     double timeout;
 
@@ -86,6 +87,9 @@ private:
     lua_State* costate{ nullptr }; // coroutine stack
     bool alive{ false };
     Timer* timer;
+    // Sum of the tick intervals, which follow the movie frame rate while
+    // recording instead of the system clock
+    double scriptTime{ 0.0 };
     double scriptAwakenTime{ 0.0 };
     IOMode ioMode{ NoIO };
     bool eventHandlerEnabled{ false };
@@ -1314,6 +1314,146 @@ static int celestia_stars(lua_State* l)
 }
 
 
+// Collects the stars found by an octree query
+class StarCollector : public StarHandler
+{
+ public:
+    void process(const Star& star, float distance, float appMag) override
+    {
+        stars.push_back(&star);
+        distances.push_back(distance);
+        appMags.push_back(appMag);
+    }
+
+    vector<const Star*> stars;
+    vector<float> distances;
+    vector<float> appMags;
+};
+
+
+template <typename F> static void setStarArray(lua_State* l, const char* name, size_t n, F value)
+{
+    lua_pushstring(l, name);
+    lua_createtable(l, (int) n, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        lua_pushnumber(l, value(i));
+        lua_rawseti(l, -2, (int) i + 1);
+    }
+    lua_settable(l, -3);
+}
+
+
+// Push a table holding the properties of stars as arrays of numbers, one
+// per property, rather than an object per star:
+// count, index (for celestia:getstar), catalog, x, y, z (position in light
+// years), absmag and, for octree queries, distance and appmag.
+static void pushStarArrays(lua_State* l,
+                           const StarDatabase& starDB,
+                           const vector<const Star*>& stars,
+                           const StarCollector* collector = nullptr)
+{
+    size_t n = stars.size();
+    lua_createtable(l, 0, collector != nullptr ? 9 : 7);
+
+    lua_pushstring(l, "count");
+    lua_pushnumber(l, (lua_Number) n);
+    lua_settable(l, -3);
+
+    const Star* first = starDB.getStar(0);
+    setStarArray(l, "index", n, [&](size_t i) { return (lua_Number) (stars[i] - first); });
+    setStarArray(l, "catalog", n, [&](size_t i) { return (lua_Number) stars[i]->getCatalogNumber(); });
+    setStarArray(l, "x", n, [&](size_t i) { return stars[i]->getPosition().x(); });
+    setStarArray(l, "y", n, [&](size_t i) { return stars[i]->getPosition().y(); });
+    setStarArray(l, "z", n, [&](size_t i) { return stars[i]->getPosition().z(); });
+    setStarArray(l, "absmag", n, [&](size_t i) { return stars[i]->getAbsoluteMagnitude(); });
+    if (collector != nullptr)
+    {
+        setStarArray(l, "distance", n, [&](size_t i) { return collector->distances[i]; });
+        setStarArray(l, "appmag", n, [&](size_t i) { return collector->appMags[i]; });
+    }
+}
+
+
+static int celestia_getstardata(lua_State* l)
+{
+    Celx_CheckArgs(l, 1, 3, "At most two arguments expected to function celestia:getstardata");
+
+    CelestiaCore* appCore = this_celestia(l);
+    StarDatabase* starDB = appCore->getSimulation()->getUniverse()->getStarCatalog();
+    double first = Celx_SafeGetNumber(l, 2, WrongType, "First arg to celestia:getstardata must be a number", 0.0);
+    double count = Celx_SafeGetNumber(l, 3, WrongType, "Second arg to celestia:getstardata must be a number", starDB->size());
+
+    auto begin = (uint32_t) max(0.0, min(first, (double) starDB->size()));
+    auto end = (uint32_t) max((double) begin, min(first + count, (double) starDB->size()));
+
+    vector<const Star*> stars;
+    stars.reserve(end - begin);
+    for (uint32_t i = begin; i < end; i++)
+        stars.push_back(starDB->getStar(i));
+
+    pushStarArrays(l, *starDB, stars);
+
+    return 1;
+}
+
+
+static int celestia_findstars(lua_State* l)
+{
+    Celx_CheckArgs(l, 3, 3, "Two arguments expected to function celestia:findstars");
+
+    CelestiaCore* appCore = this_celestia(l);
+    UniversalCoord* position = to_position(l, 2);
+    if (position == nullptr)
+    {
+        Celx_DoError(l, "First arg to celestia:findstars must be a position");
+        return 0;
+    }
+    double radius = Celx_SafeGetNumber(l, 3, AllErrors, "Second arg to celestia:findstars must be a number");
+
+    StarDatabase* starDB = appCore->getSimulation()->getUniverse()->getStarCatalog();
+    StarCollector collector;
+    starDB->findCloseStars(collector, position->toLy().cast<float>(), (float) radius);
+
+    pushStarArrays(l, *starDB, collector.stars, &collector);
+
+    return 1;
+}
+
+
+static int celestia_findvisiblestars(lua_State* l)
+{
+    Celx_CheckArgs(l, 3, 4, "Two or three arguments expected to function celestia:findvisiblestars");
+
+    CelestiaCore* appCore = this_celestia(l);
+    Observer* observer = to_observer(l, 2);
+    if (observer == nullptr)
+    {
+        Celx_DoError(l, "First arg to celestia:findvisiblestars must be an observer");
+        return 0;
+    }
+    double faintestMag = Celx_SafeGetNumber(l, 3, AllErrors, "Second arg to celestia:findvisiblestars must be a number");
+
+    int width, height;
+    appCore->getRenderer()->getScreenSize(nullptr, nullptr, &width, &height);
+    double aspectRatio = height > 0 ? (double) width / (double) height : 1.0;
+    aspectRatio = Celx_SafeGetNumber(l, 4, WrongType, "Third arg to celestia:findvisiblestars must be a number", aspectRatio);
+
+    StarDatabase* starDB = appCore->getSimulation()->getUniverse()->getStarCatalog();
+    StarCollector collector;
+    starDB->findVisibleStars(collector,
+                             observer->getPosition().toLy().cast<float>(),
+                             observer->getOrientationf(),
+                             observer->getFOV(),
+                             (float) aspectRatio,
+                             (float) faintestMag);
+
+    pushStarArrays(l, *starDB, collector.stars, &collector);
+
+    return 1;
+}
+
+
 static int celestia_getdsocount(lua_State* l)
 {
     Celx_CheckArgs(l, 1, 1, "No arguments expected to function celestia:getdsocount");
@@ -1727,7 +1867,7 @@ static int celestia_getscripttime(lua_State* l)
     this_celestia(l);
 
     LuaState* luastate_ptr = getLuaStateObject(l);
-    lua_pushnumber(l, luastate_ptr->getTime());
+    lua_pushnumber(l, luastate_ptr->getScriptTime());
     return 1;
 }
 
@@ -2232,6 +2372,9 @@ void CreateCelestiaMetaTable(lua_State* l)
     Celx_RegisterMethod(l, "registereventhandler", celestia_registereventhandler);
     Celx_RegisterMethod(l, "geteventhandler", celestia_geteventhandler);
     Celx_RegisterMethod(l, "stars", celestia_stars);
+    Celx_RegisterMethod(l, "getstardata", celestia_getstardata);
+    Celx_RegisterMethod(l, "findstars", celestia_findstars);
+    Celx_RegisterMethod(l, "findvisiblestars", celestia_findvisiblestars);
     Celx_RegisterMethod(l, "dsos", celestia_dsos);
     Celx_RegisterMethod(l, "windowbordersvisible", celestia_windowbordersvisible);
     Celx_RegisterMethod(l, "setwindowbordersvisible", celestia_setwindowbordersvisible);
@@ -122,11 +122,25 @@ CelestiaConfig* ReadCelestiaConfig(const fs::path& filename, CelestiaConfig *con
     configParams->getNumber("LinearFadeFraction", config->linearFadeFraction);
 
     config->orbitPathSamplePoints = getUint(configParams, "OrbitPathSamplePoints", 100);
+    config->orbitCacheSize = getUint(configParams, "OrbitCacheSize", 64);
     config->shadowTextureSize = getUint(configParams, "ShadowTextureSize", 256);
     config->eclipseTextureSize = getUint(configParams, "EclipseTextureSize", 128);
 
     config->consoleLogRows = getUint(configParams, "LogSize", 200);
 
+    config->loaderThreads = getUint(configParams, "LoaderThreads", 0);
+
+    config->vsop87ErrorMultiplier = 0.0;
+    configParams->getNumber("VSOP87ErrorMultiplier", config->vsop87ErrorMultiplier);
+
+    configParams->getPath("ShaderCacheFile", config->shaderCacheFile);
+    config->shaderWarmUp = false;
+    configParams->getBoolean("ShaderWarmUp", config->shaderWarmUp);
+    configParams->getPath("TextureCacheDir", config->textureCacheDir);
+    config->optimizeModels = false;
+    configParams->getBoolean("OptimizeModels", config->optimizeModels);
+    configParams->getPath("ModelCacheDir", config->modelCacheDir);
+
     Value* solarSystemsVal = configParams->getValue("SolarSystemCatalogs");
     if (solarSystemsVal != nullptr)
     {
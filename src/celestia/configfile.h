@@ -70,6 +70,30 @@ public:
 
     unsigned int consoleLogRows;
 
+    // Memory kept for sampled orbit paths, in megabytes
+    unsigned int orbitCacheSize;
+
+    // Number of threads loading textures and models in the background;
+    // zero loads them when they're first needed.
+    unsigned int loaderThreads;
+
+    // Multiplier of the error budgets the VSOP87 series were truncated
+    // with; zero sums all the terms.
+    double vsop87ErrorMultiplier;
+
+    // File keeping the compiled shader programs between sessions, and
+    // whether to build them all at startup
+    fs::path shaderCacheFile;
+    bool shaderWarmUp;
+
+    // Directory keeping procedural textures between sessions
+    fs::path textureCacheDir;
+
+    // Optimize models for the vertex caches as they're loaded, and the
+    // directory keeping the optimized models between sessions
+    bool optimizeModels;
+    fs::path modelCacheDir;
+
     Hash* params;
 
     float getFloatValue(const std::string& name);
@@ -10,11 +10,23 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
-#include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <tuple>
+#include <celutil/threadpool.h>
+#ifdef CELX
+#include <celephem/scriptobject.h>
+#endif
 #include "eclipsefinder.h"
 #include "celmath/ray.h"
 #include "celmath/distance.h"
+#include "celmath/mathlib.h"
 
 using namespace Eigen;
 using namespace std;
@@ -31,6 +43,15 @@ constexpr const int EclipseObjectMask = Body::Planet      |
 // TODO: share this constant and function with render.cpp
 static const float MinRelativeOccluderRadius = 0.005f;
 
+// One hour, the spacing of the times at which eclipses are looked for
+constexpr const double searchStep = 1.0 / 24.0;
+
+// Number of search steps per task when the search is split across threads
+constexpr const size_t MinStepsPerChunk = 720;
+
+// Contact times are searched for within this number of dT steps
+constexpr const size_t MaxContactSteps = 1 << 24;
+
 EclipseFinder::EclipseFinder(Body* _body,
                              EclipseFinderWatcher* _watcher) :
     body(_body),
@@ -39,165 +60,224 @@ EclipseFinder::EclipseFinder(Body* _body,
 };
 
 
-bool testEclipse(const Body& receiver, const Body& caster, double now)
+// Ignore situations where the shadow casting body is much smaller than
+// the receiver, as these shadows aren't likely to be relevant.  Also,
+// ignore eclipses where the caster is not an ellipsoid, since we can't
+// generate correct shadows in this case.
+static bool canCastShadow(const Body& receiver, const Body& caster)
+{
+    return caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
+           caster.isEllipsoid();
+}
+
+
+// If clearance isn't null, it's set to a time span during which the
+// eclipse is certain not to begin, or to zero when the receiver is in the
+// shadow or close to it.
+static bool testEclipse(const Body& receiver, const Body& caster, double now,
+                        double* clearance = nullptr)
 {
-    // Ignore situations where the shadow casting body is much smaller than
-    // the receiver, as these shadows aren't likely to be relevant.  Also,
-    // ignore eclipses where the caster is not an ellipsoid, since we can't
-    // generate correct shadows in this case.
-    if (caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
-        caster.isEllipsoid())
+    // All of the eclipse related code assumes that both the caster
+    // and receiver are spherical.  Irregular receivers will work more
+    // or less correctly, but casters that are sufficiently non-spherical
+    // will produce obviously incorrect shadows.  Another assumption we
+    // make is that the distance between the caster and receiver is much
+    // less than the distance between the sun and the receiver.  This
+    // approximation works everywhere in the solar system, and likely
+    // works for any orbitally stable pair of objects orbiting a star.
+    Vector3d posReceiver = receiver.getAstrocentricPosition(now);
+    Vector3d posCaster = caster.getAstrocentricPosition(now);
+
+    const Star* sun = receiver.getSystem()->getStar();
+    assert(sun != nullptr);
+    double distToSun = posReceiver.norm();
+    float appSunRadius = (float) (sun->getRadius() / distToSun);
+
+    Vector3d dir = posCaster - posReceiver;
+    double distToCaster = dir.norm() - receiver.getRadius();
+    float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
+
+    // The shadow radius is the radius of the occluder plus some additional
+    // amount that depends upon the apparent radius of the sun.  For
+    // a sun that's distant/small and effectively a point, the shadow
+    // radius will be the same as the radius of the occluder.
+    float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
+        caster.getRadius();
+
+    // Test whether a shadow is cast on the receiver.  We want to know
+    // if the receiver lies within the shadow volume of the caster.  Since
+    // we're assuming that everything is a sphere and the sun is far
+    // away relative to the caster, the shadow volume is a
+    // cylinder capped at one end.  Testing for the intersection of a
+    // singly capped cylinder is as simple as checking the distance
+    // from the center of the receiver to the axis of the shadow cylinder.
+    // If the distance is less than the sum of the caster's and receiver's
+    // radii, then we have an eclipse.
+    float R = receiver.getRadius() + shadowRadius;
+    double dist = distance(posReceiver, Ray3d(posCaster, posCaster));
+    if (dist < R)
     {
-        // All of the eclipse related code assumes that both the caster
-        // and receiver are spherical.  Irregular receivers will work more
-        // or less correctly, but casters that are sufficiently non-spherical
-        // will produce obviously incorrect shadows.  Another assumption we
-        // make is that the distance between the caster and receiver is much
-        // less than the distance between the sun and the receiver.  This
-        // approximation works everywhere in the solar system, and likely
-        // works for any orbitally stable pair of objects orbiting a star.
-        Vector3d posReceiver = receiver.getAstrocentricPosition(now);
-        Vector3d posCaster = caster.getAstrocentricPosition(now);
-
-        const Star* sun = receiver.getSystem()->getStar();
-        assert(sun != nullptr);
-        double distToSun = posReceiver.norm();
-        float appSunRadius = (float) (sun->getRadius() / distToSun);
-
-        Vector3d dir = posCaster - posReceiver;
-        double distToCaster = dir.norm() - receiver.getRadius();
-        float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
-
-        // The shadow radius is the radius of the occluder plus some additional
-        // amount that depends upon the apparent radius of the sun.  For
-        // a sun that's distant/small and effectively a point, the shadow
-        // radius will be the same as the radius of the occluder.
-        float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
-            caster.getRadius();
-
-        // Test whether a shadow is cast on the receiver.  We want to know
-        // if the receiver lies within the shadow volume of the caster.  Since
-        // we're assuming that everything is a sphere and the sun is far
-        // away relative to the caster, the shadow volume is a
-        // cylinder capped at one end.  Testing for the intersection of a
-        // singly capped cylinder is as simple as checking the distance
-        // from the center of the receiver to the axis of the shadow cylinder.
-        // If the distance is less than the sum of the caster's and receiver's
-        // radii, then we have an eclipse.
-        float R = receiver.getRadius() + shadowRadius;
-        double dist = distance(posReceiver, Ray3d(posCaster, posCaster));
-        if (dist < R)
-        {
-            // Ignore "eclipses" where the caster and receiver have
-            // intersecting bounding spheres.
-            if (distToCaster > caster.getRadius())
-                return true;
-        }
+        // Ignore "eclipses" where the caster and receiver have
+        // intersecting bounding spheres.
+        if (distToCaster > caster.getRadius())
+            return true;
+    }
+
+    if (clearance != nullptr)
+    {
+        // Bound the rate at which the receiver can approach the shadow
+        // axis: the relative motion of the pair, the swing of the axis as
+        // the caster goes around the sun, and the growth of the shadow
+        // radius. Only half of the margin is used, which leaves room for
+        // the velocities changing meanwhile, and the span is kept below a
+        // quarter of the relative orbit for the same reason.
+        Vector3d sunVelocity = sun->getVelocity(now);
+        Vector3d velReceiver = receiver.getVelocity(now) - sunVelocity;
+        Vector3d velCaster = caster.getVelocity(now) - sunVelocity;
+        double relativeSpeed = (velCaster - velReceiver).norm();
+        double d = dir.norm();
+        double sunRatio = sun->getRadius() / distToSun;
+        double rate = relativeSpeed * (1.0 + sunRatio) +
+                      d * (velCaster.norm() / posCaster.norm() +
+                           sunRatio * velReceiver.norm() / distToSun);
+
+        double margin = dist - R;
+        double span = margin / (2.0 * rate);
+        if (relativeSpeed > 0.0)
+            span = min(span, 0.5 * PI * d / relativeSpeed);
+        *clearance = span > 0.0 ? span : 0.0;
     }
 
     return false;
 }
 
-#if 1
-double findEclipseSpan(const Body& receiver, const Body& caster,
-                       double now, double dt)
+
+// The time of the (now + k * dt) step, computed by accumulating steps so
+// that contact times don't depend on how they're searched for.
+static double stepTime(double now, double dt, size_t k)
 {
     double t = now;
-    while (testEclipse(receiver, caster, t))
+    for (size_t i = 0; i < k; i++)
         t += dt;
-
     return t;
 }
-#else
-// Given a time during an eclipse, find the start of the eclipse to
-// a precision of minStep.
-double findEclipseStart(const Body& receiver, const Body& occulter,
-                        double now,
-                        double startStep,
-                        double minStep)
+
+
+// Given a time during an eclipse, find the first step of dt away from it
+// at which the receiver is out of the shadow. The step is bracketed with
+// doubling steps, then found with a binary search.
+static double findEclipseSpan(const Body& receiver, const Body& caster,
+                              double now, double dt)
 {
-    double step = startStep / 2;
-    double t = now - step;
-    bool eclipsed = true;
+    size_t inside = 0;
+    size_t outside = 1;
+    while (outside < MaxContactSteps && testEclipse(receiver, caster, stepTime(now, dt, outside)))
+    {
+        inside = outside;
+        outside *= 2;
+    }
 
-    // Perform a binary search to find the end of the eclipse
-    while (step > minStep)
+    while (outside - inside > 1)
     {
-        eclipsed = testEclipse(receiver, occulter, t);
-        step *= 0.5;
-        if (eclipsed)
-            t -= step;
+        size_t middle = inside + (outside - inside) / 2;
+        if (testEclipse(receiver, caster, stepTime(now, dt, middle)))
+            inside = middle;
         else
-            t += step;
+            outside = middle;
     }
 
-    // Always return a time when the receiver is /not/ in eclipse
-    if (eclipsed)
-        t -= step;
-
-    return t;
+    return stepTime(now, dt, outside);
 }
 
-// Given a time during an eclipse, find the end of the eclipse to
-// a precision of minStep.
-double findEclipseEnd(const Body& receiver, const Body& occulter,
-                      double now,
-                      double startStep,
-                      double minStep)
-{
-    // First do a coarse search to find the eclipse end to within the precision
-    // of startStep.
-    while (testEclipse(receiver, occulter, now + startStep))
-        now += startStep;
-
-    double step = startStep / 2;
-    double t = now + step;
-    bool eclipsed = true;
 
+namespace
+{
+struct FoundEclipse
+{
+    size_t step;
+    unsigned int bodyIndex;
+    unsigned int type; // 0 for solar eclipses, 1 for lunar ones
+    Eclipse eclipse;
 
-    // Perform a binary search to find the end of the eclipse
-    while (step > minStep)
+    bool operator<(const FoundEclipse& other) const
     {
-        eclipsed = testEclipse(receiver, occulter, t);
-        step *= 0.5;
-        if (eclipsed)
-            t += step;
-        else
-            t -= step;
+        return tie(step, bodyIndex, type) < tie(other.step, other.bodyIndex, other.type);
     }
+};
 
-    // Always return a time when the receiver is /not/ in eclipse
-    if (eclipsed)
-        t += step;
+struct EclipsePair
+{
+    const Body* receiver;
+    const Body* caster;
+    unsigned int type;
+};
 
-    return t;
+// The eclipses of a satellite over a range of search steps
+struct ScanResult
+{
+    vector<FoundEclipse> eclipses;
+    double lastEnd;
+    bool complete{ false };
+};
 }
-#endif
 
-void addEclipse(const Body& receiver, const Body& occulter,
-                double now,
-                double /*startStep*/, double /*minStep*/,
-                vector<Eclipse>& eclipses,
-                vector<double>& previousEclipseEndTimes, int i)
+
+// Look for the eclipses of pairs at the search steps [first, last) and
+// return false if aborted. previousEnd is the end time of the last
+// eclipse found before first; an eclipse isn't looked for until it's
+// over.
+static bool scanEclipses(const vector<double>& times, size_t first, size_t last,
+                         const vector<EclipsePair>& pairs, unsigned int bodyIndex,
+                         double previousEnd, const atomic<bool>& aborted,
+                         ScanResult& result)
 {
-    if (testEclipse(receiver, occulter, now))
+    result.eclipses.clear();
+    result.lastEnd = previousEnd;
+    result.complete = false;
+
+    size_t k = first;
+    while (k < last)
     {
-        Eclipse eclipse;
-#if 1
-        eclipse.startTime = findEclipseSpan(receiver, occulter, now, -dT);
-        eclipse.endTime = findEclipseSpan(receiver, occulter, now, dT);
-#else
-        eclipse.startTime = findEclipseStart(receiver, occulter, now, searchStep, minStep);
-        eclipse.endTime = findEclipseEnd(receiver, occulter, now, searchStep, minStep);
-#endif
-        eclipse.receiver = const_cast<Body*>(&receiver);
-        eclipse.occulter = const_cast<Body*>(&occulter);
-        eclipses.emplace_back(eclipse);
+        if (aborted.load(memory_order_relaxed))
+            return false;
+
+        // Only test for an eclipse if we're not in the middle of
+        // of previous one.
+        double t = times[k];
+        if (t <= result.lastEnd)
+        {
+            k = upper_bound(times.begin() + k, times.begin() + last, result.lastEnd) - times.begin();
+            continue;
+        }
+
+        double clearance = numeric_limits<double>::infinity();
+        for (const auto& pair : pairs)
+        {
+            double pairClearance;
+            if (testEclipse(*pair.receiver, *pair.caster, t, &pairClearance))
+            {
+                Eclipse eclipse;
+                eclipse.startTime = findEclipseSpan(*pair.receiver, *pair.caster, t, -dT);
+                eclipse.endTime = findEclipseSpan(*pair.receiver, *pair.caster, t, dT);
+                eclipse.receiver = const_cast<Body*>(pair.receiver);
+                eclipse.occulter = const_cast<Body*>(pair.caster);
+                result.eclipses.push_back({ k, bodyIndex, pair.type, eclipse });
+                result.lastEnd = eclipse.endTime;
+                pairClearance = 0.0;
+            }
+            clearance = min(clearance, pairClearance);
+        }
 
-        previousEclipseEndTimes[i] = eclipse.endTime;
+        // The steps strictly inside the clearance can't be in an eclipse
+        double steps = floor(clearance / searchStep);
+        k += steps > 1.0 ? (size_t) min(steps, (double) (last - k)) : 1;
     }
+
+    result.complete = true;
+    return true;
 }
 
+
 void EclipseFinder::findEclipses(double startDate,
                                  double endDate,
                                  int eclipseTypeMask,
@@ -209,53 +289,150 @@ void EclipseFinder::findEclipses(double startDate,
     if (satellites == nullptr)
         return;
 
-    // For each body, we'll need to store the time when the last eclipse ended
-    vector<double> previousEclipseEndTimes;
-
     // Make a list of satellites that we'll actually test for eclipses; ignore
     // spacecraft and very small objects.
-    vector<Body*> testBodies;
+    vector<vector<EclipsePair>> testPairs;
     for (int i = 0; i < satellites->getSystemSize(); i++)
     {
         Body* obj = satellites->getBody(i);
         if ((obj->getClassification() & EclipseObjectMask) != 0 &&
             obj->getRadius() >= body->getRadius() * MinRelativeOccluderRadius)
         {
-            testBodies.push_back(obj);
-            previousEclipseEndTimes.push_back(startDate - 1.0);
+            vector<EclipsePair> pairs;
+            if ((eclipseTypeMask & Eclipse::Solar) != 0 && canCastShadow(*body, *obj))
+                pairs.push_back({ body, obj, 0 });
+            if ((eclipseTypeMask & Eclipse::Lunar) != 0 && canCastShadow(*obj, *body))
+                pairs.push_back({ obj, body, 1 });
+            if (!pairs.empty())
+                testPairs.push_back(pairs);
         }
     }
 
-    if (testBodies.empty())
+    if (testPairs.empty())
         return;
 
-    // TODO: Use a fixed step of one hour for now; we should use a binary
-    // search instead.
-    double searchStep = 1.0 / 24.0; // one hour
+    // The search times are accumulated as they always were, so that the
+    // eclipses found don't depend on how the search is split.
+    vector<double> times;
+    for (double t = startDate; t <= endDate; t += searchStep)
+        times.push_back(t);
 
-    // Precision of eclipse duration calculation
-    double durationPrecision = 1.0 / (24.0 * 360.0); // ten seconds
+    if (times.empty())
+        return;
 
-    for (double t = startDate; t <= endDate; t += searchStep)
+    // Each task searches the eclipses of a satellite over a range of
+    // times. As the search doesn't start before the end of the last
+    // eclipse, a task following one which found an eclipse overlapping
+    // its range is redone once the end of that eclipse is known; that
+    // seldom happens.
+    ThreadPool& pool = ThreadPool::shared();
+    bool parallel = !ThreadPool::isWorkerThread();
+#ifdef CELX
+    // Scripted orbits are evaluated by the Lua state of the main thread
+    if (ScriptedObjectsExist())
+        parallel = false;
+#endif
+    size_t nChunks = parallel ? min((size_t) pool.size() * 4, times.size() / MinStepsPerChunk) : 0;
+    nChunks = max(nChunks, (times.size() + MinStepsPerChunk * 24 - 1) / (MinStepsPerChunk * 24));
+    nChunks = max(nChunks, (size_t) 1);
+
+    vector<size_t> chunkStart(nChunks + 1);
+    for (size_t c = 0; c <= nChunks; c++)
+        chunkStart[c] = times.size() * c / nChunks;
+
+    size_t nBodies = testPairs.size();
+    vector<ScanResult> results(nChunks * nBodies);
+    atomic<bool> aborted{ false };
+    double previousEnd = startDate - 1.0;
+
+    if (parallel && nChunks > 1)
     {
-        if (watcher != nullptr)
+        vector<future<void>> tasks;
+        tasks.reserve(results.size());
+        atomic<size_t> nDone{ 0 };
+        for (size_t c = 0; c < nChunks; c++)
         {
-            if (watcher->eclipseFinderProgressUpdate(t) == EclipseFinderWatcher::AbortOperation)
-                return;
+            for (unsigned int i = 0; i < nBodies; i++)
+            {
+                tasks.push_back(pool.submit([&, c, i]()
+                {
+                    scanEclipses(times, chunkStart[c], chunkStart[c + 1], testPairs[i], i,
+                                 previousEnd, aborted, results[c * nBodies + i]);
+                    nDone++;
+                }));
+            }
         }
 
-        for (unsigned int i = 0; i < testBodies.size(); i++)
+        for (auto& task : tasks)
+        {
+            while (task.wait_for(chrono::milliseconds(50)) != future_status::ready)
+            {
+                if (watcher != nullptr && !aborted)
+                {
+                    double t = startDate + (endDate - startDate) * (double) nDone / (double) tasks.size();
+                    if (watcher->eclipseFinderProgressUpdate(t) == EclipseFinderWatcher::AbortOperation)
+                        aborted = true;
+                }
+            }
+            task.get();
+        }
+    }
+    else
+    {
+        for (size_t c = 0; c < nChunks && !aborted; c++)
         {
-            // Only test for an eclipse if we're not in the middle of
-            // of previous one.
-            if (t <= previousEclipseEndTimes[i])
-                continue;
+            if (watcher != nullptr &&
+                watcher->eclipseFinderProgressUpdate(times[chunkStart[c]]) == EclipseFinderWatcher::AbortOperation)
+            {
+                break;
+            }
+
+            for (unsigned int i = 0; i < nBodies; i++)
+            {
+                scanEclipses(times, chunkStart[c], chunkStart[c + 1], testPairs[i], i,
+                             previousEnd, aborted, results[c * nBodies + i]);
+            }
+        }
+    }
 
-            if (eclipseTypeMask & Eclipse::Solar)
-                addEclipse(*body, *testBodies[i], t, searchStep, durationPrecision, eclipses, previousEclipseEndTimes, i);
+    // Join the ranges of each satellite, then order the eclipses found by
+    // time as a single search would have. An aborted search returns the
+    // eclipses of the ranges completed for all satellites.
+    size_t nComplete = 0;
+    while (nComplete < nChunks &&
+           all_of(results.begin() + nComplete * nBodies, results.begin() + (nComplete + 1) * nBodies,
+                  [](const ScanResult& result) { return result.complete; }))
+    {
+        nComplete++;
+    }
 
-            if (eclipseTypeMask & Eclipse::Lunar)
-                addEclipse(*testBodies[i], *body, t, searchStep, durationPrecision, eclipses, previousEclipseEndTimes, i);
+    atomic<bool> notAborted{ false };
+    for (unsigned int i = 0; i < nBodies; i++)
+    {
+        double lastEnd = previousEnd;
+        for (size_t c = 0; c < nComplete; c++)
+        {
+            ScanResult& result = results[c * nBodies + i];
+            if (lastEnd >= times[chunkStart[c]])
+            {
+                scanEclipses(times, chunkStart[c], chunkStart[c + 1], testPairs[i], i,
+                             lastEnd, notAborted, result);
+            }
+            lastEnd = result.lastEnd;
+        }
+    }
+
+    vector<FoundEclipse> found;
+    for (size_t c = 0; c < nComplete; c++)
+    {
+        for (unsigned int i = 0; i < nBodies; i++)
+        {
+            const auto& chunkEclipses = results[c * nBodies + i].eclipses;
+            found.insert(found.end(), chunkEclipses.begin(), chunkEclipses.end());
         }
     }
+
+    sort(found.begin(), found.end());
+    for (const auto& f : found)
+        eclipses.push_back(f.eclipse);
 }
@@ -0,0 +1,296 @@
+// framecapture.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Readback of rendered frames, pipelined for movie capture and immediate
+// for screenshots.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <cstring>
+#include <GL/glew.h>
+#include "framecapture.h"
+
+using namespace std;
+
+
+// finish() may be called from UI code, such as the handler of a stop
+// recording menu item, where the GL context isn't necessarily current.
+// glGetString returns null then.
+static bool HasCurrentContext()
+{
+    return glGetString(GL_VERSION) != nullptr;
+}
+
+
+// Both pixel formats have 3 bytes per pixel, and rows are aligned on the
+// default GL_PACK_ALIGNMENT of 4.
+static int RowStride(int width)
+{
+    return (width * 3 + 3) & ~0x3;
+}
+
+
+FrameCapture::FrameCapture(QueuePolicy policy, unsigned int maxQueued) :
+    policy(policy),
+    maxQueued(max(maxQueued, 1u))
+{
+}
+
+
+FrameCapture::~FrameCapture()
+{
+    finish();
+}
+
+
+bool FrameCapture::start(const Renderer* _renderer,
+                         int _width, int _height,
+                         Renderer::PixelFormat _format,
+                         const FrameHandler& handler)
+{
+    finish();
+
+    if (_renderer == nullptr || _width <= 0 || _height <= 0 || !handler)
+        return false;
+
+    renderer = _renderer;
+    width = _width;
+    height = _height;
+    format = _format;
+    frameHandler = handler;
+
+    rowStride = RowStride(width);
+    freeBuffers.clear();
+
+    stopping = false;
+    worker = thread(&FrameCapture::run, this);
+    started = true;
+
+    return true;
+}
+
+
+bool FrameCapture::captureFrame(int x, int y)
+{
+    if (!started)
+        return false;
+
+    if (!pixelBuffersChecked)
+    {
+        pixelBuffersChecked = true;
+        createPixelBuffers();
+    }
+
+    if (pixelBuffers[0] == 0)
+    {
+        // No pixel buffer objects: read synchronously.
+        vector<unsigned char> buffer;
+        if (!acquireBuffer(buffer))
+            return true;
+
+        if (!renderer->captureFrame(x, y, width, height, format, buffer.data()))
+        {
+            releaseBuffer(move(buffer));
+            return false;
+        }
+        queueFrame(move(buffer));
+        return true;
+    }
+
+    // With a pixel pack buffer bound, glReadPixels takes an offset into the
+    // buffer instead of a pointer and returns without waiting for the
+    // pixels.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[pixelBufferIndex]);
+    bool captured = renderer->captureFrame(x, y, width, height, format, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // The other buffer holds the previous frame, which is complete by now.
+    // Failing to map it loses that frame only, the one just read is still
+    // pending.
+    bool readOk = !pending || readPending(pixelBufferIndex ^ 1);
+    pending = captured;
+    pixelBufferIndex ^= 1;
+
+    return captured && readOk;
+}
+
+
+bool FrameCapture::captureNow(const Renderer* renderer,
+                              int x, int y,
+                              int width, int height,
+                              Renderer::PixelFormat format,
+                              const ImageHandler& handler)
+{
+    if (renderer == nullptr || width <= 0 || height <= 0 || !handler)
+        return false;
+
+    int rowStride = RowStride(width);
+    vector<unsigned char> pixels((size_t) rowStride * height);
+    if (!renderer->captureFrame(x, y, width, height, format, pixels.data(), true))
+        return false;
+
+    return handler(pixels.data(), rowStride);
+}
+
+
+void FrameCapture::finish()
+{
+    if (!started)
+        return;
+
+    bool hasContext = (pending || pixelBuffers[0] != 0) && HasCurrentContext();
+    if (pending && hasContext)
+        readPending(pixelBufferIndex ^ 1);
+    pending = false;
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    frameAvailable.notify_all();
+    worker.join();
+
+    // Without a context the buffers are left to be deleted with it.
+    if (hasContext)
+        deletePixelBuffers();
+    pixelBuffers[0] = pixelBuffers[1] = 0;
+    pixelBuffersChecked = false;
+    pixelBufferIndex = 0;
+
+    frameHandler = nullptr;
+    freeBuffers.clear();
+    started = false;
+}
+
+
+// Take a free buffer for a new frame, first waiting for room in the queue
+// or, depending on the policy, dropping the frame if the queue is full.
+bool FrameCapture::acquireBuffer(vector<unsigned char>& buffer)
+{
+    unique_lock<mutex> lock(queueMutex);
+    if (queue.size() >= maxQueued)
+    {
+        if (policy == QueuePolicy::DropFrames)
+        {
+            droppedFrames++;
+            return false;
+        }
+        spaceAvailable.wait(lock, [this] { return queue.size() < maxQueued; });
+    }
+
+    if (freeBuffers.empty())
+    {
+        buffer.resize((size_t) rowStride * height);
+    }
+    else
+    {
+        buffer = move(freeBuffers.back());
+        freeBuffers.pop_back();
+    }
+
+    return true;
+}
+
+
+void FrameCapture::queueFrame(vector<unsigned char>&& buffer)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        queue.push_back(move(buffer));
+    }
+    frameAvailable.notify_one();
+}
+
+
+void FrameCapture::releaseBuffer(vector<unsigned char>&& buffer)
+{
+    lock_guard<mutex> lock(queueMutex);
+    freeBuffers.push_back(move(buffer));
+}
+
+
+bool FrameCapture::createPixelBuffers()
+{
+    if (GLEW_VERSION_2_1 == GL_FALSE && GLEW_ARB_pixel_buffer_object == GL_FALSE)
+        return false;
+
+    glGenBuffers(2, pixelBuffers);
+    for (auto pixelBuffer : pixelBuffers)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) rowStride * height, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (glGetError() != GL_NO_ERROR)
+    {
+        deletePixelBuffers();
+        return false;
+    }
+
+    return true;
+}
+
+
+void FrameCapture::deletePixelBuffers()
+{
+    if (pixelBuffers[0] != 0)
+        glDeleteBuffers(2, pixelBuffers);
+    pixelBuffers[0] = pixelBuffers[1] = 0;
+}
+
+
+// Copy the frame held by a pixel buffer to a queued frame.
+bool FrameCapture::readPending(int index)
+{
+    pending = false;
+
+    vector<unsigned char> buffer;
+    if (!acquireBuffer(buffer))
+        return true;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[index]);
+    const void* data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (data != nullptr)
+    {
+        memcpy(buffer.data(), data, buffer.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (data == nullptr)
+    {
+        releaseBuffer(move(buffer));
+        return false;
+    }
+    queueFrame(move(buffer));
+
+    return true;
+}
+
+
+void FrameCapture::run()
+{
+    unique_lock<mutex> lock(queueMutex);
+    for (;;)
+    {
+        frameAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+            break;
+
+        vector<unsigned char> pixels = move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        spaceAvailable.notify_one();
+
+        frameHandler(pixels.data(), rowStride);
+
+        lock.lock();
+        if (freeBuffers.size() <= maxQueued)
+            freeBuffers.push_back(move(pixels));
+    }
+}
@@ -0,0 +1,126 @@
+// framecapture.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Readback of rendered frames, pipelined for movie capture and immediate
+// for screenshots.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <celengine/render.h>
+
+// Reads frames back from the framebuffer and hands them to a handler on a
+// worker thread, so that colour conversion, encoding and file writes don't
+// stall the renderer.
+//
+// Frames are read into one of two pixel buffer objects while the frame
+// read by the previous call is mapped from the other one, so glReadPixels
+// doesn't have to wait for the GPU to finish rendering. Screenshots are
+// read with captureNow() instead, which waits for the frame and runs the
+// handler on the caller.
+//
+// All the methods except the handler must be called from the thread that
+// owns the GL context.
+class FrameCapture
+{
+ public:
+    // What to do with a new frame when maxQueued frames are already waiting
+    // for the worker
+    enum class QueuePolicy
+    {
+        Block,      // wait for the worker, no frame is lost
+        DropFrames, // discard the new frame
+    };
+
+    // Called on the worker thread. Rows are bottom up, as GL returns them,
+    // and padded to a multiple of 4 bytes.
+    using FrameHandler = std::function<void(const unsigned char* pixels, int rowStride)>;
+
+    // Same as FrameHandler, called on the thread of captureNow(), which
+    // returns its result.
+    using ImageHandler = std::function<bool(const unsigned char* pixels, int rowStride)>;
+
+    explicit FrameCapture(QueuePolicy policy = QueuePolicy::Block,
+                          unsigned int maxQueued = 3);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Start the worker for frames of the given size, which are passed to
+    // handler.
+    bool start(const Renderer* renderer,
+               int width, int height,
+               Renderer::PixelFormat format,
+               const FrameHandler& handler);
+
+    // Queue a readback of the front buffer at (x, y). The frame reaches the
+    // handler once the next frame is captured or finish() is called.
+    bool captureFrame(int x, int y);
+
+    // Read the frame of the given size at (x, y) of the back buffer, which
+    // holds the frame just rendered, and pass it to handler. This neither
+    // needs start() nor touches the queue, so a screenshot can be taken
+    // while a movie is recorded.
+    static bool captureNow(const Renderer* renderer,
+                           int x, int y,
+                           int width, int height,
+                           Renderer::PixelFormat format,
+                           const ImageHandler& handler);
+
+    // Hand over the frame still in a pixel buffer, wait until the worker
+    // has processed every queued frame and stop it.
+    void finish();
+
+    bool isStarted() const { return started; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    Renderer::PixelFormat getFormat() const { return format; }
+    unsigned int getDroppedFrames() const { return droppedFrames; }
+
+ private:
+    bool acquireBuffer(std::vector<unsigned char>& buffer);
+    void queueFrame(std::vector<unsigned char>&& buffer);
+    void releaseBuffer(std::vector<unsigned char>&& buffer);
+    bool createPixelBuffers();
+    void deletePixelBuffers();
+    bool readPending(int index);
+    void run();
+
+    QueuePolicy policy;
+    unsigned int maxQueued;
+
+    const Renderer* renderer{ nullptr };
+    int width{ 0 };
+    int height{ 0 };
+    int rowStride{ 0 };
+    Renderer::PixelFormat format{ Renderer::PixelFormat::RGB };
+    FrameHandler frameHandler;
+    bool started{ false };
+
+    unsigned int pixelBuffers[2]{ 0, 0 };
+    bool pixelBuffersChecked{ false };
+    int pixelBufferIndex{ 0 };   // buffer the next frame is read into
+    bool pending{ false };
+
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable frameAvailable;
+    std::condition_variable spaceAvailable;
+    std::deque<std::vector<unsigned char>> queue;
+    std::vector<std::vector<unsigned char>> freeBuffers;
+    bool stopping{ false };
+    std::atomic<unsigned int> droppedFrames{ 0 };
+};
@@ -8,7 +8,9 @@
 // of the License, or (at your option) any later version.
 
 #include <config.h>
+#include <csetjmp>
 #include <celutil/debug.h>
+#include "framecapture.h"
 #include "imagecapture.h"
 
 extern "C" {
@@ -20,41 +22,76 @@ extern "C" {
 using namespace std;
 
 
-bool CaptureGLBufferToJPEG(const fs::path& filename,
-                           int x, int y,
-                           int width, int height,
-                           const Renderer *renderer)
+// Screenshots are read and written synchronously, as the callers report
+// failures to write the file and expect the current frame.
+static bool CaptureImage(const fs::path& filename,
+                         int x, int y,
+                         int width, int height,
+                         const Renderer *renderer,
+                         bool (*writeImage)(FILE*, const fs::path&,
+                                            const unsigned char*, int, int, int))
 {
-    int rowStride = (width * 3 + 3) & ~0x3;
-    int imageSize = height * rowStride;
-    auto* pixels = new unsigned char[imageSize];
-
-    if (!renderer->captureFrame(x, y, width, height,
-                                Renderer::PixelFormat::RGB,
-                                pixels, true))
+    auto handler = [&](const unsigned char* pixels, int rowStride)
     {
-        return false;
-    }
-
-    FILE* out;
 #ifdef _WIN32
-    out = _wfopen(filename.c_str(), L"wb");
+        FILE* out = _wfopen(filename.c_str(), L"wb");
 #else
-    out = fopen(filename.c_str(), "wb");
+        FILE* out = fopen(filename.c_str(), "wb");
 #endif
-    if (out == nullptr)
-    {
-        DPRINTF(0, "Can't open screen capture file '%s'\n", filename);
-        delete[] pixels;
-        return false;
-    }
+        if (out == nullptr)
+        {
+            DPRINTF(0, "Can't open screen capture file '%s'\n", filename);
+            return false;
+        }
+
+        bool ok = writeImage(out, filename, pixels, width, height, rowStride);
+        ok = !ferror(out) && ok;
+        if (fclose(out) != 0 || !ok)
+        {
+            DPRINTF(0, "Error writing screen capture file '%s'\n", filename);
+            return false;
+        }
+
+        return true;
+    };
+
+    return FrameCapture::captureNow(renderer, x, y, width, height,
+                                    Renderer::PixelFormat::RGB, handler);
+}
+
+
+struct JPEGErrorManager
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
 
+// The default handler exits the program, on a full disk for instance
+METHODDEF(void) JPEGErrorExit(j_common_ptr cinfo)
+{
+    (*cinfo->err->output_message) (cinfo);
+    longjmp(reinterpret_cast<JPEGErrorManager*>(cinfo->err)->setjmp_buffer, 1);
+}
+
+
+static bool WriteJPEG(FILE* out, const fs::path& filename,
+                      const unsigned char* pixels,
+                      int width, int height, int rowStride)
+{
     struct jpeg_compress_struct cinfo;
 
-    struct jpeg_error_mgr jerr;
+    JPEGErrorManager jerr;
     JSAMPROW row[1];
 
-    cinfo.err = jpeg_std_error(&jerr);
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = JPEGErrorExit;
+    if (setjmp(jerr.setjmp_buffer))
+    {
+        DPRINTF(0, "Error writing JPEG file '%s'\n", filename);
+        jpeg_destroy_compress(&cinfo);
+        return false;
+    }
+
     jpeg_create_compress(&cinfo);
 
     jpeg_stdio_dest(&cinfo, out);
@@ -72,55 +109,38 @@ bool CaptureGLBufferToJPEG(const fs::path& filename,
 
     while (cinfo.next_scanline < cinfo.image_height)
     {
-        row[0] = &pixels[rowStride * (cinfo.image_height - cinfo.next_scanline - 1)];
+        row[0] = (JSAMPROW) &pixels[rowStride * (cinfo.image_height - cinfo.next_scanline - 1)];
         (void) jpeg_write_scanlines(&cinfo, row, 1);
     }
 
     jpeg_finish_compress(&cinfo);
-    fclose(out);
     jpeg_destroy_compress(&cinfo);
 
-    delete[] pixels;
-
     return true;
 }
 
 
-void PNGWriteData(png_structp png_ptr, png_bytep data, png_size_t length)
-{
-    auto* fp = (FILE*) png_get_io_ptr(png_ptr);
-    fwrite((void*) data, 1, length, fp);
-}
-
-
-bool CaptureGLBufferToPNG(const fs::path& filename,
+bool CaptureGLBufferToJPEG(const fs::path& filename,
                            int x, int y,
                            int width, int height,
                            const Renderer *renderer)
 {
-    int rowStride = (width * 3 + 3) & ~0x3;
-    int imageSize = height * rowStride;
-    auto* pixels = new unsigned char[imageSize];
+    return CaptureImage(filename, x, y, width, height, renderer, WriteJPEG);
+}
 
-    if (!renderer->captureFrame(x, y, width, height,
-                                Renderer::PixelFormat::RGB,
-                                pixels, true))
-    {
-        return false;
-    }
 
-#ifdef _WIN32
-    FILE* out = _wfopen(filename.c_str(), L"wb");
-#else
-    FILE* out = fopen(filename.c_str(), "wb");
-#endif
-    if (out == nullptr)
-    {
-        DPRINTF(0, "Can't open screen capture file '%s'\n", filename);
-        delete[] pixels;
-        return false;
-    }
+void PNGWriteData(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    auto* fp = (FILE*) png_get_io_ptr(png_ptr);
+    if (fwrite((void*) data, 1, length, fp) != length)
+        png_error(png_ptr, "Write error");
+}
 
+
+bool WritePNGImage(FILE* out, const fs::path& filename,
+                   const unsigned char* pixels,
+                   int width, int height, int rowStride)
+{
     auto* row_pointers = new png_bytep[height];
     for (int i = 0; i < height; i++)
         row_pointers[i] = (png_bytep) &pixels[rowStride * (height - i - 1)];
@@ -134,8 +154,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (png_ptr == nullptr)
     {
         DPRINTF(0, "Screen capture: error allocating png_ptr\n");
-        fclose(out);
-        delete[] pixels;
         delete[] row_pointers;
         return false;
     }
@@ -144,8 +162,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (info_ptr == nullptr)
     {
         DPRINTF(0, "Screen capture: error allocating info_ptr\n");
-        fclose(out);
-        delete[] pixels;
         delete[] row_pointers;
         png_destroy_write_struct(&png_ptr, (png_infopp) nullptr);
         return false;
@@ -154,8 +170,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (setjmp(png_jmpbuf(png_ptr)))
     {
         DPRINTF(0, "Error writing PNG file '%s'\n", filename);
-        fclose(out);
-        delete[] pixels;
         delete[] row_pointers;
         png_destroy_write_struct(&png_ptr, &info_ptr);
         return false;
@@ -180,8 +194,15 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     // Clean up everything . . .
     png_destroy_write_struct(&png_ptr, &info_ptr);
     delete[] row_pointers;
-    delete[] pixels;
-    fclose(out);
 
     return true;
 }
+
+
+bool CaptureGLBufferToPNG(const fs::path& filename,
+                           int x, int y,
+                           int width, int height,
+                           const Renderer *renderer)
+{
+    return CaptureImage(filename, x, y, width, height, renderer, WritePNGImage);
+}
@@ -10,6 +10,7 @@
 #ifndef _IMAGECAPTURE_H_
 #define _IMAGECAPTURE_H_
 
+#include <cstdio>
 #include <celcompat/filesystem.h>
 #include <celengine/render.h>
 
@@ -23,4 +24,10 @@ extern bool CaptureGLBufferToPNG(const fs::path& filename,
                                  int width, int height,
                                  const Renderer *renderer);
 
+// Write bottom up RGB rows as a PNG image to an open file; filename is only
+// used in error messages.
+extern bool WritePNGImage(FILE* out, const fs::path& filename,
+                          const unsigned char* pixels,
+                          int width, int height, int rowStride);
+
 #endif // _IMAGECAPTURE_H_
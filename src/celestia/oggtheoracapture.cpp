@@ -99,10 +99,9 @@ OggTheoraCapture::OggTheoraCapture(const Renderer *r):
     video_r(-1), // 45000 <= video_r <= 2000000 (45Kbps - 2000Kbps)
     video_q(63), // 0-63 aka 0-10 * 6.3 the higher the value the faster the encoding and the larger the output file
     capturing(false),
+    frames_captured(0),
     video_frame_count(0),
     video_bytesout(0),
-    rowStride(0),
-    pixels(nullptr),
     outfile(nullptr)
 {
     yuvframe[0] = nullptr;
@@ -288,10 +287,6 @@ bool OggTheoraCapture::start(const std::string& filename,
     yuvframe[0]= new unsigned char[video_x*video_y*3];
     yuvframe[1]= new unsigned char[video_x*video_y*3];
 
-    // Now the buffer for reading the GL RGB pixels
-    rowStride = (frame_x * 3 + 3) & ~0x3;
-    pixels = new unsigned char[rowStride*frame_y];
-
         /* clear initial frame as it may be larger than actual video data */
         /* fill Y plane with 0x10 and UV planes with 0x80, for black data */
     // The UV plane must be 4:2:0
@@ -317,6 +312,17 @@ bool OggTheoraCapture::start(const std::string& filename,
                 video_x,video_y,
                 frame_x_offset,frame_y_offset);
 
+    // Movie frames are captured at a fixed rate, so none can be dropped;
+    // the renderer waits if the encoder falls behind.
+    if (!capture.start(renderer, frame_x, frame_y, Renderer::PixelFormat::RGB,
+                       [this](const unsigned char* pixels, int rowStride)
+                       {
+                           encodeFrame(pixels, rowStride);
+                       }))
+    {
+        return false;
+    }
+
     capturing = true;
     return true;
 }
@@ -326,6 +332,24 @@ bool OggTheoraCapture::captureFrame()
     if (!capturing)
         return false;
 
+    // Get the dimensions of the current viewport
+    int x, y, w, h;
+    renderer->getScreenSize(&x, &y, &w, &h);
+
+    x += (w - frame_x) / 2;
+    y += (h - frame_y) / 2;
+    if (!capture.captureFrame(x, y))
+        return false;
+
+    frames_captured++;
+    frameCaptured();
+
+    return true;
+}
+
+// Called on the capture worker for each frame read back.
+void OggTheoraCapture::encodeFrame(const unsigned char* pixels, int rowStride)
+{
     while (ogg_stream_pageout(&to,&videopage)>0)
     {
         /* flush a video page */
@@ -333,17 +357,7 @@ bool OggTheoraCapture::captureFrame()
         video_bytesout+=fwrite(videopage.body,1,videopage.body_len,outfile);
 
     }
-    if(ogg_stream_eos(&to)) return false;
-
-    // Get the dimensions of the current viewport
-    int x, y, w, h;
-    renderer->getScreenSize(&x, &y, &w, &h);
-
-    x += (w - frame_x) / 2;
-    y += (h - frame_y) / 2;
-    renderer->captureFrame(x, y, frame_x, frame_y,
-                           Renderer::PixelFormat::RGB,
-                           pixels);
+    if(ogg_stream_eos(&to)) return;
 
     unsigned char *ybase = yuvframe[0];
     unsigned char *ubase = yuvframe[0]+ video_x*video_y;
@@ -354,7 +368,7 @@ bool OggTheoraCapture::captureFrame()
         unsigned char *yptr = ybase + (video_x*(y+frame_y_offset))+frame_x_offset;
         unsigned char *uptr = ubase + (video_x*(y+frame_y_offset))+frame_x_offset;
         unsigned char *vptr = vbase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *rgb = pixels + ((frame_y-1-y)*rowStride); // The video is inverted
+        const unsigned char *rgb = pixels + ((frame_y-1-y)*rowStride); // The video is inverted
         for (int x=0; x<frame_x; x++)
         {
             unsigned char r = *rgb++;
@@ -374,91 +388,64 @@ bool OggTheoraCapture::captureFrame()
      */
 
     if (video_frame_count > 0)
-    {
-        yuv.y= yuvframe[1];
-        yuv.u= yuvframe[1]+ video_x*video_y;
-        yuv.v= yuvframe[1]+ video_x*video_y*2;
-        // Convert to 4:2:0
-        unsigned char * uin0 = yuv.u;
-        unsigned char * uin1 = yuv.u + video_x;
-        unsigned char * uout = yuv.u;
-        unsigned char * vin0 = yuv.v;
-        unsigned char * vin1 = yuv.v + video_x;
-        unsigned char * vout = yuv.v;
-        for (int y = 0; y < video_y; y += 2)
-        {
-            for (int x = 0; x < video_x; x += 2)
-            {
-                *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
-                uin0 += 2;
-                uin1 += 2;
-                uout++;
-                *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
-                vin0 += 2;
-                vin1 += 2;
-                vout++;
-            }
-            uin0 += video_x;
-            uin1 += video_x;
-            vin0 += video_x;
-            vin1 += video_x;
-        }
-        theora_encode_YUVin(&td,&yuv);
-        theora_encode_packetout(&td,0,&op);
-        ogg_stream_packetin(&to,&op);
-    }
+        encodeYUV(0);
     video_frame_count += 1;
     //if ((video_frame_count % 10) == 0)
     //    fmt::printf("Writing frame %d\n", video_frame_count);
     unsigned char *temp = yuvframe[0];
     yuvframe[0] = yuvframe[1];
     yuvframe[1] = temp;
-    frameCaptured();
+}
 
-    return true;
+// Convert the previous frame to 4:2:0 and submit it to the encoder.
+void OggTheoraCapture::encodeYUV(int lastFrame)
+{
+    yuv.y= yuvframe[1];
+    yuv.u= yuvframe[1]+ video_x*video_y;
+    yuv.v= yuvframe[1]+ video_x*video_y*2;
+    // Convert to 4:2:0
+    unsigned char * uin0 = yuv.u;
+    unsigned char * uin1 = yuv.u + video_x;
+    unsigned char * uout = yuv.u;
+    unsigned char * vin0 = yuv.v;
+    unsigned char * vin1 = yuv.v + video_x;
+    unsigned char * vout = yuv.v;
+    for (int y = 0; y < video_y; y += 2)
+    {
+        for (int x = 0; x < video_x; x += 2)
+        {
+            *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
+            uin0 += 2;
+            uin1 += 2;
+            uout++;
+            *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
+            vin0 += 2;
+            vin1 += 2;
+            vout++;
+        }
+        uin0 += video_x;
+        uin1 += video_x;
+        vin0 += video_x;
+        vin1 += video_x;
+    }
+    theora_encode_YUVin(&td,&yuv);
+    theora_encode_packetout(&td,lastFrame,&op);
+    ogg_stream_packetin(&to,&op);
 }
+
 void OggTheoraCapture::cleanup()
 {
     capturing = false;
     /* clear out state */
 
+    // Wait for the frames still being read back or encoded
+    capture.finish();
+
     if(outfile)
     {
-        fmt::printf(_("OggTheoraCapture::cleanup() - wrote %d frames\n"), video_frame_count);
+        fmt::printf(_("OggTheoraCapture::cleanup() - wrote %d frames\n"), (int) video_frame_count);
         if (video_frame_count > 0)
-        {
-            yuv.y= yuvframe[1];
-            yuv.u= yuvframe[1]+ video_x*video_y;
-            yuv.v= yuvframe[1]+ video_x*video_y*2 ;
-            // Convert to 4:2:0
-            unsigned char * uin0 = yuv.u;
-            unsigned char * uin1 = yuv.u + video_x;
-            unsigned char * uout = yuv.u;
-            unsigned char * vin0 = yuv.v;
-            unsigned char * vin1 = yuv.v + video_x;
-            unsigned char * vout = yuv.v;
-            for (int y = 0; y < video_y; y += 2)
-            {
-                for (int x = 0; x < video_x; x += 2)
-                {
-                    *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
-                    uin0 += 2;
-                    uin1 += 2;
-                    uout++;
-                    *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
-                    vin0 += 2;
-                    vin1 += 2;
-                    vout++;
-                }
-                uin0 += video_x;
-                uin1 += video_x;
-                vin0 += video_x;
-                vin1 += video_x;
-            }
-            theora_encode_YUVin(&td,&yuv);
-            theora_encode_packetout(&td,1,&op);
-            ogg_stream_packetin(&to,&op);
-        }
+            encodeYUV(1);
         while(ogg_stream_pageout(&to,&videopage)>0)
         {
             /* flush a video page */
@@ -481,7 +468,6 @@ void OggTheoraCapture::cleanup()
         outfile = nullptr;
         delete [] yuvframe[0];
         delete [] yuvframe[1];
-        delete [] pixels;
     }
 }
 
@@ -500,7 +486,7 @@ int OggTheoraCapture::getHeight() const
 }
 int OggTheoraCapture::getFrameCount() const
 {
-    return video_frame_count;
+    return frames_captured;
 }
 float OggTheoraCapture::getFrameRate() const
 {
@@ -2,7 +2,9 @@
 #ifndef _OGGTHEORACAPTURE_H_
 #define _OGGTHEORACAPTURE_H_
 
+#include <atomic>
 #include "theora/theora.h"
+#include "framecapture.h"
 #include "moviecapture.h"
 
 class OggTheoraCapture : public MovieCapture
@@ -25,6 +27,8 @@ public:
     void recordingStatus(bool) {};  // Added to allow GTK compilation
 
 private:
+    void encodeFrame(const unsigned char* pixels, int rowStride);
+    void encodeYUV(int lastFrame);
     void cleanup();
 
 private:
@@ -42,15 +46,18 @@ private:
     int video_q; // 0-63 aka 0-10 * 6.3
 
     bool       capturing;
-    int        video_frame_count;
-    int        video_bytesout;
+    // Frames handed to the capture, reported by getFrameCount() so that the
+    // recording time doesn't lag behind the encoder
+    int        frames_captured;
+    // Updated by the capture worker, which does the conversion and encoding
+    std::atomic<int> video_frame_count;
+    std::atomic<int> video_bytesout;
 
     // Consider RGB to YUV Color converstion table - jpeglib has one
     // but according the standards it's incorrect (generates values 0-255,
     // instead of clamped to 16-240).
 
-    int            rowStride;
-    unsigned char  *pixels;
+    FrameCapture   capture;
     unsigned char  *yuvframe[2];
     yuv_buffer     yuv;
     FILE           *outfile;
@@ -0,0 +1,412 @@
+// rendermain.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Offline renderer: runs a script without a window and writes every frame
+// to numbered PNG images or a Theora movie, stepping time by exactly one
+// frame instead of following the system clock.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <config.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <getopt.h>
+#include <unistd.h>
+#include <GL/glew.h>
+#include <fmt/printf.h>
+#include <celutil/util.h>
+#include <celutil/debug.h>
+#include <celengine/astro.h>
+#include <celengine/virtualtex.h>
+#include "celestiacore.h"
+#include "framecapture.h"
+#include "imagecapture.h"
+#ifdef THEORA
+#include "oggtheoracapture.h"
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+using namespace std;
+
+
+class RenderAlerter : public CelestiaCore::Alerter
+{
+ public:
+    void fatalError(const string& msg) override
+    {
+        fmt::fprintf(cerr, "%s\n", msg);
+    }
+};
+
+
+// Create a GL context without a window or a display server, through Mesa's
+// surfaceless EGL platform. Mesa's software renderer works on machines
+// without a GPU.
+static bool CreateContext()
+{
+    EGLDisplay display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                               EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+        cerr << "Can't initialize the surfaceless EGL display.\n";
+        return false;
+    }
+
+    // Nothing is drawn to an EGL surface, so the context needs no config.
+    EGLContext context = EGL_NO_CONTEXT;
+    if (eglBindAPI(EGL_OPENGL_API))
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, nullptr);
+
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        cerr << "Can't create an offscreen GL context.\n";
+        return false;
+    }
+
+    return true;
+}
+
+
+// The context has no default framebuffer: frames are drawn into a
+// framebuffer object of the frame size, which stays bound.
+static bool CreateFramebuffer(int width, int height)
+{
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE_EXT, &maxSize);
+    if (width > maxSize || height > maxSize)
+    {
+        fmt::fprintf(cerr, "Frames can't be larger than %ix%i.\n", maxSize, maxSize);
+        return false;
+    }
+
+    GLuint fbo = 0;
+    GLuint renderbuffers[2] = { 0, 0 };
+    glGenFramebuffersEXT(1, &fbo);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
+    glGenRenderbuffersEXT(2, renderbuffers);
+
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, renderbuffers[0]);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, width, height);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                 GL_RENDERBUFFER_EXT, renderbuffers[0]);
+
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, renderbuffers[1]);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT,
+                                 GL_RENDERBUFFER_EXT, renderbuffers[1]);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+    if (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT)
+    {
+        cerr << "Can't create an offscreen framebuffer.\n";
+        return false;
+    }
+
+    glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+
+    return true;
+}
+
+
+static bool HasSuffix(const string& s, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && compareIgnoringCase(s.substr(s.size() - n), suffix) == 0;
+}
+
+
+// The frame file names are made on the capture worker, where a bad
+// pattern would throw, so check here that it formats frame numbers into
+// distinct names.
+static bool IsFramePattern(const string& pattern)
+{
+    try
+    {
+        return fmt::sprintf(pattern, 0L) != fmt::sprintf(pattern, 1L);
+    }
+    catch (const fmt::format_error&)
+    {
+        return false;
+    }
+}
+
+
+// Relative paths are resolved before moving to the data directory.
+static string MakeAbsolute(const string& path, const string& cwd)
+{
+    if (path.empty() || path[0] == '/')
+        return path;
+    return cwd + "/" + path;
+}
+
+
+static void Usage(const char* name)
+{
+    fmt::fprintf(cerr,
+                 "Usage: %s [options] script\n"
+                 "  -o, --output FILE    frame%%05d.png by default; a printf pattern\n"
+                 "                       for PNG images, or a .ogv movie\n"
+                 "  -s, --size WxH       frame size, 1280x720 by default\n"
+                 "  -r, --fps RATE       frames per second, 30 by default\n"
+                 "  -n, --frames COUNT   render COUNT frames instead of stopping\n"
+                 "                       when the script ends\n"
+                 "  -t, --time JD        starting time, J2000 by default\n"
+                 "  -q, --quality Q      Theora quality, 0 to 10\n"
+                 "  -c, --conf FILE      configuration file\n"
+                 "  -d, --dir DIR        data directory\n"
+                 "  -e, --extrasdir DIR  additional extras directory\n",
+                 name);
+}
+
+
+int main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+    setlocale(LC_NUMERIC, "C");
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    bind_textdomain_codeset(PACKAGE, "UTF-8");
+    textdomain(PACKAGE);
+
+    string output = "frame%05d.png";
+    int width = 1280;
+    int height = 720;
+    double fps = 30.0;
+    long maxFrames = 0;
+    double startTime = astro::J2000;
+    float quality = 10.0f;
+    string configFile;
+    string dataDir = CONFIG_DATA_DIR;
+    vector<fs::path> extrasDirs;
+
+    static const struct option options[] =
+    {
+        { "output",    required_argument, nullptr, 'o' },
+        { "size",      required_argument, nullptr, 's' },
+        { "fps",       required_argument, nullptr, 'r' },
+        { "frames",    required_argument, nullptr, 'n' },
+        { "time",      required_argument, nullptr, 't' },
+        { "quality",   required_argument, nullptr, 'q' },
+        { "conf",      required_argument, nullptr, 'c' },
+        { "dir",       required_argument, nullptr, 'd' },
+        { "extrasdir", required_argument, nullptr, 'e' },
+        { nullptr,     0,                 nullptr, 0   }
+    };
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr)
+        cwd[0] = '\0';
+
+    int c;
+    while ((c = getopt_long(argc, argv, "o:s:r:n:t:q:c:d:e:", options, nullptr)) != -1)
+    {
+        switch (c)
+        {
+        case 'o':
+            output = optarg;
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2)
+                width = height = 0;
+            break;
+        case 'r':
+            fps = atof(optarg);
+            break;
+        case 'n':
+            maxFrames = atol(optarg);
+            break;
+        case 't':
+            startTime = atof(optarg);
+            break;
+        case 'q':
+            quality = (float) atof(optarg);
+            break;
+        case 'c':
+            configFile = MakeAbsolute(optarg, cwd);
+            break;
+        case 'd':
+            dataDir = optarg;
+            break;
+        case 'e':
+            extrasDirs.push_back(MakeAbsolute(optarg, cwd));
+            break;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1 || width <= 0 || height <= 0 || !(fps > 0.0))
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    bool movie = HasSuffix(output, ".ogv") || HasSuffix(output, ".ogg");
+#ifndef THEORA
+    if (movie)
+    {
+        cerr << "This build doesn't support Theora movies.\n";
+        return 1;
+    }
+#endif
+    if (!movie && !IsFramePattern(output))
+    {
+        cerr << "The output must be a .ogv movie or a pattern such as frame%05d.png.\n";
+        return 1;
+    }
+
+    string scriptFile = MakeAbsolute(argv[optind], cwd);
+    output = MakeAbsolute(output, cwd);
+
+    if (chdir(dataDir.c_str()) == -1)
+    {
+        cerr << "Cannot chdir to '" << dataDir << "'.\n";
+        return 1;
+    }
+
+    if (!CreateContext())
+        return 1;
+
+    GLenum glewErr = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX loads the GL functions, then fails to find the GLX
+    // display an EGL context doesn't have.
+    if (glewErr == GLEW_ERROR_NO_GLX_DISPLAY)
+        glewErr = GLEW_OK;
+#endif
+    if (glewErr != GLEW_OK)
+    {
+        fmt::fprintf(cerr, "Unable to initialize OpenGL extensions (error %i).\n", glewErr);
+        return 1;
+    }
+
+    if (!CreateFramebuffer(width, height))
+        return 1;
+
+    auto* appCore = new CelestiaCore();
+    RenderAlerter alerter;
+    appCore->setAlerter(&alerter);
+
+    if (!appCore->initSimulation(configFile, extrasDirs))
+    {
+        cerr << "Error initializing simulation.\n";
+        return 1;
+    }
+
+    // A frame must not depend on how fast textures, models and tiles load
+    // in the background.
+    appCore->getConfig()->loaderThreads = 0;
+    VirtualTexture::setSynchronousLoading(true);
+
+    if (!appCore->initRenderer())
+    {
+        cerr << "Error initializing renderer.\n";
+        return 1;
+    }
+    appCore->getRenderer()->setSolarSystemMaxDistance(appCore->getConfig()->SolarSystemMaxDistance);
+    // Every orbit path is sampled in the frame it first appears in.
+    appCore->getRenderer()->setOrbitSamplingBudget(0.0);
+    appCore->resize(width, height);
+
+    appCore->start(startTime);
+    appCore->setTimeZoneBias(0);
+    appCore->setTimeZoneName("UTC");
+
+    // Frames are read back while the next one is rendered, and written on
+    // the capture worker.
+    atomic<bool> writeFailed{ false };
+    long framesWritten = 0;
+    FrameCapture capture;
+#ifdef THEORA
+    OggTheoraCapture* movieCapture = nullptr;
+    if (movie)
+    {
+        movieCapture = new OggTheoraCapture(appCore->getRenderer());
+        movieCapture->setAspectRatio(width, height);
+        movieCapture->setQuality(quality);
+        if (!movieCapture->start(output, width, height, (float) fps))
+        {
+            fmt::fprintf(cerr, "Error creating %s.\n", output);
+            return 1;
+        }
+    }
+    else
+#endif
+    {
+        capture.start(appCore->getRenderer(), width, height, Renderer::PixelFormat::RGB,
+                      [&](const unsigned char* pixels, int rowStride)
+                      {
+                          string filename = fmt::sprintf(output, framesWritten++);
+                          FILE* out = fopen(filename.c_str(), "wb");
+                          if (out == nullptr)
+                          {
+                              fmt::fprintf(cerr, "Can't create %s.\n", filename);
+                              writeFailed = true;
+                              return;
+                          }
+                          if (!WritePNGImage(out, filename, pixels, width, height, rowStride))
+                              writeFailed = true;
+                          if (fclose(out) != 0)
+                              writeFailed = true;
+                      });
+    }
+
+    appCore->runScript(fs::path(scriptFile));
+    if (!appCore->isScriptRunning())
+    {
+        fmt::fprintf(cerr, "Can't run %s.\n", scriptFile);
+        return 1;
+    }
+
+    double dt = 1.0 / fps;
+    long frame = 0;
+    while (maxFrames > 0 ? frame < maxFrames : appCore->isScriptRunning())
+    {
+        appCore->tick(dt);
+        if (maxFrames == 0 && !appCore->isScriptRunning())
+            break;
+
+        appCore->setViewChanged();
+        appCore->draw();
+
+#ifdef THEORA
+        if (movieCapture != nullptr)
+            movieCapture->captureFrame();
+        else
+#endif
+            capture.captureFrame(0, 0);
+
+        if (writeFailed)
+            break;
+
+        frame++;
+        if (frame % (long) ceil(fps) == 0)
+            fmt::fprintf(cerr, "\r%ld frames", frame);
+    }
+
+#ifdef THEORA
+    if (movieCapture != nullptr)
+    {
+        movieCapture->end();
+        delete movieCapture;
+    }
+#endif
+    capture.finish();
+    fmt::fprintf(cerr, "\r%ld frames rendered.\n", frame);
+
+    delete appCore;
+
+    return writeFailed ? 1 : 0;
+}
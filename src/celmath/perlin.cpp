@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
+#include <mutex>
 
 #include "mathlib.h"
 #include "perlin.h"
@@ -154,7 +155,8 @@ static float g3[B + B + 2][3];
 static float g2[B + B + 2][2];
 static float g1[B + B + 2];
 
-static bool initialized = false;
+// Noise may be computed on resource loader threads
+static std::once_flag initialized;
 
 static void init();
 
@@ -169,8 +171,7 @@ static void init();
 
 float noise1(float arg)
 {
-    if (!initialized)
-        init();
+    std::call_once(initialized, init);
 
     int bx0, bx1;
     float rx0, rx1, t, u, v, vec[1];
@@ -191,8 +192,7 @@ float noise2(const float vec[2])
     float rx0, rx1, ry0, ry1, *q, sx, sy, a, b, t, u, v;
     int i, j;
 
-    if (!initialized)
-        init();
+    std::call_once(initialized, init);
 
     setup(0, bx0,bx1, rx0,rx1);
     setup(1, by0,by1, ry0,ry1);
@@ -223,8 +223,7 @@ float noise2(const float vec[2])
 
 float noise3(const float vec[3])
 {
-    if (!initialized)
-        init();
+    std::call_once(initialized, init);
 
     int bx0, bx1, by0, by1, bz0, bz1, b00, b10, b01, b11;
     float rx0, rx1, ry0, ry1, rz0, rz1, *q, sy, sz, a, b, c, d, t, u, v;
@@ -329,7 +328,5 @@ static void init()
         g3[B + i][1] = g3[i][1];
         g3[B + i][2] = g3[i][2];
     }
-
-    initialized = true;
 }
 
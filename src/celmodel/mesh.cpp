@@ -187,6 +187,7 @@ Mesh::setVertices(unsigned int _nVertices, void* vertexData)
 
     nVertices = _nVertices;
     vertices = vertexData;
+    bvh = nullptr;
 }
 
 
@@ -197,6 +198,7 @@ Mesh::setVertexDescription(const VertexDescription& desc)
         return false;
 
     vertexDesc = desc;
+    bvh = nullptr;
 
     return true;
 }
@@ -232,6 +234,7 @@ unsigned int
 Mesh::addGroup(PrimitiveGroup* group)
 {
     groups.push_back(group);
+    bvh = nullptr;
     return groups.size();
 }
 
@@ -266,6 +269,7 @@ Mesh::clearGroups()
         delete group;
 
     groups.clear();
+    bvh = nullptr;
 }
 
 
@@ -293,6 +297,8 @@ Mesh::remapIndices(const vector<index32>& indexMap)
             group->indices[i] = indexMap[group->indices[i]];
         }
     }
+
+    bvh = nullptr;
 }
 
 
@@ -321,15 +327,13 @@ void
 Mesh::aggregateByMaterial()
 {
     sort(groups.begin(), groups.end(), PrimitiveGroupComparator());
+    bvh = nullptr;
 }
 
 
 bool
 Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult* result) const
 {
-    double maxDistance = 1.0e30;
-    double closest = maxDistance;
-
     // Pick will automatically fail without vertex positions--no reasonable
     // mesh should lack these.
     if (vertexDesc.getAttribute(Position).semantic != Position ||
@@ -338,119 +342,23 @@ Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult*
         return false;
     }
 
-    unsigned int posOffset = vertexDesc.getAttribute(Position).offset;
-    auto* vdata = reinterpret_cast<char*>(vertices);
+    if (bvh == nullptr)
+        bvh = unique_ptr<MeshBVH>(new MeshBVH(*this));
 
-    // Iterate over all primitive groups in the mesh
-    for (const auto group : groups)
+    double distance;
+    unsigned int groupIndex;
+    unsigned int primitiveIndex;
+    if (!bvh->pick(*this, rayOrigin, rayDirection, distance, groupIndex, primitiveIndex))
+        return false;
+
+    if (result)
     {
-        Mesh::PrimitiveGroupType primType = group->prim;
-        index32 nIndices = group->nIndices;
-
-        // Only attempt to compute the intersection of the ray with triangle
-        // groups.
-        if ((primType == TriList || primType == TriStrip || primType == TriFan) &&
-            (nIndices >= 3) &&
-            !(primType == TriList && nIndices % 3 != 0))
-        {
-            unsigned int primitiveIndex = 0;
-            index32 index = 0;
-            index32 i0 = group->indices[0];
-            index32 i1 = group->indices[1];
-            index32 i2 = group->indices[2];
-
-            // Iterate over the triangles in the primitive group
-            do
-            {
-                // Get the triangle vertices v0, v1, and v2
-                Vector3d v0 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i0 * vertexDesc.stride + posOffset)).cast<double>();
-                Vector3d v1 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i1 * vertexDesc.stride + posOffset)).cast<double>();
-                Vector3d v2 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i2 * vertexDesc.stride + posOffset)).cast<double>();
-
-                // Compute the edge vectors e0 and e1, and the normal n
-                Vector3d e0 = v1 - v0;
-                Vector3d e1 = v2 - v0;
-                Vector3d n = e0.cross(e1);
-
-                // c is the cosine of the angle between the ray and triangle normal
-                double c = n.dot(rayDirection);
-
-                // If the ray is parallel to the triangle, it either misses the
-                // triangle completely, or is contained in the triangle's plane.
-                // If it's contained in the plane, we'll still call it a miss.
-                if (c != 0.0)
-                {
-                    double t = (n.dot(v0 - rayOrigin)) / c;
-                    if (t < closest && t > 0.0)
-                    {
-                        double m00 = e0.dot(e0);
-                        double m01 = e0.dot(e1);
-                        double m10 = e1.dot(e0);
-                        double m11 = e1.dot(e1);
-                        double det = m00 * m11 - m01 * m10;
-                        if (det != 0.0)
-                        {
-                            Vector3d p = rayOrigin + rayDirection * t;
-                            Vector3d q = p - v0;
-                            double q0 = e0.dot(q);
-                            double q1 = e1.dot(q);
-                            double d = 1.0 / det;
-                            double s0 = (m11 * q0 - m01 * q1) * d;
-                            double s1 = (m00 * q1 - m10 * q0) * d;
-                            if (s0 >= 0.0 && s1 >= 0.0 && s0 + s1 <= 1.0)
-                            {
-                                closest = t;
-                                if (result)
-                                {
-                                    result->group = group;
-                                    result->primitiveIndex = primitiveIndex;
-                                    result->distance = closest;
-                                }
-                            }
-                        }
-                    }
-                }
-
-                // Get the indices for the next triangle
-                if (primType == TriList)
-                {
-                    index += 3;
-                    if (index < nIndices)
-                    {
-                        i0 = group->indices[index + 0];
-                        i1 = group->indices[index + 1];
-                        i2 = group->indices[index + 2];
-                    }
-                }
-                else if (primType == TriStrip)
-                {
-                    index += 1;
-                    if (index < nIndices)
-                    {
-                        i0 = i1;
-                        i1 = i2;
-                        i2 = group->indices[index];
-                        // TODO: alternate orientation of triangles in a strip
-                    }
-                }
-                else // primType == TriFan
-                {
-                    index += 1;
-                    if (index < nIndices)
-                    {
-                        index += 1;
-                        i1 = i2;
-                        i2 = group->indices[index];
-                    }
-                }
-
-                primitiveIndex++;
-
-            } while (index < nIndices);
-        }
+        result->group = groups[groupIndex];
+        result->primitiveIndex = primitiveIndex;
+        result->distance = distance;
     }
 
-    return closest != maxDistance;
+    return true;
 }
 
 
@@ -529,6 +437,8 @@ Mesh::transform(const Vector3f& translation, float scale)
         for (i = 0; i < nVertices; i++, vdata += vertexDesc.stride)
             reinterpret_cast<float*>(vdata)[0] *= scale;
     }
+
+    bvh = nullptr;
 }
 
 
@@ -12,8 +12,10 @@
 #define _CELMODEL_MESH_H_
 
 #include "material.h"
+#include "meshbvh.h"
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -203,6 +205,10 @@ class Mesh
     void* vertices{ nullptr };
     mutable BufferResource* vbResource{ nullptr };
 
+    // Built the first time the mesh is picked, which only happens on the
+    // main thread, and discarded when the vertices or groups change.
+    mutable std::unique_ptr<MeshBVH> bvh;
+
     std::vector<PrimitiveGroup*> groups;
 
     std::string name;
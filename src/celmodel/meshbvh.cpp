@@ -0,0 +1,448 @@
+// meshbvh.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Bounding volume hierarchy for picking the triangles of a mesh.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "meshbvh.h"
+#include "mesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <Eigen/Geometry>
+
+using namespace Eigen;
+using namespace std;
+
+
+namespace cmod
+{
+
+static constexpr unsigned int BinCount = 16;
+
+// Nodes with up to MinLeafSize triangles are never split, and nodes with
+// more than MaxLeafSize always are.
+static constexpr uint32_t MinLeafSize = 4;
+static constexpr uint32_t MaxLeafSize = 8;
+
+// Below this depth, nodes are split at the median, so that no path is
+// longer than 64 nodes however unbalanced the SAH splits are.
+static constexpr unsigned int MedianSplitDepth = 32;
+static constexpr unsigned int StackSize = 72;
+
+
+// Triangles are partitioned by value rather than through an index, so
+// that every pass of the build reads memory sequentially.
+struct MeshBVH::BuildItem
+{
+    AlignedBox3f bounds;
+    Vector3f centroid;
+    uint32_t triangle;
+};
+
+
+static float SurfaceArea(const AlignedBox3f& box)
+{
+    if (box.isEmpty())
+        return 0.0f;
+
+    Vector3f d = box.sizes();
+    return d.x() * d.y() + d.y() * d.z() + d.z() * d.x();
+}
+
+
+MeshBVH::MeshBVH(const Mesh& mesh)
+{
+    const Mesh::VertexDescription& desc = mesh.getVertexDescription();
+    if (desc.getAttribute(Mesh::Position).format != Mesh::Float3 || mesh.getVertexData() == nullptr)
+        return;
+
+    const char* vdata = reinterpret_cast<const char*>(mesh.getVertexData()) +
+                        desc.getAttribute(Mesh::Position).offset;
+    auto position = [vdata, &desc](uint32_t i)
+    {
+        return Map<const Vector3f>(reinterpret_cast<const float*>(vdata + (size_t) i * desc.stride));
+    };
+
+    // Collect the triangles of the triangle groups, numbered as the
+    // primitives of their group
+    unsigned int nVertices = mesh.getVertexCount();
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        Mesh::PrimitiveGroupType prim = group->prim;
+        unsigned int nIndices = group->nIndices;
+        if ((prim != Mesh::TriList && prim != Mesh::TriStrip && prim != Mesh::TriFan) ||
+            nIndices < 3 ||
+            (prim == Mesh::TriList && nIndices % 3 != 0))
+        {
+            continue;
+        }
+
+        const Mesh::index32* indices = group->indices;
+        unsigned int nTriangles = prim == Mesh::TriList ? nIndices / 3 : nIndices - 2;
+        for (unsigned int p = 0; p < nTriangles; p++)
+        {
+            Triangle triangle;
+            if (prim == Mesh::TriList)
+            {
+                triangle.index[0] = indices[p * 3];
+                triangle.index[1] = indices[p * 3 + 1];
+                triangle.index[2] = indices[p * 3 + 2];
+            }
+            else
+            {
+                triangle.index[0] = prim == Mesh::TriStrip ? indices[p] : indices[0];
+                triangle.index[1] = indices[p + 1];
+                triangle.index[2] = indices[p + 2];
+            }
+            triangle.group = g;
+            triangle.primitive = p;
+
+            if (triangle.index[0] < nVertices &&
+                triangle.index[1] < nVertices &&
+                triangle.index[2] < nVertices)
+            {
+                triangles.push_back(triangle);
+            }
+        }
+    }
+
+    if (triangles.empty())
+        return;
+
+    vector<BuildItem> items(triangles.size());
+    for (uint32_t i = 0; i < triangles.size(); i++)
+    {
+        BuildItem& item = items[i];
+        item.bounds = AlignedBox3f(position(triangles[i].index[0]));
+        item.bounds.extend(position(triangles[i].index[1]));
+        item.bounds.extend(position(triangles[i].index[2]));
+        item.centroid = item.bounds.center();
+        item.triangle = i;
+    }
+
+    nodes.reserve(triangles.size() / 2);
+    build(items.data(), 0, (uint32_t) items.size(), 0);
+    nodes.shrink_to_fit();
+
+    // Store the triangles in the order the leaves reference them
+    vector<Triangle> sorted;
+    sorted.reserve(triangles.size());
+    for (const auto& item : items)
+        sorted.push_back(triangles[item.triangle]);
+    triangles.swap(sorted);
+}
+
+
+uint32_t
+MeshBVH::build(BuildItem* items, uint32_t first, uint32_t count, unsigned int depth)
+{
+    auto nodeIndex = (uint32_t) nodes.size();
+    nodes.emplace_back();
+
+    AlignedBox3f bounds;
+    AlignedBox3f centroidBounds;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        bounds.extend(items[i].bounds);
+        centroidBounds.extend(items[i].centroid);
+    }
+
+    // Rays are tested against the boxes in single precision but against
+    // the triangles in double, so leave some room.
+    float pad = (bounds.sizes().maxCoeff() +
+                 bounds.min().cwiseAbs().maxCoeff() +
+                 bounds.max().cwiseAbs().maxCoeff()) * 1.0e-5f;
+    Node& node = nodes[nodeIndex];
+    for (int i = 0; i < 3; i++)
+    {
+        node.lower[i] = bounds.min()[i] - pad;
+        node.upper[i] = bounds.max()[i] + pad;
+    }
+    node.lower[3] = -FLT_MAX;
+    node.upper[3] = FLT_MAX;
+    node.first = first;
+    node.count = count;
+
+    if (count <= MinLeafSize)
+        return nodeIndex;
+
+    // Identical centroids can't be told apart
+    int axis;
+    float extent = centroidBounds.sizes().maxCoeff(&axis);
+    if (extent <= 0.0f)
+        return nodeIndex;
+
+    // Bin the centroids along the axis where they're most spread out, and
+    // evaluate the surface area heuristic at the bin boundaries. Trying the
+    // other axes too makes the build much slower for little gain.
+    float binScale = (float) BinCount / extent;
+    float binOrigin = centroidBounds.min()[axis];
+    auto binOf = [binScale, binOrigin, axis](const BuildItem& item)
+    {
+        return min((unsigned int) ((item.centroid[axis] - binOrigin) * binScale), BinCount - 1);
+    };
+
+    float bestCost = FLT_MAX;
+    unsigned int bestSplit = 0;
+    if (depth < MedianSplitDepth)
+    {
+        AlignedBox3f binBounds[BinCount];
+        uint32_t binCounts[BinCount] = { 0 };
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            unsigned int bin = binOf(items[i]);
+            binCounts[bin]++;
+            binBounds[bin].extend(items[i].bounds);
+        }
+
+        float rightArea[BinCount];
+        uint32_t rightCount[BinCount];
+        AlignedBox3f side;
+        uint32_t n = 0;
+        for (unsigned int b = BinCount - 1; b > 0; b--)
+        {
+            side.extend(binBounds[b]);
+            n += binCounts[b];
+            rightArea[b] = SurfaceArea(side);
+            rightCount[b] = n;
+        }
+
+        side.setEmpty();
+        n = 0;
+        for (unsigned int b = 1; b < BinCount; b++)
+        {
+            side.extend(binBounds[b - 1]);
+            n += binCounts[b - 1];
+            if (n == 0 || rightCount[b] == 0)
+                continue;
+
+            float cost = (float) n * SurfaceArea(side) + (float) rightCount[b] * rightArea[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+    }
+
+    // Traversing a node costs about as much as testing a triangle
+    float area = SurfaceArea(bounds);
+    if (bestSplit > 0 && count <= MaxLeafSize && area + bestCost >= (float) count * area)
+        return nodeIndex;
+
+    BuildItem* begin = items + first;
+    BuildItem* end = begin + count;
+    BuildItem* mid = begin;
+    if (bestSplit > 0)
+        mid = partition(begin, end, [&](const BuildItem& item) { return binOf(item) < bestSplit; });
+
+    if (mid == begin || mid == end)
+    {
+        mid = begin + count / 2;
+        nth_element(begin, mid, end, [axis](const BuildItem& a, const BuildItem& b)
+                    {
+                        return a.centroid[axis] < b.centroid[axis];
+                    });
+    }
+
+    auto leftCount = (uint32_t) (mid - begin);
+    build(items, first, leftCount, depth + 1);
+    uint32_t second = build(items, first + leftCount, count - leftCount, depth + 1);
+
+    nodes[nodeIndex].first = second;
+    nodes[nodeIndex].count = 0;
+
+    return nodeIndex;
+}
+
+
+// Slab test of all three axes at once; the fourth lane always passes.
+static inline bool
+IntersectBox(const float* lower, const float* upper,
+             const Array4f& origin, const Array4f& invDirection,
+             float tMax, float& tEntry)
+{
+    Array4f t0 = (Map<const Array4f>(lower) - origin) * invDirection;
+    Array4f t1 = (Map<const Array4f>(upper) - origin) * invDirection;
+    float tNear = max(t0.min(t1).maxCoeff(), 0.0f);
+    float tFar = min(t0.max(t1).minCoeff(), tMax);
+
+    tEntry = tNear;
+    return tNear <= tFar;
+}
+
+
+static inline float
+BoxDistanceLimit(double closest)
+{
+    return (float) (closest * 1.00001);
+}
+
+
+static bool
+IntersectTriangle(const Vector3d& v0, const Vector3d& v1, const Vector3d& v2,
+                  const Vector3d& rayOrigin, const Vector3d& rayDirection,
+                  double closest, double& distance)
+{
+    // Compute the edge vectors e0 and e1, and the normal n
+    Vector3d e0 = v1 - v0;
+    Vector3d e1 = v2 - v0;
+    Vector3d n = e0.cross(e1);
+
+    // c is the cosine of the angle between the ray and triangle normal
+    double c = n.dot(rayDirection);
+
+    // If the ray is parallel to the triangle, it either misses the
+    // triangle completely, or is contained in the triangle's plane.
+    // If it's contained in the plane, we'll still call it a miss.
+    if (c == 0.0)
+        return false;
+
+    double t = (n.dot(v0 - rayOrigin)) / c;
+    if (t >= closest || t <= 0.0)
+        return false;
+
+    double m00 = e0.dot(e0);
+    double m01 = e0.dot(e1);
+    double m10 = e1.dot(e0);
+    double m11 = e1.dot(e1);
+    double det = m00 * m11 - m01 * m10;
+    if (det == 0.0)
+        return false;
+
+    Vector3d p = rayOrigin + rayDirection * t;
+    Vector3d q = p - v0;
+    double q0 = e0.dot(q);
+    double q1 = e1.dot(q);
+    double d = 1.0 / det;
+    double s0 = (m11 * q0 - m01 * q1) * d;
+    double s1 = (m00 * q1 - m10 * q0) * d;
+    if (s0 < 0.0 || s1 < 0.0 || s0 + s1 > 1.0)
+        return false;
+
+    distance = t;
+    return true;
+}
+
+
+bool
+MeshBVH::pick(const Mesh& mesh,
+              const Vector3d& rayOrigin,
+              const Vector3d& rayDirection,
+              double& distance,
+              unsigned int& groupIndex,
+              unsigned int& primitiveIndex) const
+{
+    if (nodes.empty())
+        return false;
+
+    const Mesh::VertexDescription& desc = mesh.getVertexDescription();
+    const char* vdata = reinterpret_cast<const char*>(mesh.getVertexData()) +
+                        desc.getAttribute(Mesh::Position).offset;
+    auto position = [vdata, &desc](uint32_t i)
+    {
+        return Map<const Vector3f>(reinterpret_cast<const float*>(vdata + (size_t) i * desc.stride)).cast<double>();
+    };
+
+    Array4f origin((float) rayOrigin.x(), (float) rayOrigin.y(), (float) rayOrigin.z(), 0.0f);
+    Array4f invDirection;
+    for (int i = 0; i < 3; i++)
+    {
+        // Avoid 0 * infinity when the ray lies in the plane of a slab
+        auto d = (float) rayDirection[i];
+        if (abs(d) < 1.0e-30f)
+            d = copysign(1.0e-30f, d);
+        invDirection[i] = 1.0f / d;
+    }
+    invDirection[3] = 1.0f;
+
+    double closest = 1.0e30;
+    bool hit = false;
+
+    struct StackEntry
+    {
+        uint32_t node;
+        float distance;
+    };
+    StackEntry stack[StackSize];
+    unsigned int stackSize = 0;
+
+    float tEntry;
+    if (!IntersectBox(nodes[0].lower, nodes[0].upper, origin, invDirection, FLT_MAX, tEntry))
+        return false;
+    stack[stackSize++] = { 0, tEntry };
+
+    while (stackSize > 0)
+    {
+        StackEntry entry = stack[--stackSize];
+        if (entry.distance > BoxDistanceLimit(closest))
+            continue;
+
+        const Node& node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                double t;
+                if (IntersectTriangle(position(triangle.index[0]),
+                                      position(triangle.index[1]),
+                                      position(triangle.index[2]),
+                                      rayOrigin, rayDirection, closest, t))
+                {
+                    closest = t;
+                    hit = true;
+                    groupIndex = triangle.group;
+                    primitiveIndex = triangle.primitive;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first, so that farther nodes can be
+        // skipped once a hit is found.
+        StackEntry first = { entry.node + 1, 0.0f };
+        StackEntry second = { node.first, 0.0f };
+        float limit = BoxDistanceLimit(closest);
+        bool hitFirst = IntersectBox(nodes[first.node].lower, nodes[first.node].upper,
+                                     origin, invDirection, limit, first.distance);
+        bool hitSecond = IntersectBox(nodes[second.node].lower, nodes[second.node].upper,
+                                      origin, invDirection, limit, second.distance);
+        if (hitFirst && hitSecond)
+        {
+            if (second.distance < first.distance)
+                swap(first, second);
+            stack[stackSize++] = second;
+            stack[stackSize++] = first;
+        }
+        else if (hitFirst)
+        {
+            stack[stackSize++] = first;
+        }
+        else if (hitSecond)
+        {
+            stack[stackSize++] = second;
+        }
+    }
+
+    if (hit)
+        distance = closest;
+
+    return hit;
+}
+
+
+size_t
+MeshBVH::memoryUsage() const
+{
+    return nodes.capacity() * sizeof(Node) + triangles.capacity() * sizeof(Triangle);
+}
+
+} // namespace cmod
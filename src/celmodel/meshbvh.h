@@ -0,0 +1,77 @@
+// meshbvh.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Bounding volume hierarchy for picking the triangles of a mesh.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+
+namespace cmod
+{
+
+class Mesh;
+
+/*! A bounding volume hierarchy over the triangles of a mesh, so that a
+ *  ray only has to be tested against the few triangles near it.
+ *
+ *  It's split with the surface area heuristic and stored as a flat array
+ *  of nodes in depth first order: the first child of an interior node is
+ *  the next node, and the node records the index of the second one.
+ *  Triangles are referenced by vertex index, so the hierarchy must be
+ *  rebuilt when the mesh changes.
+ */
+class MeshBVH
+{
+ public:
+    explicit MeshBVH(const Mesh& mesh);
+
+    /*! Find the closest intersection of the ray with the triangles of the
+     *  mesh the hierarchy was built for. On a hit, return the distance in
+     *  units of rayDirection, and the index of the primitive group and of
+     *  the triangle in it.
+     */
+    bool pick(const Mesh& mesh,
+              const Eigen::Vector3d& rayOrigin,
+              const Eigen::Vector3d& rayDirection,
+              double& distance,
+              unsigned int& groupIndex,
+              unsigned int& primitiveIndex) const;
+
+    size_t memoryUsage() const;
+
+ private:
+    struct Triangle
+    {
+        uint32_t index[3];
+        uint32_t group;
+        uint32_t primitive;
+    };
+
+    // Bounds have a fourth lane, spanning all floats, so that a ray is
+    // tested against the three slabs at once with SIMD.
+    struct Node
+    {
+        float lower[4];
+        float upper[4];
+        uint32_t first;  // first triangle of a leaf, second child otherwise
+        uint32_t count;  // 0 for interior nodes
+    };
+
+    struct BuildItem;
+
+    uint32_t build(BuildItem* items, uint32_t first, uint32_t count, unsigned int depth);
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+};
+
+} // namespace cmod
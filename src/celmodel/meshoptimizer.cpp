@@ -0,0 +1,463 @@
+// meshoptimizer.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Load time mesh optimization: vertex welding, triangle reordering for the
+// post-transform vertex cache and vertex reordering for fetch locality.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "meshoptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <vector>
+
+using namespace std;
+
+
+namespace cmod
+{
+
+using index32 = Mesh::index32;
+
+
+static void SetGroupIndices(Mesh::PrimitiveGroup* group,
+                            Mesh::PrimitiveGroupType prim,
+                            const vector<index32>& indices)
+{
+    delete[] group->indices;
+    group->prim = prim;
+    group->nIndices = indices.size();
+    group->indices = new index32[indices.size()];
+    copy(indices.begin(), indices.end(), group->indices);
+}
+
+
+bool
+UniquifyVertices(Mesh& mesh)
+{
+    unsigned int nVertices = mesh.getVertexCount();
+    unsigned int stride = mesh.getVertexStride();
+    const char* vertexData = reinterpret_cast<const char*>(mesh.getVertexData());
+    if (nVertices == 0 || vertexData == nullptr)
+        return false;
+
+    auto vertex = [vertexData, stride](index32 i) { return vertexData + (size_t) i * stride; };
+
+    // Sort the vertices so that identical ones will be ordered consecutively
+    vector<index32> order(nVertices);
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(),
+         [&](index32 a, index32 b) { return memcmp(vertex(a), vertex(b), stride) < 0; });
+
+    // Build the vertex map
+    vector<index32> vertexMap(nVertices);
+    unsigned int uniqueVertexCount = 0;
+    for (unsigned int i = 0; i < nVertices; i++)
+    {
+        if (i == 0 || memcmp(vertex(order[i - 1]), vertex(order[i]), stride) != 0)
+            uniqueVertexCount++;
+        vertexMap[order[i]] = uniqueVertexCount - 1;
+    }
+
+    // No work left to do if we couldn't eliminate any vertices
+    if (uniqueVertexCount == nVertices)
+        return true;
+
+    auto* newVertexData = new char[(size_t) uniqueVertexCount * stride];
+    for (unsigned int i = 0; i < nVertices; i++)
+        memcpy(newVertexData + (size_t) vertexMap[i] * stride, vertex(i), stride);
+
+    mesh.setVertices(uniqueVertexCount, newVertexData);
+    mesh.remapIndices(vertexMap);
+
+    return true;
+}
+
+
+void
+ConvertToTriangleLists(Mesh& mesh)
+{
+    vector<index32> triangles;
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        if (group->prim != Mesh::TriStrip && group->prim != Mesh::TriFan)
+            continue;
+
+        const index32* indices = group->indices;
+        triangles.clear();
+        for (unsigned int i = 2; i < group->nIndices; i++)
+        {
+            index32 i0, i1;
+            if (group->prim == Mesh::TriFan)
+            {
+                i0 = indices[0];
+                i1 = indices[i - 1];
+            }
+            else if (i % 2 == 0)
+            {
+                i0 = indices[i - 2];
+                i1 = indices[i - 1];
+            }
+            else
+            {
+                // Every other triangle of a strip has its winding reversed
+                i0 = indices[i - 1];
+                i1 = indices[i - 2];
+            }
+            index32 i2 = indices[i];
+
+            if (i0 != i1 && i1 != i2 && i0 != i2)
+            {
+                triangles.push_back(i0);
+                triangles.push_back(i1);
+                triangles.push_back(i2);
+            }
+        }
+
+        SetGroupIndices(group, Mesh::TriList, triangles);
+    }
+}
+
+
+void
+MergeGroupsByMaterial(Mesh& mesh)
+{
+    struct MergedGroup
+    {
+        Mesh::PrimitiveGroupType prim;
+        unsigned int materialIndex;
+        vector<index32> indices;
+    };
+
+    vector<MergedGroup> merged;
+    map<unsigned int, size_t> triListForMaterial;
+    bool changed = false;
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        if (group->prim == Mesh::TriList)
+        {
+            auto iter = triListForMaterial.find(group->materialIndex);
+            if (iter != triListForMaterial.end())
+            {
+                vector<index32>& indices = merged[iter->second].indices;
+                indices.insert(indices.end(), group->indices, group->indices + group->nIndices);
+                changed = true;
+                continue;
+            }
+            triListForMaterial[group->materialIndex] = merged.size();
+        }
+
+        merged.push_back({ group->prim,
+                           group->materialIndex,
+                           vector<index32>(group->indices, group->indices + group->nIndices) });
+    }
+
+    if (!changed)
+        return;
+
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+        delete[] mesh.getGroup(g)->indices;
+    mesh.clearGroups();
+
+    for (const auto& group : merged)
+    {
+        auto* indices = new index32[group.indices.size()];
+        copy(group.indices.begin(), group.indices.end(), indices);
+        mesh.addGroup(group.prim, group.materialIndex, group.indices.size(), indices);
+    }
+}
+
+
+// Scoring from Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+// The cache here is only a model for ranking triangles; the result works
+// well with any real cache size.
+static constexpr unsigned int ForsythCacheSize = 32;
+static constexpr unsigned int ForsythMaxValence = 32;
+
+class ForsythScoreTable
+{
+ public:
+    ForsythScoreTable()
+    {
+        for (unsigned int i = 0; i < ForsythCacheSize; i++)
+        {
+            // The vertices of the last triangle get a fixed score, so that
+            // it isn't simply drawn again with one new vertex.
+            if (i < 3)
+                cacheScore[i] = 0.75f;
+            else
+                cacheScore[i] = pow(1.0f - (float) (i - 3) / (float) (ForsythCacheSize - 3), 1.5f);
+        }
+
+        // Vertices with few triangles left are favoured, so that they can
+        // leave the cache for good.
+        valenceScore[0] = 0.0f;
+        for (unsigned int i = 1; i <= ForsythMaxValence; i++)
+            valenceScore[i] = 2.0f / sqrt((float) i);
+    }
+
+    float score(int cachePosition, unsigned int remainingTriangles) const
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float s = valenceScore[min(remainingTriangles, ForsythMaxValence)];
+        if (cachePosition >= 0)
+            s += cacheScore[cachePosition];
+        return s;
+    }
+
+ private:
+    float cacheScore[ForsythCacheSize];
+    float valenceScore[ForsythMaxValence + 1];
+};
+
+
+static void
+ReorderTriangles(index32* indices, unsigned int nTriangles)
+{
+    static const ForsythScoreTable scores;
+
+    unsigned int nVertices = *max_element(indices, indices + nTriangles * 3) + 1;
+
+    // Triangles using each vertex, as ranges of vertexTriangles. The live
+    // triangles of vertex v are the first remaining[v] of its range.
+    vector<unsigned int> remaining(nVertices, 0);
+    for (unsigned int i = 0; i < nTriangles * 3; i++)
+        remaining[indices[i]]++;
+
+    vector<unsigned int> offsets(nVertices + 1, 0);
+    for (unsigned int v = 0; v < nVertices; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    vector<unsigned int> vertexTriangles(nTriangles * 3);
+    vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int i = 0; i < nTriangles * 3; i++)
+        vertexTriangles[fill[indices[i]]++] = i / 3;
+
+    vector<int> cachePosition(nVertices, -1);
+    vector<float> vertexScore(nVertices);
+    for (unsigned int v = 0; v < nVertices; v++)
+        vertexScore[v] = scores.score(-1, remaining[v]);
+
+    vector<bool> emitted(nTriangles, false);
+    vector<index32> output;
+    output.reserve(nTriangles * 3);
+
+    vector<index32> cache;
+    vector<index32> newCache;
+    cache.reserve(ForsythCacheSize + 3);
+    newCache.reserve(ForsythCacheSize + 3);
+
+    unsigned int nextUnemitted = 0;
+    int bestTriangle = -1;
+    for (unsigned int n = 0; n < nTriangles; n++)
+    {
+        // When no triangle uses a cached vertex, start again from the first
+        // triangle that hasn't been drawn yet.
+        if (bestTriangle < 0)
+        {
+            while (emitted[nextUnemitted])
+                nextUnemitted++;
+            bestTriangle = (int) nextUnemitted;
+        }
+
+        const index32* triangle = indices + bestTriangle * 3;
+        emitted[bestTriangle] = true;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            index32 v = triangle[k];
+            auto begin = vertexTriangles.begin() + offsets[v];
+            auto end = begin + remaining[v];
+            auto iter = find(begin, end, (unsigned int) bestTriangle);
+            if (iter != end)
+            {
+                *iter = *(end - 1);
+                remaining[v]--;
+            }
+        }
+
+        // The triangle's vertices move to the front of the cache
+        newCache.clear();
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            if (find(newCache.begin(), newCache.end(), triangle[k]) == newCache.end())
+                newCache.push_back(triangle[k]);
+        }
+        for (index32 v : cache)
+        {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache.push_back(v);
+        }
+
+        for (unsigned int i = 0; i < newCache.size(); i++)
+        {
+            index32 v = newCache[i];
+            cachePosition[v] = i < ForsythCacheSize ? (int) i : -1;
+            vertexScore[v] = scores.score(cachePosition[v], remaining[v]);
+        }
+
+        // Only the triangles of the vertices that were or are in the cache
+        // changed score; pick the best one with a vertex still cached.
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        unsigned int cachedCount = min((unsigned int) newCache.size(), ForsythCacheSize);
+        for (unsigned int i = 0; i < cachedCount; i++)
+        {
+            index32 v = newCache[i];
+            for (unsigned int j = 0; j < remaining[v]; j++)
+            {
+                unsigned int t = vertexTriangles[offsets[v] + j];
+                const index32* tri = indices + t * 3;
+                float score = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = (int) t;
+                }
+            }
+        }
+
+        newCache.resize(cachedCount);
+        swap(cache, newCache);
+    }
+
+    copy(output.begin(), output.end(), indices);
+}
+
+
+void
+OptimizeVertexCache(Mesh& mesh)
+{
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        if (group->prim == Mesh::TriList && group->nIndices >= 6)
+            ReorderTriangles(group->indices, group->nIndices / 3);
+    }
+}
+
+
+void
+OptimizeVertexFetch(Mesh& mesh)
+{
+    unsigned int nVertices = mesh.getVertexCount();
+    unsigned int stride = mesh.getVertexStride();
+    const char* vertexData = reinterpret_cast<const char*>(mesh.getVertexData());
+    if (nVertices == 0 || vertexData == nullptr)
+        return;
+
+    const index32 Unused = ~0u;
+    vector<index32> vertexMap(nVertices, Unused);
+    index32 next = 0;
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        for (unsigned int i = 0; i < group->nIndices; i++)
+        {
+            index32 v = group->indices[i];
+            if (v < nVertices && vertexMap[v] == Unused)
+                vertexMap[v] = next++;
+        }
+    }
+
+    // Unused vertices still count for the bounding box
+    for (auto& v : vertexMap)
+    {
+        if (v == Unused)
+            v = next++;
+    }
+
+    auto* newVertexData = new char[(size_t) nVertices * stride];
+    for (unsigned int i = 0; i < nVertices; i++)
+        memcpy(newVertexData + (size_t) vertexMap[i] * stride, vertexData + (size_t) i * stride, stride);
+
+    mesh.setVertices(nVertices, newVertexData);
+    mesh.remapIndices(vertexMap);
+}
+
+
+void
+OptimizeModel(Model& model)
+{
+    for (unsigned int i = 0; i < model.getMeshCount(); i++)
+    {
+        Mesh* mesh = model.getMesh(i);
+        UniquifyVertices(*mesh);
+        ConvertToTriangleLists(*mesh);
+        MergeGroupsByMaterial(*mesh);
+        OptimizeVertexCache(*mesh);
+        OptimizeVertexFetch(*mesh);
+    }
+}
+
+
+// Simulate a FIFO cache over the index stream of every triangle group,
+// starting with an empty cache for each group.
+static void
+CountCacheMisses(const Mesh& mesh, unsigned int cacheSize,
+                 unsigned int& misses, unsigned int& triangles)
+{
+    // A vertex is cached if fewer than cacheSize vertices were loaded
+    // since it was.
+    vector<unsigned int> loadedAt(mesh.getVertexCount(), 0);
+    unsigned int loadCount = cacheSize;
+
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        if (group->prim != Mesh::TriList &&
+            group->prim != Mesh::TriStrip &&
+            group->prim != Mesh::TriFan)
+        {
+            continue;
+        }
+
+        triangles += group->getPrimitiveCount();
+        for (unsigned int i = 0; i < group->nIndices; i++)
+        {
+            index32 v = group->indices[i];
+            if (v >= loadedAt.size() || loadCount - loadedAt[v] < cacheSize)
+                continue;
+            loadedAt[v] = loadCount++;
+            misses++;
+        }
+        loadCount += cacheSize;
+    }
+}
+
+
+float
+ComputeACMR(const Mesh& mesh, unsigned int cacheSize)
+{
+    unsigned int misses = 0;
+    unsigned int triangles = 0;
+    CountCacheMisses(mesh, cacheSize, misses, triangles);
+
+    return triangles == 0 ? 0.0f : (float) misses / (float) triangles;
+}
+
+
+float
+ComputeACMR(const Model& model, unsigned int cacheSize)
+{
+    unsigned int misses = 0;
+    unsigned int triangles = 0;
+    for (unsigned int i = 0; i < model.getMeshCount(); i++)
+        CountCacheMisses(*model.getMesh(i), cacheSize, misses, triangles);
+
+    return triangles == 0 ? 0.0f : (float) misses / (float) triangles;
+}
+
+} // namespace cmod
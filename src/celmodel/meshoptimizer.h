@@ -0,0 +1,55 @@
+// meshoptimizer.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Load time mesh optimization: vertex welding, triangle reordering for the
+// post-transform vertex cache and vertex reordering for fetch locality.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include "model.h"
+
+namespace cmod
+{
+
+/*! Merge vertices whose attributes are identical. Returns false if the
+ *  mesh has no vertex data.
+ */
+bool UniquifyVertices(Mesh& mesh);
+
+/*! Replace triangle strips and fans with triangle lists, dropping the
+ *  degenerate triangles used to join strips.
+ */
+void ConvertToTriangleLists(Mesh& mesh);
+
+/*! Join the triangle lists that use the same material into a single
+ *  group, placed where the first of them was.
+ */
+void MergeGroupsByMaterial(Mesh& mesh);
+
+/*! Reorder the triangles of every triangle list to make good use of the
+ *  post-transform vertex cache, with Tom Forsyth's linear-speed algorithm.
+ */
+void OptimizeVertexCache(Mesh& mesh);
+
+/*! Renumber the vertices in the order they're first used by the
+ *  primitive groups. Unused vertices are kept at the end.
+ */
+void OptimizeVertexFetch(Mesh& mesh);
+
+/*! Apply all of the above to every mesh of the model. */
+void OptimizeModel(Model& model);
+
+/*! Average number of vertices transformed per triangle (ACMR) with a FIFO
+ *  vertex cache of the given size; 3 means no reuse at all, and 0.5 is the
+ *  lower bound for large regular meshes.
+ */
+float ComputeACMR(const Mesh& mesh, unsigned int cacheSize = 32);
+float ComputeACMR(const Model& model, unsigned int cacheSize = 32);
+
+} // namespace cmod
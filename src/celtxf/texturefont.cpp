@@ -36,19 +36,11 @@ TextureFont::~TextureFont()
  */
 void TextureFont::render(wchar_t ch) const
 {
-    const Glyph* glyph = getGlyph(ch);
-    if (glyph == nullptr) glyph = getGlyph((wchar_t)'?');
+    const Glyph* glyph = getGlyphOrDefault(ch);
     if (glyph != nullptr)
     {
         glBegin(GL_QUADS);
-        glTexCoord2f(glyph->texCoords[0].u, glyph->texCoords[0].v);
-        glVertex2f(glyph->xoff, glyph->yoff);
-        glTexCoord2f(glyph->texCoords[1].u, glyph->texCoords[1].v);
-        glVertex2f(glyph->xoff + glyph->width, glyph->yoff);
-        glTexCoord2f(glyph->texCoords[2].u, glyph->texCoords[2].v);
-        glVertex2f(glyph->xoff + glyph->width, glyph->yoff + glyph->height);
-        glTexCoord2f(glyph->texCoords[3].u, glyph->texCoords[3].v);
-        glVertex2f(glyph->xoff, glyph->yoff + glyph->height);
+        emitGlyph(*glyph, 0.0f, 0.0f);
         glEnd();
         glTranslatef(glyph->advance, 0.0f, 0.0f);
     }
@@ -60,19 +52,11 @@ void TextureFont::render(wchar_t ch) const
  */
 void TextureFont::render(wchar_t ch, float xoffset, float yoffset) const
 {
-    const Glyph* glyph = getGlyph(ch);
-    if (glyph == nullptr) glyph = getGlyph((wchar_t)'?');
+    const Glyph* glyph = getGlyphOrDefault(ch);
     if (glyph != nullptr)
     {
         glBegin(GL_QUADS);
-        glTexCoord2f(glyph->texCoords[0].u, glyph->texCoords[0].v);
-        glVertex2f(glyph->xoff + xoffset, glyph->yoff + yoffset);
-        glTexCoord2f(glyph->texCoords[1].u, glyph->texCoords[1].v);
-        glVertex2f(glyph->xoff + glyph->width + xoffset, glyph->yoff + yoffset);
-        glTexCoord2f(glyph->texCoords[2].u, glyph->texCoords[2].v);
-        glVertex2f(glyph->xoff + glyph->width + xoffset, glyph->yoff + glyph->height + yoffset);
-        glTexCoord2f(glyph->texCoords[3].u, glyph->texCoords[3].v);
-        glVertex2f(glyph->xoff + xoffset, glyph->yoff + glyph->height + yoffset);
+        emitGlyph(*glyph, xoffset, yoffset);
         glEnd();
     }
 }
@@ -89,18 +73,19 @@ void TextureFont::render(const string& s) const
 
     float xoffset = 0.0f;
 
+    glBegin(GL_QUADS);
     while (i < len && validChar) {
         wchar_t ch = 0;
         validChar = UTF8Decode(s, i, ch);
         i += UTF8EncodedSize(ch);
 
-        render(ch, xoffset, 0.0f);
-
-        const Glyph* glyph = getGlyph(ch);
+        const Glyph* glyph = getGlyphOrDefault(ch);
         if (glyph == nullptr)
-            glyph = getGlyph((wchar_t)'?');
+            continue;
+        emitGlyph(*glyph, xoffset, 0.0f);
         xoffset += glyph->advance;
     }
+    glEnd();
 
     glTranslatef(xoffset, 0.0f, 0.0f);
 }
@@ -115,18 +100,96 @@ void TextureFont::render(const string& s, float xoffset, float yoffset) const
     bool validChar = true;
     int i = 0;
 
+    glBegin(GL_QUADS);
     while (i < len && validChar) {
         wchar_t ch = 0;
         validChar = UTF8Decode(s, i, ch);
         i += UTF8EncodedSize(ch);
 
-        render(ch, xoffset, yoffset);
-
-        const Glyph* glyph = getGlyph(ch);
+        const Glyph* glyph = getGlyphOrDefault(ch);
         if (glyph == nullptr)
-            glyph = getGlyph((wchar_t)'?');
+            continue;
+        emitGlyph(*glyph, xoffset, yoffset);
         xoffset += glyph->advance;
     }
+    glEnd();
+}
+
+
+void TextureFont::addText(vector<TextVertex>& vertices,
+                          const string& s,
+                          float x, float y, float z,
+                          Color color) const
+{
+    TextVertex vertex;
+    vertex.z = z;
+    color.get(vertex.color);
+
+    int len = s.length();
+    bool validChar = true;
+    int i = 0;
+
+    while (i < len && validChar)
+    {
+        wchar_t ch = 0;
+        validChar = UTF8Decode(s, i, ch);
+        i += UTF8EncodedSize(ch);
+
+        const Glyph* glyph = getGlyphOrDefault(ch);
+        if (glyph == nullptr)
+            continue;
+
+        float x0 = x + glyph->xoff;
+        float y0 = y + glyph->yoff;
+        float x1 = x0 + glyph->width;
+        float y1 = y0 + glyph->height;
+        const float corners[4][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+        for (int j = 0; j < 4; j++)
+        {
+            vertex.x = corners[j][0];
+            vertex.y = corners[j][1];
+            vertex.u = glyph->texCoords[j].u;
+            vertex.v = glyph->texCoords[j].v;
+            vertices.push_back(vertex);
+        }
+
+        x += glyph->advance;
+    }
+}
+
+
+void TextureFont::render(const vector<TextVertex>& vertices) const
+{
+    if (vertices.empty())
+        return;
+
+    const GLsizei stride = sizeof(TextVertex);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, &vertices[0].x);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, stride, &vertices[0].u);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(4, GL_UNSIGNED_BYTE, stride, &vertices[0].color);
+
+    glDrawArrays(GL_QUADS, 0, (GLsizei) vertices.size());
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+
+// Must be called between glBegin(GL_QUADS) and glEnd().
+void TextureFont::emitGlyph(const Glyph& glyph, float xoffset, float yoffset) const
+{
+    glTexCoord2f(glyph.texCoords[0].u, glyph.texCoords[0].v);
+    glVertex2f(glyph.xoff + xoffset, glyph.yoff + yoffset);
+    glTexCoord2f(glyph.texCoords[1].u, glyph.texCoords[1].v);
+    glVertex2f(glyph.xoff + glyph.width + xoffset, glyph.yoff + yoffset);
+    glTexCoord2f(glyph.texCoords[2].u, glyph.texCoords[2].v);
+    glVertex2f(glyph.xoff + glyph.width + xoffset, glyph.yoff + glyph.height + yoffset);
+    glTexCoord2f(glyph.texCoords[3].u, glyph.texCoords[3].v);
+    glVertex2f(glyph.xoff + xoffset, glyph.yoff + glyph.height + yoffset);
 }
 
 
@@ -213,6 +276,16 @@ const TextureFont::Glyph* TextureFont::getGlyph(wchar_t ch) const
 }
 
 
+// Characters missing from the font are shown as question marks.
+const TextureFont::Glyph* TextureFont::getGlyphOrDefault(wchar_t ch) const
+{
+    const Glyph* glyph = getGlyph(ch);
+    if (glyph == nullptr)
+        glyph = getGlyph((wchar_t) '?');
+    return glyph;
+}
+
+
 bool TextureFont::buildTexture()
 {
     assert(fontImage != nullptr);
@@ -14,6 +14,7 @@
 #include <string>
 #include <iostream>
 #include <celcompat/filesystem.h>
+#include <celutil/color.h>
 
 
 class TextureFont
@@ -28,6 +29,22 @@ class TextureFont
     void render(wchar_t ch, float xoffset, float yoffset) const;
     void render(const std::string& s, float xoffset, float yoffset) const;
 
+    struct TextVertex
+    {
+        float x, y, z;
+        float u, v;
+        unsigned char color[4];
+    };
+
+    // Append the glyph quads of a string starting at (x, y, z) to
+    // vertices, so that many strings can be drawn with one call to
+    // render(vertices). The font texture must be bound by the caller.
+    void addText(std::vector<TextVertex>& vertices,
+                 const std::string& s,
+                 float x, float y, float z,
+                 Color color) const;
+    void render(const std::vector<TextVertex>& vertices) const;
+
     int getWidth(const std::string&) const;
     int getWidth(int c) const;
     int getMaxWidth() const;
@@ -81,6 +98,8 @@ class TextureFont
  private:
     void addGlyph(const Glyph&);
     const TextureFont::Glyph* getGlyph(wchar_t) const;
+    const TextureFont::Glyph* getGlyphOrDefault(wchar_t) const;
+    void emitGlyph(const Glyph&, float xoffset, float yoffset) const;
     void rebuildGlyphLookupTable();
 
  private:
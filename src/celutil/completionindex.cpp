@@ -0,0 +1,173 @@
+// completionindex.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Name index for fast completion and substring searches.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include "completionindex.h"
+#include "utf8.h"
+
+using namespace std;
+
+
+static uint32_t trigramKey(const string& s, size_t i)
+{
+    return ((uint32_t) (unsigned char) s[i] << 16) |
+           ((uint32_t) (unsigned char) s[i + 1] << 8) |
+           (uint32_t) (unsigned char) s[i + 2];
+}
+
+
+void CompletionIndex::add(const string& name)
+{
+    auto id = (uint32_t) entries.size();
+    if (!ids.emplace(name, id).second)
+        return;
+
+    entries.push_back({ name, UTF8NormalizeString(name, true), false });
+    sorted.push_back(id);
+
+    if (hasTrigrams)
+        addTrigrams(id);
+}
+
+
+void CompletionIndex::remove(const string& name)
+{
+    auto iter = ids.find(name);
+    if (iter == ids.end())
+        return;
+
+    // Removed entries stay in the trigram index and are skipped by searches
+    entries[iter->second].removed = true;
+    ids.erase(iter);
+    anyRemoved = true;
+}
+
+
+void CompletionIndex::clear()
+{
+    entries.clear();
+    ids.clear();
+    sorted.clear();
+    nSorted = 0;
+    anyRemoved = false;
+    trigrams.clear();
+    hasTrigrams = false;
+}
+
+
+void CompletionIndex::findPrefix(const string& prefix,
+                                 vector<string>& completion,
+                                 bool ignoreCase) const
+{
+    sortPending();
+
+    string folded = UTF8NormalizeString(prefix, true);
+    int prefixLength = UTF8Length(prefix);
+
+    auto iter = lower_bound(sorted.begin(), sorted.end(), folded,
+                            [&](uint32_t id, const string& s) { return entries[id].folded < s; });
+    for (; iter != sorted.end(); ++iter)
+    {
+        const Entry& entry = entries[*iter];
+        if (entry.folded.compare(0, folded.length(), folded) != 0)
+            break;
+        if (ignoreCase || UTF8StringCompare(entry.name, prefix, prefixLength) == 0)
+            completion.push_back(entry.name);
+    }
+}
+
+
+void CompletionIndex::findSubstring(const string& s, vector<string>& matches) const
+{
+    sortPending();
+
+    string folded = UTF8NormalizeString(s, true);
+    if (folded.length() < 3)
+    {
+        // Too short for the trigram index
+        for (uint32_t id : sorted)
+        {
+            if (entries[id].folded.find(folded) != string::npos)
+                matches.push_back(entries[id].name);
+        }
+        return;
+    }
+
+    if (!hasTrigrams)
+    {
+        for (uint32_t id = 0; id < entries.size(); id++)
+            addTrigrams(id);
+        hasTrigrams = true;
+    }
+
+    // Every trigram of s must appear in a match, so only the entries of
+    // the rarest one need to be checked.
+    const vector<uint32_t>* candidates = nullptr;
+    for (size_t i = 0; i + 3 <= folded.length(); i++)
+    {
+        auto iter = trigrams.find(trigramKey(folded, i));
+        if (iter == trigrams.end())
+            return;
+        if (candidates == nullptr || iter->second.size() < candidates->size())
+            candidates = &iter->second;
+    }
+
+    vector<uint32_t> found;
+    for (uint32_t id : *candidates)
+    {
+        const Entry& entry = entries[id];
+        if (!entry.removed && entry.folded.find(folded) != string::npos)
+            found.push_back(id);
+    }
+
+    sort(found.begin(), found.end(),
+         [&](uint32_t a, uint32_t b) { return entries[a].folded < entries[b].folded; });
+    for (uint32_t id : found)
+        matches.push_back(entries[id].name);
+}
+
+
+void CompletionIndex::sortPending() const
+{
+    if (anyRemoved)
+    {
+        // Compact the sorted and the pending part separately to keep the
+        // sorted part in order
+        auto isRemoved = [&](uint32_t id) { return entries[id].removed; };
+        auto pendingBegin = sorted.begin() + nSorted;
+        auto sortedEnd = std::remove_if(sorted.begin(), pendingBegin, isRemoved);
+        auto pendingEnd = std::remove_if(pendingBegin, sorted.end(), isRemoved);
+        nSorted = sortedEnd - sorted.begin();
+        sorted.erase(move(pendingBegin, pendingEnd, sortedEnd), sorted.end());
+        anyRemoved = false;
+    }
+
+    if (nSorted == sorted.size())
+        return;
+
+    auto byFolded = [&](uint32_t a, uint32_t b) { return entries[a].folded < entries[b].folded; };
+    sort(sorted.begin() + nSorted, sorted.end(), byFolded);
+    inplace_merge(sorted.begin(), sorted.begin() + nSorted, sorted.end(), byFolded);
+    nSorted = sorted.size();
+}
+
+
+void CompletionIndex::addTrigrams(uint32_t id) const
+{
+    const string& folded = entries[id].folded;
+    for (size_t i = 0; i + 3 <= folded.length(); i++)
+    {
+        vector<uint32_t>& posting = trigrams[trigramKey(folded, i)];
+        // A name repeating a trigram is only listed once
+        if (posting.empty() || posting.back() != id)
+            posting.push_back(id);
+    }
+}
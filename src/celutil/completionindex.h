@@ -0,0 +1,67 @@
+// completionindex.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Name index for fast completion and substring searches.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The names are kept sorted by their normalized, case folded form (see
+// UTF8NormalizeString), so all completions of a prefix are a contiguous
+// range found with a binary search. Names added since the last query are
+// sorted and merged in by the next one. The trigram index used for
+// substring searches is only built by the first substring search.
+class CompletionIndex
+{
+ public:
+    // Adding a name already in the index does nothing
+    void add(const std::string& name);
+    void remove(const std::string& name);
+    void clear();
+
+    size_t size() const { return ids.size(); }
+
+    // Append the names starting with prefix to completion, in index order.
+    // Case is ignored unless ignoreCase is false, in which case the
+    // matches are the ones of a case sensitive UTF8StringCompare.
+    void findPrefix(const std::string& prefix,
+                    std::vector<std::string>& completion,
+                    bool ignoreCase = true) const;
+
+    // Append the names containing s, ignoring case, to matches, in index
+    // order.
+    void findSubstring(const std::string& s, std::vector<std::string>& matches) const;
+
+ private:
+    struct Entry
+    {
+        std::string name;
+        std::string folded;
+        bool removed;
+    };
+
+    void sortPending() const;
+    void addTrigrams(uint32_t id) const;
+
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, uint32_t> ids;
+
+    // Indexes of the entries; the first nSorted are in folded order.
+    // Removed entries are dropped by the next query.
+    mutable std::vector<uint32_t> sorted;
+    mutable size_t nSorted{ 0 };
+    mutable bool anyRemoved{ false };
+
+    mutable std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+    mutable bool hasTrigrams{ false };
+};
@@ -0,0 +1,182 @@
+// hashindex.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Flat hash table for 32 bit keys such as catalog numbers.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Open addressing with linear probing in a single array kept at most half
+// full, so a lookup usually touches a single cache line instead of the
+// log(n) scattered ones of a binary search over an array of pointers.
+// The key 0xffffffff (InvalidCatalogNumber) marks empty slots and can't
+// be stored.
+template <class T> class HashIndex
+{
+ public:
+    static const uint32_t EmptyKey = 0xffffffff;
+
+    // Make room for n entries without rehashing
+    void reserve(size_t n);
+
+    // Insert the key unless it's already present; returns whether it was
+    // inserted.
+    bool insert(uint32_t key, const T& value);
+
+    // Insert the key or replace its value
+    void set(uint32_t key, const T& value);
+
+    // Returns nullptr if the key isn't present
+    const T* find(uint32_t key) const;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear();
+
+ private:
+    struct Slot
+    {
+        uint32_t key;
+        T        value;
+    };
+
+    size_t slotIndex(uint32_t key) const
+    {
+        // Fibonacci hashing: catalog numbers are mostly consecutive, so
+        // the key bits have to be mixed before masking them.
+        return (size_t) ((key * 0x9e3779b1u) >> shift);
+    }
+
+    T* findSlot(uint32_t key, bool& found);
+    void rehash(size_t capacity);
+
+    std::vector<Slot> slots;
+    size_t            count{ 0 };
+    unsigned int      shift{ 32 };
+};
+
+
+template <class T>
+void HashIndex<T>::reserve(size_t n)
+{
+    size_t capacity = 16;
+    while (capacity < n * 2)
+        capacity *= 2;
+
+    if (capacity > slots.size())
+        rehash(capacity);
+}
+
+
+template <class T>
+bool HashIndex<T>::insert(uint32_t key, const T& value)
+{
+    if (key == EmptyKey)
+        return false;
+
+    bool found;
+    T* slotValue = findSlot(key, found);
+    if (found)
+        return false;
+
+    *slotValue = value;
+    return true;
+}
+
+
+template <class T>
+void HashIndex<T>::set(uint32_t key, const T& value)
+{
+    if (key == EmptyKey)
+        return;
+
+    bool found;
+    *findSlot(key, found) = value;
+}
+
+
+template <class T>
+const T* HashIndex<T>::find(uint32_t key) const
+{
+    if (count == 0 || key == EmptyKey)
+        return nullptr;
+
+    size_t mask = slots.size() - 1;
+    for (size_t i = slotIndex(key); ; i = (i + 1) & mask)
+    {
+        if (slots[i].key == key)
+            return &slots[i].value;
+        if (slots[i].key == EmptyKey)
+            return nullptr;
+    }
+}
+
+
+template <class T>
+void HashIndex<T>::clear()
+{
+    slots.clear();
+    slots.shrink_to_fit();
+    count = 0;
+    shift = 32;
+}
+
+
+// Return the value slot of key, claiming an empty slot for it if the key
+// isn't present yet.
+template <class T>
+T* HashIndex<T>::findSlot(uint32_t key, bool& found)
+{
+    if ((count + 1) * 2 > slots.size())
+        rehash(slots.empty() ? 16 : slots.size() * 2);
+
+    size_t mask = slots.size() - 1;
+    size_t i = slotIndex(key);
+    while (slots[i].key != EmptyKey)
+    {
+        if (slots[i].key == key)
+        {
+            found = true;
+            return &slots[i].value;
+        }
+        i = (i + 1) & mask;
+    }
+
+    found = false;
+    slots[i].key = key;
+    count++;
+    return &slots[i].value;
+}
+
+
+template <class T>
+void HashIndex<T>::rehash(size_t capacity)
+{
+    std::vector<Slot> oldSlots(capacity, Slot{ EmptyKey, T() });
+    oldSlots.swap(slots);
+
+    shift = 32;
+    for (size_t n = capacity; n > 1; n >>= 1)
+        shift--;
+
+    size_t mask = capacity - 1;
+    for (const Slot& slot : oldSlots)
+    {
+        if (slot.key == EmptyKey)
+            continue;
+
+        size_t i = slotIndex(slot.key);
+        while (slots[i].key != EmptyKey)
+            i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
@@ -10,9 +10,15 @@
 #ifndef _CELUTIL_RESMANAGER_H_
 #define _CELUTIL_RESMANAGER_H_
 
-#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <celutil/reshandle.h>
+#include <celutil/threadpool.h>
 #include <celcompat/filesystem.h>
 
 
@@ -20,6 +26,7 @@ enum ResourceState {
     ResourceNotLoaded     = 0,
     ResourceLoaded        = 1,
     ResourceLoadingFailed = 2,
+    ResourceLoadPending   = 3,
 };
 
 
@@ -32,6 +39,17 @@ template<class T> class ResourceInfo
     virtual fs::path resolve(const fs::path&) = 0;
     virtual T* load(const fs::path&) = 0;
 
+    // Asynchronous loading is done in two steps: prepare() is called on a
+    // loader thread with a copy of the info and does the slow work that
+    // doesn't need the main thread, such as reading and decoding files;
+    // commit() is then called on the same copy from the main thread and
+    // creates the resource. By default all the work is done by commit().
+    // discard() is called instead of commit() when the load is dropped,
+    // and frees what prepare() made.
+    virtual void prepare(const fs::path&) {};
+    virtual T* commit(const fs::path& name) { return load(name); };
+    virtual void discard() {};
+
     typedef T ResourceType;
     ResourceState state;
     fs::path resolvedName;
@@ -51,21 +69,60 @@ template<class T> class ResourceManager
 
     typedef typename T::ResourceType ResourceType;
 
+    struct LoadStatistics
+    {
+        size_t queueDepth{ 0 };     // loads requested and not committed yet
+        size_t loadCount{ 0 };      // loads committed
+        double totalLatency{ 0.0 }; // seconds from request to commit
+        double maxLatency{ 0.0 };
+    };
+
  private:
-    typedef std::vector<T> ResourceTable;
+    // A deque keeps the infos returned by getResourceInfo() in place when
+    // a loader thread adds a handle.
+    typedef std::deque<T> ResourceTable;
     typedef std::map<T, ResourceHandle> ResourceHandleMap;
     typedef std::map<fs::path, ResourceType*> NameMap;
 
     typedef typename ResourceHandleMap::value_type ResourceHandleMapValue;
     typedef typename NameMap::value_type NameMapValue;
 
+    struct LoadRequest
+    {
+        T info;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Requests prepared by the loader pool, waiting for commitPending().
+    // It's shared with the loader tasks so that they never refer to the
+    // manager itself. Once cancelled, the tasks discard their loads.
+    struct LoadQueue
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<LoadRequest>> prepared;
+        bool cancelled{ false };
+    };
+
     ResourceTable resources;
     ResourceHandleMap handles;
     NameMap loadedResources;
 
+    // Handles waiting for each resolved name being loaded asynchronously
+    std::map<fs::path, std::vector<ResourceHandle>> pendingNames;
+    std::shared_ptr<LoadQueue> loadQueue{ std::make_shared<LoadQueue>() };
+    ThreadPool* loaderPool{ nullptr };
+    ResourceType* fallback{ nullptr };
+    LoadStatistics loadStatistics;
+
+    // Loading a resource may request handles from other managers on a
+    // loader thread (a model asks for its textures, for instance.)
+    mutable std::mutex mutex;
+
  public:
     ResourceHandle getHandle(const T& info)
     {
+        std::lock_guard<std::mutex> lock(mutex);
+
         typename ResourceHandleMap::iterator iter = handles.find(info);
         if (iter != handles.end())
         {
@@ -80,8 +137,15 @@ template<class T> class ResourceManager
         }
     }
 
+    // Returns the resource, loading it if needed. When a loader pool is set
+    // the resource is loaded in the background instead: the fallback
+    // resource, null unless one is set, is returned and the state of the
+    // resource is ResourceLoadPending until commitPending() picks up the
+    // result.
     ResourceType* find(ResourceHandle h)
     {
+        std::lock_guard<std::mutex> lock(mutex);
+
         if (h >= (int) handles.size() || h < 0)
         {
             return nullptr;
@@ -98,6 +162,10 @@ template<class T> class ResourceManager
                     resources[h].resource = iter->second;
                     resources[h].state = ResourceLoaded;
                 }
+                else if (loaderPool != nullptr)
+                {
+                    requestLoad(h);
+                }
                 else
                 {
                     resources[h].resource = resources[h].load(resources[h].resolvedName);
@@ -115,6 +183,8 @@ template<class T> class ResourceManager
 
             if (resources[h].state == ResourceLoaded)
                 return resources[h].resource;
+            else if (resources[h].state == ResourceLoadPending)
+                return fallback;
             else
                 return nullptr;
         }
@@ -122,12 +192,148 @@ template<class T> class ResourceManager
 
     const T* getResourceInfo(ResourceHandle h)
     {
+        std::lock_guard<std::mutex> lock(mutex);
+
         if (h >= (int) handles.size() || h < 0)
             return nullptr;
         else
             return &resources[h];
     }
+
+    ResourceState getState(ResourceHandle h) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (h >= (int) handles.size() || h < 0)
+            return ResourceNotLoaded;
+        else
+            return resources[h].state;
+    }
+
+    // Load resources on the pool instead of in find(); a null pool
+    // switches back to synchronous loading. Loads that haven't been
+    // committed are dropped when the pool changes, and the resources are
+    // loaded again when next found. Tasks already submitted to the old
+    // pool only discard their results, but the pool must outlive them.
+    void setLoaderPool(ThreadPool* pool)
+    {
+        std::shared_ptr<LoadQueue> cancelledQueue;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pool == loaderPool)
+                return;
+            loaderPool = pool;
+
+            for (const auto& pending : pendingNames)
+            {
+                for (ResourceHandle h : pending.second)
+                    resources[h].state = ResourceNotLoaded;
+            }
+            pendingNames.clear();
+            loadStatistics.queueDepth = 0;
+
+            cancelledQueue = loadQueue;
+            loadQueue = std::make_shared<LoadQueue>();
+        }
+
+        std::lock_guard<std::mutex> lock(cancelledQueue->mutex);
+        cancelledQueue->cancelled = true;
+        for (const auto& request : cancelledQueue->prepared)
+            request->info.discard();
+        cancelledQueue->prepared.clear();
+    }
+
+    // Resource returned by find() while a resource is loading
+    void setFallback(ResourceType* resource)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fallback = resource;
+    }
+
+    // Create the resources prepared by the loader pool. This must be
+    // called from the main thread, which for textures is the one with the
+    // GL context. Returns the number of resources committed.
+    unsigned int commitPending()
+    {
+        std::shared_ptr<LoadQueue> queue;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue = loadQueue;
+        }
+
+        std::vector<std::shared_ptr<LoadRequest>> prepared;
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            prepared.swap(queue->prepared);
+        }
+        if (prepared.empty())
+            return 0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& request : prepared)
+        {
+            const fs::path& name = request->info.resolvedName;
+            ResourceType* resource = request->info.commit(name);
+            if (resource != nullptr)
+                loadedResources.insert(NameMapValue(name, resource));
+
+            auto iter = pendingNames.find(name);
+            for (ResourceHandle h : iter->second)
+            {
+                resources[h].resource = resource;
+                resources[h].state = resource != nullptr ? ResourceLoaded : ResourceLoadingFailed;
+            }
+            pendingNames.erase(iter);
+
+            double latency = std::chrono::duration<double>(now - request->start).count();
+            loadStatistics.queueDepth--;
+            loadStatistics.loadCount++;
+            loadStatistics.totalLatency += latency;
+            loadStatistics.maxLatency = std::max(loadStatistics.maxLatency, latency);
+        }
+
+        return (unsigned int) prepared.size();
+    }
+
+    LoadStatistics getLoadStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return loadStatistics;
+    }
+
+ private:
+    void requestLoad(ResourceHandle h)
+    {
+        resources[h].state = ResourceLoadPending;
+
+        // Handles resolving to the same file share a single load
+        std::vector<ResourceHandle>& waiting = pendingNames[resources[h].resolvedName];
+        waiting.push_back(h);
+        if (waiting.size() > 1)
+            return;
+
+        auto request = std::make_shared<LoadRequest>(LoadRequest{ resources[h], std::chrono::steady_clock::now() });
+        loadStatistics.queueDepth++;
+
+        std::shared_ptr<LoadQueue> queue = loadQueue;
+        loaderPool->submit([request, queue]()
+        {
+            {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                if (queue->cancelled)
+                    return;
+            }
+
+            request->info.prepare(request->info.resolvedName);
+
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (queue->cancelled)
+                request->info.discard();
+            else
+                queue->prepared.push_back(request);
+        });
+    }
 };
 
 #endif // _CELUTIL_RESMANAGER_H_
-
@@ -0,0 +1,148 @@
+// threadpool.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// A fixed size pool of worker threads.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "threadpool.h"
+
+
+static thread_local bool workerThread = false;
+
+
+ThreadPool::ThreadPool(unsigned int nThreads)
+{
+    if (nThreads == 0)
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < nThreads; i++)
+        workers.emplace_back(&ThreadPool::run, this);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+
+size_t ThreadPool::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size();
+}
+
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packagedTask(std::move(task));
+    std::future<void> result = packagedTask.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(packagedTask));
+    }
+    condition.notify_one();
+
+    return result;
+}
+
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+    if (count == 0)
+        return;
+
+    // Helpers may start after all the work is done and parallelFor has
+    // returned, so the shared state must outlive this call. Only the
+    // iterations are waited for, never the helper tasks themselves; this
+    // is what makes nested use deadlock free.
+    struct State
+    {
+        explicit State(const std::function<void(size_t)>& b) : body(b) {}
+
+        std::function<void(size_t)> body;
+        std::atomic<size_t> next{ 0 };
+        size_t done{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    auto state = std::make_shared<State>(body);
+    size_t total = count;
+    auto work = [state, total]()
+    {
+        size_t completed = 0;
+        for (size_t i = state->next++; i < total; i = state->next++)
+        {
+            state->body(i);
+            completed++;
+        }
+
+        if (completed != 0)
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done += completed;
+            if (state->done == total)
+                state->finished.notify_all();
+        }
+    };
+
+    size_t nHelpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < nHelpers; i++)
+        submit(work);
+
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [state, total]{ return state->done == total; });
+}
+
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+
+bool ThreadPool::isWorkerThread()
+{
+    return workerThread;
+}
+
+
+void ThreadPool::run()
+{
+    workerThread = true;
+
+    for (;;)
+    {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]{ return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
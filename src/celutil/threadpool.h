@@ -0,0 +1,61 @@
+// threadpool.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// A fixed size pool of worker threads.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+ public:
+    // A thread count of zero creates one worker per hardware thread
+    explicit ThreadPool(unsigned int nThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return (unsigned int) workers.size(); }
+
+    // Number of tasks waiting for a free worker
+    size_t pending() const;
+
+    std::future<void> submit(std::function<void()> task);
+
+    // Call body(i) for every i in [0, count) using the workers and the
+    // calling thread, and return once all calls have finished. The calling
+    // thread takes part in the work, so parallelFor may be called from a
+    // task running on the same pool.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Pool shared by the engine for short compute tasks; long running or
+    // blocking work should use a pool of its own.
+    static ThreadPool& shared();
+
+    // True on the worker threads of any pool. Objects with unsynchronized
+    // caches, such as orbits and rotation models, bypass them there.
+    static bool isWorkerThread();
+
+ private:
+    void run();
+
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> tasks;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{ false };
+};
@@ -606,6 +606,36 @@ int UTF8StringCompare(const std::string& s0, const std::string& s1, size_t n, bo
 }
 
 
+std::string UTF8NormalizeString(const std::string& s, bool ignoreCase)
+{
+    std::string normalized;
+    normalized.reserve(s.length());
+
+    int len = s.length();
+    int i = 0;
+    while (i < len)
+    {
+        wchar_t ch = 0;
+        if (!UTF8Decode(s, i, ch))
+        {
+            // Keep the undecodable tail as is
+            normalized.append(s, i, std::string::npos);
+            break;
+        }
+        i += UTF8EncodedSize(ch);
+
+        ch = UTF8Normalize(ch);
+        if (ignoreCase)
+            ch = std::tolower(ch);
+
+        char buf[8];
+        normalized.append(buf, UTF8Encode(ch, buf));
+    }
+
+    return normalized;
+}
+
+
 #if 0
 //! Currently incomplete, but could be a helpful class for dealing with
 //! UTF-8 streams
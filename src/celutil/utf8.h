@@ -25,6 +25,9 @@ bool UTF8Decode(const char* str, int pos, int length, wchar_t& ch);
 int UTF8Encode(wchar_t ch, char* s);
 int UTF8StringCompare(const std::string& s0, const std::string& s1);
 int UTF8StringCompare(const std::string& s0, const std::string& s1, size_t n, bool ignoreCase = false);
+// Apply the per character normalization of UTF8StringCompare to a whole
+// string, so that normalized strings can be compared bytewise.
+std::string UTF8NormalizeString(const std::string& s, bool ignoreCase = false);
 
 class UTF8StringOrderingPredicate
 {
@@ -12,21 +12,104 @@
 #include <fstream>
 #include <string>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <celmath/vecmath.h>
 #include <celmath/mathlib.h>
-#include <celmath/ray.h>
-#include <celmath/sphere.h>
-#include <celmath/intersect.h>
 #ifdef MACOSX
 #include "../../../macosx/png.h"
 #else
 #include "png.h"
 #endif // MACOSX
+#include <zlib.h>
 
 using namespace std;
+using namespace celmath;
+
+
+// The rays and spheres of celmath are built on Eigen, while scattersim
+// still uses the vector classes of vecmath.h.
+template<class T> class Ray3
+{
+public:
+    Ray3(const Point3<T>& _origin, const Vector3<T>& _direction) :
+        origin(_origin), direction(_direction)
+    {
+    }
+
+    Point3<T> point(T t) const
+    {
+        return origin + direction * t;
+    }
+
+    Point3<T> origin;
+    Vector3<T> direction;
+};
+
+using Ray3d = Ray3<double>;
+
+template<class T> Ray3<T> operator*(const Ray3<T>& r, const Matrix4<T>& m)
+{
+    return Ray3<T>(r.origin * m, r.direction * m);
+}
+
+
+template<class T> class Sphere
+{
+public:
+    Sphere() = default;
+    Sphere(T _radius) : radius(_radius) {}
+    Sphere(const Point3<T>& _center, T _radius) : center(_center), radius(_radius) {}
+
+    Point3<T> center{ 0, 0, 0 };
+    T radius{ 1 };
+};
+
+using Sphered = Sphere<double>;
+
+
+template<class T> bool testIntersection(const Ray3<T>& ray,
+                                        const Sphere<T>& sphere,
+                                        T& distance)
+{
+    Vector3<T> diff = ray.origin - sphere.center;
+    T s = (T) 1.0 / square(sphere.radius);
+    T a = ray.direction * ray.direction * s;
+    T b = ray.direction * diff * s;
+    T c = diff * diff * s - (T) 1.0;
+    T disc = b * b - a * c;
+    if (disc < 0.0)
+        return false;
+
+    disc = (T) sqrt(disc);
+    T sol0 = (-b + disc) / a;
+    T sol1 = (-b - disc) / a;
+
+    if (sol0 > 0)
+    {
+        if (sol0 < sol1 || sol1 < 0)
+            distance = sol0;
+        else
+            distance = sol1;
+        return true;
+    }
+    else if (sol1 > 0)
+    {
+        distance = sol1;
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
 
 
 
@@ -54,11 +137,39 @@ enum LUTUsageType
 static LUTUsageType LUTUsage = NoLUT;
 static bool UseFisheyeCameras = false;
 static double CameraExposure = 0.0;
+// Zero uses one thread per hardware thread
+static unsigned int ThreadCount = 0;
 
 
 typedef map<string, double> ParameterSet;
 
 
+// Call body(i) for every i in [0, count) on ThreadCount threads. The items
+// are computed independently of each other, so the output doesn't depend
+// on the number of threads.
+static void parallelFor(unsigned int count, const function<void(unsigned int)>& body)
+{
+    unsigned int nThreads = ThreadCount;
+    if (nThreads == 0)
+        nThreads = max(1u, thread::hardware_concurrency());
+    nThreads = min(nThreads, count);
+
+    atomic<unsigned int> next{ 0 };
+    auto worker = [&]()
+    {
+        for (unsigned int i = next++; i < count; i = next++)
+            body(i);
+    };
+
+    vector<thread> threads;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+}
+
+
 struct Color
 {
     Color() = default;
@@ -109,7 +220,7 @@ static uint8_t floatToByte(float f)
     if (f >= 1.0f)
         return 255;
     else
-        return (uint8_t)_t (f * 255.99f);
+        return (uint8_t) (f * 255.99f);
 }
 
 
@@ -315,7 +426,7 @@ public:
         height(h),
         pixels(nullptr)
     {
-        pixels = new uint8_t[_twidth * height * 3];
+        pixels = new uint8_t[width * height * 3];
     }
 
     ~RGBImage()
@@ -380,6 +491,9 @@ void usage()
     cerr << "           set the number of integration steps for depth\n";
     cerr << "   --scattersteps <value> (or -s)\n";
     cerr << "           set the number of integration steps for scattering\n";
+    cerr << "   --threads <value> (or -t)\n";
+    cerr << "           set the number of threads (default is one per CPU);\n";
+    cerr << "           the output is the same for any number\n";
 }
 
 
@@ -890,9 +1004,15 @@ Atmosphere::computeExtinction(const OpticalDepths& depth) const
 }
 
 
-Vec3d integrateInscattering(const Scene& scene,
-                            const Point3d& atmStart,
-                            const Point3d& atmEnd)
+// Integrate the light from lightDir scattered toward atmStart along the
+// path from atmEnd, leaving out the phase functions and the scattering
+// coefficients.
+static void integrateScatteringSums(const Scene& scene,
+                                    const Point3d& atmStart,
+                                    const Point3d& atmEnd,
+                                    const Vec3d& lightDir,
+                                    Vec3d& rayleighScatter,
+                                    Vec3d& mieScatter)
 {
     const unsigned int nSteps = IntegrateScatterSteps;
 
@@ -904,10 +1024,9 @@ Vec3d integrateInscattering(const Scene& scene,
     // Start at the midpoint of the first interval
     Point3d samplePoint = origin + 0.5 * stepDist * dir;
 
-    Vec3d rayleighScatter(0.0, 0.0, 0.0);
-    Vec3d mieScatter(0.0, 0.0, 0.0);
+    rayleighScatter = Vec3d(0.0, 0.0, 0.0);
+    mieScatter = Vec3d(0.0, 0.0, 0.0);
 
-    Vec3d lightDir = -scene.light.direction;
     Sphered shell = Sphered(Point3d(0.0, 0.0, 0.0),
                             scene.planet.radius + scene.atmosphereShellHeight);
 
@@ -938,7 +1057,20 @@ Vec3d integrateInscattering(const Scene& scene,
 
         samplePoint += stepDist * dir;
     }
+}
+
+
+Vec3d integrateInscattering(const Scene& scene,
+                            const Point3d& atmStart,
+                            const Point3d& atmEnd)
+{
+    Vec3d lightDir = -scene.light.direction;
+    Vec3d rayleighScatter;
+    Vec3d mieScatter;
+    integrateScatteringSums(scene, atmStart, atmEnd, lightDir, rayleighScatter, mieScatter);
 
+    Vec3d dir = atmEnd - atmStart;
+    dir.normalize();
     double cosSunAngle = lightDir * dir;
 
     double miePhase = scene.atmosphere.miePhase(cosSunAngle);
@@ -955,49 +1087,9 @@ Vec4d integrateInscatteringFactors(const Scene& scene,
                                    const Point3d& atmEnd,
                                    const Vec3d& lightDir)
 {
-    const unsigned int nSteps = IntegrateScatterSteps;
-
-    Vec3d dir = atmEnd - atmStart;
-    Point3d origin = Point3d(0.0, 0.0, 0.0) + (atmStart - scene.planet.center);
-    double stepDist = dir.length() / (double) nSteps;
-    dir.normalize();
-
-    // Start at the midpoint of the first interval
-    Point3d samplePoint = origin + 0.5 * stepDist * dir;
-
-    Vec3d rayleighScatter(0.0, 0.0, 0.0);
-    Vec3d mieScatter(0.0, 0.0, 0.0);
-
-    Sphered shell = Sphered(Point3d(0.0, 0.0, 0.0),
-                            scene.planet.radius + scene.atmosphereShellHeight);
-
-    for (unsigned int i = 0; i < nSteps; i++)
-    {
-        Ray3d sunRay(samplePoint, lightDir);
-        double sunDist = 0.0;
-        testIntersection(sunRay, shell, sunDist);
-
-        // Compute the optical depth along path from sample point to the sun
-        OpticalDepths sunDepth = integrateOpticalDepth(scene, samplePoint, sunRay.point(sunDist));
-        // Compute the optical depth along the path from the sample point to the eye
-        OpticalDepths eyeDepth = integrateOpticalDepth(scene, samplePoint, atmStart);
-
-        // Sum the optical depths to get the depth on the complete path from sun
-        // to sample point to eye.
-        OpticalDepths totalDepth = sumOpticalDepths(sunDepth, eyeDepth);
-        totalDepth.rayleigh *= 4.0 * PI;
-        totalDepth.mie      *= 4.0 * PI;
-
-        Vec3d extinction = scene.atmosphere.computeExtinction(totalDepth);
-
-        double h = samplePoint.distanceFromOrigin() - scene.planet.radius;
-
-        // Add the inscattered light from Rayleigh and Mie scattering particles
-        rayleighScatter += scene.atmosphere.rayleighDensity(h) * stepDist * extinction;
-        mieScatter +=      scene.atmosphere.mieDensity(h)      * stepDist * extinction;
-
-        samplePoint += stepDist * dir;
-    }
+    Vec3d rayleighScatter;
+    Vec3d mieScatter;
+    integrateScatteringSums(scene, atmStart, atmEnd, lightDir, rayleighScatter, mieScatter);
 
     return Vec4d(rayleighScatter.x,
                  rayleighScatter.y,
@@ -1033,7 +1125,7 @@ buildExtinctionLUT(const Scene& scene)
     Sphered planet = Sphered(scene.planet.radius);
     Sphered shell = Sphered(scene.planet.radius + scene.atmosphereShellHeight);
 
-    for (unsigned int i = 0; i < ExtinctionLUTHeightSteps; i++)
+    parallelFor(ExtinctionLUTHeightSteps, [&](unsigned int i)
     {
         double h = (double) i / (double) (ExtinctionLUTHeightSteps - 1) *
             scene.atmosphereShellHeight * 0.9999;
@@ -1063,7 +1155,7 @@ buildExtinctionLUT(const Scene& scene)
 
             lut->setValue(i, j, ext);
         }
-    }
+    });
 
     return lut;
 }
@@ -1096,7 +1188,7 @@ buildOpticalDepthLUT(const Scene& scene)
     Sphered planet = Sphered(scene.planet.radius);
     Sphered shell = Sphered(scene.planet.radius + scene.atmosphereShellHeight);
 
-    for (unsigned int i = 0; i < ExtinctionLUTHeightSteps; i++)
+    parallelFor(ExtinctionLUTHeightSteps, [&](unsigned int i)
     {
         double h = (double) i / (double) (ExtinctionLUTHeightSteps - 1) *
             scene.atmosphereShellHeight;
@@ -1122,7 +1214,7 @@ buildOpticalDepthLUT(const Scene& scene)
 
             lut->setValue(i, j, Vec3d(depth.rayleigh, depth.mie, depth.absorption));
         }
-    }
+    });
 
     return lut;
 }
@@ -1320,48 +1412,49 @@ buildScatteringLUT(const Scene& scene)
 
     Sphered shell = Sphered(scene.planet.radius + scene.atmosphereShellHeight);
 
-    for (unsigned int i = 0; i < ScatteringLUTHeightSteps; i++)
+    // Each height and view angle is a work item
+    parallelFor(ScatteringLUTHeightSteps * ScatteringLUTViewAngleSteps, [&](unsigned int item)
     {
+        unsigned int i = item / ScatteringLUTViewAngleSteps;
+        unsigned int j = item % ScatteringLUTViewAngleSteps;
+
         double h = (double) i / (double) (ScatteringLUTHeightSteps - 1) *
             scene.atmosphereShellHeight * 0.9999;
         Point3d atmStart = Point3d(0.0, 0.0, 0.0) +
             Vec3d(1.0, 0.0, 0.0) * (h + scene.planet.radius);
 
-        for (unsigned int j = 0; j < ScatteringLUTViewAngleSteps; j++)
-        {
-            double cosAngle = unpackSNorm((double) j / (ScatteringLUTViewAngleSteps - 1));
-            double sinAngle = sqrt(1.0 - min(1.0, cosAngle * cosAngle));
-            Vec3d viewDir(cosAngle, sinAngle, 0.0);
+        double cosAngle = unpackSNorm((double) j / (ScatteringLUTViewAngleSteps - 1));
+        double sinAngle = sqrt(1.0 - min(1.0, cosAngle * cosAngle));
+        Vec3d viewDir(cosAngle, sinAngle, 0.0);
 
-            Ray3d viewRay(atmStart, viewDir);
-            double dist = 0.0;
-            if (!testIntersection(viewRay, shell, dist))
-                dist = 0.0;
+        Ray3d viewRay(atmStart, viewDir);
+        double dist = 0.0;
+        if (!testIntersection(viewRay, shell, dist))
+            dist = 0.0;
 
-            Point3d atmEnd = viewRay.point(dist);
+        Point3d atmEnd = viewRay.point(dist);
 
-            for (unsigned int k = 0; k < ScatteringLUTLightAngleSteps; k++)
-            {
-                double cosLightAngle = unpackSNorm((double) k / (ScatteringLUTLightAngleSteps - 1));
-                double sinLightAngle = sqrt(1.0 - min(1.0, cosLightAngle * cosLightAngle));
-                Vec3d lightDir(cosLightAngle, sinLightAngle, 0.0);
+        for (unsigned int k = 0; k < ScatteringLUTLightAngleSteps; k++)
+        {
+            double cosLightAngle = unpackSNorm((double) k / (ScatteringLUTLightAngleSteps - 1));
+            double sinLightAngle = sqrt(1.0 - min(1.0, cosLightAngle * cosLightAngle));
+            Vec3d lightDir(cosLightAngle, sinLightAngle, 0.0);
 
 #if 0
-                Vec4d inscatter = integrateInscatteringFactors_LUT(scene,
-                                                                   atmStart,
-                                                                   atmEnd,
-                                                                   lightDir,
-                                                                   true);
-#else
-                Vec4d inscatter = integrateInscatteringFactors(scene,
+            Vec4d inscatter = integrateInscatteringFactors_LUT(scene,
                                                                atmStart,
                                                                atmEnd,
-                                                               lightDir);
+                                                               lightDir,
+                                                               true);
+#else
+            Vec4d inscatter = integrateInscatteringFactors(scene,
+                                                           atmStart,
+                                                           atmEnd,
+                                                           lightDir);
 #endif
-                lut->setValue(i, j, k, inscatter);
-            }
+            lut->setValue(i, j, k, inscatter);
         }
-    }
+    });
 
     return lut;
 }
@@ -1622,14 +1715,14 @@ void render(const Scene& scene,
     unsigned int bottom = min(image.height, viewport.y + viewport.height);
 
     cout << "Rendering " << viewport.width << "x" << viewport.height << " view" << endl;
-    for (unsigned int i = viewport.y; i < bottom; i++)
-    {
-        unsigned int row = i - viewport.y;
-        if (row % 50 == 49)
-            cout << row + 1 << endl;
-        else if (row % 10 == 0)
-            cout << ".";
 
+    // Scanlines are rendered in parallel; progress is reported by the
+    // number of them completed.
+    atomic<unsigned int> rowsDone{ 0 };
+    mutex progressMutex;
+    parallelFor(bottom - viewport.y, [&](unsigned int row)
+    {
+        unsigned int i = viewport.y + row;
         for (unsigned int j = viewport.x; j < right; j++)
         {
             double viewportX = ((double) (j - viewport.x) / (double) (viewport.width - 1) - 0.5) * aspectRatio;
@@ -1648,7 +1741,14 @@ void render(const Scene& scene,
 
             image.setPixel(j, i, color);
         }
-    }
+
+        unsigned int done = ++rowsDone;
+        lock_guard<mutex> lock(progressMutex);
+        if (done % 50 == 0)
+            cout << done << endl;
+        else if (done % 10 == 1)
+            cout << ".";
+    });
     cout << endl << "Complete" << endl;
 }
 
@@ -1899,6 +1999,15 @@ bool parseCommandLine(int argc, char* argv[])
                     return false;
                 i++;
             }
+            else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--threads"))
+            {
+                if (i == argc - 1)
+                    return false;
+
+                if (sscanf(argv[i + 1], " %u", &ThreadCount) != 1)
+                    return false;
+                i++;
+            }
             else if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--image"))
             {
                 if (i == argc - 1)
@@ -17,13 +17,17 @@ CMOD_HEADERS = \
 
 CELMODEL_SOURCES = \
     ../../../celmodel/material.cpp \
+    ../../../celmodel/meshbvh.cpp \
     ../../../celmodel/mesh.cpp \
+    ../../../celmodel/meshoptimizer.cpp \
     ../../../celmodel/model.cpp \
     ../../../celmodel/modelfile.cpp
     
 CELMODEL_HEADERS = \
     ../../../celmodel/material.h \
+    ../../../celmodel/meshbvh.h \
     ../../../celmodel/mesh.h \
+    ../../../celmodel/meshoptimizer.h \
     ../../../celmodel/model.h \
     ../../../celmodel/modelfile.h \
 
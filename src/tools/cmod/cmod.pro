@@ -2,6 +2,7 @@ TEMPLATE = subdirs
 SUBDIRS = \
     3dstocmod \
     cmodfix \
+    cmodpick \
     cmodsphere \
     cmodview \
     itokawa
\ No newline at end of file
@@ -9,6 +9,7 @@
 //
 // Perform various adjustments to a cmod file
 
+#include <celmodel/meshoptimizer.h>
 #include <celmodel/modelfile.h>
 #include <celmath/mathlib.h>
 #include <Eigen/Core>
@@ -37,6 +38,7 @@ bool genTangents = false;
 bool weldVertices = false;
 bool mergeMeshes = false;
 bool stripify = false;
+bool reorder = false;
 unsigned int vertexCacheSize = 16;
 float smoothAngle = 60.0f;
 
@@ -52,6 +54,7 @@ void usage()
     cerr << "   --smooth (or -s) <angle> : smoothing angle for normal generation\n";
     cerr << "   --weld (or -w)        : join identical vertices before normal generation\n";
     cerr << "   --merge (or -m)       : merge submeshes to improve rendering performance\n";
+    cerr << "   --reorder (or -r)     : reorder triangles and vertices for the vertex caches\n";
 #ifdef TRISTRIP
     cerr << "   --optimize (or -o)    : optimize by converting triangle lists to strips\n";
 #endif
@@ -1468,6 +1471,10 @@ bool parseCommandLine(int argc, char* argv[])
             {
                 mergeMeshes = true;
             }
+            else if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--reorder"))
+            {
+                reorder = true;
+            }
             else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--optimize"))
             {
                 stripify = true;
@@ -1609,6 +1616,15 @@ int main(int argc, char* argv[])
         }
     }
 
+    if (reorder)
+    {
+        // Report the vertices transformed per triangle with a 32 entry
+        // FIFO cache, so the gain can be checked on real models.
+        float acmr = ComputeACMR(*model);
+        OptimizeModel(*model);
+        fprintf(stderr, "ACMR: %.3f before, %.3f after\n", acmr, ComputeACMR(*model));
+    }
+
 #ifdef TRISTRIP
     if (stripify)
     {
@@ -10,12 +10,16 @@ CMODFIX_SOURCES = \
 CELMODEL_SOURCES = \
     ../../../celmodel/material.cpp \
     ../../../celmodel/mesh.cpp \
+    ../../../celmodel/meshbvh.cpp \
+    ../../../celmodel/meshoptimizer.cpp \
     ../../../celmodel/model.cpp \
     ../../../celmodel/modelfile.cpp
     
 CELMODEL_HEADERS = \
     ../../../celmodel/material.h \
     ../../../celmodel/mesh.h \
+    ../../../celmodel/meshbvh.h \
+    ../../../celmodel/meshoptimizer.h \
     ../../../celmodel/model.h \
     ../../../celmodel/modelfile.h \
 
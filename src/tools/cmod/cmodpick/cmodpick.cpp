@@ -0,0 +1,331 @@
+// cmodpick.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Shoot random rays at cmod models and time picking through the mesh
+// bounding volume hierarchy against testing every triangle, checking that
+// both find the same hits.
+
+#include <celmodel/modelfile.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cmod;
+using namespace Eigen;
+using namespace std;
+
+static unsigned int rayCount = 100000;
+static unsigned int seed = 1;
+static vector<string> inputFilenames;
+
+static void usage()
+{
+    cerr << "Usage: cmodpick [options] <cmod file>...\n";
+    cerr << "   --rays <count> (or -n) : number of rays per model (default 100000)\n";
+    cerr << "   --seed <number> (or -s) : seed for the random rays\n";
+}
+
+
+static bool parseCommandLine(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") || !strcmp(argv[i], "--rays"))
+        {
+            if (++i == argc)
+                return false;
+            rayCount = (unsigned int) strtoul(argv[i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--seed"))
+        {
+            if (++i == argc)
+                return false;
+            seed = (unsigned int) strtoul(argv[i], nullptr, 10);
+        }
+        else if (argv[i][0] == '-')
+        {
+            return false;
+        }
+        else
+        {
+            inputFilenames.push_back(argv[i]);
+        }
+    }
+
+    return !inputFilenames.empty() && rayCount > 0;
+}
+
+
+// Reference pick testing every triangle of the mesh, as Mesh::pick did
+// before it had a hierarchy.
+static bool pickAllTriangles(const Mesh& mesh,
+                             const Vector3d& rayOrigin,
+                             const Vector3d& rayDirection,
+                             double& distance)
+{
+    const Mesh::VertexDescription& desc = mesh.getVertexDescription();
+    if (desc.getAttribute(Mesh::Position).semantic != Mesh::Position ||
+        desc.getAttribute(Mesh::Position).format != Mesh::Float3)
+    {
+        return false;
+    }
+
+    double maxDistance = 1.0e30;
+    double closest = maxDistance;
+    unsigned int posOffset = desc.getAttribute(Mesh::Position).offset;
+    auto vdata = reinterpret_cast<const char*>(mesh.getVertexData());
+    auto position = [&](Mesh::index32 i)
+    {
+        return Map<const Vector3f>(reinterpret_cast<const float*>(vdata + (size_t) i * desc.stride + posOffset)).cast<double>();
+    };
+
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        Mesh::PrimitiveGroupType primType = group->prim;
+        Mesh::index32 nIndices = group->nIndices;
+        if ((primType != Mesh::TriList && primType != Mesh::TriStrip && primType != Mesh::TriFan) ||
+            nIndices < 3 || (primType == Mesh::TriList && nIndices % 3 != 0))
+        {
+            continue;
+        }
+
+        Mesh::index32 index = 0;
+        Mesh::index32 i0 = group->indices[0];
+        Mesh::index32 i1 = group->indices[1];
+        Mesh::index32 i2 = group->indices[2];
+        do
+        {
+            Vector3d v0 = position(i0);
+            Vector3d e0 = position(i1) - v0;
+            Vector3d e1 = position(i2) - v0;
+            Vector3d n = e0.cross(e1);
+            double c = n.dot(rayDirection);
+            if (c != 0.0)
+            {
+                double t = (n.dot(v0 - rayOrigin)) / c;
+                if (t < closest && t > 0.0)
+                {
+                    double m00 = e0.dot(e0);
+                    double m01 = e0.dot(e1);
+                    double m10 = e1.dot(e0);
+                    double m11 = e1.dot(e1);
+                    double det = m00 * m11 - m01 * m10;
+                    if (det != 0.0)
+                    {
+                        Vector3d q = rayOrigin + rayDirection * t - v0;
+                        double q0 = e0.dot(q);
+                        double q1 = e1.dot(q);
+                        double d = 1.0 / det;
+                        double s0 = (m11 * q0 - m01 * q1) * d;
+                        double s1 = (m00 * q1 - m10 * q0) * d;
+                        if (s0 >= 0.0 && s1 >= 0.0 && s0 + s1 <= 1.0)
+                            closest = t;
+                    }
+                }
+            }
+
+            if (primType == Mesh::TriList)
+            {
+                index += 3;
+                if (index < nIndices)
+                {
+                    i0 = group->indices[index + 0];
+                    i1 = group->indices[index + 1];
+                    i2 = group->indices[index + 2];
+                }
+            }
+            else if (primType == Mesh::TriStrip)
+            {
+                index += 1;
+                if (index < nIndices)
+                {
+                    i0 = i1;
+                    i1 = i2;
+                    i2 = group->indices[index];
+                }
+            }
+            else
+            {
+                index += 1;
+                if (index < nIndices)
+                {
+                    index += 1;
+                    i1 = i2;
+                    i2 = group->indices[index];
+                }
+            }
+        } while (index < nIndices);
+    }
+
+    if (closest == maxDistance)
+        return false;
+
+    distance = closest;
+    return true;
+}
+
+
+static bool pickAllTriangles(const Model& model,
+                             const Vector3d& rayOrigin,
+                             const Vector3d& rayDirection,
+                             double& distance)
+{
+    bool hit = false;
+    for (unsigned int i = 0; i < model.getMeshCount(); i++)
+    {
+        double meshDistance;
+        if (pickAllTriangles(*model.getMesh(i), rayOrigin, rayDirection, meshDistance) &&
+            (!hit || meshDistance < distance))
+        {
+            distance = meshDistance;
+            hit = true;
+        }
+    }
+
+    return hit;
+}
+
+
+struct Ray
+{
+    Vector3d origin;
+    Vector3d direction;
+};
+
+
+// Rays start on a sphere around the model and aim at random points of its
+// bounding box, so that most of them hit.
+static vector<Ray> makeRays(const Model& model)
+{
+    AlignedBox<float, 3> bounds;
+    for (unsigned int i = 0; i < model.getMeshCount(); i++)
+        bounds.extend(model.getMesh(i)->getBoundingBox());
+
+    Vector3d center = bounds.center().cast<double>();
+    Vector3d halfSize = bounds.sizes().cast<double>() * 0.5;
+    double radius = halfSize.norm() * 2.0;
+
+    mt19937 rng(seed);
+    uniform_real_distribution<double> uniform(-1.0, 1.0);
+    vector<Ray> rays(rayCount);
+    for (auto& ray : rays)
+    {
+        Vector3d dir;
+        do
+        {
+            dir = Vector3d(uniform(rng), uniform(rng), uniform(rng));
+        } while (dir.squaredNorm() > 1.0 || dir.squaredNorm() < 1.0e-6);
+
+        ray.origin = center + dir.normalized() * radius;
+        Vector3d target = center + Vector3d(uniform(rng), uniform(rng), uniform(rng)).cwiseProduct(halfSize);
+        ray.direction = (target - ray.origin).normalized();
+    }
+
+    return rays;
+}
+
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+static bool benchmark(const string& filename)
+{
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.good())
+    {
+        cerr << "Error opening " << filename << "\n";
+        return false;
+    }
+
+    Model* model = LoadModel(in);
+    if (model == nullptr)
+    {
+        cerr << "Error loading " << filename << "\n";
+        return false;
+    }
+
+    vector<Ray> rays = makeRays(*model);
+
+    // The first pick builds the hierarchies
+    auto start = chrono::steady_clock::now();
+    double distance;
+    model->pick(rays[0].origin, rays[0].direction, distance);
+    double buildTime = secondsSince(start);
+
+    vector<double> bvhDistances(rays.size(), -1.0);
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (model->pick(rays[i].origin, rays[i].direction, distance))
+            bvhDistances[i] = distance;
+    }
+    double bvhTime = secondsSince(start);
+
+    vector<double> referenceDistances(rays.size(), -1.0);
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (pickAllTriangles(*model, rays[i].origin, rays[i].direction, distance))
+            referenceDistances[i] = distance;
+    }
+    double referenceTime = secondsSince(start);
+
+    unsigned int hits = 0;
+    unsigned int mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (referenceDistances[i] >= 0.0)
+            hits++;
+        if (bvhDistances[i] != referenceDistances[i])
+            mismatches++;
+    }
+
+    cout << filename << ": " << model->getPrimitiveCount() << " primitives, "
+         << hits << "/" << rays.size() << " hits, "
+         << "build " << buildTime * 1000.0 << " ms, "
+         << "hierarchy " << bvhTime * 1.0e6 / rays.size() << " us/ray, "
+         << "all triangles " << referenceTime * 1.0e6 / rays.size() << " us/ray";
+    if (mismatches != 0)
+        cout << ", " << mismatches << " MISMATCHES";
+    cout << '\n';
+
+    delete model;
+    return mismatches == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (!parseCommandLine(argc, argv))
+    {
+        usage();
+        return 1;
+    }
+
+    bool ok = true;
+    for (const auto& filename : inputFilenames)
+    {
+        if (!benchmark(filename))
+            ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -37,13 +37,17 @@ CMODVIEW_SOURCES = \
 
 MODEL_SOURCES = \
     ../../../celmodel/material.cpp \
+    ../../../celmodel/meshbvh.cpp \
     ../../../celmodel/mesh.cpp \
+    ../../../celmodel/meshoptimizer.cpp \
     ../../../celmodel/model.cpp \
     ../../../celmodel/modelfile.cpp
 
 MODEL_HEADERS = \
     ../../../celmodel/material.h \
+    ../../../celmodel/meshbvh.h \
     ../../../celmodel/mesh.h \
+    ../../../celmodel/meshoptimizer.h \
     ../../../celmodel/model.h \
     ../../../celmodel/modelfile.h
 
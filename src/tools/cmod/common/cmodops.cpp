@@ -36,34 +36,6 @@ public:
 };
 
 
-class FullComparator : public VertexComparator
-{
-public:
-    FullComparator(int _vertexSize) :
-        vertexSize(_vertexSize)
-    {
-    }
-
-    bool compare(const Vertex& a, const Vertex& b) const override
-    {
-        const auto* s0 = reinterpret_cast<const char*>(a.attributes);
-        const auto* s1 = reinterpret_cast<const char*>(b.attributes);
-        for (int i = 0; i < vertexSize; i++)
-        {
-            if (s0[i] < s1[i])
-                return true;
-            if (s0[i] > s1[i])
-                return false;
-        }
-
-        return false;
-    }
-
-private:
-    int vertexSize;
-};
-
-
 class PointOrderingPredicate : public VertexComparator
 {
 public:
@@ -238,21 +210,6 @@ private:
 };
 
 
-bool equal(const Vertex& a, const Vertex& b, uint32_t vertexSize)
-{
-    const auto* s0 = reinterpret_cast<const char*>(a.attributes);
-    const auto* s1 = reinterpret_cast<const char*>(b.attributes);
-
-    for (uint32_t i = 0; i < vertexSize; i++)
-    {
-        if (s0[i] != s1[i])
-            return false;
-    }
-
-    return true;
-}
-
-
 bool equalPoint(const Vertex& a, const Vertex& b)
 {
     const Vector3f* p0 = reinterpret_cast<const Vector3f*>(a.attributes);
@@ -352,70 +309,6 @@ private:
 
 
 
-bool
-UniquifyVertices(Mesh& mesh)
-{
-    uint32_t nVertices = mesh.getVertexCount();
-    const Mesh::VertexDescription& desc = mesh.getVertexDescription();
-
-    if (nVertices == 0)
-        return false;
-
-    const char* vertexData = reinterpret_cast<const char*>(mesh.getVertexData());
-    if (vertexData == nullptr)
-        return false;
-
-    // Initialize the array of vertices
-    vector<Vertex> vertices(nVertices);
-    uint32_t i;
-    for (i = 0; i < nVertices; i++)
-    {
-        vertices[i] = Vertex(i, vertexData + i * desc.stride);
-    }
-
-    // Sort the vertices so that identical ones will be ordered consecutively
-    sort(vertices.begin(), vertices.end(), FullComparator(desc.stride));
-
-    // Count the number of unique vertices
-    uint32_t uniqueVertexCount = 0;
-    for (i = 0; i < nVertices; i++)
-    {
-        if (i == 0 || !equal(vertices[i - 1], vertices[i], desc.stride))
-            uniqueVertexCount++;
-    }
-
-    // No work left to do if we couldn't eliminate any vertices
-    if (uniqueVertexCount == nVertices)
-        return true;
-
-    // Build the vertex map and the uniquified vertex data
-    vector<uint32_t> vertexMap(nVertices);
-    auto* newVertexData = new char[uniqueVertexCount * desc.stride];
-    const char* oldVertexData = reinterpret_cast<const char*>(mesh.getVertexData());
-    uint32_t j = 0;
-    for (i = 0; i < nVertices; i++)
-    {
-        if (i == 0 || !equal(vertices[i - 1], vertices[i], desc.stride))
-        {
-            if (i != 0)
-                j++;
-            assert(j < uniqueVertexCount);
-            memcpy(newVertexData + j * desc.stride,
-                   oldVertexData + vertices[i].index * desc.stride,
-                   desc.stride);
-        }
-        vertexMap[vertices[i].index] = j;
-    }
-
-    // Replace the vertex data with the compacted data
-    mesh.setVertices(uniqueVertexCount, newVertexData);
-
-    mesh.remapIndices(vertexMap);
-
-    return true;
-}
-
-
 Vector3f
 getVertex(const void* vertexData,
           int positionOffset,
@@ -13,6 +13,7 @@
 #define _CMODOPS_H_
 
 #include <celmodel/model.h>
+#include <celmodel/meshoptimizer.h>
 #include <Eigen/Core>
 #include <vector>
 
@@ -41,7 +42,7 @@ struct Face
 // Mesh operations
 extern cmod::Mesh* GenerateNormals(const cmod::Mesh& mesh, float smoothAngle, bool weld, float weldTolerance = 0.0f);
 extern cmod::Mesh* GenerateTangents(const cmod::Mesh& mesh, bool weld);
-extern bool UniquifyVertices(cmod::Mesh& mesh);
+using cmod::UniquifyVertices;
 
 // Model operations
 extern cmod::Model* MergeModelMeshes(const cmod::Model& model);
@@ -0,0 +1,310 @@
+// eclipsebench.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Search the eclipses of the satellites of a body with EclipseFinder and
+// with the search it replaced, which tested every satellite at every
+// hourly step and found contact times one minute step at a time. Both must
+// find the same eclipses, in the same order and with the same start and
+// end times; the time taken by each search is reported.
+
+#include <celengine/astro.h>
+#include <celengine/body.h>
+#include <celengine/solarsys.h>
+#include <celengine/stardb.h>
+#include <celengine/starname.h>
+#include <celengine/universe.h>
+#include <celestia/eclipsefinder.h>
+#include <celmath/distance.h>
+#include <celmath/ray.h>
+#include <celutil/filetype.h>
+#include <fmt/printf.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+using namespace celmath;
+
+// The constants of eclipsefinder.cpp
+constexpr const double dT = 1.0 / (24.0 * 60.0);
+constexpr const double searchStep = 1.0 / 24.0;
+constexpr const int EclipseObjectMask = Body::Planet      |
+                                        Body::Moon        |
+                                        Body::MinorMoon   |
+                                        Body::DwarfPlanet |
+                                        Body::Asteroid;
+constexpr const float MinRelativeOccluderRadius = 0.005f;
+
+static string bodyPath = "Sol/Jupiter";
+static double startDate = 2451545.0; // J2000
+static double years = 10.0;
+static vector<string> catalogFilenames;
+
+
+static void Usage()
+{
+    cerr << "Usage: eclipsebench [options] <star and solar system catalogs...>\n"
+         << "   -b <path>  : body whose satellites are searched (default Sol/Jupiter)\n"
+         << "   -t <date>  : Julian date of the start of the search (default J2000)\n"
+         << "   -y <years> : length of the search in years (default 10)\n";
+}
+
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+// The search of EclipseFinder before it was split across threads, kept
+// here as the reference.
+static bool LegacyTestEclipse(const Body& receiver, const Body& caster, double now)
+{
+    if (caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
+        caster.isEllipsoid())
+    {
+        Vector3d posReceiver = receiver.getAstrocentricPosition(now);
+        Vector3d posCaster = caster.getAstrocentricPosition(now);
+
+        const Star* sun = receiver.getSystem()->getStar();
+        assert(sun != nullptr);
+        double distToSun = posReceiver.norm();
+        float appSunRadius = (float) (sun->getRadius() / distToSun);
+
+        Vector3d dir = posCaster - posReceiver;
+        double distToCaster = dir.norm() - receiver.getRadius();
+        float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
+
+        float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
+            caster.getRadius();
+
+        float R = receiver.getRadius() + shadowRadius;
+        double dist = distance(posReceiver, Ray3d(posCaster, posCaster));
+        if (dist < R)
+        {
+            if (distToCaster > caster.getRadius())
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
+static double LegacyFindEclipseSpan(const Body& receiver, const Body& caster,
+                                    double now, double dt)
+{
+    double t = now;
+    while (LegacyTestEclipse(receiver, caster, t))
+        t += dt;
+
+    return t;
+}
+
+
+static void LegacyAddEclipse(const Body& receiver, const Body& occulter,
+                             double now,
+                             vector<Eclipse>& eclipses,
+                             vector<double>& previousEclipseEndTimes, int i)
+{
+    if (LegacyTestEclipse(receiver, occulter, now))
+    {
+        Eclipse eclipse;
+        eclipse.startTime = LegacyFindEclipseSpan(receiver, occulter, now, -dT);
+        eclipse.endTime = LegacyFindEclipseSpan(receiver, occulter, now, dT);
+        eclipse.receiver = const_cast<Body*>(&receiver);
+        eclipse.occulter = const_cast<Body*>(&occulter);
+        eclipses.emplace_back(eclipse);
+
+        previousEclipseEndTimes[i] = eclipse.endTime;
+    }
+}
+
+
+static void LegacyFindEclipses(Body* body,
+                               double startDate,
+                               double endDate,
+                               int eclipseTypeMask,
+                               vector<Eclipse>& eclipses)
+{
+    PlanetarySystem* satellites = body->getSatellites();
+    if (satellites == nullptr)
+        return;
+
+    vector<double> previousEclipseEndTimes;
+    vector<Body*> testBodies;
+    for (int i = 0; i < satellites->getSystemSize(); i++)
+    {
+        Body* obj = satellites->getBody(i);
+        if ((obj->getClassification() & EclipseObjectMask) != 0 &&
+            obj->getRadius() >= body->getRadius() * MinRelativeOccluderRadius)
+        {
+            testBodies.push_back(obj);
+            previousEclipseEndTimes.push_back(startDate - 1.0);
+        }
+    }
+
+    for (double t = startDate; t <= endDate; t += searchStep)
+    {
+        for (unsigned int i = 0; i < testBodies.size(); i++)
+        {
+            if (t <= previousEclipseEndTimes[i])
+                continue;
+
+            if (eclipseTypeMask & Eclipse::Solar)
+                LegacyAddEclipse(*body, *testBodies[i], t, eclipses, previousEclipseEndTimes, i);
+
+            if (eclipseTypeMask & Eclipse::Lunar)
+                LegacyAddEclipse(*testBodies[i], *body, t, eclipses, previousEclipseEndTimes, i);
+        }
+    }
+}
+
+
+static bool LoadCatalog(const string& filename, StarDatabase& starDB, Universe& universe)
+{
+    switch (DetermineFileType(filename))
+    {
+    case Content_CelestiaStarCatalog:
+        {
+            ifstream in(filename, ios::in);
+            return in.good() && starDB.load(in);
+        }
+    case Content_CelestiaCatalog:
+        {
+            ifstream in(filename, ios::in);
+            return in.good() && LoadSolarSystemObjects(in, universe);
+        }
+    default:
+        {
+            ifstream in(filename, ios::in | ios::binary);
+            return in.good() && starDB.loadBinary(in);
+        }
+    }
+}
+
+
+static void PrintEclipse(const char* label, const Eclipse& eclipse)
+{
+    fmt::fprintf(cerr, "%s: %s on %s, %.9f to %.9f\n", label,
+                 eclipse.occulter->getName(), eclipse.receiver->getName(),
+                 eclipse.startTime, eclipse.endTime);
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc)
+        {
+            bodyPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            startDate = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-y") && i + 1 < argc)
+        {
+            years = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            Usage();
+            return 1;
+        }
+        else
+        {
+            catalogFilenames.push_back(argv[i]);
+        }
+    }
+
+    if (catalogFilenames.empty() || !(years > 0.0))
+    {
+        Usage();
+        return 1;
+    }
+
+    // Star catalogs are read before solar system catalogs, as Celestia does
+    auto* starDB = new StarDatabase();
+    starDB->setNameDatabase(new StarNameDatabase());
+    Universe universe;
+    universe.setSolarSystemCatalog(new SolarSystemCatalog());
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (const auto& filename : catalogFilenames)
+        {
+            bool isSolarSystem = DetermineFileType(filename) == Content_CelestiaCatalog;
+            if (isSolarSystem != (pass == 1))
+                continue;
+
+            if (!LoadCatalog(filename, *starDB, universe))
+            {
+                fmt::fprintf(cerr, "Error reading %s\n", filename);
+                return 1;
+            }
+        }
+
+        if (pass == 0)
+        {
+            starDB->finish();
+            universe.setStarCatalog(starDB);
+        }
+    }
+
+    Body* body = universe.findPath(bodyPath).body();
+    if (body == nullptr)
+    {
+        fmt::fprintf(cerr, "Body %s not found\n", bodyPath);
+        return 1;
+    }
+
+    double endDate = startDate + years * 365.25;
+    int mask = Eclipse::Solar | Eclipse::Lunar;
+
+    vector<Eclipse> eclipses;
+    auto start = chrono::steady_clock::now();
+    EclipseFinder(body).findEclipses(startDate, endDate, mask, eclipses);
+    double finderTime = SecondsSince(start);
+
+    vector<Eclipse> legacyEclipses;
+    start = chrono::steady_clock::now();
+    LegacyFindEclipses(body, startDate, endDate, mask, legacyEclipses);
+    double legacyTime = SecondsSince(start);
+
+    fmt::printf("%s, %.1f years from %.1f: %zu eclipses\n",
+                bodyPath, years, startDate, legacyEclipses.size());
+    fmt::printf("EclipseFinder %.3f s, fixed step search %.3f s\n", finderTime, legacyTime);
+
+    for (size_t i = 0; i < max(eclipses.size(), legacyEclipses.size()); i++)
+    {
+        if (i >= eclipses.size() || i >= legacyEclipses.size() ||
+            eclipses[i].occulter != legacyEclipses[i].occulter ||
+            eclipses[i].receiver != legacyEclipses[i].receiver ||
+            eclipses[i].startTime != legacyEclipses[i].startTime ||
+            eclipses[i].endTime != legacyEclipses[i].endTime)
+        {
+            fmt::fprintf(cerr, "Eclipse %zu differs\n", i);
+            if (i < eclipses.size())
+                PrintEclipse("EclipseFinder", eclipses[i]);
+            if (i < legacyEclipses.size())
+                PrintEclipse("fixed step search", legacyEclipses[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
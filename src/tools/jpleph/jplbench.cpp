@@ -0,0 +1,349 @@
+// jplbench.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Compare the memory mapped JPL ephemeris loader with the old one, which
+// read every record of the file into memory: load time, resident memory
+// and evaluation time, checking that both compute the same positions.
+
+#include <celephem/jpleph.h>
+#include <fmt/printf.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace Eigen;
+using namespace std;
+
+static unsigned int evaluationCount = 1000000;
+static unsigned int seed = 1;
+static string inputFilename;
+
+
+static void Usage()
+{
+    cerr << "Usage: jplbench [options] <DE file>\n"
+         << "   -n <count> : number of positions to evaluate (default 1000000)\n"
+         << "   -s <seed>  : seed for the random times and items\n";
+}
+
+
+// Resident memory of the process in kilobytes, or -1 where we can't tell
+static long ResidentMemory()
+{
+#ifdef __linux__
+    ifstream in("/proc/self/statm");
+    long size = 0;
+    long resident = 0;
+    if (in >> size >> resident)
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+    return -1;
+}
+
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+// The loader Celestia used before the ephemeris was memory mapped, kept
+// here as the reference: every record is read one double at a time into
+// an array of its own, and only DE200, DE405 and DE406 are known.
+class LegacyEphemeris
+{
+ public:
+    static LegacyEphemeris* load(const string& filename);
+
+    Vector3d getPlanetPosition(JPLEphemItem planet, double tjd) const;
+
+ private:
+    struct Record
+    {
+        double t0;
+        double t1;
+        unique_ptr<double[]> coeffs;
+    };
+
+    uint32_t readUint(istream& in) const;
+    double readDouble(istream& in) const;
+
+    JPLEphCoeffInfo coeffInfo[JPLEph_NItems];
+    double startDate;
+    double endDate;
+    double daysPerInterval;
+    double earthMoonMassRatio;
+    unsigned int recordSize;
+    bool swapBytes;
+    vector<Record> records;
+};
+
+
+uint32_t LegacyEphemeris::readUint(istream& in) const
+{
+    unsigned char b[4];
+    in.read(reinterpret_cast<char*>(b), 4);
+    if (swapBytes)
+        reverse(b, b + 4);
+
+    uint32_t n;
+    memcpy(&n, b, 4);
+    return n;
+}
+
+
+double LegacyEphemeris::readDouble(istream& in) const
+{
+    unsigned char b[8];
+    in.read(reinterpret_cast<char*>(b), 8);
+    if (swapBytes)
+        reverse(b, b + 8);
+
+    double d;
+    memcpy(&d, b, 8);
+    return d;
+}
+
+
+LegacyEphemeris* LegacyEphemeris::load(const string& filename)
+{
+    const int LabelSize = 84;
+    const unsigned int NConstants = 400;
+    const unsigned int ConstantNameLength = 6;
+    const size_t DENumberOffset = LabelSize * 3 + NConstants * ConstantNameLength + 24 + 4 + 16 + JPLEph_NItems * 12;
+
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.good())
+        return nullptr;
+
+    unique_ptr<LegacyEphemeris> eph(new LegacyEphemeris());
+
+    // The old loader only read big endian files; tell the byte order from
+    // the DE number as the new one does, so that both can be compared.
+    in.seekg(DENumberOffset);
+    eph->swapBytes = false;
+    uint32_t DENum = eph->readUint(in);
+    if (DENum == 0 || DENum > 9999)
+    {
+        eph->swapBytes = true;
+        in.seekg(DENumberOffset);
+        DENum = eph->readUint(in);
+    }
+
+    switch (DENum)
+    {
+    case 200:
+        eph->recordSize = 826;
+        break;
+    case 405:
+        eph->recordSize = 1018;
+        break;
+    case 406:
+        eph->recordSize = 728;
+        break;
+    default:
+        return nullptr;
+    }
+
+    in.seekg(LabelSize * 3 + NConstants * ConstantNameLength);
+    eph->startDate = eph->readDouble(in);
+    eph->endDate = eph->readDouble(in);
+    eph->daysPerInterval = eph->readDouble(in);
+    (void) eph->readUint(in);
+    (void) eph->readDouble(in);
+    eph->earthMoonMassRatio = eph->readDouble(in);
+    for (auto& info : eph->coeffInfo)
+    {
+        info.offset = eph->readUint(in) - 3;
+        info.nCoeffs = eph->readUint(in);
+        info.nGranules = eph->readUint(in);
+    }
+
+    // Skip the header and constants records
+    in.seekg((streamoff) eph->recordSize * 8 * 2);
+    if (!in.good() || !(eph->daysPerInterval > 0.0))
+        return nullptr;
+
+    auto nRecords = (unsigned int) ((eph->endDate - eph->startDate) / eph->daysPerInterval);
+    eph->records.resize(nRecords);
+    for (auto& rec : eph->records)
+    {
+        rec.t0 = eph->readDouble(in);
+        rec.t1 = eph->readDouble(in);
+        rec.coeffs.reset(new double[eph->recordSize - 2]);
+        for (unsigned int j = 0; j < eph->recordSize - 2; j++)
+            rec.coeffs[j] = eph->readDouble(in);
+
+        if (!in.good())
+            return nullptr;
+    }
+
+    return eph.release();
+}
+
+
+Vector3d LegacyEphemeris::getPlanetPosition(JPLEphemItem planet, double tjd) const
+{
+    if (planet == JPLEph_SSB)
+        return Vector3d::Zero();
+
+    if (planet == JPLEph_Earth)
+    {
+        Vector3d embPos = getPlanetPosition(JPLEph_EarthMoonBary, tjd);
+        Vector3d moonPos = getPlanetPosition(JPLEph_Moon, tjd);
+        return embPos - moonPos * (1.0 / (earthMoonMassRatio + 1.0));
+    }
+
+    tjd = max(startDate, min(tjd, endDate));
+    auto recNo = (unsigned int) ((tjd - startDate) / daysPerInterval);
+    if (recNo >= records.size())
+        recNo = records.size() - 1;
+    const Record& rec = records[recNo];
+
+    const JPLEphCoeffInfo& info = coeffInfo[planet];
+    double daysPerGranule = daysPerInterval / info.nGranules;
+    auto granule = (int) ((tjd - rec.t0) / daysPerGranule);
+    double granuleStartDate = rec.t0 + daysPerGranule * (double) granule;
+    const double* coeffs = rec.coeffs.get() + info.offset + granule * info.nCoeffs * 3;
+    double u = 2.0 * (tjd - granuleStartDate) / daysPerGranule - 1.0;
+
+    double sum[3];
+    double cc[32];
+    for (int i = 0; i < 3; i++)
+    {
+        cc[0] = 1.0;
+        cc[1] = u;
+        sum[i] = coeffs[i * info.nCoeffs] + coeffs[i * info.nCoeffs + 1] * u;
+        for (unsigned int j = 2; j < info.nCoeffs; j++)
+        {
+            cc[j] = 2.0 * u * cc[j - 1] - cc[j - 2];
+            sum[i] += coeffs[i * info.nCoeffs + j] * cc[j];
+        }
+    }
+
+    return Vector3d(sum[0], sum[1], sum[2]);
+}
+
+
+struct Evaluation
+{
+    JPLEphemItem item;
+    double t;
+};
+
+
+template<typename Ephemeris> static double
+TimeEvaluations(const Ephemeris& eph, const vector<Evaluation>& evaluations, vector<Vector3d>& positions)
+{
+    positions.resize(evaluations.size());
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < evaluations.size(); i++)
+        positions[i] = eph.getPlanetPosition(evaluations[i].item, evaluations[i].t);
+    return SecondsSince(start);
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            evaluationCount = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            seed = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] == '-' || !inputFilename.empty())
+        {
+            Usage();
+            return 1;
+        }
+        else
+        {
+            inputFilename = argv[i];
+        }
+    }
+
+    if (inputFilename.empty() || evaluationCount == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    long memory = ResidentMemory();
+    auto start = chrono::steady_clock::now();
+    unique_ptr<JPLEphemeris> eph(JPLEphemeris::load(inputFilename));
+    double loadTime = SecondsSince(start);
+    if (eph == nullptr)
+    {
+        fmt::fprintf(cerr, "Error loading %s\n", inputFilename);
+        return 1;
+    }
+    long loadMemory = ResidentMemory() - memory;
+
+    fmt::printf("DE%u, %.1f to %.1f\n", eph->getDENumber(), eph->getStartDate(), eph->getEndDate());
+
+    mt19937 rng(seed);
+    uniform_real_distribution<double> uniformTime(eph->getStartDate(), eph->getEndDate());
+    uniform_int_distribution<int> uniformItem(JPLEph_Mercury, JPLEph_Earth);
+    vector<Evaluation> evaluations(evaluationCount);
+    for (auto& e : evaluations)
+    {
+        e.item = (JPLEphemItem) uniformItem(rng);
+        e.t = uniformTime(rng);
+    }
+
+    vector<Vector3d> positions;
+    memory = ResidentMemory();
+    double evalTime = TimeEvaluations(*eph, evaluations, positions);
+    long evalMemory = ResidentMemory() - memory;
+
+    fmt::printf("mapped: load %.3f ms, +%ld kB resident; %u evaluations %.1f ns each, +%ld kB resident\n",
+                loadTime * 1000.0, loadMemory, evaluationCount,
+                evalTime * 1.0e9 / evaluationCount, evalMemory);
+    eph = nullptr;
+
+    memory = ResidentMemory();
+    start = chrono::steady_clock::now();
+    unique_ptr<LegacyEphemeris> legacy(LegacyEphemeris::load(inputFilename));
+    loadTime = SecondsSince(start);
+    if (legacy == nullptr)
+    {
+        fmt::printf("legacy: can't load this file\n");
+        return 0;
+    }
+    loadMemory = ResidentMemory() - memory;
+
+    vector<Vector3d> legacyPositions;
+    evalTime = TimeEvaluations(*legacy, evaluations, legacyPositions);
+
+    double maxDifference = 0.0;
+    for (size_t i = 0; i < positions.size(); i++)
+        maxDifference = max(maxDifference, (positions[i] - legacyPositions[i]).norm());
+
+    fmt::printf("legacy: load %.3f ms, +%ld kB resident; %u evaluations %.1f ns each\n",
+                loadTime * 1000.0, loadMemory, evaluationCount,
+                evalTime * 1.0e9 / evaluationCount);
+    fmt::printf("largest position difference: %g km\n", maxDifference);
+
+    return maxDifference == 0.0 ? 0 : 1;
+}
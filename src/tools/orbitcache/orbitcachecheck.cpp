@@ -0,0 +1,299 @@
+// orbitcachecheck.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Check the eviction of the orbit path cache against a plain list kept in
+// least recently used order: the same paths must be hit, evicted and
+// accounted for, and the cache must never hold more than its byte limit
+// unless a single path is larger than the limit.
+
+#include <celengine/curveplot.h>
+#include <celengine/orbitpathcache.h>
+#include <celephem/orbit.h>
+#include <fmt/printf.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+
+static unsigned int operationCount = 200000;
+static unsigned int orbitCount = 5000;
+static size_t maxBytes = 16 * 1024 * 1024;
+static unsigned int seed = 1;
+
+
+static void Usage()
+{
+    cerr << "Usage: orbitcachecheck [options]\n"
+         << "   -n <count> : number of path lookups (default 200000)\n"
+         << "   -o <count> : number of orbits (default 5000)\n"
+         << "   -m <kB>    : cache limit in kilobytes (default 16384)\n"
+         << "   -s <seed>  : seed for the random lookups\n";
+}
+
+
+static CurvePlot* MakePlot(unsigned int nSamples)
+{
+    auto* plot = new CurvePlot();
+    for (unsigned int i = 0; i < nSamples; i++)
+    {
+        CurvePlotSample sample;
+        sample.position = Vector3d::Zero();
+        sample.velocity = Vector3d::UnitX();
+        sample.t = (double) i;
+        plot->addSample(sample);
+    }
+    return plot;
+}
+
+
+// The reference: paths in a vector, most recently used first, with every
+// operation done by linear search.
+class ReferenceCache
+{
+ public:
+    explicit ReferenceCache(size_t maxBytes) : maxBytes(maxBytes) {}
+
+    const CurvePlot* find(const Orbit* orbit)
+    {
+        auto iter = find_if(entries.begin(), entries.end(),
+                            [orbit](const Entry& e) { return e.orbit == orbit; });
+        if (iter == entries.end())
+            return nullptr;
+        rotate(entries.begin(), iter, iter + 1);
+        return entries.front().plot;
+    }
+
+    void insert(const Orbit* orbit, const CurvePlot* plot)
+    {
+        entries.insert(entries.begin(), Entry{ orbit, plot, plot->memoryUsage() });
+        evict();
+    }
+
+    void updateSize()
+    {
+        entries.front().bytes = entries.front().plot->memoryUsage();
+        evict();
+    }
+
+    void setMaxBytes(size_t _maxBytes)
+    {
+        maxBytes = _maxBytes;
+        evict();
+    }
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (const auto& e : entries)
+            total += e.bytes;
+        return total;
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t evictions{ 0 };
+
+ private:
+    void evict()
+    {
+        while (bytes() > maxBytes && entries.size() > 1)
+        {
+            entries.pop_back();
+            evictions++;
+        }
+    }
+
+    struct Entry
+    {
+        const Orbit* orbit;
+        const CurvePlot* plot;
+        size_t bytes;
+    };
+
+    vector<Entry> entries;
+    size_t maxBytes;
+};
+
+
+static bool Compare(const OrbitPathCache& cache, const ReferenceCache& ref, const char* when)
+{
+    const auto& stats = cache.getStatistics();
+    size_t refBytes = ref.bytes();
+    if (stats.entries == ref.size() && stats.bytes == refBytes && stats.evictions == ref.evictions
+        && (stats.bytes <= cache.getMaxBytes() || stats.entries == 1))
+    {
+        return true;
+    }
+
+    fmt::fprintf(cerr, "Mismatch %s: cache %zu paths, %zu bytes, %zu evictions; "
+                       "reference %zu paths, %zu bytes, %zu evictions; limit %zu bytes\n",
+                 when, stats.entries, stats.bytes, stats.evictions,
+                 ref.size(), refBytes, ref.evictions, cache.getMaxBytes());
+    return false;
+}
+
+
+// Fill the cache exactly to its limit, which must not evict anything, then
+// go one byte over it, which must evict the least recently used path.
+static bool CheckLimit(const vector<unique_ptr<Orbit>>& orbits)
+{
+    const unsigned int nSamples = 100;
+    const unsigned int nPaths = 8;
+    size_t pathBytes = unique_ptr<CurvePlot>(MakePlot(nSamples))->memoryUsage();
+
+    OrbitPathCache cache(pathBytes * nPaths);
+    for (unsigned int i = 0; i < nPaths; i++)
+        cache.insert(orbits[i].get(), MakePlot(nSamples));
+    if (cache.getStatistics().evictions != 0 || cache.getStatistics().bytes != pathBytes * nPaths)
+    {
+        fmt::fprintf(cerr, "Paths evicted from a cache that is exactly full\n");
+        return false;
+    }
+
+    // Use the oldest path, so that the second one becomes the least recently used
+    cache.find(orbits[0].get());
+    cache.setMaxBytes(pathBytes * nPaths - 1);
+    if (cache.getStatistics().evictions != 1 || cache.find(orbits[1].get()) != nullptr
+        || cache.find(orbits[0].get()) == nullptr)
+    {
+        fmt::fprintf(cerr, "Wrong path evicted one byte over the limit\n");
+        return false;
+    }
+
+    // A path larger than the whole cache is kept on its own
+    cache.insert(orbits[nPaths].get(), MakePlot(nSamples * nPaths * 2));
+    if (cache.getStatistics().entries != 1 || cache.find(orbits[nPaths].get()) == nullptr)
+    {
+        fmt::fprintf(cerr, "Oversized path not kept on its own\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            operationCount = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            orbitCount = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            maxBytes = (size_t) strtoul(argv[++i], nullptr, 10) * 1024;
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (orbitCount < 16 || maxBytes == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    // The cache only uses the orbits as keys
+    vector<unique_ptr<Orbit>> orbits;
+    for (unsigned int i = 0; i < orbitCount; i++)
+        orbits.emplace_back(new FixedOrbit(Vector3d::Zero()));
+
+    if (!CheckLimit(orbits))
+        return 1;
+
+    // Lookups favor a few orbits, as when some paths stay on screen while
+    // many others come and go, with path sizes ranging from asteroid orbits
+    // to spacecraft trajectories.
+    mt19937 rng(seed);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    uniform_int_distribution<unsigned int> sampleCount(100, 1000);
+
+    OrbitPathCache cache(maxBytes);
+    ReferenceCache ref(maxBytes);
+    for (unsigned int i = 0; i < operationCount; i++)
+    {
+        double u = uniform(rng);
+        const Orbit* orbit = orbits[(size_t) (u * u * u * orbitCount)].get();
+
+        CurvePlot* plot = cache.find(orbit);
+        const CurvePlot* refPlot = ref.find(orbit);
+        if (plot != refPlot)
+        {
+            fmt::fprintf(cerr, "Lookup %u: cache %s, reference %s\n", i,
+                         plot != nullptr ? "hit" : "missed",
+                         refPlot != nullptr ? "hit" : "missed");
+            return 1;
+        }
+
+        if (plot == nullptr)
+        {
+            plot = MakePlot(sampleCount(rng));
+            cache.insert(orbit, plot);
+            ref.insert(orbit, plot);
+            if (!Compare(cache, ref, "after insertion"))
+                return 1;
+        }
+        else if (uniform(rng) < 0.1)
+        {
+            // Resample the window, as done for periodic orbits
+            if (uniform(rng) < 0.5)
+                plot->removeSamplesAfter(plot->endTime() * uniform(rng));
+            else
+                for (unsigned int j = sampleCount(rng); j > 0; j--)
+                    plot->addSample(CurvePlotSample{ Vector3d::Zero(), plot->endTime() + 1.0, Vector3d::Zero() });
+            cache.updateSize();
+            ref.updateSize();
+            if (!Compare(cache, ref, "after resampling"))
+                return 1;
+        }
+
+        if (i % 100000 == 99999)
+        {
+            size_t limit = maxBytes / 2 + (size_t) (uniform(rng) * maxBytes);
+            cache.setMaxBytes(limit);
+            ref.setMaxBytes(limit);
+            if (!Compare(cache, ref, "after changing the limit"))
+                return 1;
+        }
+    }
+
+    const auto& stats = cache.getStatistics();
+    fmt::printf("%u lookups: %zu hits, %zu misses, %zu evictions; %zu paths in %zu of %zu bytes\n",
+                operationCount, stats.hits, stats.misses, stats.evictions,
+                stats.entries, stats.bytes, cache.getMaxBytes());
+
+    // Time the lookups alone, on a cache large enough to hold everything
+    OrbitPathCache timed(SIZE_MAX);
+    for (const auto& orbit : orbits)
+        timed.insert(orbit.get(), new CurvePlot());
+    auto start = chrono::steady_clock::now();
+    size_t hits = 0;
+    for (unsigned int i = 0; i < operationCount; i++)
+        hits += timed.find(orbits[rng() % orbitCount].get()) != nullptr;
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (hits != operationCount)
+    {
+        fmt::fprintf(cerr, "Paths missing from an unbounded cache\n");
+        return 1;
+    }
+    fmt::printf("lookup with %u paths cached: %.1f ns\n", orbitCount, elapsed * 1.0e9 / operationCount);
+
+    return 0;
+}
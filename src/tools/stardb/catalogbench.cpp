@@ -0,0 +1,299 @@
+// catalogbench.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Time catalog number lookups with the hash indexes of StarDatabase
+// against the structures they replaced: a binary search over an array of
+// star pointers sorted by catalog number, the std::map used while loading
+// stc files, and sorted cross index arrays, which were searched linearly
+// for the Celestia to catalog mapping. All of them must give the same
+// results.
+
+#include <celengine/stardb.h>
+#include <celutil/bytes.h>
+#include <celutil/hashindex.h>
+#include <fmt/printf.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static unsigned int lookupCount = 1000000;
+static unsigned int seed = 1;
+static string starsFilename;
+static string xindexFilename;
+
+
+static void Usage()
+{
+    cerr << "Usage: catalogbench [options] <stars.dat> [HD cross index]\n"
+         << "   -n <count> : number of lookups (default 1000000)\n"
+         << "   -s <seed>  : seed for the random catalog numbers\n";
+}
+
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+struct CrossIndexEntry
+{
+    uint32_t catalogNumber;
+    uint32_t celCatalogNumber;
+};
+
+
+// Read the entries of a cross index file, sorted by catalog number as
+// StarDatabase used to keep them
+static bool ReadCrossIndex(const string& filename, vector<CrossIndexEntry>& entries)
+{
+    ifstream in(filename, ios::in | ios::binary);
+    char header[8];
+    uint16_t version;
+    if (!in.read(header, sizeof header) || strncmp(header, "CELINDEX", sizeof header) != 0 ||
+        !in.read((char*) &version, sizeof version))
+    {
+        return false;
+    }
+
+    CrossIndexEntry ent;
+    while (in.read((char*) &ent, sizeof ent))
+    {
+        LE_TO_CPU_INT32(ent.catalogNumber, ent.catalogNumber);
+        LE_TO_CPU_INT32(ent.celCatalogNumber, ent.celCatalogNumber);
+        entries.push_back(ent);
+    }
+
+    stable_sort(entries.begin(), entries.end(),
+                [](const CrossIndexEntry& a, const CrossIndexEntry& b)
+                { return a.catalogNumber < b.catalogNumber; });
+    return true;
+}
+
+
+// Random lookups of numbers present in keys, with one in ten numbers
+// which are likely absent.
+static vector<uint32_t> RandomLookups(const vector<uint32_t>& keys, unsigned int count, mt19937& rng)
+{
+    uniform_int_distribution<size_t> uniformIndex(0, keys.size() - 1);
+    uniform_int_distribution<uint32_t> uniformNumber(0, keys.back());
+    vector<uint32_t> lookups(count);
+    for (unsigned int i = 0; i < count; i++)
+        lookups[i] = i % 10 == 9 ? uniformNumber(rng) : keys[uniformIndex(rng)];
+    return lookups;
+}
+
+
+// Time the lookups of the numbers, returning the time per lookup in
+// nanoseconds
+template <class T, class F> static double
+TimeLookups(const vector<uint32_t>& numbers, vector<T>& results, F lookup)
+{
+    results.resize(numbers.size());
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < numbers.size(); i++)
+        results[i] = lookup(numbers[i]);
+    return SecondsSince(start) * 1.0e9 / (double) numbers.size();
+}
+
+
+static bool CheckStars(const StarDatabase& starDB, mt19937& rng)
+{
+    vector<const Star*> sortedStars;
+    vector<uint32_t> catalogNumbers;
+    map<uint32_t, const Star*> starMap;
+    HashIndex<const Star*> starIndex;
+    for (uint32_t i = 0; i < starDB.size(); i++)
+    {
+        const Star* star = starDB.getStar(i);
+        sortedStars.push_back(star);
+        catalogNumbers.push_back(star->getCatalogNumber());
+        starMap[star->getCatalogNumber()] = star;
+        starIndex.insert(star->getCatalogNumber(), star);
+    }
+    sort(sortedStars.begin(), sortedStars.end(),
+         [](const Star* a, const Star* b) { return a->getCatalogNumber() < b->getCatalogNumber(); });
+    sort(catalogNumbers.begin(), catalogNumbers.end());
+
+    vector<uint32_t> lookups = RandomLookups(catalogNumbers, lookupCount, rng);
+
+    vector<const Star*> sortedResults;
+    double sortedTime = TimeLookups(lookups, sortedResults, [&](uint32_t catalogNumber) -> const Star*
+    {
+        auto iter = lower_bound(sortedStars.begin(), sortedStars.end(), catalogNumber,
+                                [](const Star* star, uint32_t n) { return star->getCatalogNumber() < n; });
+        return iter != sortedStars.end() && (*iter)->getCatalogNumber() == catalogNumber ? *iter : nullptr;
+    });
+
+    vector<const Star*> mapResults;
+    double mapTime = TimeLookups(lookups, mapResults, [&](uint32_t catalogNumber) -> const Star*
+    {
+        auto iter = starMap.find(catalogNumber);
+        return iter != starMap.end() ? iter->second : nullptr;
+    });
+
+    vector<const Star*> hashResults;
+    double hashTime = TimeLookups(lookups, hashResults, [&](uint32_t catalogNumber) -> const Star*
+    {
+        const Star* const* star = starIndex.find(catalogNumber);
+        return star != nullptr ? *star : nullptr;
+    });
+
+    vector<const Star*> findResults;
+    double findTime = TimeLookups(lookups, findResults, [&](uint32_t catalogNumber) -> const Star*
+    {
+        return starDB.find(catalogNumber);
+    });
+
+    fmt::printf("%u stars, %u lookups: sorted array %.1f ns, std::map %.1f ns, HashIndex %.1f ns, StarDatabase::find %.1f ns\n",
+                starDB.size(), lookupCount, sortedTime, mapTime, hashTime, findTime);
+
+    if (mapResults != sortedResults || hashResults != sortedResults || findResults != sortedResults)
+    {
+        fmt::fprintf(cerr, "The star lookups differ\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool CheckCrossIndex(StarDatabase& starDB, mt19937& rng)
+{
+    vector<CrossIndexEntry> entries;
+    ifstream in(xindexFilename, ios::in | ios::binary);
+    if (!ReadCrossIndex(xindexFilename, entries) || entries.empty() ||
+        !starDB.loadCrossIndex(StarDatabase::HenryDraper, in))
+    {
+        fmt::fprintf(cerr, "Error reading cross index %s\n", xindexFilename);
+        return false;
+    }
+
+    vector<uint32_t> numbers;
+    vector<uint32_t> celNumbers;
+    for (const auto& ent : entries)
+    {
+        numbers.push_back(ent.catalogNumber);
+        celNumbers.push_back(ent.celCatalogNumber);
+    }
+    sort(celNumbers.begin(), celNumbers.end());
+
+    vector<uint32_t> lookups = RandomLookups(numbers, lookupCount, rng);
+
+    vector<uint32_t> sortedResults;
+    double sortedTime = TimeLookups(lookups, sortedResults, [&](uint32_t number)
+    {
+        auto iter = lower_bound(entries.begin(), entries.end(), number,
+                                [](const CrossIndexEntry& ent, uint32_t n) { return ent.catalogNumber < n; });
+        return iter != entries.end() && iter->catalogNumber == number ? iter->celCatalogNumber : Star::InvalidCatalogNumber;
+    });
+
+    vector<uint32_t> hashResults;
+    double hashTime = TimeLookups(lookups, hashResults, [&](uint32_t number)
+    {
+        return starDB.searchCrossIndexForCatalogNumber(StarDatabase::HenryDraper, number);
+    });
+
+    // The linear search is much slower; a thousandth of the lookups is
+    // enough to time it.
+    vector<uint32_t> reverseLookups = RandomLookups(celNumbers, max(lookupCount / 1000, 1u), rng);
+
+    vector<uint32_t> linearResults;
+    double linearTime = TimeLookups(reverseLookups, linearResults, [&](uint32_t celNumber)
+    {
+        auto iter = find_if(entries.begin(), entries.end(),
+                            [celNumber](const CrossIndexEntry& ent) { return ent.celCatalogNumber == celNumber; });
+        return iter != entries.end() ? iter->catalogNumber : Star::InvalidCatalogNumber;
+    });
+
+    vector<uint32_t> reverseHashResults;
+    double reverseHashTime = TimeLookups(reverseLookups, reverseHashResults, [&](uint32_t celNumber)
+    {
+        return starDB.crossIndex(StarDatabase::HenryDraper, celNumber);
+    });
+
+    fmt::printf("%zu cross index entries: to Celestia numbers, sorted array %.1f ns, HashIndex %.1f ns; "
+                "from Celestia numbers, linear search %.1f ns, HashIndex %.1f ns\n",
+                entries.size(), sortedTime, hashTime, linearTime, reverseHashTime);
+
+    if (hashResults != sortedResults || reverseHashResults != linearResults)
+    {
+        fmt::fprintf(cerr, "The cross index lookups differ\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            lookupCount = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            seed = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] == '-')
+        {
+            Usage();
+            return 1;
+        }
+        else if (starsFilename.empty())
+        {
+            starsFilename = argv[i];
+        }
+        else if (xindexFilename.empty())
+        {
+            xindexFilename = argv[i];
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (starsFilename.empty() || lookupCount == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    StarDatabase starDB;
+    ifstream starsFile(starsFilename, ios::in | ios::binary);
+    if (!starsFile.good() || !starDB.loadBinary(starsFile))
+    {
+        fmt::fprintf(cerr, "Error reading stars from %s\n", starsFilename);
+        return 1;
+    }
+    starDB.finish();
+
+    mt19937 rng(seed);
+    if (starDB.size() == 0 || !CheckStars(starDB, rng))
+        return 1;
+    if (!xindexFilename.empty() && !CheckCrossIndex(starDB, rng))
+        return 1;
+
+    return 0;
+}
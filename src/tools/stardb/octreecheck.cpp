@@ -0,0 +1,283 @@
+// octreecheck.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Check that building the star and DSO octrees on a thread pool gives the
+// same octrees as inserting the objects one at a time: the same nodes, and
+// the same objects in the same order in every node. The build times of
+// both are reported.
+
+#include <celengine/astro.h>
+#include <celengine/dsodb.h>
+#include <celengine/dsoname.h>
+#include <celengine/dsooctree.h>
+#include <celengine/stardb.h>
+#include <celengine/staroctree.h>
+#include <celutil/threadpool.h>
+#include <fmt/printf.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+
+// The octree parameters of StarDatabase::buildOctree() and
+// DSODatabase::buildOctree()
+constexpr const float STAR_OCTREE_ROOT_SIZE = 10000000.0f;
+constexpr const float STAR_OCTREE_MAGNITUDE = 6.0f;
+constexpr const float DSO_OCTREE_MAGNITUDE  = 8.0f;
+
+static unsigned int threadCount = 4;
+static string starsFilename;
+static vector<string> dsoFilenames;
+
+
+static void Usage()
+{
+    cerr << "Usage: octreecheck [options] <stars.dat> [DSO catalogs...]\n"
+         << "   -t <threads> : threads of the pool building the octree (default 4)\n";
+}
+
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+template <class OBJ, class PREC> struct BuiltOctree
+{
+    unique_ptr<StaticOctree<OBJ, PREC>> root;
+    unique_ptr<OBJ[]> objects;
+    double buildTime;
+};
+
+
+// Insert the objects into root, one by one or with insertObjects(), and
+// turn it into a static octree as the databases do.
+template <class OBJ, class PREC>
+static BuiltOctree<OBJ, PREC> Build(DynamicOctree<OBJ, PREC>* root,
+                                    const typename DynamicOctree<OBJ, PREC>::ObjectList& objects,
+                                    size_t totalCount,
+                                    PREC rootSize,
+                                    ThreadPool* pool)
+{
+    BuiltOctree<OBJ, PREC> built;
+    auto start = chrono::steady_clock::now();
+    if (pool == nullptr)
+    {
+        for (const OBJ* obj : objects)
+            root->insertObject(*obj, rootSize);
+    }
+    else
+    {
+        root->insertObjects(objects, rootSize, *pool);
+    }
+    built.buildTime = SecondsSince(start);
+
+    built.objects.reset(new OBJ[totalCount]);
+    OBJ* firstObject = built.objects.get();
+    StaticOctree<OBJ, PREC>* staticRoot = nullptr;
+    root->rebuildAndSort(staticRoot, firstObject);
+    built.root.reset(staticRoot);
+    delete root;
+
+    return built;
+}
+
+
+// Compare two octrees node by node, objects being told apart by key.
+template <class OBJ, class PREC, class KEY>
+static bool Compare(const StaticOctree<OBJ, PREC>* a,
+                    const StaticOctree<OBJ, PREC>* b,
+                    KEY key,
+                    const string& path,
+                    size_t& nodeCount)
+{
+    nodeCount++;
+    if (a->getCellCenterPos() != b->getCellCenterPos() ||
+        a->getExclusionFactor() != b->getExclusionFactor() ||
+        a->getObjectCount() != b->getObjectCount())
+    {
+        fmt::fprintf(cerr, "Node %s differs: %u objects serially, %u in parallel\n",
+                     path.empty() ? "root" : path, a->getObjectCount(), b->getObjectCount());
+        return false;
+    }
+
+    for (unsigned int i = 0; i < a->getObjectCount(); i++)
+    {
+        if (key(a->getFirstObject()[i]) != key(b->getFirstObject()[i]))
+        {
+            fmt::fprintf(cerr, "Object %u of node %s differs\n", i, path.empty() ? "root" : path);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        const StaticOctree<OBJ, PREC>* childA = a->getChild(i);
+        const StaticOctree<OBJ, PREC>* childB = b->getChild(i);
+        string childPath = path + (char) ('0' + i);
+        if ((childA == nullptr) != (childB == nullptr))
+        {
+            fmt::fprintf(cerr, "Node %s is split in only one octree\n", childPath);
+            return false;
+        }
+        if (childA != nullptr && !Compare(childA, childB, key, childPath, nodeCount))
+            return false;
+    }
+
+    return true;
+}
+
+
+template <class OBJ, class PREC, class KEY>
+static bool Check(const char* name,
+                  const function<DynamicOctree<OBJ, PREC>*()>& makeRoot,
+                  const typename DynamicOctree<OBJ, PREC>::ObjectList& objects,
+                  size_t totalCount,
+                  PREC rootSize,
+                  ThreadPool& pool,
+                  KEY key)
+{
+    auto serial = Build(makeRoot(), objects, totalCount, rootSize, (ThreadPool*) nullptr);
+    auto parallel = Build(makeRoot(), objects, totalCount, rootSize, &pool);
+
+    size_t nodeCount = 0;
+    if (!Compare(serial.root.get(), parallel.root.get(), key, "", nodeCount))
+    {
+        fmt::fprintf(cerr, "%s: the octrees differ\n", name);
+        return false;
+    }
+
+    fmt::printf("%s: %zu objects inserted, %zu identical nodes; serial %.1f ms, %u threads %.1f ms\n",
+                name, objects.size(), nodeCount,
+                serial.buildTime * 1000.0, pool.size(), parallel.buildTime * 1000.0);
+    return true;
+}
+
+
+static bool CheckStars(const StarDatabase& starDB, ThreadPool& pool)
+{
+    auto key = [](const Star& star) { return star.getCatalogNumber(); };
+    float absMag = astro::appToAbsMag(STAR_OCTREE_MAGNITUDE, STAR_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
+    auto makeRoot = [absMag]() { return new DynamicStarOctree(Vector3f(1000.0f, 1000.0f, 1000.0f), absMag); };
+
+    DynamicStarOctree::ObjectList stars;
+    for (uint32_t i = 0; i < starDB.size(); i++)
+        stars.push_back(starDB.getStar(i));
+    if (!Check<Star, float>("stars", makeRoot, stars, stars.size(), STAR_OCTREE_ROOT_SIZE, pool, key))
+        return false;
+
+    // As with stc files changing a presorted catalog: start from the
+    // octree of half of the stars, leave one in ten of them out, and insert
+    // those again with the other half.
+    size_t half = stars.size() / 2;
+    DynamicStarOctree::ObjectList firstHalf(stars.begin(), stars.begin() + half);
+    auto presorted = Build(makeRoot(), firstHalf, half, STAR_OCTREE_ROOT_SIZE, (ThreadPool*) nullptr);
+    const Star* presortedStars = presorted.objects.get();
+    auto isModified = [presortedStars](const Star& star) { return (&star - presortedStars) % 10 == 0; };
+    auto makeModifiedRoot = [&presorted, isModified]() { return new DynamicStarOctree(*presorted.root, isModified); };
+
+    DynamicStarOctree::ObjectList newStars;
+    for (size_t i = 0; i < half; i++)
+    {
+        if (isModified(presortedStars[i]))
+            newStars.push_back(&presortedStars[i]);
+    }
+    newStars.insert(newStars.end(), stars.begin() + half, stars.end());
+    return Check<Star, float>("stars added to a presorted octree", makeModifiedRoot, newStars,
+                              stars.size(), STAR_OCTREE_ROOT_SIZE, pool, key);
+}
+
+
+static bool CheckDSOs(const DSODatabase& dsoDB, ThreadPool& pool)
+{
+    auto key = [](const DeepSkyObject* dso) { return dso; };
+    float absMag = astro::appToAbsMag(DSO_OCTREE_MAGNITUDE, DSO_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
+    auto makeRoot = [absMag]() { return new DynamicDSOOctree(Vector3d::Zero(), absMag); };
+
+    vector<DeepSkyObject*> dsos;
+    for (uint32_t i = 0; i < dsoDB.size(); i++)
+        dsos.push_back(dsoDB.getDSO(i));
+    DynamicDSOOctree::ObjectList objects;
+    for (const auto& dso : dsos)
+        objects.push_back(&dso);
+
+    return Check<DeepSkyObject*, double>("DSOs", makeRoot, objects, objects.size(),
+                                          DSO_OCTREE_ROOT_SIZE, pool, key);
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            threadCount = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] == '-')
+        {
+            Usage();
+            return 1;
+        }
+        else if (starsFilename.empty())
+        {
+            starsFilename = argv[i];
+        }
+        else
+        {
+            dsoFilenames.push_back(argv[i]);
+        }
+    }
+
+    if (starsFilename.empty() || threadCount == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    StarDatabase starDB;
+    ifstream starsFile(starsFilename, ios::in | ios::binary);
+    if (!starsFile.good() || !starDB.loadBinary(starsFile))
+    {
+        fmt::fprintf(cerr, "Error reading stars from %s\n", starsFilename);
+        return 1;
+    }
+    starDB.finish();
+
+    DSODatabase dsoDB;
+    dsoDB.setNameDatabase(new DSONameDatabase);
+    for (const auto& filename : dsoFilenames)
+    {
+        ifstream dsoFile(filename, ios::in);
+        if (!dsoFile.good() || !dsoDB.load(dsoFile, ""))
+        {
+            fmt::fprintf(cerr, "Error reading deep sky objects from %s\n", filename);
+            return 1;
+        }
+    }
+    dsoDB.finish();
+
+    ThreadPool pool(threadCount);
+    if (!CheckStars(starDB, pool))
+        return 1;
+    if (dsoDB.size() > 0 && !CheckDSOs(dsoDB, pool))
+        return 1;
+
+    return 0;
+}
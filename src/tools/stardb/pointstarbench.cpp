@@ -0,0 +1,302 @@
+// pointstarbench.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Replay a fixed observer over a star database and time the point star
+// renderer with the batched kernel, PointStarRenderer::processBatch, and
+// with the per star path, a process() call for every star found by the
+// octree traversal. Both must select the same stars. No OpenGL context is
+// needed: the stars are written to deferred vertex buffers, which never
+// draw.
+
+#include <celengine/astro.h>
+#include <celengine/observer.h>
+#include <celengine/pointstarrenderer.h>
+#include <celengine/pointstarvertexbuffer.h>
+#include <celengine/render.h>
+#include <celengine/starcolors.h>
+#include <celengine/stardb.h>
+#include <celmath/mathlib.h>
+#include <fmt/printf.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+using namespace celmath;
+
+// StarDatabase's octree root size, and the renderer's default view
+constexpr const float STAR_OCTREE_ROOT_SIZE = 10000000.0f;
+constexpr const float FieldOfView = 45.0f;
+constexpr const int WindowWidth = 1920;
+constexpr const int WindowHeight = 1080;
+constexpr const float BaseStarDiscSize = 5.0f;
+constexpr const float SaturationMag = 1.0f;
+
+static unsigned int frameCount = 200;
+static float faintestMag = 8.0f;
+static string inputFilename;
+
+
+static void Usage()
+{
+    cerr << "Usage: pointstarbench [options] <stars.dat>\n"
+         << "   -n <frames>    : number of frames to replay (default 200)\n"
+         << "   -m <magnitude> : faintest visible magnitude (default 8)\n";
+}
+
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+// Passes the stars to PointStarRenderer one at a time; being no
+// StarBatchProcessor, it makes the traversal call process() for each star.
+class PerStarHandler : public StarHandler
+{
+ public:
+    PerStarHandler(PointStarRenderer& _renderer) : renderer(_renderer) {}
+
+    void process(const Star& star, float distance, float appMag) override
+    {
+        renderer.process(star, distance, appMag);
+    }
+
+ private:
+    PointStarRenderer& renderer;
+};
+
+
+struct FrameOutput
+{
+    int nProcessed{ 0 };
+    int nRendered{ 0 };
+    int nClose{ 0 };
+    int nLabelled{ 0 };
+    size_t nRenderListEntries{ 0 };
+
+    bool operator==(const FrameOutput& other) const
+    {
+        return nProcessed == other.nProcessed &&
+               nRendered == other.nRendered &&
+               nClose == other.nClose &&
+               nLabelled == other.nLabelled &&
+               nRenderListEntries == other.nRenderListEntries;
+    }
+};
+
+
+// Render frames of the stars as Renderer::renderPointStars() does and
+// return the time spent in the traversal by the fastest frame, which is
+// less affected by the other processes of the system than the mean
+static double Replay(const Renderer& renderer,
+                     const PointStarRenderer& setup,
+                     const function<void(PointStarRenderer&)>& findStars,
+                     FrameOutput& output)
+{
+    double bestTime = numeric_limits<double>::max();
+    for (unsigned int i = 0; i < frameCount; i++)
+    {
+        PointStarVertexBuffer starVertices(renderer, 4096);
+        PointStarVertexBuffer glareVertices(renderer, 1024);
+        starVertices.setDeferred(true);
+        glareVertices.setDeferred(true);
+        vector<RenderListEntry> renderList;
+        vector<PointStarRenderer::PendingLabel> labels;
+
+        PointStarRenderer starRenderer = setup;
+        starRenderer.starVertexBuffer = &starVertices;
+        starRenderer.glareVertexBuffer = &glareVertices;
+        starRenderer.renderList = &renderList;
+        starRenderer.pendingLabels = &labels;
+
+        auto start = chrono::steady_clock::now();
+        findStars(starRenderer);
+        bestTime = min(bestTime, SecondsSince(start));
+
+        output.nProcessed = starRenderer.nProcessed;
+        output.nRendered = starRenderer.nRendered;
+        output.nClose = starRenderer.nClose;
+        output.nLabelled = starRenderer.nLabelled;
+        output.nRenderListEntries = renderList.size();
+    }
+
+    return bestTime;
+}
+
+
+// Same frustum as StarDatabase::findVisibleStars()
+static void ComputeFrustumPlanes(Hyperplane<float, 3>* frustumPlanes,
+                                 const Vector3f& position,
+                                 const Quaternionf& orientation,
+                                 float fovY,
+                                 float aspectRatio)
+{
+    Vector3f planeNormals[5];
+    Matrix3f rot = orientation.toRotationMatrix();
+    float h = (float) tan(fovY / 2);
+    float w = h * aspectRatio;
+    planeNormals[0] = Vector3f(0.0f, 1.0f, -h);
+    planeNormals[1] = Vector3f(0.0f, -1.0f, -h);
+    planeNormals[2] = Vector3f(1.0f, 0.0f, -w);
+    planeNormals[3] = Vector3f(-1.0f, 0.0f, -w);
+    planeNormals[4] = Vector3f(0.0f, 0.0f, -1.0f);
+    for (int i = 0; i < 5; i++)
+    {
+        planeNormals[i] = rot.transpose() * planeNormals[i].normalized();
+        frustumPlanes[i] = Hyperplane<float, 3>(planeNormals[i], position);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            frameCount = (unsigned int) strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+        {
+            faintestMag = (float) atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-' || !inputFilename.empty())
+        {
+            Usage();
+            return 1;
+        }
+        else
+        {
+            inputFilename = argv[i];
+        }
+    }
+
+    if (inputFilename.empty() || frameCount == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    StarDatabase starDB;
+    ifstream starsFile(inputFilename, ios::in | ios::binary);
+    if (!starsFile.good() || !starDB.loadBinary(starsFile))
+    {
+        fmt::fprintf(cerr, "Error reading stars from %s\n", inputFilename);
+        return 1;
+    }
+    starDB.finish();
+
+    // An observer at the Earth's distance from the Sun, looking toward the
+    // galactic center, the densest part of the sky.
+    Observer observer;
+    observer.setPosition(UniversalCoord::CreateLy(Vector3d(astro::AUtoLightYears(1.0), 0.0, 0.0)));
+    Vector3f viewDirection = astro::equatorialToCelestialCart(17.761f, -28.94f, 1.0f);
+    observer.setOrientation(Quaternionf::FromTwoVectors(-Vector3f::UnitZ(), viewDirection).conjugate());
+
+    Vector3d obsPos = observer.getPosition().toLy();
+    float aspectRatio = (float) WindowWidth / (float) WindowHeight;
+    float corrFac = 0.12f * FieldOfView / 45.0f * FieldOfView / 45.0f + 1.0f;
+    float brightnessScale = faintestMag - SaturationMag >= 6.0f ? 1.0f / (faintestMag - SaturationMag) : 0.1667f;
+    float maxFOV = 2.0f * (float) atan(sqrt(aspectRatio * aspectRatio + 1.0f) * tan(degToRad(FieldOfView / 2.0f)));
+
+    Renderer renderer;
+    float pixelSize = renderer.calcPixelSize(FieldOfView, (float) WindowHeight);
+    PointStarRenderer setup;
+    setup.renderer          = &renderer;
+    setup.starDB            = &starDB;
+    setup.observer          = &observer;
+    setup.obsPos            = obsPos;
+    setup.viewNormal        = observer.getOrientationf().conjugate() * -Vector3f::UnitZ();
+    setup.fov               = FieldOfView;
+    setup.cosFOV            = cos(maxFOV / 2.0f);
+    setup.pixelSize         = pixelSize;
+    setup.brightnessScale   = brightnessScale * corrFac;
+    setup.brightnessBias    = 0.0f;
+    setup.faintestMag       = faintestMag;
+    setup.faintestMagNight  = faintestMag;
+    setup.saturationMag     = SaturationMag;
+    setup.distanceLimit     = 1.0e6f;
+    setup.labelMode         = Renderer::StarLabels;
+    setup.labelThresholdMag = 1.2f * max(1.0f, faintestMag - 4.0f);
+    setup.size              = BaseStarDiscSize;
+    setup.colorTemp         = GetStarColorTable(ColorTable_Blackbody_D65);
+
+    auto findBatched = [&](PointStarRenderer& starRenderer)
+    {
+        starDB.findVisibleStars(starRenderer,
+                                obsPos.cast<float>(),
+                                observer.getOrientationf(),
+                                degToRad(FieldOfView),
+                                aspectRatio,
+                                faintestMag);
+    };
+
+    // The traversal of the octree itself rather than of its mirror, as
+    // before the batched kernel
+    Hyperplane<float, 3> frustumPlanes[5];
+    ComputeFrustumPlanes(frustumPlanes, obsPos.cast<float>(), observer.getOrientationf(),
+                         degToRad(FieldOfView), aspectRatio);
+    auto findPerStar = [&](PointStarRenderer& starRenderer)
+    {
+        PerStarHandler handler(starRenderer);
+        starDB.getOctree()->processVisibleObjects(handler,
+                                                  obsPos.cast<float>(),
+                                                  frustumPlanes,
+                                                  faintestMag,
+                                                  STAR_OCTREE_ROOT_SIZE);
+    };
+
+    // The traversal of the mirror, but calling process() for each star
+    auto findMirrorPerStar = [&](PointStarRenderer& starRenderer)
+    {
+        PerStarHandler handler(starRenderer);
+        starDB.findVisibleStars(handler,
+                                obsPos.cast<float>(),
+                                observer.getOrientationf(),
+                                degToRad(FieldOfView),
+                                aspectRatio,
+                                faintestMag);
+    };
+
+    FrameOutput batched;
+    FrameOutput perStar;
+    FrameOutput mirrorPerStar;
+    double perStarTime = Replay(renderer, setup, findPerStar, perStar);
+    double mirrorTime = Replay(renderer, setup, findMirrorPerStar, mirrorPerStar);
+    double batchedTime = Replay(renderer, setup, findBatched, batched);
+
+    fmt::printf("%u stars, faintest magnitude %.1f: %d processed, %d point stars, %d close, %d labels, %zu render list entries\n",
+                starDB.size(), faintestMag, perStar.nProcessed, perStar.nRendered,
+                perStar.nClose, perStar.nLabelled, perStar.nRenderListEntries);
+    fmt::printf("fastest frame: octree per star %.3f ms, mirror per star %.3f ms, batched %.3f ms\n",
+                perStarTime * 1000.0, mirrorTime * 1000.0, batchedTime * 1000.0);
+
+    if (!(mirrorPerStar == perStar) || !(batched == perStar))
+    {
+        fmt::fprintf(cerr, "The stars selected differ: mirror %d/%d/%d/%d/%zu, batched %d/%d/%d/%d/%zu\n",
+                     mirrorPerStar.nProcessed, mirrorPerStar.nRendered, mirrorPerStar.nClose,
+                     mirrorPerStar.nLabelled, mirrorPerStar.nRenderListEntries,
+                     batched.nProcessed, batched.nRendered, batched.nClose,
+                     batched.nLabelled, batched.nRenderListEntries);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,249 @@
+// sortstardb.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Convert a version 0x0100 star database to a presorted (0x0200) one.
+// The stars of the output file are stored in octree order, preceded by the
+// octree nodes, so that Celestia can load the file without sorting it.
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <celutil/bytes.h>
+#include <celengine/stardb.h>
+
+using namespace std;
+
+
+static string inputFilename;
+static string outputFilename;
+
+static const size_t StarRecordSize = 20;
+
+
+void Usage()
+{
+    cerr << "Usage: sortstardb <input star database> <output star database>\n";
+}
+
+
+bool parseCommandLine(int argc, char* argv[])
+{
+    int i = 1;
+    int fileCount = 0;
+
+    while (i < argc)
+    {
+        if (argv[i][0] == '-')
+        {
+            cerr << "Unknown command line switch: " << argv[i] << '\n';
+            return false;
+        }
+        else
+        {
+            if (fileCount == 0)
+            {
+                // input filename first
+                inputFilename = string(argv[i]);
+                fileCount++;
+            }
+            else if (fileCount == 1)
+            {
+                // output filename second
+                outputFilename = string(argv[i]);
+                fileCount++;
+            }
+            else
+            {
+                // more than two filenames on the command line is an error
+                return false;
+            }
+            i++;
+        }
+    }
+
+    return fileCount == 2;
+}
+
+
+static void writeUint(ostream& out, uint32_t n)
+{
+    LE_TO_CPU_INT32(n, n);
+    out.write(reinterpret_cast<char*>(&n), sizeof n);
+}
+
+static void writeFloat(ostream& out, float f)
+{
+    LE_TO_CPU_FLOAT(f, f);
+    out.write(reinterpret_cast<char*>(&f), sizeof f);
+}
+
+static void writeShort(ostream& out, int16_t n)
+{
+    LE_TO_CPU_INT16(n, n);
+    out.write(reinterpret_cast<char*>(&n), sizeof n);
+}
+
+
+// Read the raw star records of a version 0x0100 database, keyed by catalog
+// number. The records are copied unchanged to the sorted database, so the
+// packed spectral types survive the conversion.
+static bool ReadStarRecords(istream& in, unordered_map<uint32_t, vector<char>>& records)
+{
+    char header[10];
+    in.read(header, sizeof header);
+    if (!in.good() || strncmp(header, "CELSTARS", 8) != 0)
+    {
+        cerr << "Bad star database header\n";
+        return false;
+    }
+
+    int16_t version;
+    memcpy(&version, header + 8, sizeof version);
+    LE_TO_CPU_INT16(version, version);
+    if (version != 0x0100)
+    {
+        cerr << "Only version 0x0100 star databases can be converted\n";
+        return false;
+    }
+
+    uint32_t nStarsInFile;
+    in.read(reinterpret_cast<char*>(&nStarsInFile), sizeof nStarsInFile);
+    LE_TO_CPU_INT32(nStarsInFile, nStarsInFile);
+
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+    {
+        vector<char> record(StarRecordSize);
+        in.read(record.data(), StarRecordSize);
+        if (!in.good())
+        {
+            cerr << "Error reading star record #" << i << '\n';
+            return false;
+        }
+
+        uint32_t catalogNumber;
+        memcpy(&catalogNumber, record.data(), sizeof catalogNumber);
+        LE_TO_CPU_INT32(catalogNumber, catalogNumber);
+        if (!records.emplace(catalogNumber, move(record)).second)
+        {
+            cerr << "Duplicate catalog number " << catalogNumber << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static uint32_t CountNodes(const StarOctree* node)
+{
+    uint32_t count = 1;
+    if (node->getChild(0) != nullptr)
+    {
+        for (int i = 0; i < 8; i++)
+            count += CountNodes(node->getChild(i));
+    }
+
+    return count;
+}
+
+
+static void WriteNodes(ostream& out, const StarOctree* node)
+{
+    writeFloat(out, node->getCellCenterPos().x());
+    writeFloat(out, node->getCellCenterPos().y());
+    writeFloat(out, node->getCellCenterPos().z());
+    writeFloat(out, node->getExclusionFactor());
+    writeUint(out, node->getObjectCount());
+    writeUint(out, node->getChild(0) != nullptr ? 1 : 0);
+
+    if (node->getChild(0) != nullptr)
+    {
+        for (int i = 0; i < 8; i++)
+            WriteNodes(out, node->getChild(i));
+    }
+}
+
+
+static bool WriteSortedStarDatabase(const StarDatabase& starDB,
+                                    const unordered_map<uint32_t, vector<char>>& records,
+                                    ostream& out)
+{
+    const StarOctree* root = starDB.getOctree();
+
+    out.write("CELSTARS", 8);
+    writeShort(out, 0x0200);
+    writeUint(out, starDB.size());
+    writeUint(out, CountNodes(root));
+
+    WriteNodes(out, root);
+
+    // The star database keeps its stars in octree order
+    for (uint32_t i = 0; i < starDB.size(); i++)
+    {
+        auto iter = records.find(starDB.getStar(i)->getCatalogNumber());
+        if (iter == records.end())
+        {
+            cerr << "Missing record for star " << starDB.getStar(i)->getCatalogNumber() << '\n';
+            return false;
+        }
+        out.write(iter->second.data(), StarRecordSize);
+    }
+
+    return out.good();
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (!parseCommandLine(argc, argv))
+    {
+        Usage();
+        return 1;
+    }
+
+    unordered_map<uint32_t, vector<char>> records;
+    {
+        ifstream inputFile(inputFilename, ios::in | ios::binary);
+        if (!inputFile.good())
+        {
+            cerr << "Error opening input file " << inputFilename << '\n';
+            return 1;
+        }
+
+        if (!ReadStarRecords(inputFile, records))
+            return 1;
+    }
+
+    // Sort the stars with the star database itself, so that the octree is
+    // exactly the one Celestia would have built.
+    StarDatabase starDB;
+    if (!starDB.loadBinary(fs::path(inputFilename)))
+    {
+        cerr << "Error reading star database " << inputFilename << '\n';
+        return 1;
+    }
+    starDB.finish();
+
+    ofstream stardbFile(outputFilename, ios::out | ios::binary);
+    if (!stardbFile.good())
+    {
+        cerr << "Error opening star database file " << outputFilename << '\n';
+        return 1;
+    }
+
+    if (!WriteSortedStarDatabase(starDB, records, stardbFile))
+    {
+        cerr << "Error writing star database file " << outputFilename << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+// chebcheck.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Check a trajectory compiled by xyzv2cheb against the xyzv trajectory it
+// was made from, both loaded the way Celestia loads them: the position
+// error must stay within the tolerance the file was compiled with.
+
+#include <celephem/chebyshevorbit.h>
+#include <celephem/samporbit.h>
+#include <fmt/printf.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+
+static double tolerance = 0.001; // km
+static unsigned int checkCount = 1000000;
+
+
+static void Usage(const char* name)
+{
+    fmt::fprintf(cerr, "Usage: %s [-t tolerance] [-n count] infile.xyzv infile.cheb\n", name);
+    fmt::fprintf(cerr, "  The tolerance is in km, %g by default; it should be the one given to\n"
+                       "  xyzv2cheb. Positions are compared at count random times, %u by default.\n",
+                 tolerance, checkCount);
+}
+
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+static double TimePositions(const Orbit& orbit, const vector<double>& times, vector<Vector3d>& positions)
+{
+    positions.resize(times.size());
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < times.size(); i++)
+        positions[i] = orbit.positionAtTime(times[i]);
+    return SecondsSince(start);
+}
+
+
+int main(int argc, char* argv[])
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "-t") == 0)
+        {
+            tolerance = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-n") == 0)
+        {
+            checkCount = (unsigned int) atoi(argv[i + 1]);
+        }
+        else
+        {
+            fmt::fprintf(cerr, "Unknown command line switch: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (argc - i != 2 || !(tolerance > 0.0) || checkCount == 0)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    unique_ptr<Orbit> sampled(LoadXYZVTrajectoryDoublePrec(argv[i], TrajectoryInterpolationCubic));
+    if (sampled == nullptr)
+    {
+        fmt::fprintf(cerr, "Error loading %s\n", argv[i]);
+        return 1;
+    }
+    unique_ptr<Orbit> compiled(LoadChebyshevTrajectory(argv[i + 1]));
+    if (compiled == nullptr)
+    {
+        fmt::fprintf(cerr, "Error loading %s\n", argv[i + 1]);
+        return 1;
+    }
+
+    double begin, end, compiledBegin, compiledEnd;
+    sampled->getValidRange(begin, end);
+    compiled->getValidRange(compiledBegin, compiledEnd);
+    if (begin != compiledBegin || end != compiledEnd)
+    {
+        fmt::fprintf(cerr, "Valid ranges differ: %.6f to %.6f, compiled %.6f to %.6f\n",
+                     begin, end, compiledBegin, compiledEnd);
+        return 1;
+    }
+
+    // Random times, plus both ends of the range
+    mt19937 rng(1);
+    uniform_real_distribution<double> uniformTime(begin, end);
+    vector<double> times(checkCount);
+    for (auto& t : times)
+        t = uniformTime(rng);
+    times.front() = begin;
+    times.back() = end;
+
+    vector<Vector3d> positions, compiledPositions;
+    double sampledTime = TimePositions(*sampled, times, positions);
+    double compiledTime = TimePositions(*compiled, times, compiledPositions);
+
+    // The same times in order, as when a trajectory is followed
+    vector<double> sortedTimes(times);
+    sort(sortedTimes.begin(), sortedTimes.end());
+    vector<Vector3d> sortedPositions, sortedCompiledPositions;
+    double sortedSampledTime = TimePositions(*sampled, sortedTimes, sortedPositions);
+    double sortedCompiledTime = TimePositions(*compiled, sortedTimes, sortedCompiledPositions);
+
+    double maxError = 0.0;
+    double sumSquares = 0.0;
+    double maxErrorTime = begin;
+    double maxVelocityError = 0.0;
+    for (size_t j = 0; j < times.size(); j++)
+    {
+        double error = (positions[j] - compiledPositions[j]).norm();
+        sumSquares += error * error;
+        if (error > maxError)
+        {
+            maxError = error;
+            maxErrorTime = times[j];
+        }
+    }
+
+    // Segments found from the previous one must be the same
+    for (size_t j = 0; j < sortedTimes.size(); j++)
+    {
+        double error = (sortedPositions[j] - sortedCompiledPositions[j]).norm();
+        if (error > maxError)
+        {
+            maxError = error;
+            maxErrorTime = sortedTimes[j];
+        }
+    }
+
+    // Velocities, relative to the speed, at a subset of the times
+    for (size_t j = 0; j < times.size(); j += max((size_t) 1, times.size() / 10000))
+    {
+        Vector3d v = sampled->velocityAtTime(times[j]);
+        Vector3d compiledV = compiled->velocityAtTime(times[j]);
+        if (v.norm() > 0.0)
+            maxVelocityError = max(maxVelocityError, (v - compiledV).norm() / v.norm());
+    }
+
+    fmt::printf("position error: max %.6g km at %.6f, rms %.6g km; velocity error: max %.3g%%\n",
+                maxError, maxErrorTime, sqrt(sumSquares / times.size()), maxVelocityError * 100.0);
+    fmt::printf("positionAtTime at random times: sampled %.1f ns, compiled %.1f ns\n",
+                sampledTime * 1.0e9 / times.size(), compiledTime * 1.0e9 / times.size());
+    fmt::printf("positionAtTime in time order: sampled %.1f ns, compiled %.1f ns\n",
+                sortedSampledTime * 1.0e9 / times.size(), sortedCompiledTime * 1.0e9 / times.size());
+
+    if (maxError > tolerance)
+    {
+        fmt::fprintf(cerr, "Position error above the tolerance of %g km\n", tolerance);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include <celephem/chebyshevbinary.h>
+#include <celephem/xyzvbinary.h>
+#include <celutil/bytes.h> // __BYTE_ORDER__
+#include <fmt/printf.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring> // memcpy
+#include <fstream>
+#include <iostream>
+#include <limits> // std::numeric_limits
+#include <vector>
+
+using namespace std;
+
+constexpr char magic[8] = "CELCHEB";
+
+// Fitting gives up on a segment above this number of coefficients and
+// tries again with shorter segments.
+static unsigned int maxCoeffs = 16;
+static double tolerance = 0.001; // km
+
+struct Sample
+{
+    double t;
+    double position[3];
+    double velocity[3]; // km/day
+};
+
+// Scan past comments. A comment begins with the # character and ends
+// with a newline. Return true if the stream state is good. The stream
+// position will be at the first non-comment, non-whitespace character.
+static bool SkipComments(istream& in)
+{
+    bool inComment = false;
+    bool done = false;
+
+    int c = in.get();
+    while (!done)
+    {
+        if (in.eof())
+        {
+            done = true;
+        }
+        else
+        {
+            if (inComment)
+            {
+                if (c == '\n')
+                    inComment = false;
+            }
+            else
+            {
+                if (c == '#')
+                {
+                    inComment = true;
+                }
+                else if (isspace(c) == 0)
+                {
+                    in.unget();
+                    done = true;
+                }
+            }
+        }
+
+        if (!done)
+            c = in.get();
+    }
+
+    return in.good();
+}
+
+// Read a text xyzv file or a binary one written by xyzv2bin. Velocities
+// are converted from km/s to km/day, and samples with a repeated time are
+// skipped, as Celestia does.
+static bool readSamples(const string& filename, vector<Sample>& samples)
+{
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.good())
+        return false;
+
+    char header[8] = { 0 };
+    in.read(header, sizeof header);
+    bool binary = in.good() && memcmp(header, "CELXYZV", 8) == 0;
+
+    Sample sample;
+    if (binary)
+    {
+        XYZVBinaryHeader binaryHeader;
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(&binaryHeader), sizeof(binaryHeader)) ||
+            binaryHeader.byteOrder != __BYTE_ORDER__ ||
+            binaryHeader.digits != std::numeric_limits<double>::digits)
+        {
+            return false;
+        }
+
+        XYZVBinaryData data;
+        while (in.read(reinterpret_cast<char*>(&data), sizeof(data)))
+        {
+            sample.t = data.tdb;
+            for (int i = 0; i < 3; i++)
+            {
+                sample.position[i] = data.position[i];
+                sample.velocity[i] = data.velocity[i] * 86400.0;
+            }
+            if (samples.empty() || sample.t != samples.back().t)
+                samples.push_back(sample);
+        }
+    }
+    else
+    {
+        in.clear();
+        in.seekg(0);
+        if (!SkipComments(in))
+            return false;
+
+        while (in.good())
+        {
+            in >> sample.t;
+            for (int i = 0; i < 3; i++)
+                in >> sample.position[i];
+            for (int i = 0; i < 3; i++)
+            {
+                in >> sample.velocity[i];
+                sample.velocity[i] *= 86400.0;
+            }
+
+            if (!in.good())
+                continue;
+
+            if (samples.empty() || sample.t != samples.back().t)
+                samples.push_back(sample);
+        }
+    }
+
+    return samples.size() >= 2;
+}
+
+// Coordinate i of the trajectory at time t, with the cubic Hermite
+// interpolation Celestia uses for xyzv trajectories.
+static double interpolate(const vector<Sample>& samples, double t, int i)
+{
+    auto iter = upper_bound(samples.begin(), samples.end(), t,
+                            [](double t, const Sample& s) { return t < s.t; });
+    if (iter == samples.begin())
+        return samples.front().position[i];
+    if (iter == samples.end())
+        return samples.back().position[i];
+
+    const Sample& s0 = *(iter - 1);
+    const Sample& s1 = *iter;
+    double h = s1.t - s0.t;
+    double u = (t - s0.t) / h;
+
+    double p0 = s0.position[i];
+    double p1 = s1.position[i];
+    double v0 = s0.velocity[i] * h;
+    double v1 = s1.velocity[i] * h;
+    return p0 + ((2.0 * (p0 - p1) + v1 + v0) * (u * u * u)) +
+                ((3.0 * (p1 - p0) - 2.0 * v0 - v1) * (u * u)) +
+                (v0 * u);
+}
+
+static double evaluate(const double* c, unsigned int n, double s)
+{
+    double t0 = 1.0, t1 = s;
+    double value = c[0];
+    for (unsigned int k = 1; k < n; k++)
+    {
+        value += c[k] * t1;
+        double t2 = 2.0 * s * t1 - t0;
+        t0 = t1;
+        t1 = t2;
+    }
+    return value;
+}
+
+// Fit the smallest number of coefficients that keeps the position within
+// the tolerance over [t0, t0 + duration]. The error is checked at the
+// samples, at four points between each two of them, and on a regular grid.
+// Returns false if maxCoeffs coefficients aren't enough.
+static bool fitSegment(const vector<Sample>& samples,
+                       double t0, double duration,
+                       vector<double>& coeffs)
+{
+    const double pi = 3.14159265358979323846;
+
+    // The error between the check times can be a little larger
+    const double checkTolerance = tolerance * 0.9;
+
+    vector<double> checkTimes;
+    auto first = lower_bound(samples.begin(), samples.end(), t0,
+                             [](const Sample& s, double t) { return s.t < t; });
+    for (auto iter = first; iter != samples.end() && iter->t <= t0 + duration; ++iter)
+    {
+        checkTimes.push_back(iter->t);
+        if (iter + 1 != samples.end() && (iter + 1)->t <= t0 + duration)
+        {
+            for (int i = 1; i < 5; i++)
+                checkTimes.push_back(iter->t + ((iter + 1)->t - iter->t) * i / 5.0);
+        }
+    }
+    for (unsigned int i = 0; i <= maxCoeffs * 4; i++)
+        checkTimes.push_back(t0 + duration * i / (maxCoeffs * 4));
+
+    for (unsigned int n = 2; n <= maxCoeffs; n++)
+    {
+        coeffs.assign(n * 3, 0.0);
+        for (int i = 0; i < 3; i++)
+        {
+            double* c = &coeffs[n * i];
+            for (unsigned int j = 0; j < n; j++)
+            {
+                double node = cos(pi * (j + 0.5) / n);
+                double f = interpolate(samples, t0 + (node + 1.0) * 0.5 * duration, i);
+                for (unsigned int k = 0; k < n; k++)
+                    c[k] += f * cos(pi * k * (j + 0.5) / n);
+            }
+            for (unsigned int k = 0; k < n; k++)
+                c[k] *= (k == 0 ? 1.0 : 2.0) / n;
+        }
+
+        bool ok = true;
+        for (auto iter = checkTimes.begin(); ok && iter != checkTimes.end(); ++iter)
+        {
+            double s = min(1.0, max(-1.0, 2.0 * (*iter - t0) / duration - 1.0));
+            double error2 = 0.0;
+            for (int i = 0; i < 3; i++)
+            {
+                double d = evaluate(&coeffs[n * i], n, s) - interpolate(samples, *iter, i);
+                error2 += d * d;
+            }
+            ok = error2 <= checkTolerance * checkTolerance;
+        }
+        if (ok)
+            return true;
+    }
+
+    return false;
+}
+
+// Fit the segment between samples first and last, or if that fails, the
+// two segments on each side of the sample in the middle. Segments end at
+// samples because the interpolation of the samples is only smooth between
+// them, so a segment spanning a single interval, which is a cubic, can
+// always be fitted with four coefficients. Segments are appended in time
+// order.
+static bool fitSegments(const vector<Sample>& samples,
+                        size_t first, size_t last,
+                        vector<ChebyshevBinarySegment>& segments,
+                        vector<double>& coeffs)
+{
+    double t0 = samples[first].t;
+    vector<double> segmentCoeffs;
+    if (!fitSegment(samples, t0, samples[last].t - t0, segmentCoeffs))
+    {
+        if (last - first < 2)
+            return false;
+        size_t middle = first + (last - first) / 2;
+        return fitSegments(samples, first, middle, segments, coeffs) &&
+               fitSegments(samples, middle, last, segments, coeffs);
+    }
+
+    ChebyshevBinarySegment segment;
+    segment.startTime = t0;
+    segment.offset = coeffs.size();
+    segment.coeffCount = (uint32_t) (segmentCoeffs.size() / 3);
+    segment.reserved = 0;
+    segments.push_back(segment);
+    coeffs.insert(coeffs.end(), segmentCoeffs.begin(), segmentCoeffs.end());
+    return true;
+}
+
+static bool xyzvToChebyshev(const string& inFilename, const string& outFilename)
+{
+    vector<Sample> samples;
+    if (!readSamples(inFilename, samples))
+    {
+        fmt::fprintf(cerr, "Error reading samples from %s\n", inFilename);
+        return false;
+    }
+
+    // Start with segments of 16 sample intervals, and split only the
+    // segments that can't be fitted.
+    const size_t baseLength = 16;
+    vector<ChebyshevBinarySegment> segments;
+    vector<double> coeffs;
+    for (size_t first = 0; first + 1 < samples.size(); first += baseLength)
+    {
+        size_t last = min(first + baseLength, samples.size() - 1);
+        if (!fitSegments(samples, first, last, segments, coeffs))
+        {
+            fmt::fprintf(cerr, "Can't fit the trajectory within %g km\n", tolerance);
+            return false;
+        }
+    }
+
+    double boundingRadius = 0.0;
+    for (const auto& sample : samples)
+    {
+        boundingRadius = max(boundingRadius, sqrt(sample.position[0] * sample.position[0] +
+                                                  sample.position[1] * sample.position[1] +
+                                                  sample.position[2] * sample.position[2]));
+    }
+
+    ChebyshevBinaryHeader header;
+    memcpy(header.magic, magic, 8);
+    header.byteOrder = __BYTE_ORDER__;
+    header.digits = std::numeric_limits<double>::digits;
+    header.reserved = 0;
+    header.segmentCount = segments.size();
+    header.coeffCount = coeffs.size();
+    header.startTime = samples.front().t;
+    header.endTime = samples.back().t;
+    header.boundingRadius = boundingRadius;
+
+    ofstream out(outFilename, ios::out | ios::binary);
+    if (!out.good() ||
+        !out.write(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        !out.write(reinterpret_cast<char*>(segments.data()), segments.size() * sizeof(ChebyshevBinarySegment)) ||
+        !out.write(reinterpret_cast<char*>(coeffs.data()), coeffs.size() * sizeof(double)))
+    {
+        return false;
+    }
+
+    size_t outSize = sizeof(header) + segments.size() * sizeof(ChebyshevBinarySegment) + coeffs.size() * sizeof(double);
+    fmt::fprintf(cout, "%zu samples fitted with %u segments, %zu bytes (%zu as samples)\n",
+                 samples.size(), (unsigned int) segments.size(), outSize,
+                 samples.size() * sizeof(XYZVBinaryData));
+
+    return true;
+}
+
+static void Usage(const char* name)
+{
+    fmt::fprintf(cerr, "Usage: %s [-t tolerance] [-n max coefficients] infile.xyzv outfile.cheb\n", name);
+    fmt::fprintf(cerr, "  The tolerance is in km, %g by default. Binary xyzv files are accepted too.\n", tolerance);
+}
+
+int main(int argc, char* argv[])
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "-t") == 0)
+        {
+            tolerance = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-n") == 0)
+        {
+            maxCoeffs = (unsigned int) atoi(argv[i + 1]);
+        }
+        else
+        {
+            fmt::fprintf(cerr, "Unknown command line switch: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (argc - i != 2 || !(tolerance > 0.0) || maxCoeffs < 4)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    if (!xyzvToChebyshev(argv[i], argv[i + 1]))
+    {
+        fmt::fprintf(cerr, "Error converting %s to %s.\n", argv[i], argv[i + 1]);
+        return 1;
+    }
+
+    return 0;
+}